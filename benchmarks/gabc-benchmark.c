@@ -0,0 +1,1059 @@
+/* gabc-benchmark.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Benchmarks for the paths that get slow on big tunebooks.
+ *
+ * Generates a synthetic tunebook of --tunes tunes and times, over a number
+ * of iterations;
+ *
+ *   open-file          gabc_tunebook_open_file () until loaded and idle
+ *   open-first-screen  gabc_tunebook_open_file () until the first text is in
+ *   append-file        gabc_tunebook_append_file () until loaded and idle
+ *   search-index       indexing the tunebook's directory from scratch
+ *   find-similar       gabc_search_index_find_similar () for the first tune
+ *   highlight          highlighting the whole buffer with data/abc.lang
+ *   highlight-native   highlighting the whole buffer with GabcHighlighter
+ *   scratch-abcm2ps    gabc_tunebook_write_to_scratch_file () for abcm2ps
+ *   scratch-abc2midi   the same for abc2midi, with a MIDI program injected
+ *   render-ps          scratch file plus an abcm2ps run, end to end
+ *   render-midi        scratch file plus an abc2midi run, end to end
+ *   render-queue       a burst of one-tune abcm2ps runs through a render
+ *                      service, four per CPU, until the last has finished
+ *   parse              every tune through gabc_abc_tune_parse ()
+ *   reparse-edit       a space typed into a tune in the middle of the
+ *                      loaded tunebook, then every parsed tune asked for
+ *                      again, which parses only the edited one
+ *   check              every tune through gabc_abc_tune_check (), as the
+ *                      validator does, parsing included
+ *   transpose          gabc_tunebook_transpose () of the whole loaded
+ *                      tunebook up a tone, then undone outside the timing
+ *   midi-sequence      gabc_midi_sequence_new () for the whole tunebook
+ *   play-wav           the first tune through the built-in player into a
+ *                      WAV file, as fast as the synthesizer goes
+ *
+ * Before the results are written, single notes either side of A4 are played
+ * into a WAV file and the run fails if any of them came out silent; the
+ * timings above would not notice.
+ *
+ * The render benchmarks use whatever abcm2ps and abc2midi are on the PATH;
+ * meson puts the stubs in benchmarks/stubs first so that they measure gabc
+ * rather than the tools.  Results are printed and written to --json.
+ *
+ * Run it with GSETTINGS_BACKEND=memory and GSETTINGS_SCHEMA_DIR pointing at
+ * the compiled schema, as meson test --benchmark does.
+ */
+
+#include <string.h>
+#include <glib/gstdio.h>
+#include <gtksourceview/gtksource.h>
+
+#include "gabc-abc-check.h"
+#include "gabc-abc-parser.h"
+#include "gabc-player.h"
+#include "gabc-render-job.h"
+#include "gabc-render-service.h"
+#include "gabc-search-index.h"
+#include "gabc-tunebook.h"
+#include "gabc-tunebook-generator.h"
+
+#define GABC_BENCHMARK_SEED 0x61626332
+
+typedef struct {
+  const gchar  *name;
+  GArray       *samples;              /* gint64 microseconds */
+} GabcBenchmark;
+
+typedef struct {
+  gboolean loaded;
+  gint64 start_time;
+  gint64 first_text_time;
+} benchmark_load_data_t;
+
+typedef struct {
+  GMainLoop *loop;
+  gboolean succeeded;
+  guint n_pending;
+} benchmark_job_data_t;
+
+
+static GabcBenchmark *
+gabc_benchmark_new (GPtrArray   *benchmarks,
+                    const gchar *name)
+{
+  GabcBenchmark *benchmark;
+
+  benchmark = g_new0 (GabcBenchmark, 1);
+  benchmark->name = name;
+  benchmark->samples = g_array_new (FALSE, FALSE, sizeof (gint64));
+  g_ptr_array_add (benchmarks, benchmark);
+
+  return benchmark;
+}
+
+
+static void
+gabc_benchmark_free (GabcBenchmark *benchmark)
+{
+  g_array_unref (benchmark->samples);
+  g_free (benchmark);
+}
+
+
+static void
+gabc_benchmark_add_sample (GabcBenchmark *benchmark,
+                           gint64         start_time)
+{
+  gint64 elapsed = g_get_monotonic_time () - start_time;
+
+  g_array_append_val (benchmark->samples, elapsed);
+}
+
+
+static gint
+gabc_benchmark_compare_samples (gconstpointer a,
+                                gconstpointer b)
+{
+  gint64 sample_a = *(const gint64 *) a;
+  gint64 sample_b = *(const gint64 *) b;
+
+  return (sample_a > sample_b) - (sample_a < sample_b);
+}
+
+
+/*
+ * Run the default main context until nothing is pending, which lets the
+ * loaders finish and the highlighter's idle work run to completion.
+ */
+static void
+gabc_benchmark_drain_main_context (void)
+{
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+}
+
+
+static void
+gabc_benchmark_load_progress_cb (GabcTunebook          *tunebook,
+                                 gdouble                fraction,
+                                 benchmark_load_data_t *data)
+{
+  if (data->first_text_time == 0)
+    data->first_text_time = g_get_monotonic_time ();
+}
+
+
+static void
+gabc_benchmark_loaded_cb (GabcTunebook          *tunebook,
+                          benchmark_load_data_t *data)
+{
+  if (data->first_text_time == 0)
+    data->first_text_time = g_get_monotonic_time ();
+  data->loaded = TRUE;
+}
+
+
+/*
+ * Returns the time from start_time until the first text was in the buffer.
+ */
+static gint64
+gabc_benchmark_wait_loaded (GabcTunebook *tunebook,
+                            gint64        start_time)
+{
+  benchmark_load_data_t data = { FALSE, start_time, 0 };
+  gulong loaded_id;
+  gulong progress_id;
+
+  loaded_id = g_signal_connect (tunebook, "loaded", G_CALLBACK (gabc_benchmark_loaded_cb), &data);
+  progress_id = g_signal_connect (tunebook, "load-progress", G_CALLBACK (gabc_benchmark_load_progress_cb), &data);
+
+  /* The fast path may already have put the first chunk in. */
+  if (gtk_text_buffer_get_char_count (GTK_TEXT_BUFFER (tunebook)) > 0)
+    data.first_text_time = g_get_monotonic_time ();
+
+  while (!data.loaded)
+    g_main_context_iteration (NULL, TRUE);
+  g_signal_handler_disconnect (tunebook, loaded_id);
+  g_signal_handler_disconnect (tunebook, progress_id);
+
+  gabc_benchmark_drain_main_context ();
+
+  return data.first_text_time - data.start_time;
+}
+
+
+static void
+gabc_benchmark_job_cb (GObject      *source_object,
+                       GAsyncResult *result,
+                       gpointer      user_data)
+{
+  benchmark_job_data_t *data = user_data;
+  g_autoptr (GError) error = NULL;
+
+  data->succeeded = gabc_render_job_run_finish (GABC_RENDER_JOB (source_object), result, &error) &&
+                    gabc_render_job_get_exit_status (GABC_RENDER_JOB (source_object)) == 0;
+  if (error != NULL)
+    g_printerr ("%s\n", error->message);
+
+  g_main_loop_quit (data->loop);
+}
+
+
+static gboolean
+gabc_benchmark_run_job (const gchar * const *argv)
+{
+  g_autoptr (GabcRenderJob) job = NULL;
+  benchmark_job_data_t data;
+
+  data.loop = g_main_loop_new (NULL, FALSE);
+  data.succeeded = FALSE;
+
+  job = gabc_render_job_new (argv, NULL);
+  gabc_render_job_run_async (job, NULL, gabc_benchmark_job_cb, &data);
+  g_main_loop_run (data.loop);
+  g_main_loop_unref (data.loop);
+
+  return data.succeeded;
+}
+
+
+static void
+gabc_benchmark_open_file (GabcBenchmark *benchmark,
+                          GabcBenchmark *first_screen_benchmark,
+                          GFile         *file,
+                          guint          iterations)
+{
+  guint i;
+
+  for (i = 0; i < iterations; i++)
+    {
+      g_autoptr (GabcTunebook) tunebook = gabc_tunebook_new ();
+      gint64 start_time = g_get_monotonic_time ();
+      gint64 first_screen;
+
+      gabc_tunebook_open_file (tunebook, file);
+      first_screen = gabc_benchmark_wait_loaded (tunebook, start_time);
+      gabc_benchmark_add_sample (benchmark, start_time);
+      g_array_append_val (first_screen_benchmark->samples, first_screen);
+    }
+}
+
+
+static void
+gabc_benchmark_append_file (GabcBenchmark *benchmark,
+                            GFile         *file,
+                            guint          iterations)
+{
+  guint i;
+
+  for (i = 0; i < iterations; i++)
+    {
+      g_autoptr (GabcTunebook) tunebook = gabc_tunebook_new ();
+      gint64 start_time = g_get_monotonic_time ();
+
+      /* The callback drops the reference it is given. */
+      gabc_tunebook_append_file (tunebook, g_object_ref (file));
+      gabc_benchmark_wait_loaded (tunebook, start_time);
+      gabc_benchmark_add_sample (benchmark, start_time);
+    }
+}
+
+
+static void
+gabc_benchmark_search_index_updated_cb (GabcSearchIndex *search_index,
+                                        gboolean        *updated)
+{
+  *updated = TRUE;
+}
+
+
+/*
+ * Build a new index of directory each time, then time a similarity search
+ * for the melody of the first tune in text.
+ */
+static void
+gabc_benchmark_search (GabcBenchmark *index_benchmark,
+                       GabcBenchmark *similar_benchmark,
+                       const gchar   *tmp_dir,
+                       const gchar   *directory,
+                       const gchar   *text,
+                       guint          iterations)
+{
+  const gchar *directories[] = { directory, NULL };
+  const gchar *second_tune;
+  GabcMelody melody;
+  guint i;
+
+  second_tune = strstr (text, "\nX:");
+  gabc_melody_init (&melody, NULL);
+  gabc_melody_add_text (&melody, text, second_tune != NULL ? second_tune - text : -1);
+
+  for (i = 0; i < iterations; i++)
+    {
+      g_autofree gchar *name = g_strdup_printf ("index-%u.gvariant", i);
+      g_autofree gchar *index_path = g_build_filename (tmp_dir, "search", name, NULL);
+      g_autoptr (GabcSearchIndex) search_index = gabc_search_index_new (index_path);
+      g_autoptr (GPtrArray) results = NULL;
+      gboolean updated = FALSE;
+      gint64 start_time;
+
+      g_signal_connect (search_index, "updated",
+                        G_CALLBACK (gabc_benchmark_search_index_updated_cb), &updated);
+
+      start_time = g_get_monotonic_time ();
+      gabc_search_index_set_directories (search_index, directories);
+      while (!updated)
+        g_main_context_iteration (NULL, TRUE);
+      gabc_benchmark_add_sample (index_benchmark, start_time);
+
+      start_time = g_get_monotonic_time ();
+      results = gabc_search_index_find_similar (search_index, &melody, 100);
+      gabc_benchmark_add_sample (similar_benchmark, start_time);
+    }
+}
+
+
+/*
+ * Highlight the whole buffer from scratch, as a view scrolled from top to
+ * bottom would.  Clearing the language throws away the existing context
+ * tree so each iteration starts cold.
+ */
+static gboolean
+gabc_benchmark_highlight (GabcBenchmark *benchmark,
+                          GabcTunebook  *tunebook,
+                          guint          iterations)
+{
+  GtkSourceBuffer *buffer = GTK_SOURCE_BUFFER (tunebook);
+  GtkSourceLanguage *language;
+  guint i;
+
+  language = gtk_source_buffer_get_language (buffer);
+  if (language == NULL)
+    return FALSE;
+
+  g_object_ref (language);
+
+  for (i = 0; i < iterations; i++)
+    {
+      GtkTextIter start;
+      GtkTextIter end;
+      gint64 start_time;
+
+      gtk_source_buffer_set_language (buffer, NULL);
+      gtk_source_buffer_set_language (buffer, language);
+      gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+
+      start_time = g_get_monotonic_time ();
+      gtk_source_buffer_ensure_highlight (buffer, &start, &end);
+      gabc_benchmark_add_sample (benchmark, start_time);
+    }
+
+  g_object_unref (language);
+
+  return TRUE;
+}
+
+
+/*
+ * The same for the built-in highlighter.  Turning it off removes all of
+ * its tags, so each iteration starts cold here too.
+ */
+static void
+gabc_benchmark_highlight_native (GabcBenchmark *benchmark,
+                                 GabcTunebook  *tunebook,
+                                 guint          iterations)
+{
+  GabcHighlighter *highlighter = gabc_tunebook_get_highlighter (tunebook);
+  guint i;
+
+  for (i = 0; i < iterations; i++)
+    {
+      GtkTextIter start;
+      GtkTextIter end;
+      gint64 start_time;
+
+      gabc_highlighter_set_enabled (highlighter, FALSE);
+      gabc_highlighter_set_enabled (highlighter, TRUE);
+      gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (tunebook), &start, &end);
+
+      start_time = g_get_monotonic_time ();
+      gabc_highlighter_ensure (highlighter, &start, &end);
+      gabc_benchmark_add_sample (benchmark, start_time);
+    }
+}
+
+
+static gboolean
+gabc_benchmark_scratch (GabcBenchmark          *benchmark,
+                        GabcTunebook           *tunebook,
+                        GabcPreprocessorTarget  target,
+                        guint                   iterations)
+{
+  guint i;
+
+  for (i = 0; i < iterations; i++)
+    {
+      gint64 start_time = g_get_monotonic_time ();
+      g_autofree gchar *scratch_file_path = NULL;
+      g_autoptr (GError) error = NULL;
+
+      scratch_file_path = gabc_tunebook_write_to_scratch_file (tunebook, target, &error);
+      if (scratch_file_path == NULL)
+        {
+          g_printerr ("%s\n", error->message);
+          return FALSE;
+        }
+
+      gabc_benchmark_add_sample (benchmark, start_time);
+    }
+
+  return TRUE;
+}
+
+
+static gboolean
+gabc_benchmark_render (GabcBenchmark *benchmark,
+                       GabcTunebook  *tunebook,
+                       gboolean       midi,
+                       const gchar   *output_dir,
+                       guint          iterations)
+{
+  g_autofree gchar *output_path = NULL;
+  guint i;
+
+  output_path = g_build_filename (output_dir, midi ? "render.mid" : "render.ps", NULL);
+
+  for (i = 0; i < iterations; i++)
+    {
+      gint64 start_time = g_get_monotonic_time ();
+      g_autofree gchar *scratch_file_path = NULL;
+      gboolean succeeded;
+
+      if (midi)
+        {
+          scratch_file_path = gabc_tunebook_write_to_scratch_file (tunebook, GABC_PREPROCESSOR_TARGET_ABC2MIDI, NULL);
+          succeeded = scratch_file_path != NULL &&
+                      gabc_benchmark_run_job ((const gchar * const []) {
+                                                "abc2midi", scratch_file_path, "-o", output_path, NULL });
+        }
+      else
+        {
+          scratch_file_path = gabc_tunebook_write_to_scratch_file (tunebook, GABC_PREPROCESSOR_TARGET_ABCM2PS, NULL);
+          succeeded = scratch_file_path != NULL &&
+                      gabc_benchmark_run_job ((const gchar * const []) {
+                                                "abcm2ps", "-O", output_path, scratch_file_path, NULL });
+        }
+
+      if (!succeeded)
+        return FALSE;
+
+      gabc_benchmark_add_sample (benchmark, start_time);
+    }
+
+  return TRUE;
+}
+
+
+static void
+gabc_benchmark_queue_job_cb (GObject      *source_object,
+                             GAsyncResult *result,
+                             gpointer      user_data)
+{
+  benchmark_job_data_t *data = user_data;
+
+  if (!gabc_render_job_run_finish (GABC_RENDER_JOB (source_object), result, NULL) ||
+      gabc_render_job_get_exit_status (GABC_RENDER_JOB (source_object)) != 0)
+    data->succeeded = FALSE;
+
+  if (--data->n_pending == 0)
+    g_main_loop_quit (data->loop);
+}
+
+
+static gboolean
+gabc_benchmark_render_queue (GabcBenchmark *benchmark,
+                             GSettings     *settings,
+                             GabcTunebook  *tunebook,
+                             const gchar   *output_dir,
+                             guint          iterations)
+{
+  g_autoptr (GabcRenderService) service = gabc_render_service_new (settings);
+  g_autoptr (GError) error = NULL;
+  g_autofree gchar *abc_path = NULL;
+  guint n_jobs = 4 * g_get_num_processors ();
+  guint max_queue_depth;
+  gint64 mean_latency;
+  guint i;
+  guint j;
+
+  abc_path = g_build_filename (output_dir, "queue.abc", NULL);
+  if (!gabc_tunebook_write_tunes_to_file (tunebook, GABC_PREPROCESSOR_TARGET_ABCM2PS, 0, 0, abc_path, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return FALSE;
+    }
+
+  for (i = 0; i < iterations; i++)
+    {
+      gint64 start_time = g_get_monotonic_time ();
+      benchmark_job_data_t data;
+
+      data.loop = g_main_loop_new (NULL, FALSE);
+      data.succeeded = TRUE;
+      data.n_pending = n_jobs;
+
+      for (j = 0; j < n_jobs; j++)
+        {
+          g_autofree gchar *output_name = g_strdup_printf ("queue-%u.ps", j);
+          g_autofree gchar *output_path = g_build_filename (output_dir, output_name, NULL);
+          g_autoptr (GabcRenderJob) job = NULL;
+
+          job = gabc_render_job_new ((const gchar * const []) { "abcm2ps", "-O", output_path, abc_path, NULL }, NULL);
+          gabc_render_service_run_async (service, job, NULL, gabc_benchmark_queue_job_cb, &data);
+        }
+
+      g_main_loop_run (data.loop);
+      g_main_loop_unref (data.loop);
+
+      if (!data.succeeded)
+        return FALSE;
+
+      gabc_benchmark_add_sample (benchmark, start_time);
+    }
+
+  gabc_render_service_get_stats (service, NULL, NULL, &max_queue_depth, &mean_latency);
+  g_print ("render-queue: up to %u jobs queued, %.2f ms mean latency per job\n",
+           max_queue_depth, mean_latency / 1000.0);
+
+  return TRUE;
+}
+
+
+static void
+gabc_benchmark_player_finished_cb (GabcPlayer *player,
+                                   GError     *error,
+                                   gpointer    user_data)
+{
+  benchmark_job_data_t *data = user_data;
+
+  if (error != NULL)
+    {
+      g_printerr ("%s\n", error->message);
+      data->succeeded = FALSE;
+    }
+
+  g_main_loop_quit (data->loop);
+}
+
+
+static void
+gabc_benchmark_transpose (GabcBenchmark *benchmark,
+                          GabcTunebook  *tunebook,
+                          guint          iterations)
+{
+  guint n_tunes = gabc_tune_index_get_n_tunes (gabc_tunebook_get_tune_index (tunebook));
+  guint i;
+
+  if (n_tunes == 0)
+    return;
+
+  for (i = 0; i < iterations; i++)
+    {
+      gint64 start_time = g_get_monotonic_time ();
+
+      gabc_tunebook_transpose (tunebook, 0, n_tunes - 1, 2);
+      gabc_benchmark_add_sample (benchmark, start_time);
+
+      gtk_text_buffer_undo (GTK_TEXT_BUFFER (tunebook));
+      gabc_benchmark_drain_main_context ();
+    }
+}
+
+
+static void
+gabc_benchmark_parse (GabcBenchmark *parse_benchmark,
+                      GabcBenchmark *reparse_benchmark,
+                      GabcBenchmark *check_benchmark,
+                      GabcTunebook  *tunebook,
+                      const gchar   *text,
+                      gsize          length,
+                      guint          iterations)
+{
+  GabcTuneIndex *tune_index = gabc_tunebook_get_tune_index (tunebook);
+  GtkTextBuffer *buffer = GTK_TEXT_BUFFER (tunebook);
+  guint n_tunes = gabc_tune_index_get_n_tunes (tune_index);
+  guint i, j;
+
+  for (i = 0; i < iterations; i++)
+    {
+      const gchar *end = text + length;
+      const gchar *tune = strstr (text, "X:");
+      gint64 start_time = g_get_monotonic_time ();
+
+      while (tune != NULL)
+        {
+          const gchar *next = g_strstr_len (tune, end - tune, "\nX:");
+          const gchar *tune_end = (next != NULL) ? next + 1 : end;
+
+          gabc_abc_tune_free (gabc_abc_tune_parse (tune, tune_end - tune));
+          tune = (next != NULL) ? next + 1 : NULL;
+        }
+      gabc_benchmark_add_sample (parse_benchmark, start_time);
+    }
+
+  for (i = 0; i < iterations; i++)
+    {
+      const gchar *end = text + length;
+      const gchar *tune = strstr (text, "X:");
+      gint64 start_time = g_get_monotonic_time ();
+
+      while (tune != NULL)
+        {
+          const gchar *next = g_strstr_len (tune, end - tune, "\nX:");
+          const gchar *tune_end = (next != NULL) ? next + 1 : end;
+          g_autoptr (GabcAbcTune) parsed = gabc_abc_tune_parse (tune, tune_end - tune);
+
+          g_array_unref (gabc_abc_tune_check (parsed));
+          tune = (next != NULL) ? next + 1 : NULL;
+        }
+      gabc_benchmark_add_sample (check_benchmark, start_time);
+    }
+
+  if (n_tunes == 0)
+    return;
+
+  for (j = 0; j < n_tunes; j++)
+    gabc_tune_index_get_parsed_tune (tune_index, j);
+
+  for (i = 0; i < iterations; i++)
+    {
+      GtkTextIter iter;
+      GtkTextIter space_end;
+      gint64 start_time;
+
+      /* At the end of the last line of the tune, clear of its X: line. */
+      gabc_tune_index_get_tune_bounds (tune_index, n_tunes / 2, NULL, &iter);
+      gtk_text_iter_backward_char (&iter);
+
+      start_time = g_get_monotonic_time ();
+      gtk_text_buffer_insert (buffer, &iter, " ", 1);
+      for (j = 0; j < n_tunes; j++)
+        gabc_tune_index_get_parsed_tune (tune_index, j);
+      gabc_benchmark_add_sample (reparse_benchmark, start_time);
+
+      space_end = iter;
+      gtk_text_iter_backward_char (&iter);
+      gtk_text_buffer_delete (buffer, &iter, &space_end);
+    }
+}
+
+
+/*
+ * Build the MIDI sequence of the whole tunebook, then play the first tune
+ * through the player into a WAV file, which doesn't wait for a device.
+ */
+static gboolean
+gabc_benchmark_player (GabcBenchmark *sequence_benchmark,
+                       GabcBenchmark *play_benchmark,
+                       const gchar   *output_dir,
+                       const gchar   *text,
+                       gsize          length,
+                       guint          iterations)
+{
+  g_autoptr (GabcPlayer) player = gabc_player_new ();
+  g_autofree gchar *wav_path = g_build_filename (output_dir, "play.wav", NULL);
+  const gchar *second_tune = strstr (text, "\nX:");
+  gsize first_length = (second_tune != NULL) ? (gsize) (second_tune - text) : length;
+  benchmark_job_data_t data;
+  guint i;
+
+  g_signal_connect (player, "finished", G_CALLBACK (gabc_benchmark_player_finished_cb), &data);
+
+  for (i = 0; i < iterations; i++)
+    {
+      g_autoptr (GError) error = NULL;
+      GabcMidiSequence *sequence;
+      GabcAudioSink *sink;
+      gint64 start_time;
+
+      start_time = g_get_monotonic_time ();
+      sequence = gabc_midi_sequence_new (text, length, 0, length);
+      gabc_benchmark_add_sample (sequence_benchmark, start_time);
+      gabc_midi_sequence_free (sequence);
+
+      sink = gabc_audio_sink_new_wav (wav_path, GABC_PLAYER_RATE, &error);
+      if (sink == NULL)
+        {
+          g_printerr ("%s\n", error->message);
+          return FALSE;
+        }
+
+      data.loop = g_main_loop_new (NULL, FALSE);
+      data.succeeded = TRUE;
+
+      start_time = g_get_monotonic_time ();
+      gabc_player_play (player, gabc_midi_sequence_new (text, first_length, 0, first_length), sink, FALSE);
+      g_main_loop_run (data.loop);
+      g_main_loop_unref (data.loop);
+
+      if (!data.succeeded)
+        return FALSE;
+
+      gabc_benchmark_add_sample (play_benchmark, start_time);
+    }
+
+  return TRUE;
+}
+
+
+/*
+ * Play a note below, at and above A4 (MIDI 69) on its own and check that
+ * each comes out audible.  Returns FALSE, saying which, if one does not.
+ */
+static gboolean
+gabc_benchmark_check_player (const gchar *output_dir)
+{
+  const gchar *notes[] = { "C,", "C", "^G", "A", "c", "c'" };
+  g_autoptr (GabcPlayer) player = gabc_player_new ();
+  g_autofree gchar *wav_path = g_build_filename (output_dir, "pitch.wav", NULL);
+  benchmark_job_data_t data;
+  guint i;
+
+  g_signal_connect (player, "finished", G_CALLBACK (gabc_benchmark_player_finished_cb), &data);
+
+  for (i = 0; i < G_N_ELEMENTS (notes); i++)
+    {
+      g_autoptr (GError) error = NULL;
+      g_autofree gchar *text = NULL;
+      g_autofree gchar *contents = NULL;
+      GabcAudioSink *sink;
+      gint peak = 0;
+      gsize length;
+      gsize j;
+
+      sink = gabc_audio_sink_new_wav (wav_path, GABC_PLAYER_RATE, &error);
+      if (sink == NULL)
+        {
+          g_printerr ("%s\n", error->message);
+          return FALSE;
+        }
+
+      text = g_strdup_printf ("X:1\nL:1/4\nK:C\n%s4|\n", notes[i]);
+      data.loop = g_main_loop_new (NULL, FALSE);
+      data.succeeded = TRUE;
+      gabc_player_play (player, gabc_midi_sequence_new (text, strlen (text), 0, strlen (text)), sink, FALSE);
+      g_main_loop_run (data.loop);
+      g_main_loop_unref (data.loop);
+
+      if (!data.succeeded)
+        return FALSE;
+
+      if (!g_file_get_contents (wav_path, &contents, &length, &error))
+        {
+          g_printerr ("%s\n", error->message);
+          return FALSE;
+        }
+
+      /* 16 bit little endian samples after the 44 byte header. */
+      for (j = 44; j + 1 < length; j += 2)
+        {
+          gint16 sample = (gint16) ((guint8) contents[j] | ((guint8) contents[j + 1] << 8));
+
+          peak = MAX (peak, ABS ((gint) sample));
+        }
+
+      if (peak < 1000)
+        {
+          g_printerr ("the built-in player played %s as silence (peak %d)\n", notes[i], peak);
+          return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+
+static void
+gabc_benchmark_print (GabcBenchmark *benchmark)
+{
+  GArray *samples = benchmark->samples;
+
+  if (samples->len == 0)
+    {
+      g_print ("%-18s skipped\n", benchmark->name);
+      return;
+    }
+
+  g_array_sort (samples, gabc_benchmark_compare_samples);
+  g_print ("%-18s min %10.3f ms   median %10.3f ms   max %10.3f ms\n",
+           benchmark->name,
+           g_array_index (samples, gint64, 0) / 1000.0,
+           g_array_index (samples, gint64, samples->len / 2) / 1000.0,
+           g_array_index (samples, gint64, samples->len - 1) / 1000.0);
+}
+
+
+/*
+ * {
+ *   "tunes": 1000, "bytes": 301234, "iterations": 3,
+ *   "benchmarks": {
+ *     "open-file": { "samples_us": [ ... ], "min_us": ..., "median_us": ..., "max_us": ... },
+ *     ...
+ *   }
+ * }
+ *
+ * Skipped benchmarks are left out.  Samples are sorted.
+ */
+static gboolean
+gabc_benchmark_write_json (GPtrArray    *benchmarks,
+                           guint         n_tunes,
+                           gsize         length,
+                           guint         iterations,
+                           const gchar  *json_path,
+                           GError      **error)
+{
+  g_autoptr (GString) json = g_string_new (NULL);
+  gboolean first = TRUE;
+  guint i;
+  guint j;
+
+  g_string_append_printf (json,
+                          "{\n"
+                          "  \"tunes\": %u,\n"
+                          "  \"bytes\": %" G_GSIZE_FORMAT ",\n"
+                          "  \"iterations\": %u,\n"
+                          "  \"benchmarks\": {",
+                          n_tunes, length, iterations);
+
+  for (i = 0; i < benchmarks->len; i++)
+    {
+      GabcBenchmark *benchmark = g_ptr_array_index (benchmarks, i);
+      GArray *samples = benchmark->samples;
+
+      if (samples->len == 0)
+        continue;
+
+      g_string_append_printf (json, "%s\n    \"%s\": { \"samples_us\": [", first ? "" : ",", benchmark->name);
+      for (j = 0; j < samples->len; j++)
+        g_string_append_printf (json, "%s%" G_GINT64_FORMAT, j > 0 ? ", " : " ", g_array_index (samples, gint64, j));
+      g_string_append_printf (json,
+                              " ], \"min_us\": %" G_GINT64_FORMAT
+                              ", \"median_us\": %" G_GINT64_FORMAT
+                              ", \"max_us\": %" G_GINT64_FORMAT " }",
+                              g_array_index (samples, gint64, 0),
+                              g_array_index (samples, gint64, samples->len / 2),
+                              g_array_index (samples, gint64, samples->len - 1));
+      first = FALSE;
+    }
+
+  g_string_append (json, "\n  }\n}\n");
+
+  return g_file_set_contents (json_path, json->str, json->len, error);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_autoptr (GOptionContext) context = NULL;
+  g_autoptr (GError) error = NULL;
+  g_autoptr (GPtrArray) benchmarks = NULL;
+  g_autoptr (GabcTunebook) tunebook = NULL;
+  g_autoptr (GSettings) settings = NULL;
+  g_autoptr (GFile) file = NULL;
+  g_autofree gchar *tmp_dir = NULL;
+  g_autofree gchar *tunebook_dir = NULL;
+  g_autofree gchar *tunebook_path = NULL;
+  g_autofree gchar *generate_path = NULL;
+  g_autofree gchar *json_path = NULL;
+  g_autofree gchar *lang_dir = NULL;
+  g_autofree gchar *text = NULL;
+  GabcBenchmark *benchmark;
+  GabcBenchmark *play_benchmark;
+  gint n_tunes = 1000;
+  gint iterations = 3;
+  gsize length;
+
+  GOptionEntry entries[] = {
+    { "tunes", 'n', 0, G_OPTION_ARG_INT, &n_tunes, "Number of tunes in the generated tunebook", "N" },
+    { "iterations", 'i', 0, G_OPTION_ARG_INT, &iterations, "Times to run each benchmark", "N" },
+    { "json", 0, 0, G_OPTION_ARG_FILENAME, &json_path, "Write the results to FILE", "FILE" },
+    { "lang-dir", 0, 0, G_OPTION_ARG_FILENAME, &lang_dir, "Directory containing abc.lang", "DIR" },
+    { "generate", 0, 0, G_OPTION_ARG_FILENAME, &generate_path, "Only write the tunebook to FILE", "FILE" },
+    { NULL }
+  };
+
+  context = g_option_context_new ("- benchmark gabc's tunebook paths");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return 1;
+    }
+
+  if (n_tunes < 1 || iterations < 1)
+    {
+      g_printerr ("--tunes and --iterations must be at least 1\n");
+      return 1;
+    }
+
+  if (generate_path != NULL)
+    {
+      if (!gabc_tunebook_generator_write (n_tunes, GABC_BENCHMARK_SEED, generate_path, &error))
+        {
+          g_printerr ("%s\n", error->message);
+          return 1;
+        }
+      return 0;
+    }
+
+  /* Keep the scratch files and settings away from the user's. */
+  tmp_dir = g_dir_make_tmp ("gabc-benchmark-XXXXXX", &error);
+  if (tmp_dir == NULL)
+    {
+      g_printerr ("%s\n", error->message);
+      return 1;
+    }
+  g_setenv ("XDG_CACHE_HOME", tmp_dir, TRUE);
+  if (g_getenv ("GSETTINGS_BACKEND") == NULL)
+    g_setenv ("GSETTINGS_BACKEND", "memory", TRUE);
+
+  gtk_source_init ();
+
+  if (lang_dir != NULL)
+    {
+      GtkSourceLanguageManager *lm = gtk_source_language_manager_get_default ();
+      const gchar * const *search_path = gtk_source_language_manager_get_search_path (lm);
+      g_autoptr (GStrvBuilder) builder = g_strv_builder_new ();
+      g_auto (GStrv) new_search_path = NULL;
+
+      g_strv_builder_add (builder, lang_dir);
+      g_strv_builder_addv (builder, (const gchar **) search_path);
+      new_search_path = g_strv_builder_end (builder);
+      gtk_source_language_manager_set_search_path (lm, (const gchar * const *) new_search_path);
+    }
+
+  /* On its own, so the search benchmarks index nothing else. */
+  tunebook_dir = g_build_filename (tmp_dir, "tunebooks", NULL);
+  g_mkdir_with_parents (tunebook_dir, 0700);
+  tunebook_path = g_build_filename (tunebook_dir, "tunebook.abc", NULL);
+  text = gabc_tunebook_generator_generate (n_tunes, GABC_BENCHMARK_SEED, &length);
+  if (!g_file_set_contents (tunebook_path, text, length, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return 1;
+    }
+  file = g_file_new_for_path (tunebook_path);
+
+  g_print ("%d tunes, %" G_GSIZE_FORMAT " bytes, %d iterations\n", n_tunes, length, iterations);
+
+  benchmarks = g_ptr_array_new_with_free_func ((GDestroyNotify) gabc_benchmark_free);
+
+  settings = g_settings_new ("me.pm.m0dns.gabc");
+
+  /* The validator's worker thread would run alongside the benchmarks. */
+  g_settings_set_boolean (settings, "validate-while-typing", FALSE);
+
+  benchmark = gabc_benchmark_new (benchmarks, "open-file");
+  gabc_benchmark_open_file (benchmark, gabc_benchmark_new (benchmarks, "open-first-screen"), file, iterations);
+  gabc_benchmark_append_file (gabc_benchmark_new (benchmarks, "append-file"), file, iterations);
+
+  gabc_benchmark_search (gabc_benchmark_new (benchmarks, "search-index"),
+                         gabc_benchmark_new (benchmarks, "find-similar"),
+                         tmp_dir, tunebook_dir, text, iterations);
+
+  /* One loaded tunebook for everything that works on the buffer. */
+  tunebook = gabc_tunebook_new ();
+  gabc_tunebook_open_file (tunebook, file);
+  gabc_benchmark_wait_loaded (tunebook, g_get_monotonic_time ());
+
+  /* abc.lang only does anything with the built-in highlighter off. */
+  g_settings_set_boolean (settings, "native-highlighting", FALSE);
+  gabc_benchmark_drain_main_context ();
+
+  benchmark = gabc_benchmark_new (benchmarks, "highlight");
+  if (!gabc_benchmark_highlight (benchmark, tunebook, iterations))
+    g_printerr ("abc.lang not found, skipping the highlight benchmark (use --lang-dir)\n");
+
+  g_settings_set_boolean (settings, "native-highlighting", TRUE);
+  gabc_benchmark_drain_main_context ();
+
+  gabc_benchmark_highlight_native (gabc_benchmark_new (benchmarks, "highlight-native"), tunebook, iterations);
+
+  g_settings_set_enum (settings, "abc2midi-midi-program", 40);
+  gabc_benchmark_drain_main_context ();
+
+  if (!gabc_benchmark_scratch (gabc_benchmark_new (benchmarks, "scratch-abcm2ps"),
+                               tunebook, GABC_PREPROCESSOR_TARGET_ABCM2PS, iterations) ||
+      !gabc_benchmark_scratch (gabc_benchmark_new (benchmarks, "scratch-abc2midi"),
+                               tunebook, GABC_PREPROCESSOR_TARGET_ABC2MIDI, iterations))
+    return 1;
+
+  benchmark = gabc_benchmark_new (benchmarks, "render-ps");
+  if (!gabc_benchmark_render (benchmark, tunebook, FALSE, tmp_dir, iterations))
+    {
+      g_printerr ("abcm2ps failed, skipping the render-ps benchmark\n");
+      g_array_set_size (benchmark->samples, 0);
+    }
+
+  benchmark = gabc_benchmark_new (benchmarks, "render-midi");
+  if (!gabc_benchmark_render (benchmark, tunebook, TRUE, tmp_dir, iterations))
+    {
+      g_printerr ("abc2midi failed, skipping the render-midi benchmark\n");
+      g_array_set_size (benchmark->samples, 0);
+    }
+
+  benchmark = gabc_benchmark_new (benchmarks, "render-queue");
+  if (!gabc_benchmark_render_queue (benchmark, settings, tunebook, tmp_dir, iterations))
+    {
+      g_printerr ("abcm2ps failed, skipping the render-queue benchmark\n");
+      g_array_set_size (benchmark->samples, 0);
+    }
+
+  gabc_benchmark_parse (gabc_benchmark_new (benchmarks, "parse"),
+                        gabc_benchmark_new (benchmarks, "reparse-edit"),
+                        gabc_benchmark_new (benchmarks, "check"),
+                        tunebook, text, length, iterations);
+
+  gabc_benchmark_transpose (gabc_benchmark_new (benchmarks, "transpose"), tunebook, iterations);
+
+  benchmark = gabc_benchmark_new (benchmarks, "midi-sequence");
+  play_benchmark = gabc_benchmark_new (benchmarks, "play-wav");
+  if (!gabc_benchmark_player (benchmark, play_benchmark, tmp_dir, text, length, iterations))
+    {
+      g_printerr ("the built-in player failed, skipping the play-wav benchmark\n");
+      g_array_set_size (play_benchmark->samples, 0);
+    }
+
+  if (!gabc_benchmark_check_player (tmp_dir))
+    return 1;
+
+  g_ptr_array_foreach (benchmarks, (GFunc) gabc_benchmark_print, NULL);
+
+  if (json_path != NULL &&
+      !gabc_benchmark_write_json (benchmarks, n_tunes, length, iterations, json_path, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return 1;
+    }
+
+  return 0;
+}
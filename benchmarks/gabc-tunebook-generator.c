@@ -0,0 +1,167 @@
+/* gabc-tunebook-generator.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Synthetic tunebooks for the benchmarks.
+ *
+ * The tunes are random but reproducible for a given seed, and are shaped
+ * like the session books gabc is used with: a file header, then X: records
+ * with the usual header fields, a few lines of reels or jigs with repeats,
+ * chord symbols, decorations, the odd comment and the odd lyric line.
+ */
+
+#include <string.h>
+
+#include "gabc-tunebook-generator.h"
+
+static const gchar *keys[] = { "G", "D", "A", "Em", "Bm", "Ador", "Edor", "Dmix", "C", "F" };
+static const gchar *chords[] = { "G", "D", "A", "Em", "Bm", "C", "Am", "D7" };
+static const gchar *notes = "DEFGABcdefgab";
+
+typedef struct {
+  const gchar *rhythm;
+  const gchar *meter;
+  guint        notes_per_bar;
+} GabcTuneShape;
+
+static const GabcTuneShape shapes[] = {
+  { "reel",      "4/4", 8 },
+  { "jig",       "6/8", 6 },
+  { "slip jig",  "9/8", 9 },
+  { "hornpipe",  "4/4", 8 },
+  { "polka",     "2/4", 4 },
+};
+
+
+static void
+gabc_tunebook_generator_append_bar (GString       *text,
+                                    GRand         *rand,
+                                    guint          n_notes)
+{
+  guint i;
+
+  if (g_rand_int_range (rand, 0, 4) == 0)
+    g_string_append_printf (text, "\"%s\"", chords[g_rand_int_range (rand, 0, G_N_ELEMENTS (chords))]);
+
+  for (i = 0; i < n_notes; i++)
+    {
+      guint note = g_rand_int_range (rand, 0, strlen (notes));
+
+      if (g_rand_int_range (rand, 0, 16) == 0)
+        g_string_append_c (text, '~');
+      if (g_rand_int_range (rand, 0, 24) == 0)
+        g_string_append_c (text, '^');
+
+      g_string_append_c (text, notes[note]);
+
+      /* Beam in groups of three or four, like real transcriptions. */
+      if ((i + 1) % (n_notes % 3 == 0 ? 3 : 4) == 0 && i + 1 < n_notes)
+        g_string_append_c (text, ' ');
+    }
+}
+
+
+static void
+gabc_tunebook_generator_append_tune (GString *text,
+                                     GRand   *rand,
+                                     guint    number)
+{
+  const GabcTuneShape *shape = &shapes[g_rand_int_range (rand, 0, G_N_ELEMENTS (shapes))];
+  guint part;
+  guint bar;
+
+  g_string_append_printf (text, "X:%u\n", number);
+  g_string_append_printf (text, "T:Synthetic %s number %u\n", shape->rhythm, number);
+  if (g_rand_int_range (rand, 0, 3) == 0)
+    g_string_append_printf (text, "C:Composer %u\n", g_rand_int_range (rand, 1, 500));
+  g_string_append_printf (text, "R:%s\n", shape->rhythm);
+  g_string_append_printf (text, "M:%s\n", shape->meter);
+  g_string_append (text, "L:1/8\n");
+  g_string_append_printf (text, "K:%s\n", keys[g_rand_int_range (rand, 0, G_N_ELEMENTS (keys))]);
+
+  /* Two repeated parts of eight bars, four bars to a line. */
+  for (part = 0; part < 2; part++)
+    {
+      if (g_rand_int_range (rand, 0, 8) == 0)
+        g_string_append_printf (text, "%% part %c\n", 'A' + part);
+
+      g_string_append (text, "|:");
+      for (bar = 0; bar < 8; bar++)
+        {
+          gabc_tunebook_generator_append_bar (text, rand, shape->notes_per_bar);
+
+          if (bar == 7)
+            g_string_append (text, ":|\n");
+          else if (bar == 3)
+            g_string_append (text, "|\n");
+          else
+            g_string_append (text, "|");
+        }
+    }
+
+  if (g_rand_int_range (rand, 0, 10) == 0)
+    g_string_append (text, "w:la la la la la la la la\n");
+
+  g_string_append_c (text, '\n');
+}
+
+
+/*
+ * Returns a tunebook of n_tunes tunes, numbered from 1.
+ */
+gchar *
+gabc_tunebook_generator_generate (guint    n_tunes,
+                                  guint32  seed,
+                                  gsize   *length)
+{
+  g_autoptr (GRand) rand = g_rand_new_with_seed (seed);
+  GString *text;
+  guint i;
+
+  /* A tune comes out at roughly 300 bytes. */
+  text = g_string_sized_new (64 + (gsize) n_tunes * 320);
+
+  g_string_append (text, "%abc-2.1\n");
+  g_string_append (text, "% Synthetic tunebook generated for the gabc benchmarks\n");
+  g_string_append (text, "%%pagewidth 21cm\n\n");
+
+  for (i = 1; i <= n_tunes; i++)
+    gabc_tunebook_generator_append_tune (text, rand, i);
+
+  if (length != NULL)
+    *length = text->len;
+
+  return g_string_free (text, FALSE);
+}
+
+
+gboolean
+gabc_tunebook_generator_write (guint         n_tunes,
+                               guint32       seed,
+                               const gchar  *path,
+                               GError      **error)
+{
+  g_autofree gchar *text = NULL;
+  gsize length;
+
+  text = gabc_tunebook_generator_generate (n_tunes, seed, &length);
+
+  return g_file_set_contents (path, text, length, error);
+}
@@ -0,0 +1,440 @@
+/* gabc-abc-check.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Structural checks on a parsed tune, quick enough to run as the tune is
+ * typed.
+ *
+ * This covers what abcm2ps and abc2midi complain about most without
+ * running them: a header that K: doesn't close, bars that don't add up to
+ * the meter, repeats and slurs that are opened and never closed, and
+ * decorations neither tool knows.  Bars, repeats and slurs are followed
+ * separately in each voice.  A short bar is only reported between two
+ * plain bar lines, so pickups and the bars that complete them at a repeat
+ * or at the end of a section are left alone.
+ */
+
+#include <string.h>
+
+#include "gabc-abc-check.h"
+
+/* Fields that only belong in the tune header (abc 2.1, section 3). */
+#define GABC_ABC_CHECK_HEADER_FIELDS "ABCDFGHORSXZ"
+
+typedef struct {
+  guint32   bar_length;                /* ticks so far in the bar */
+  guint     bar_offset;                /* of the first note of the bar */
+  gboolean  bar_has_multirest;
+  gboolean  plain_start;               /* the bar follows a plain "|" */
+  gint      repeat_offset;             /* of an open "|:", or -1 */
+  guint     endings_seen;
+  GArray   *slurs;                     /* guint offsets of open slurs */
+} GabcAbcCheckVoice;
+
+typedef struct {
+  const GabcAbcTune   *tune;
+  GArray              *problems;
+  GabcAbcCheckVoice   *voices;
+  GabcAbcCheckVoice   *voice;
+  guint32              meter;
+  const gchar         *meter_text;
+  GPtrArray           *deco_names;     /* from %%deco */
+} GabcAbcCheck;
+
+/* abc 2.1 section 4.14, then the ones abcm2ps adds. */
+static const gchar * const decorations [] = {
+  "trill", "trill(", "trill)", "lowermordent", "uppermordent", "mordent",
+  "pralltriller", "roll", "turn", "turnx", "invertedturn", "invertedturnx",
+  "arpeggio", ">", "accent", "emphasis", "fermata", "invertedfermata",
+  "tenuto", "0", "1", "2", "3", "4", "5", "+", "plus", "snap", "slide",
+  "wedge", "upbow", "downbow", "open", "thumb", "breath", "pppp", "ppp",
+  "pp", "p", "mp", "mf", "f", "ff", "fff", "ffff", "sfz", "crescendo(",
+  "<(", "crescendo)", "<)", "diminuendo(", ">(", "diminuendo)", ">)",
+  "segno", "coda", "D.S.", "D.C.", "dacoda", "dacapo", "fine",
+  "shortphrase", "mediumphrase", "longphrase", "editorial", "courtesy",
+
+  "invisible", "beamon", "beambr1", "beambr2", "rbstop", "rbend", "xstem",
+  "ped", "ped-up", "trem1", "trem2", "trem3", "trem4", "marcato", "^",
+  "dot", "gmark", "D.C.alcoda", "D.C.alfine", "D.S.alcoda", "D.S.alfine",
+  "8va(", "8va)", "8vb(", "8vb)", "15ma(", "15ma)", "15mb(", "15mb)",
+};
+
+
+static void
+gabc_abc_check_problem_clear (GabcAbcProblem *problem)
+{
+  g_free (problem->message);
+}
+
+
+G_GNUC_PRINTF (5, 6)
+static void
+gabc_abc_check_add (GabcAbcCheck    *check,
+                    GabcLogSeverity  severity,
+                    guint            offset,
+                    guint            length,
+                    const gchar     *format,
+                    ...)
+{
+  GabcAbcProblem problem = { severity, offset, length, NULL };
+  va_list args;
+
+  va_start (args, format);
+  problem.message = g_strdup_vprintf (format, args);
+  va_end (args);
+
+  g_array_append_val (check->problems, problem);
+}
+
+
+/*
+ * A length in ticks as a fraction of a whole note, such as "3/8", over
+ * denominator if it can be, so a bar reads in the same terms as its meter.
+ */
+static gchar *
+gabc_abc_check_format_length (guint32 ticks,
+                              guint   denominator)
+{
+  guint32 a = ticks;
+  guint32 b = GABC_ABC_TICKS_PER_WHOLE;
+
+  if (denominator > 0 && ((guint64) ticks * denominator) % GABC_ABC_TICKS_PER_WHOLE == 0)
+    return g_strdup_printf ("%u/%u", (guint) ((guint64) ticks * denominator / GABC_ABC_TICKS_PER_WHOLE), denominator);
+
+  while (b != 0)
+    {
+      guint32 t = a % b;
+
+      a = b;
+      b = t;
+    }
+
+  if (GABC_ABC_TICKS_PER_WHOLE / a == 1)
+    return g_strdup_printf ("%u", ticks / a);
+
+  return g_strdup_printf ("%u/%u", ticks / a, GABC_ABC_TICKS_PER_WHOLE / a);
+}
+
+
+static void
+gabc_abc_check_start_bar (GabcAbcCheckVoice *voice,
+                          gboolean           plain)
+{
+  voice->bar_length = 0;
+  voice->bar_has_multirest = FALSE;
+  voice->plain_start = plain;
+}
+
+
+/*
+ * A bar line closes the bar before it.  Only a plain "|" can both open
+ * and close a bar that is checked for being too short.
+ */
+static void
+gabc_abc_check_close_bar (GabcAbcCheck         *check,
+                          const GabcAbcElement *element)
+{
+  GabcAbcCheckVoice *voice = check->voice;
+  gboolean plain = element->data.bar.flags == 0 && element->data.bar.endings == 0;
+  guint end = element->offset + element->length;
+
+  if (check->meter > 0 && voice->bar_length > 0 && !voice->bar_has_multirest &&
+      (voice->bar_length > check->meter || (voice->bar_length < check->meter && voice->plain_start && plain)))
+    {
+      const gchar *slash = strrchr (check->meter_text, '/');
+      guint denominator = 0;
+      g_autofree gchar *length = NULL;
+      g_autofree gchar *meter = NULL;
+
+      /* "C" is 4/4 and "C|" is 2/2. */
+      if (check->meter_text[0] == 'C')
+        denominator = check->meter_text[1] == '|' ? 2 : 4;
+      else if (slash != NULL)
+        denominator = (guint) g_ascii_strtoull (slash + 1, NULL, 10);
+
+      length = gabc_abc_check_format_length (voice->bar_length, denominator);
+      meter = gabc_abc_check_format_length (check->meter, denominator);
+      gabc_abc_check_add (check, GABC_LOG_SEVERITY_WARNING, voice->bar_offset, end - voice->bar_offset,
+                          "Bar is %s long; M:%s bars are %s", length, check->meter_text, meter);
+    }
+
+  gabc_abc_check_start_bar (voice, plain);
+}
+
+
+static void
+gabc_abc_check_repeat (GabcAbcCheck         *check,
+                       const GabcAbcElement *element)
+{
+  GabcAbcCheckVoice *voice = check->voice;
+  guint flags = element->data.bar.flags;
+  guint endings = element->data.bar.endings;
+
+  if (flags & GABC_ABC_BAR_END_REPEAT)
+    voice->repeat_offset = -1;
+
+  if (endings != 0)
+    {
+      /* Numbered from 1, so the lowest bit set is the first ending. */
+      if ((endings & 3) == 0 && voice->endings_seen == 0)
+        gabc_abc_check_add (check, GABC_LOG_SEVERITY_WARNING, element->offset, element->length,
+                            "Ending without a first ending before it");
+      voice->endings_seen |= endings;
+    }
+
+  if (flags & GABC_ABC_BAR_START_REPEAT)
+    {
+      if (voice->repeat_offset >= 0)
+        gabc_abc_check_add (check, GABC_LOG_SEVERITY_WARNING, element->offset, element->length,
+                            "Repeat starts inside another repeat");
+      voice->repeat_offset = element->offset;
+      voice->endings_seen = 0;
+    }
+  else if ((flags & GABC_ABC_BAR_END_REPEAT) == 0 && (flags & GABC_ABC_BAR_THICK))
+    {
+      /* A double bar ends any run of endings. */
+      voice->endings_seen = 0;
+    }
+}
+
+
+static void
+gabc_abc_check_decoration (GabcAbcCheck         *check,
+                           const GabcAbcElement *element)
+{
+  const gchar *text = gabc_abc_tune_get_string (check->tune, element);
+  gsize length = strlen (text);
+  g_autofree gchar *name = NULL;
+  guint i;
+
+  /* Single character shorthands are always fine. */
+  if (length < 3 || (text[0] != '!' && text[0] != '+'))
+    return;
+
+  name = g_strndup (text + 1, length - 2);
+
+  for (i = 0; i < G_N_ELEMENTS (decorations); i++)
+    if (strcmp (name, decorations[i]) == 0)
+      return;
+
+  for (i = 0; i < check->deco_names->len; i++)
+    if (strcmp (name, g_ptr_array_index (check->deco_names, i)) == 0)
+      return;
+
+  gabc_abc_check_add (check, GABC_LOG_SEVERITY_WARNING, element->offset, element->length,
+                      "Unknown decoration %s", text);
+}
+
+
+static void
+gabc_abc_check_field (GabcAbcCheck         *check,
+                      const GabcAbcElement *element,
+                      gboolean              after_k)
+{
+  const gchar *text = gabc_abc_tune_get_string (check->tune, element);
+
+  switch (text[0])
+    {
+    case 'M':
+      check->meter = element->duration;
+      check->meter_text = text + 2 + strspn (text + 2, " \t");
+      break;
+
+    default:
+      if (after_k && !(element->flags & GABC_ABC_ELEMENT_HEADER) &&
+          strchr (GABC_ABC_CHECK_HEADER_FIELDS, text[0]) != NULL)
+        gabc_abc_check_add (check, GABC_LOG_SEVERITY_WARNING, element->offset, element->length,
+                            "%c: belongs in the tune header, before K:", text[0]);
+      break;
+    }
+}
+
+
+static void
+gabc_abc_check_collect_deco_names (GabcAbcCheck *check)
+{
+  guint i;
+
+  for (i = 0; i < check->tune->n_elements; i++)
+    {
+      const GabcAbcElement *element = &check->tune->elements[i];
+      const gchar *text;
+      gsize length;
+
+      if (element->kind != GABC_ABC_ELEMENT_DIRECTIVE)
+        continue;
+
+      text = gabc_abc_tune_get_string (check->tune, element);
+      if (!g_str_has_prefix (text, "%%deco "))
+        continue;
+
+      text += strlen ("%%deco ");
+      text += strspn (text, " \t");
+      length = strcspn (text, " \t");
+      if (length > 0)
+        g_ptr_array_add (check->deco_names, g_strndup (text, length));
+    }
+}
+
+
+/*
+ * Check tune, returning a GabcAbcProblem for each thing wrong with it in
+ * order through the tune.
+ */
+GArray *
+gabc_abc_tune_check (const GabcAbcTune *tune)
+{
+  GabcAbcCheck check = { tune, };
+  gboolean after_k = FALSE;
+  gint early_music = -1;                /* the first music before K: */
+  guint n_voices = MAX (tune->n_voices, 1);
+  guint i, v;
+
+  check.problems = g_array_new (FALSE, FALSE, sizeof (GabcAbcProblem));
+  g_array_set_clear_func (check.problems, (GDestroyNotify) gabc_abc_check_problem_clear);
+  check.voices = g_new0 (GabcAbcCheckVoice, n_voices);
+  check.voice = &check.voices[0];
+  check.meter_text = "";
+  check.deco_names = g_ptr_array_new_with_free_func (g_free);
+
+  for (v = 0; v < n_voices; v++)
+    {
+      check.voices[v].repeat_offset = -1;
+      check.voices[v].slurs = g_array_new (FALSE, FALSE, sizeof (guint));
+    }
+
+  gabc_abc_check_collect_deco_names (&check);
+
+  for (i = 0; i < tune->n_elements; i++)
+    {
+      const GabcAbcElement *element = &tune->elements[i];
+      GabcAbcCheckVoice *voice = check.voice;
+
+      switch ((GabcAbcElementKind) element->kind)
+        {
+        case GABC_ABC_ELEMENT_NOTE:
+        case GABC_ABC_ELEMENT_REST:
+        case GABC_ABC_ELEMENT_CHORD:
+        case GABC_ABC_ELEMENT_BAR:
+        case GABC_ABC_ELEMENT_TUPLET:
+          if (!after_k && early_music < 0)
+            early_music = i;
+          break;
+
+        case GABC_ABC_ELEMENT_FIELD:
+        case GABC_ABC_ELEMENT_VOICE:
+        case GABC_ABC_ELEMENT_DECORATION:
+        case GABC_ABC_ELEMENT_CHORD_SYMBOL:
+        case GABC_ABC_ELEMENT_ANNOTATION:
+        case GABC_ABC_ELEMENT_LYRICS:
+        case GABC_ABC_ELEMENT_DIRECTIVE:
+        case GABC_ABC_ELEMENT_SLUR_START:
+        case GABC_ABC_ELEMENT_SLUR_END:
+        case GABC_ABC_N_ELEMENT_KINDS:
+        default:
+          break;
+        }
+
+      switch ((GabcAbcElementKind) element->kind)
+        {
+        case GABC_ABC_ELEMENT_FIELD:
+          gabc_abc_check_field (&check, element, after_k);
+          if (gabc_abc_tune_get_string (tune, element)[0] != 'K' || after_k)
+            break;
+          after_k = TRUE;
+          if (early_music >= 0)
+            gabc_abc_check_add (&check, GABC_LOG_SEVERITY_ERROR,
+                                tune->elements[early_music].offset, tune->elements[early_music].length,
+                                "Music before K:, which has to end the tune header");
+          break;
+
+        case GABC_ABC_ELEMENT_VOICE:
+          check.voice = &check.voices[MIN (element->data.voice, n_voices - 1)];
+          gabc_abc_check_start_bar (check.voice, FALSE);
+          break;
+
+        case GABC_ABC_ELEMENT_NOTE:
+        case GABC_ABC_ELEMENT_REST:
+        case GABC_ABC_ELEMENT_CHORD:
+          if (element->flags & (GABC_ABC_ELEMENT_GRACE | GABC_ABC_ELEMENT_IN_CHORD))
+            break;
+          if (voice->bar_length == 0)
+            voice->bar_offset = element->offset;
+          voice->bar_length += element->duration;
+          if (element->kind == GABC_ABC_ELEMENT_REST && element->duration >= check.meter && check.meter > 0)
+            voice->bar_has_multirest = TRUE;
+          break;
+
+        case GABC_ABC_ELEMENT_BAR:
+          gabc_abc_check_close_bar (&check, element);
+          gabc_abc_check_repeat (&check, element);
+          break;
+
+        case GABC_ABC_ELEMENT_DECORATION:
+          gabc_abc_check_decoration (&check, element);
+          break;
+
+        case GABC_ABC_ELEMENT_SLUR_START:
+          g_array_append_val (voice->slurs, element->offset);
+          break;
+
+        case GABC_ABC_ELEMENT_SLUR_END:
+          if (voice->slurs->len > 0)
+            g_array_set_size (voice->slurs, voice->slurs->len - 1);
+          else
+            gabc_abc_check_add (&check, GABC_LOG_SEVERITY_WARNING, element->offset, element->length,
+                                "Slur ends without a start");
+          break;
+
+        case GABC_ABC_ELEMENT_TUPLET:
+        case GABC_ABC_ELEMENT_CHORD_SYMBOL:
+        case GABC_ABC_ELEMENT_ANNOTATION:
+        case GABC_ABC_ELEMENT_LYRICS:
+        case GABC_ABC_ELEMENT_DIRECTIVE:
+        case GABC_ABC_N_ELEMENT_KINDS:
+        default:
+          break;
+        }
+    }
+
+  if (tune->n_elements > 0 && !after_k)
+    gabc_abc_check_add (&check, GABC_LOG_SEVERITY_ERROR, tune->elements[0].offset, tune->elements[0].length,
+                        "The tune has no K: field");
+
+  for (v = 0; v < n_voices; v++)
+    {
+      GabcAbcCheckVoice *voice = &check.voices[v];
+
+      if (voice->repeat_offset >= 0)
+        gabc_abc_check_add (&check, GABC_LOG_SEVERITY_WARNING, voice->repeat_offset, 2,
+                            "Repeat is never closed with :|");
+
+      for (i = 0; i < voice->slurs->len; i++)
+        gabc_abc_check_add (&check, GABC_LOG_SEVERITY_WARNING, g_array_index (voice->slurs, guint, i), 1,
+                            "Slur is never closed");
+
+      g_array_unref (voice->slurs);
+    }
+
+  g_free (check.voices);
+  g_ptr_array_unref (check.deco_names);
+
+  return check.problems;
+}
@@ -0,0 +1,42 @@
+/* gabc-abc-check.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <glib.h>
+
+#include "gabc-abc-parser.h"
+#include "gabc-log-record.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Something wrong with a tune, over length bytes of its text from offset,
+ * which counts from the start of the tune.
+ */
+typedef struct {
+  GabcLogSeverity  severity;
+  guint            offset;
+  guint            length;
+  gchar           *message;
+} GabcAbcProblem;
+
+GArray *                  gabc_abc_tune_check                     (const GabcAbcTune *tune);
+
+G_END_DECLS
@@ -0,0 +1,416 @@
+/* gabc-abc-lexer.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Line at a time tokenizer for abc, for highlighting.
+ *
+ * Each line is classified in a single left to right pass with no
+ * backtracking beyond the closing character of a quoted string or
+ * decoration.  The only state kept between lines is whether we are in the
+ * file header, a tune header or a tune body, and whether we are inside a
+ * %%begintext block.  This is far from a full parser: it only has to be
+ * right about where tokens start and end.
+ */
+
+#include <string.h>
+
+#include "gabc-abc-lexer.h"
+
+/* Letters that start a field line (abc 2.1, section 3). */
+#define GABC_ABC_FIELD_LETTERS "ABCDFGHIKLMmNOPQRrSsTUVWwXZ+"
+
+/* Upper case letters that are decoration shorthands in a tune body. */
+#define GABC_ABC_SHORTHAND_DECORATIONS "HIJKLMNOPQRSTUVWY"
+
+
+void
+gabc_abc_lexer_init (GabcAbcLexer *lexer)
+{
+  lexer->section = GABC_ABC_LEXER_FILE_HEADER;
+  lexer->in_text_block = FALSE;
+}
+
+
+const gchar *
+gabc_abc_token_kind_to_string (GabcAbcTokenKind kind)
+{
+  switch (kind)
+    {
+    case GABC_ABC_TOKEN_COMMENT:
+      return "comment";
+    case GABC_ABC_TOKEN_DIRECTIVE:
+      return "directive";
+    case GABC_ABC_TOKEN_FIELD:
+      return "field";
+    case GABC_ABC_TOKEN_LYRICS:
+      return "lyrics";
+    case GABC_ABC_TOKEN_TEXT:
+      return "text";
+    case GABC_ABC_TOKEN_NOTE:
+      return "note";
+    case GABC_ABC_TOKEN_REST:
+      return "rest";
+    case GABC_ABC_TOKEN_BAR:
+      return "bar";
+    case GABC_ABC_TOKEN_DECORATION:
+      return "decoration";
+    case GABC_ABC_TOKEN_CHORD_SYMBOL:
+      return "chord-symbol";
+    case GABC_ABC_TOKEN_ANNOTATION:
+      return "annotation";
+    case GABC_ABC_TOKEN_INLINE_FIELD:
+      return "inline-field";
+    case GABC_ABC_TOKEN_TUPLET:
+      return "tuplet";
+    case GABC_ABC_N_TOKEN_KINDS:
+    default:
+      g_return_val_if_reached (NULL);
+    }
+}
+
+
+static gboolean
+gabc_abc_lexer_has_prefix (const gchar *line,
+                           gsize        length,
+                           const gchar *prefix)
+{
+  gsize prefix_length = strlen (prefix);
+
+  return length >= prefix_length && memcmp (line, prefix, prefix_length) == 0;
+}
+
+
+static gboolean
+gabc_abc_lexer_is_field_line (const gchar *line,
+                              gsize        length)
+{
+  return length >= 2 && line[1] == ':' && line[0] != '\0' &&
+         strchr (GABC_ABC_FIELD_LETTERS, line[0]) != NULL;
+}
+
+
+/*
+ * Returns the offset just past the end of the string of characters from
+ * accept starting at i.
+ */
+static gsize
+gabc_abc_lexer_span (const gchar *line,
+                     gsize        length,
+                     gsize        i,
+                     const gchar *accept)
+{
+  while (i < length && line[i] != '\0' && strchr (accept, line[i]) != NULL)
+    i++;
+
+  return i;
+}
+
+
+/*
+ * Returns the end of the bar line starting at i.  A trailing "[" only
+ * belongs to the bar when an ending number follows it, as in "|[2";
+ * otherwise it opens a chord or an inline field, as in "|[CE]".
+ */
+static gsize
+gabc_abc_lexer_bar_end (const gchar *line,
+                        gsize        length,
+                        gsize        i)
+{
+  gsize end = gabc_abc_lexer_span (line, length, i, "|:[]");
+
+  if (end > i + 1 && line[end - 1] == '[' && !(end < length && g_ascii_isdigit (line[end])))
+    end--;
+
+  return gabc_abc_lexer_span (line, length, end, "0123456789,-");
+}
+
+
+/*
+ * Returns the offset just past the next close character after i, or 0 if
+ * there is none on the line.
+ */
+static gsize
+gabc_abc_lexer_find_close (const gchar *line,
+                           gsize        length,
+                           gsize        i,
+                           gchar        close)
+{
+  const gchar *p = memchr (line + i, close, length - i);
+
+  return (p != NULL) ? (gsize) (p - line) + 1 : 0;
+}
+
+
+static void
+gabc_abc_lexer_lex_field_line (GabcAbcLexer     *lexer,
+                               const gchar      *line,
+                               gsize             length,
+                               GabcAbcTokenFunc  func,
+                               gpointer          user_data)
+{
+  const gchar *comment;
+  gsize end = length;
+
+  switch (line[0])
+    {
+    case 'X':
+      lexer->section = GABC_ABC_LEXER_TUNE_HEADER;
+      break;
+    case 'K':
+      if (lexer->section == GABC_ABC_LEXER_TUNE_HEADER)
+        lexer->section = GABC_ABC_LEXER_TUNE_BODY;
+      break;
+    case 'W':
+    case 'w':
+      func (GABC_ABC_TOKEN_LYRICS, 0, length, user_data);
+      return;
+    default:
+      break;
+    }
+
+  comment = memchr (line, '%', length);
+  if (comment != NULL && (comment == line || comment[-1] != '\\'))
+    end = comment - line;
+
+  func (GABC_ABC_TOKEN_FIELD, 0, end, user_data);
+  if (end < length)
+    func (GABC_ABC_TOKEN_COMMENT, end, length, user_data);
+}
+
+
+static void
+gabc_abc_lexer_lex_music_line (const gchar      *line,
+                               gsize             length,
+                               GabcAbcTokenFunc  func,
+                               gpointer          user_data)
+{
+  gsize i = 0;
+
+  while (i < length)
+    {
+      gchar c = line[i];
+      gsize end;
+
+      switch (c)
+        {
+        case '%':
+          func (GABC_ABC_TOKEN_COMMENT, i, length, user_data);
+          return;
+
+        case '"':
+          end = gabc_abc_lexer_find_close (line, length, i + 1, '"');
+          if (end == 0)
+            end = length;
+          if (i + 1 < length && line[i + 1] != '\0' && strchr ("^_<>@", line[i + 1]) != NULL)
+            func (GABC_ABC_TOKEN_ANNOTATION, i, end, user_data);
+          else
+            func (GABC_ABC_TOKEN_CHORD_SYMBOL, i, end, user_data);
+          i = end;
+          break;
+
+        case '!':
+        case '+':
+          end = gabc_abc_lexer_find_close (line, length, i + 1, c);
+          if (end > i + 2)
+            {
+              func (GABC_ABC_TOKEN_DECORATION, i, end, user_data);
+              i = end;
+            }
+          else
+            {
+              i++;
+            }
+          break;
+
+        case '[':
+          if (i + 2 < length && g_ascii_isalpha (line[i + 1]) && line[i + 2] == ':')
+            {
+              end = gabc_abc_lexer_find_close (line, length, i + 3, ']');
+              if (end == 0)
+                end = length;
+              func (line[i + 1] == 'r' ? GABC_ABC_TOKEN_COMMENT : GABC_ABC_TOKEN_INLINE_FIELD,
+                    i, end, user_data);
+              i = end;
+            }
+          else if (i + 1 < length && (line[i + 1] == '|' || g_ascii_isdigit (line[i + 1])))
+            {
+              end = gabc_abc_lexer_bar_end (line, length, i);
+              func (GABC_ABC_TOKEN_BAR, i, end, user_data);
+              i = end;
+            }
+          else
+            {
+              /* A chord: its notes are picked up one at a time. */
+              func (GABC_ABC_TOKEN_NOTE, i, i + 1, user_data);
+              i++;
+            }
+          break;
+
+        case '|':
+        case ':':
+          end = gabc_abc_lexer_bar_end (line, length, i);
+          func (GABC_ABC_TOKEN_BAR, i, end, user_data);
+          i = end;
+          break;
+
+        case ']':
+          func (GABC_ABC_TOKEN_NOTE, i, i + 1, user_data);
+          i++;
+          break;
+
+        case '(':
+          if (i + 1 < length && g_ascii_isdigit (line[i + 1]))
+            {
+              end = gabc_abc_lexer_span (line, length, i + 1, "0123456789:");
+              func (GABC_ABC_TOKEN_TUPLET, i, end, user_data);
+              i = end;
+            }
+          else
+            {
+              i++;
+            }
+          break;
+
+        case '^':
+        case '_':
+        case '=':
+        case 'a': case 'b': case 'c': case 'd': case 'e': case 'f': case 'g':
+        case 'A': case 'B': case 'C': case 'D': case 'E': case 'F': case 'G':
+          end = gabc_abc_lexer_span (line, length, i, "^_=");
+          if (end < length && strchr ("abcdefgABCDEFG", line[end]) != NULL && line[end] != '\0')
+            {
+              end = gabc_abc_lexer_span (line, length, end + 1, ",'");
+              end = gabc_abc_lexer_span (line, length, end, "0123456789/");
+              func (GABC_ABC_TOKEN_NOTE, i, end, user_data);
+            }
+          i = MAX (end, i + 1);
+          break;
+
+        case 'z':
+        case 'Z':
+        case 'x':
+        case 'X':
+          end = gabc_abc_lexer_span (line, length, i + 1, "0123456789/");
+          func (GABC_ABC_TOKEN_REST, i, end, user_data);
+          i = end;
+          break;
+
+        case '.':
+        case '~':
+        case 'u':
+        case 'v':
+          func (GABC_ABC_TOKEN_DECORATION, i, i + 1, user_data);
+          i++;
+          break;
+
+        default:
+          if (c != '\0' && strchr (GABC_ABC_SHORTHAND_DECORATIONS, c) != NULL)
+            func (GABC_ABC_TOKEN_DECORATION, i, i + 1, user_data);
+          else if (g_ascii_isdigit (c) || c == '/')
+            func (GABC_ABC_TOKEN_NOTE, i, gabc_abc_lexer_span (line, length, i, "0123456789/"), user_data);
+          i = MAX (gabc_abc_lexer_span (line, length, i, "0123456789/"), i + 1);
+          break;
+        }
+    }
+}
+
+
+/*
+ * Tokenize one line (without its line break), calling func for each token
+ * in order.  Text that isn't part of any token (white space, free text
+ * between tunes) is skipped.
+ */
+void
+gabc_abc_lexer_lex_line (GabcAbcLexer     *lexer,
+                         const gchar      *line,
+                         gsize             length,
+                         GabcAbcTokenFunc  func,
+                         gpointer          user_data)
+{
+  gsize i;
+
+  if (lexer->in_text_block)
+    {
+      if (gabc_abc_lexer_has_prefix (line, length, "%%endtext"))
+        {
+          lexer->in_text_block = FALSE;
+          func (GABC_ABC_TOKEN_DIRECTIVE, 0, length, user_data);
+        }
+      else if (length > 0)
+        {
+          func (GABC_ABC_TOKEN_TEXT, 0, length, user_data);
+        }
+      return;
+    }
+
+  i = gabc_abc_lexer_span (line, length, 0, " \t");
+  if (i == length)
+    {
+      /* A blank line ends the tune. */
+      lexer->section = GABC_ABC_LEXER_FILE_HEADER;
+      return;
+    }
+
+  if (gabc_abc_lexer_has_prefix (line, length, "%%"))
+    {
+      if (gabc_abc_lexer_has_prefix (line, length, "%%begintext"))
+        lexer->in_text_block = TRUE;
+      func (GABC_ABC_TOKEN_DIRECTIVE, 0, length, user_data);
+      return;
+    }
+
+  if (line[0] == '%')
+    {
+      func (GABC_ABC_TOKEN_COMMENT, 0, length, user_data);
+      return;
+    }
+
+  if (gabc_abc_lexer_is_field_line (line, length))
+    {
+      gabc_abc_lexer_lex_field_line (lexer, line, length, func, user_data);
+      return;
+    }
+
+  switch (lexer->section)
+    {
+    case GABC_ABC_LEXER_FILE_HEADER:
+      {
+        /* Free text; only comments mean anything here. */
+        const gchar *comment = memchr (line, '%', length);
+
+        if (comment != NULL)
+          func (GABC_ABC_TOKEN_COMMENT, comment - line, length, user_data);
+      }
+      break;
+
+    case GABC_ABC_LEXER_TUNE_HEADER:
+      /* Music before the K: field; abcm2ps accepts it, so lex it as music. */
+      lexer->section = GABC_ABC_LEXER_TUNE_BODY;
+      gabc_abc_lexer_lex_music_line (line, length, func, user_data);
+      break;
+
+    case GABC_ABC_LEXER_TUNE_BODY:
+      gabc_abc_lexer_lex_music_line (line, length, func, user_data);
+      break;
+
+    default:
+      g_assert_not_reached ();
+    }
+}
@@ -0,0 +1,76 @@
+/* gabc-abc-lexer.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+  GABC_ABC_TOKEN_COMMENT,
+  GABC_ABC_TOKEN_DIRECTIVE,
+  GABC_ABC_TOKEN_FIELD,
+  GABC_ABC_TOKEN_LYRICS,
+  GABC_ABC_TOKEN_TEXT,
+  GABC_ABC_TOKEN_NOTE,
+  GABC_ABC_TOKEN_REST,
+  GABC_ABC_TOKEN_BAR,
+  GABC_ABC_TOKEN_DECORATION,
+  GABC_ABC_TOKEN_CHORD_SYMBOL,
+  GABC_ABC_TOKEN_ANNOTATION,
+  GABC_ABC_TOKEN_INLINE_FIELD,
+  GABC_ABC_TOKEN_TUPLET,
+  GABC_ABC_N_TOKEN_KINDS
+} GabcAbcTokenKind;
+
+typedef enum {
+  GABC_ABC_LEXER_FILE_HEADER,
+  GABC_ABC_LEXER_TUNE_HEADER,
+  GABC_ABC_LEXER_TUNE_BODY,
+} GabcAbcLexerSection;
+
+/*
+ * Everything the lexer carries from one line to the next.  It is reset by
+ * every X: line, so lexing can always restart at the start of a tune.
+ */
+typedef struct {
+  GabcAbcLexerSection  section;
+  gboolean             in_text_block;
+} GabcAbcLexer;
+
+/*
+ * start and end are byte offsets into the line.
+ */
+typedef void (*GabcAbcTokenFunc) (GabcAbcTokenKind  kind,
+                                  gsize             start,
+                                  gsize             end,
+                                  gpointer          user_data);
+
+void                      gabc_abc_lexer_init                     (GabcAbcLexer     *lexer);
+
+void                      gabc_abc_lexer_lex_line                 (GabcAbcLexer     *lexer,
+                                                                   const gchar      *line,
+                                                                   gsize             length,
+                                                                   GabcAbcTokenFunc  func,
+                                                                   gpointer          user_data);
+
+const gchar *             gabc_abc_token_kind_to_string           (GabcAbcTokenKind  kind);
+
+G_END_DECLS
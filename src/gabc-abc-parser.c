@@ -0,0 +1,1034 @@
+/* gabc-abc-parser.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * abc 2.1 parsed into a flat array of elements per tune.
+ *
+ * The parser rides on GabcAbcLexer, which already knows where every token
+ * starts and ends, and reads the few things written between tokens (broken
+ * rhythm, ties, slurs and grace note braces) itself.  The result is an
+ * array of 16 byte elements in the order they are written, with lengths in
+ * integer ticks and pitches worked out, so anything that walks the music
+ * (the player, the validator, transposition) reads plain integers and never
+ * goes back to the text.  Elements and strings are collected in growable
+ * arrays and copied into a single block at the end, so a tune is one
+ * allocation and freeing it is one call.
+ *
+ * GabcTuneIndex keeps the parsed form of each tune and parses a tune again
+ * only after an edit touches it.
+ */
+
+#include <string.h>
+
+#include "gabc-abc-lexer.h"
+#include "gabc-abc-parser.h"
+#include "gabc-melody.h"
+
+G_STATIC_ASSERT (sizeof (GabcAbcElement) == 16);
+
+typedef struct {
+  GArray           *elements;
+  GString          *strings;
+  GArray           *voices;           /* guint32 offsets into strings */
+
+  const gchar      *line;
+  gsize             line_offset;      /* of line in the text */
+  gsize             previous_end;     /* of the last token in line */
+  gboolean          line_has_music;
+  gboolean          in_header;
+
+  GabcMelody        melody;           /* key signature and accidentals */
+  guint32           unit;             /* L: */
+  gboolean          unit_set;
+  guint32           meter;            /* length of a bar, 0 for free meter */
+
+  guint             tuplet_left;
+  guint             tuplet_p;
+  guint             tuplet_q;
+  guint             broken_numerator; /* for the next note, from > or < */
+  guint             broken_denominator;
+  gint              chord;            /* the open chord, or -1 */
+  gboolean          after_chord;      /* a length here is the chord's */
+  gboolean          in_grace;
+  gint              last;             /* last note, rest or chord taking time, or -1 */
+  gint              tie_target;       /* last note or chord, or -1 */
+} GabcAbcParser;
+
+
+static guint32
+gabc_abc_parser_scale (guint32 ticks,
+                       guint   numerator,
+                       guint   denominator)
+{
+  guint64 scaled;
+
+  if (denominator == 0)
+    return ticks;
+
+  scaled = ((guint64) ticks * numerator + denominator / 2) / denominator;
+
+  return (guint32) MIN (scaled, G_MAXUINT32);
+}
+
+
+/*
+ * A note length multiplier such as "3", "/", "//", "3/2" or "/4".
+ */
+static void
+gabc_abc_parser_parse_length (const gchar *text,
+                              gsize        length,
+                              guint       *numerator,
+                              guint       *denominator)
+{
+  gsize i = 0;
+  guint n;
+
+  *numerator = 1;
+  *denominator = 1;
+
+  for (n = 0; i < length && g_ascii_isdigit (text[i]); i++)
+    n = MIN (n * 10 + (text[i] - '0'), 1024);
+  if (i > 0 && n > 0)
+    *numerator = n;
+
+  while (i < length && text[i] == '/')
+    {
+      gsize digits = ++i;
+
+      for (n = 0; i < length && g_ascii_isdigit (text[i]); i++)
+        n = MIN (n * 10 + (text[i] - '0'), 1024);
+      *denominator = MIN (*denominator * ((i > digits && n > 0) ? n : 2), 1 << 20);
+    }
+}
+
+
+/*
+ * A fraction such as "1/8", "6/8" or "2+3/8" at *p, in ticks, advancing
+ * *p past it.  Returns 0 if there is none.
+ */
+static guint32
+gabc_abc_parser_parse_fraction (const gchar **p)
+{
+  const gchar *s = *p;
+  guint numerator = 0;
+  guint denominator = 1;
+
+  while (*s == ' ' || *s == '(')
+    s++;
+
+  while (g_ascii_isdigit (*s))
+    {
+      guint n = 0;
+
+      for (; g_ascii_isdigit (*s); s++)
+        n = MIN (n * 10 + (*s - '0'), 1024);
+      numerator += n;
+      while (*s == '+' || *s == ')')
+        s++;
+    }
+
+  if (*s == '/' && g_ascii_isdigit (s[1]))
+    {
+      s++;
+      for (denominator = 0; g_ascii_isdigit (*s); s++)
+        denominator = MIN (denominator * 10 + (*s - '0'), 1024);
+    }
+
+  *p = s;
+
+  return gabc_abc_parser_scale (GABC_ABC_TICKS_PER_WHOLE, numerator, denominator);
+}
+
+
+static guint32
+gabc_abc_parser_add_string (GabcAbcParser *parser,
+                            const gchar   *text,
+                            gsize          length)
+{
+  guint32 offset = parser->strings->len;
+
+  g_string_append_len (parser->strings, text, length);
+  g_string_append_c (parser->strings, '\0');
+
+  return offset;
+}
+
+
+static GabcAbcElement *
+gabc_abc_parser_add_element (GabcAbcParser      *parser,
+                             GabcAbcElementKind  kind,
+                             gsize               start,
+                             gsize               end)
+{
+  GabcAbcElement element = { 0, };
+
+  element.offset = parser->line_offset + start;
+  element.length = MIN (end - start, G_MAXUINT16);
+  element.kind = kind;
+  g_array_append_val (parser->elements, element);
+
+  return &g_array_index (parser->elements, GabcAbcElement, parser->elements->len - 1);
+}
+
+
+static GabcAbcElement *
+gabc_abc_parser_get_element (GabcAbcParser *parser,
+                             gint           index)
+{
+  if (index < 0)
+    return NULL;
+
+  return &g_array_index (parser->elements, GabcAbcElement, index);
+}
+
+
+static void
+gabc_abc_parser_start_tune (GabcAbcParser *parser)
+{
+  gabc_melody_init (&parser->melody, NULL);
+  parser->unit = GABC_ABC_TICKS_PER_WHOLE / 8;
+  parser->unit_set = FALSE;
+  parser->meter = 0;
+  parser->tuplet_left = 0;
+  parser->broken_numerator = 1;
+  parser->broken_denominator = 1;
+  parser->chord = -1;
+  parser->after_chord = FALSE;
+  parser->in_grace = FALSE;
+  parser->last = -1;
+  parser->tie_target = -1;
+}
+
+
+/*
+ * Broken rhythm and tuplets, for a note, rest or chord that takes time.
+ */
+static guint32
+gabc_abc_parser_apply_timing (GabcAbcParser *parser,
+                              guint32        duration)
+{
+  duration = gabc_abc_parser_scale (duration, parser->broken_numerator, parser->broken_denominator);
+  parser->broken_numerator = 1;
+  parser->broken_denominator = 1;
+
+  if (parser->tuplet_left > 0)
+    {
+      duration = gabc_abc_parser_scale (duration, parser->tuplet_q, parser->tuplet_p);
+      parser->tuplet_left--;
+    }
+
+  return duration;
+}
+
+
+static void
+gabc_abc_parser_set_meter (GabcAbcParser *parser,
+                           const gchar   *value)
+{
+  while (*value == ' ')
+    value++;
+
+  if (value[0] == 'C')
+    parser->meter = GABC_ABC_TICKS_PER_WHOLE;
+  else
+    parser->meter = gabc_abc_parser_parse_fraction (&value);
+
+  /* Without an L: field, the unit follows from the meter. */
+  if (!parser->unit_set)
+    parser->unit = (parser->meter > 0 && parser->meter < GABC_ABC_TICKS_PER_WHOLE * 3 / 4)
+                   ? GABC_ABC_TICKS_PER_WHOLE / 16 : GABC_ABC_TICKS_PER_WHOLE / 8;
+}
+
+
+/*
+ * The beat of "1/4=120", "3/8=80" or "\"Allegro\" 1/4=120"; the old "120"
+ * counts unit lengths.
+ */
+static guint32
+gabc_abc_parser_get_beat (GabcAbcParser *parser,
+                          const gchar   *value)
+{
+  const gchar *equals = strchr (value, '=');
+  const gchar *p = value;
+  guint32 beat = 0;
+
+  if (equals == NULL)
+    return parser->unit;
+
+  while (p < equals)
+    {
+      if (*p == '"')
+        {
+          p = strchr (p + 1, '"');
+          if (p == NULL || p > equals)
+            break;
+          p++;
+        }
+      else if (g_ascii_isdigit (*p))
+        {
+          beat += gabc_abc_parser_parse_fraction (&p);
+        }
+      else
+        {
+          p++;
+        }
+    }
+
+  return beat;
+}
+
+
+static guint32
+gabc_abc_parser_lookup_voice (GabcAbcParser *parser,
+                              const gchar   *value)
+{
+  gsize length;
+  guint32 i;
+
+  while (*value == ' ')
+    value++;
+  length = strcspn (value, " \t");
+
+  for (i = 0; i < parser->voices->len; i++)
+    {
+      const gchar *id = parser->strings->str + g_array_index (parser->voices, guint32, i);
+
+      if (strncmp (id, value, length) == 0 && id[length] == '\0')
+        return i;
+    }
+
+  i = gabc_abc_parser_add_string (parser, value, length);
+  g_array_append_val (parser->voices, i);
+
+  return parser->voices->len - 1;
+}
+
+
+/*
+ * A field line or an inline field, as "K:D" without brackets or comment.
+ */
+static void
+gabc_abc_parser_add_field (GabcAbcParser *parser,
+                           const gchar   *text,
+                           gsize          length,
+                           gsize          start,
+                           gsize          end)
+{
+  g_autofree gchar *value = NULL;
+  GabcAbcElement *element;
+  guint32 voice;
+
+  while (length > 2 && (text[length - 1] == ' ' || text[length - 1] == '\t'))
+    length--;
+  value = g_strndup (text + 2, length - 2);
+
+  if (text[0] == 'X')
+    {
+      gabc_abc_parser_start_tune (parser);
+      parser->in_header = TRUE;
+    }
+
+  element = gabc_abc_parser_add_element (parser, GABC_ABC_ELEMENT_FIELD, start, end);
+  element->flags = parser->in_header ? GABC_ABC_ELEMENT_HEADER : 0;
+  element->data.string = gabc_abc_parser_add_string (parser, text, length);
+
+  switch (text[0])
+    {
+    case 'K':
+      gabc_melody_set_key (&parser->melody, value);
+      parser->in_header = FALSE;
+      break;
+
+    case 'L':
+      {
+        const gchar *p = value;
+
+        parser->unit = gabc_abc_parser_parse_fraction (&p);
+        parser->unit_set = parser->unit > 0;
+        if (!parser->unit_set)
+          parser->unit = GABC_ABC_TICKS_PER_WHOLE / 8;
+        element->duration = parser->unit;
+      }
+      break;
+
+    case 'M':
+      gabc_abc_parser_set_meter (parser, value);
+      element->duration = parser->meter;
+      break;
+
+    case 'Q':
+      element->duration = gabc_abc_parser_get_beat (parser, value);
+      break;
+
+    case 'V':
+      /* Voices in the header are only declared. */
+      voice = gabc_abc_parser_lookup_voice (parser, value);
+      if (!parser->in_header)
+        {
+          element = gabc_abc_parser_add_element (parser, GABC_ABC_ELEMENT_VOICE, start, end);
+          element->data.voice = voice;
+          parser->tuplet_left = 0;
+          parser->broken_numerator = parser->broken_denominator = 1;
+          parser->last = parser->tie_target = -1;
+        }
+      break;
+
+    default:
+      break;
+    }
+}
+
+
+/*
+ * Broken rhythm, ties, slurs and grace notes are written between the
+ * tokens.
+ */
+static void
+gabc_abc_parser_scan_gap (GabcAbcParser *parser,
+                          gsize          start,
+                          gsize          end)
+{
+  GabcAbcElement *last = gabc_abc_parser_get_element (parser, parser->last);
+  GabcAbcElement *tie_target = gabc_abc_parser_get_element (parser, parser->tie_target);
+  gsize i;
+
+  for (i = start; i < end; i++)
+    {
+      gchar c = parser->line[i];
+      guint n = 0;
+
+      switch (c)
+        {
+        case '>':
+        case '<':
+          /*
+           * ">" dots the note before and halves the one after, ">>" double
+           * dots it and quarters the one after...
+           */
+          while (i < end && parser->line[i] == c && n < 8)
+            {
+              n++;
+              i++;
+            }
+          i--;
+          if (c == '>')
+            {
+              if (last != NULL)
+                last->duration = gabc_abc_parser_scale (last->duration, (2u << n) - 1, 1u << n);
+              parser->broken_numerator = 1;
+              parser->broken_denominator = 1u << n;
+            }
+          else
+            {
+              if (last != NULL)
+                last->duration = gabc_abc_parser_scale (last->duration, 1, 1u << n);
+              parser->broken_numerator = (2u << n) - 1;
+              parser->broken_denominator = 1u << n;
+            }
+          break;
+        case '-':
+          if (tie_target != NULL)
+            tie_target->flags |= GABC_ABC_ELEMENT_TIED;
+          break;
+        case '(':
+        case ')':
+          gabc_abc_parser_add_element (parser,
+                                       c == '(' ? GABC_ABC_ELEMENT_SLUR_START : GABC_ABC_ELEMENT_SLUR_END,
+                                       i, i + 1);
+          /* The elements may have moved. */
+          last = gabc_abc_parser_get_element (parser, parser->last);
+          tie_target = gabc_abc_parser_get_element (parser, parser->tie_target);
+          break;
+        case '{':
+          parser->in_grace = TRUE;
+          break;
+        case '}':
+          parser->in_grace = FALSE;
+          break;
+        default:
+          break;
+        }
+    }
+}
+
+
+static void
+gabc_abc_parser_add_note (GabcAbcParser *parser,
+                          const gchar   *text,
+                          gsize          length,
+                          gsize          start,
+                          gsize          end)
+{
+  static const gchar letters [] = "CDEFGAB";
+  GabcAbcElement *element;
+  GabcAbcElement *chord;
+  GabcAbcPitch note = { 0, };
+  gsize length_start;
+  guint numerator;
+  guint denominator;
+  guint32 duration;
+  gint pitch;
+  gsize i;
+
+  if (text[0] == '[')
+    {
+      element = gabc_abc_parser_add_element (parser, GABC_ABC_ELEMENT_CHORD, start, end);
+      element->flags = parser->in_grace ? GABC_ABC_ELEMENT_GRACE : 0;
+      parser->chord = parser->elements->len - 1;
+      parser->after_chord = FALSE;
+      return;
+    }
+  if (text[0] == ']')
+    {
+      chord = gabc_abc_parser_get_element (parser, parser->chord);
+      if (chord != NULL)
+        {
+          chord->length = MIN (parser->line_offset + end - chord->offset, G_MAXUINT16);
+          if (!(chord->flags & GABC_ABC_ELEMENT_GRACE))
+            parser->last = parser->chord;
+          parser->tie_target = parser->chord;
+          parser->after_chord = TRUE;
+        }
+      parser->chord = -1;
+      return;
+    }
+
+  pitch = gabc_melody_get_pitch (&parser->melody, text, length, &length_start);
+  if (pitch < 0)
+    {
+      /* The length of a whole chord, as in "[CEG]2". */
+      chord = gabc_abc_parser_get_element (parser, parser->last);
+      if (parser->after_chord && chord != NULL)
+        {
+          gabc_abc_parser_parse_length (text, length, &numerator, &denominator);
+          chord->duration = gabc_abc_parser_scale (chord->duration, numerator, denominator);
+          chord->length = MIN (parser->line_offset + end - chord->offset, G_MAXUINT16);
+        }
+      parser->after_chord = FALSE;
+      return;
+    }
+  parser->after_chord = FALSE;
+
+  note.pitch = pitch;
+  note.accidental = GABC_ABC_NO_ACCIDENTAL;
+  for (i = 0; text[i] == '^' || text[i] == '_' || text[i] == '='; i++)
+    {
+      if (note.accidental == GABC_ABC_NO_ACCIDENTAL)
+        note.accidental = 0;
+      note.accidental += (text[i] == '^') ? 1 : (text[i] == '_') ? -1 : 0;
+    }
+  note.letter = strchr (letters, g_ascii_toupper (text[i])) - letters;
+  note.octave = g_ascii_islower (text[i]) ? 1 : 0;
+  for (i++; i < length_start; i++)
+    note.octave += (text[i] == '\'') ? 1 : -1;
+
+  gabc_abc_parser_parse_length (text + length_start, length - length_start, &numerator, &denominator);
+  duration = gabc_abc_parser_scale (parser->unit, numerator, denominator);
+
+  element = gabc_abc_parser_add_element (parser, GABC_ABC_ELEMENT_NOTE, start, end);
+  element->data.note = note;
+  element->duration = duration;
+  parser->tie_target = parser->elements->len - 1;
+
+  chord = gabc_abc_parser_get_element (parser, parser->chord);
+  if (chord != NULL)
+    {
+      element->flags = GABC_ABC_ELEMENT_IN_CHORD | (chord->flags & GABC_ABC_ELEMENT_GRACE);
+
+      /* The first note of a chord sets its length. */
+      if (chord->data.n_notes++ == 0)
+        chord->duration = (chord->flags & GABC_ABC_ELEMENT_GRACE)
+                          ? duration : gabc_abc_parser_apply_timing (parser, duration);
+    }
+  else if (parser->in_grace)
+    {
+      element->flags = GABC_ABC_ELEMENT_GRACE;
+    }
+  else
+    {
+      element->duration = gabc_abc_parser_apply_timing (parser, duration);
+      parser->last = parser->elements->len - 1;
+    }
+}
+
+
+static void
+gabc_abc_parser_add_rest (GabcAbcParser *parser,
+                          const gchar   *text,
+                          gsize          length,
+                          gsize          start,
+                          gsize          end)
+{
+  GabcAbcElement *element;
+  guint numerator;
+  guint denominator;
+
+  parser->after_chord = FALSE;
+  gabc_abc_parser_parse_length (text + 1, length - 1, &numerator, &denominator);
+
+  element = gabc_abc_parser_add_element (parser, GABC_ABC_ELEMENT_REST, start, end);
+
+  /* Z and X are whole bars. */
+  if (text[0] == 'Z' || text[0] == 'X')
+    element->duration = gabc_abc_parser_scale (parser->meter > 0 ? parser->meter : GABC_ABC_TICKS_PER_WHOLE,
+                                               numerator, denominator);
+  else
+    element->duration = gabc_abc_parser_apply_timing (parser,
+                                                      gabc_abc_parser_scale (parser->unit, numerator, denominator));
+
+  parser->last = parser->elements->len - 1;
+  parser->tie_target = -1;
+}
+
+
+/*
+ * "|", "||", "|]", "|:", ":|", "::", ":|2", "[1", "|1,3"...
+ */
+static void
+gabc_abc_parser_add_bar (GabcAbcParser *parser,
+                         const gchar   *text,
+                         gsize          length,
+                         gsize          start,
+                         gsize          end)
+{
+  GabcAbcElement *element;
+  guint leading;
+  guint trailing = 0;
+  guint previous = 0;
+  gboolean range = FALSE;
+  guint flags = 0;
+  guint endings = 0;
+  gsize i;
+
+  gabc_melody_add_token (&parser->melody, GABC_ABC_TOKEN_BAR, text, length);
+  parser->after_chord = FALSE;
+
+  for (i = 0; i < length && text[i] == ':'; i++)
+    ;
+  leading = i;
+  for (; i < length && strchr ("|[]", text[i]) != NULL; i++)
+    ;
+  if (g_strstr_len (text, i, "||") != NULL || g_strstr_len (text, i, "|]") != NULL ||
+      g_strstr_len (text, i, "[|") != NULL)
+    flags |= GABC_ABC_BAR_THICK;
+  for (; i < length && text[i] == ':'; i++)
+    trailing++;
+
+  if (leading == length && leading >= 2)
+    flags |= GABC_ABC_BAR_START_REPEAT | GABC_ABC_BAR_END_REPEAT;
+  else
+    flags |= (leading > 0 ? GABC_ABC_BAR_END_REPEAT : 0) | (trailing > 0 ? GABC_ABC_BAR_START_REPEAT : 0);
+
+  while (i < length)
+    {
+      guint n = 0;
+
+      if (!g_ascii_isdigit (text[i]))
+        {
+          range = text[i] == '-';
+          i++;
+          continue;
+        }
+
+      for (; i < length && g_ascii_isdigit (text[i]); i++)
+        n = MIN (n * 10 + (text[i] - '0'), 15);
+      if (range)
+        for (; previous < n; previous++)
+          endings |= 1u << previous;
+      endings |= 1u << n;
+      previous = n;
+      range = FALSE;
+    }
+
+  element = gabc_abc_parser_add_element (parser, GABC_ABC_ELEMENT_BAR, start, end);
+  element->data.bar.flags = flags;
+  element->data.bar.endings = endings;
+}
+
+
+static void
+gabc_abc_parser_add_tuplet (GabcAbcParser *parser,
+                            const gchar   *text,
+                            gsize          length,
+                            gsize          start,
+                            gsize          end)
+{
+  /* How many notes of the same length "(p" puts p notes into the time of. */
+  static const guint8 default_time [10] = { 0, 0, 3, 2, 3, 2, 2, 2, 3, 2 };
+  GabcAbcElement *element;
+  guint values [3] = { 0, 0, 0 };
+  guint n = 0;
+  gsize i;
+
+  parser->after_chord = FALSE;
+
+  for (i = 1; i < length && n < G_N_ELEMENTS (values); i++)
+    {
+      if (text[i] == ':')
+        n++;
+      else
+        values[n] = MIN (values[n] * 10 + (text[i] - '0'), 64);
+    }
+
+  if (values[0] < 2)
+    return;
+
+  if (values[1] == 0)
+    values[1] = values[0] < G_N_ELEMENTS (default_time) ? default_time[values[0]] : 2;
+  if (values[2] == 0)
+    values[2] = values[0];
+
+  parser->tuplet_p = values[0];
+  parser->tuplet_q = values[1];
+  parser->tuplet_left = values[2];
+
+  element = gabc_abc_parser_add_element (parser, GABC_ABC_ELEMENT_TUPLET, start, end);
+  element->data.tuplet.p = values[0];
+  element->data.tuplet.q = values[1];
+  element->data.tuplet.r = values[2];
+}
+
+
+static void
+gabc_abc_parser_add_text (GabcAbcParser      *parser,
+                          GabcAbcElementKind  kind,
+                          const gchar        *text,
+                          gsize               length,
+                          gsize               start,
+                          gsize               end)
+{
+  GabcAbcElement *element;
+  guint32 string;
+
+  string = gabc_abc_parser_add_string (parser, text, length);
+  element = gabc_abc_parser_add_element (parser, kind, start, end);
+  element->data.string = string;
+}
+
+
+static void
+gabc_abc_parser_token_cb (GabcAbcTokenKind  kind,
+                          gsize             start,
+                          gsize             end,
+                          gpointer          user_data)
+{
+  GabcAbcParser *parser = user_data;
+  const gchar *text = parser->line + start;
+  gsize length = end - start;
+
+  switch (kind)
+    {
+    case GABC_ABC_TOKEN_NOTE:
+    case GABC_ABC_TOKEN_REST:
+    case GABC_ABC_TOKEN_BAR:
+    case GABC_ABC_TOKEN_TUPLET:
+    case GABC_ABC_TOKEN_DECORATION:
+    case GABC_ABC_TOKEN_CHORD_SYMBOL:
+    case GABC_ABC_TOKEN_ANNOTATION:
+    case GABC_ABC_TOKEN_INLINE_FIELD:
+      gabc_abc_parser_scan_gap (parser, parser->previous_end, start);
+      parser->line_has_music = TRUE;
+      break;
+
+    case GABC_ABC_TOKEN_COMMENT:
+      /* Between the music and a comment at the end of the line. */
+      if (parser->line_has_music)
+        gabc_abc_parser_scan_gap (parser, parser->previous_end, start);
+      parser->line_has_music = FALSE;
+      break;
+
+    case GABC_ABC_TOKEN_DIRECTIVE:
+    case GABC_ABC_TOKEN_FIELD:
+    case GABC_ABC_TOKEN_LYRICS:
+    case GABC_ABC_TOKEN_TEXT:
+    case GABC_ABC_N_TOKEN_KINDS:
+    default:
+      break;
+    }
+  parser->previous_end = end;
+
+  switch (kind)
+    {
+    case GABC_ABC_TOKEN_NOTE:
+      gabc_abc_parser_add_note (parser, text, length, start, end);
+      break;
+
+    case GABC_ABC_TOKEN_REST:
+      gabc_abc_parser_add_rest (parser, text, length, start, end);
+      break;
+
+    case GABC_ABC_TOKEN_BAR:
+      gabc_abc_parser_add_bar (parser, text, length, start, end);
+      break;
+
+    case GABC_ABC_TOKEN_TUPLET:
+      gabc_abc_parser_add_tuplet (parser, text, length, start, end);
+      break;
+
+    case GABC_ABC_TOKEN_FIELD:
+      if (length >= 2)
+        gabc_abc_parser_add_field (parser, text, length, start, end);
+      break;
+
+    case GABC_ABC_TOKEN_INLINE_FIELD:
+      if (length >= 4)
+        gabc_abc_parser_add_field (parser, text + 1, length - (text[length - 1] == ']' ? 2 : 1), start, end);
+      break;
+
+    case GABC_ABC_TOKEN_DECORATION:
+      gabc_abc_parser_add_text (parser, GABC_ABC_ELEMENT_DECORATION, text, length, start, end);
+      break;
+
+    case GABC_ABC_TOKEN_CHORD_SYMBOL:
+    case GABC_ABC_TOKEN_ANNOTATION:
+      gabc_abc_parser_add_text (parser,
+                                kind == GABC_ABC_TOKEN_ANNOTATION ? GABC_ABC_ELEMENT_ANNOTATION
+                                                                  : GABC_ABC_ELEMENT_CHORD_SYMBOL,
+                                text + 1, length - (length >= 2 && text[length - 1] == '"' ? 2 : 1),
+                                start, end);
+      break;
+
+    case GABC_ABC_TOKEN_LYRICS:
+      gabc_abc_parser_add_text (parser, GABC_ABC_ELEMENT_LYRICS, text, length, start, end);
+      break;
+
+    case GABC_ABC_TOKEN_DIRECTIVE:
+      gabc_abc_parser_add_text (parser, GABC_ABC_ELEMENT_DIRECTIVE, text, length, start, end);
+      break;
+
+    case GABC_ABC_TOKEN_COMMENT:
+    case GABC_ABC_TOKEN_TEXT:
+    case GABC_ABC_N_TOKEN_KINDS:
+    default:
+      break;
+    }
+}
+
+
+/*
+ * Copy everything into one block: the tune, then the elements, the voices
+ * and the strings.
+ */
+static GabcAbcTune *
+gabc_abc_parser_finish (GabcAbcParser *parser)
+{
+  gsize elements_size = parser->elements->len * sizeof (GabcAbcElement);
+  gsize voices_size = parser->voices->len * sizeof (guint32);
+  GabcAbcTune *tune;
+  gchar *p;
+
+  tune = g_malloc (sizeof (GabcAbcTune) + elements_size + voices_size + parser->strings->len);
+  p = (gchar *) (tune + 1);
+
+  tune->n_elements = parser->elements->len;
+  tune->elements = memcpy (p, parser->elements->data, elements_size);
+  p += elements_size;
+
+  tune->n_voices = parser->voices->len;
+  tune->voices = memcpy (p, parser->voices->data, voices_size);
+  p += voices_size;
+
+  tune->strings = memcpy (p, parser->strings->str, parser->strings->len);
+
+  return tune;
+}
+
+
+/*
+ * Parse one tune, from its X: line to the start of the next, or a piece
+ * of tune body without an X: line.  Offsets in the result are from the
+ * start of text.
+ */
+GabcAbcTune *
+gabc_abc_tune_parse (const gchar *text,
+                     gsize        length)
+{
+  GabcAbcParser parser = { NULL, };
+  GabcAbcTune *tune;
+  GabcAbcLexer lexer;
+  const gchar *end = text + length;
+  const gchar *line;
+
+  parser.elements = g_array_new (FALSE, FALSE, sizeof (GabcAbcElement));
+  parser.strings = g_string_new (NULL);
+  parser.voices = g_array_new (FALSE, FALSE, sizeof (guint32));
+  gabc_abc_parser_start_tune (&parser);
+
+  gabc_abc_lexer_init (&lexer);
+  if (!(length >= 2 && text[0] == 'X' && text[1] == ':'))
+    lexer.section = GABC_ABC_LEXER_TUNE_BODY;
+
+  for (line = text; line < end; )
+    {
+      const gchar *line_end = memchr (line, '\n', end - line);
+      const gchar *next = (line_end != NULL) ? line_end + 1 : end;
+      gsize line_length;
+
+      if (line_end == NULL)
+        line_end = end;
+      line_length = line_end - line;
+      if (line_length > 0 && line[line_length - 1] == '\r')
+        line_length--;
+
+      parser.line = line;
+      parser.line_offset = line - text;
+      parser.previous_end = 0;
+      parser.line_has_music = FALSE;
+      parser.in_header = lexer.section == GABC_ABC_LEXER_TUNE_HEADER;
+      gabc_abc_lexer_lex_line (&lexer, line, line_length, gabc_abc_parser_token_cb, &parser);
+
+      /* A tie at the end of the line. */
+      if (parser.line_has_music)
+        gabc_abc_parser_scan_gap (&parser, parser.previous_end, line_length);
+
+      line = next;
+    }
+
+  tune = gabc_abc_parser_finish (&parser);
+  tune->length = length;
+
+  g_array_unref (parser.elements);
+  g_string_free (parser.strings, TRUE);
+  g_array_unref (parser.voices);
+
+  return tune;
+}
+
+
+void
+gabc_abc_tune_free (GabcAbcTune *tune)
+{
+  g_free (tune);
+}
+
+
+/*
+ * The text of a field, decoration, chord symbol, annotation, lyrics line
+ * or directive, otherwise NULL.
+ */
+const gchar *
+gabc_abc_tune_get_string (const GabcAbcTune    *tune,
+                          const GabcAbcElement *element)
+{
+  switch ((GabcAbcElementKind) element->kind)
+    {
+    case GABC_ABC_ELEMENT_FIELD:
+    case GABC_ABC_ELEMENT_DECORATION:
+    case GABC_ABC_ELEMENT_CHORD_SYMBOL:
+    case GABC_ABC_ELEMENT_ANNOTATION:
+    case GABC_ABC_ELEMENT_LYRICS:
+    case GABC_ABC_ELEMENT_DIRECTIVE:
+      return tune->strings + element->data.string;
+
+    case GABC_ABC_ELEMENT_VOICE:
+    case GABC_ABC_ELEMENT_NOTE:
+    case GABC_ABC_ELEMENT_REST:
+    case GABC_ABC_ELEMENT_CHORD:
+    case GABC_ABC_ELEMENT_BAR:
+    case GABC_ABC_ELEMENT_TUPLET:
+    case GABC_ABC_ELEMENT_SLUR_START:
+    case GABC_ABC_ELEMENT_SLUR_END:
+    case GABC_ABC_N_ELEMENT_KINDS:
+    default:
+      return NULL;
+    }
+}
+
+
+/*
+ * The value of the first field with letter in the tune header, without
+ * leading spaces, or NULL if there is none.
+ */
+const gchar *
+gabc_abc_tune_get_field (const GabcAbcTune *tune,
+                         gchar              letter)
+{
+  guint i;
+
+  for (i = 0; i < tune->n_elements; i++)
+    {
+      const GabcAbcElement *element = &tune->elements[i];
+      const gchar *field;
+
+      if (element->kind != GABC_ABC_ELEMENT_FIELD || !(element->flags & GABC_ABC_ELEMENT_HEADER))
+        continue;
+
+      field = tune->strings + element->data.string;
+      if (field[0] == letter)
+        return field + 2 + strspn (field + 2, " \t");
+    }
+
+  return NULL;
+}
+
+
+/*
+ * The id of a voice, as in "V:1" or "V:Tenor", or NULL for a tune without
+ * V: fields.
+ */
+const gchar *
+gabc_abc_tune_get_voice_id (const GabcAbcTune *tune,
+                            guint              voice)
+{
+  if (voice >= tune->n_voices)
+    return NULL;
+
+  return tune->strings + tune->voices[voice];
+}
+
+
+const gchar *
+gabc_abc_element_kind_to_string (GabcAbcElementKind kind)
+{
+  switch (kind)
+    {
+    case GABC_ABC_ELEMENT_FIELD:
+      return "field";
+    case GABC_ABC_ELEMENT_VOICE:
+      return "voice";
+    case GABC_ABC_ELEMENT_NOTE:
+      return "note";
+    case GABC_ABC_ELEMENT_REST:
+      return "rest";
+    case GABC_ABC_ELEMENT_CHORD:
+      return "chord";
+    case GABC_ABC_ELEMENT_BAR:
+      return "bar";
+    case GABC_ABC_ELEMENT_TUPLET:
+      return "tuplet";
+    case GABC_ABC_ELEMENT_DECORATION:
+      return "decoration";
+    case GABC_ABC_ELEMENT_CHORD_SYMBOL:
+      return "chord-symbol";
+    case GABC_ABC_ELEMENT_ANNOTATION:
+      return "annotation";
+    case GABC_ABC_ELEMENT_LYRICS:
+      return "lyrics";
+    case GABC_ABC_ELEMENT_DIRECTIVE:
+      return "directive";
+    case GABC_ABC_ELEMENT_SLUR_START:
+      return "slur-start";
+    case GABC_ABC_ELEMENT_SLUR_END:
+      return "slur-end";
+    case GABC_ABC_N_ELEMENT_KINDS:
+    default:
+      g_return_val_if_reached (NULL);
+    }
+}
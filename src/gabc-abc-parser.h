@@ -0,0 +1,145 @@
+/* gabc-abc-parser.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Lengths are counted in ticks of a whole note.  There are enough for
+ * every power of two down to 1/512 to be divided by 3, 5 and 7, so
+ * tuplets and broken rhythm come out exact.
+ */
+#define GABC_ABC_TICKS_PER_WHOLE  (512 * 105)
+
+/* The accidental of a note written without one. */
+#define GABC_ABC_NO_ACCIDENTAL    G_MAXINT8
+
+typedef enum {
+  GABC_ABC_ELEMENT_FIELD,             /* a field line or an inline field */
+  GABC_ABC_ELEMENT_VOICE,             /* what follows is in data.voice */
+  GABC_ABC_ELEMENT_NOTE,
+  GABC_ABC_ELEMENT_REST,
+  GABC_ABC_ELEMENT_CHORD,             /* followed by its data.n_notes notes */
+  GABC_ABC_ELEMENT_BAR,
+  GABC_ABC_ELEMENT_TUPLET,
+  GABC_ABC_ELEMENT_DECORATION,
+  GABC_ABC_ELEMENT_CHORD_SYMBOL,
+  GABC_ABC_ELEMENT_ANNOTATION,
+  GABC_ABC_ELEMENT_LYRICS,
+  GABC_ABC_ELEMENT_DIRECTIVE,
+  GABC_ABC_ELEMENT_SLUR_START,
+  GABC_ABC_ELEMENT_SLUR_END,
+  GABC_ABC_N_ELEMENT_KINDS
+} GabcAbcElementKind;
+
+typedef enum {
+  GABC_ABC_ELEMENT_HEADER    = 1 << 0,  /* a field in the tune header */
+  GABC_ABC_ELEMENT_TIED      = 1 << 1,  /* a note or chord tied to the next one */
+  GABC_ABC_ELEMENT_GRACE     = 1 << 2,  /* a grace note, which takes no time */
+  GABC_ABC_ELEMENT_IN_CHORD  = 1 << 3,  /* a note of a chord */
+} GabcAbcElementFlags;
+
+typedef enum {
+  GABC_ABC_BAR_START_REPEAT  = 1 << 0,
+  GABC_ABC_BAR_END_REPEAT    = 1 << 1,
+  GABC_ABC_BAR_THICK         = 1 << 2,  /* "||", "|]" or "[|" */
+} GabcAbcBarFlags;
+
+/*
+ * A note both as written, for anything that rewrites it, and as the MIDI
+ * pitch it sounds at with the key signature and the accidentals earlier
+ * in the bar applied.
+ */
+typedef struct {
+  guint8    pitch;
+  guint8    letter;                   /* 0 to 6 for C to B */
+  gint8     octave;                   /* 0 for C to B, 1 for c to b, then ' and , */
+  gint8     accidental;               /* -2 to 2, or GABC_ABC_NO_ACCIDENTAL */
+} GabcAbcPitch;
+
+/*
+ * One element of the music, 16 bytes.  offset and length are the bytes of
+ * text it was parsed from, from the start of the tune.
+ *
+ * duration is the time a note, rest or chord takes as played, with tuplets
+ * and broken rhythm applied; the notes of a chord keep their own lengths
+ * as written.  For L:, M: and Q: fields it is the unit note length, the
+ * length of a bar and the beat of the tempo.
+ */
+typedef struct {
+  guint32   offset;
+  guint16   length;
+  guint8    kind;                     /* GabcAbcElementKind */
+  guint8    flags;                    /* GabcAbcElementFlags */
+  guint32   duration;                 /* ticks */
+  union {
+    GabcAbcPitch  note;
+    struct {
+      guint16     flags;              /* GabcAbcBarFlags */
+      guint16     endings;            /* bit n set for an ending numbered n */
+    } bar;
+    struct {
+      guint8      p;                  /* p notes in the time of q, for the next r */
+      guint8      q;
+      guint8      r;
+    } tuplet;
+    guint32       n_notes;            /* of a chord */
+    guint32       voice;              /* an index into voices */
+    guint32       string;             /* everything else, an offset into strings */
+  } data;
+} GabcAbcElement;
+
+/*
+ * A parsed tune, in one block of memory.  The strings are nul-terminated
+ * and hold fields as "K:D", decorations as "!trill!", chord symbols and
+ * annotations without their quotes, lyrics lines and directives as
+ * written.  Each voice is the offset of its id in strings, in the order
+ * the voices first appear; music before the first V: is in voice 0.
+ */
+typedef struct {
+  gsize                   length;     /* of the text parsed */
+  guint                   n_elements;
+  guint                   n_voices;
+  const GabcAbcElement   *elements;
+  const guint32          *voices;
+  const gchar            *strings;
+} GabcAbcTune;
+
+GabcAbcTune              *gabc_abc_tune_parse                     (const gchar          *text,
+                                                                   gsize                 length);
+
+void                      gabc_abc_tune_free                      (GabcAbcTune          *tune);
+
+const gchar *             gabc_abc_tune_get_string                (const GabcAbcTune    *tune,
+                                                                   const GabcAbcElement *element);
+
+const gchar *             gabc_abc_tune_get_field                 (const GabcAbcTune    *tune,
+                                                                   gchar                 letter);
+
+const gchar *             gabc_abc_tune_get_voice_id              (const GabcAbcTune    *tune,
+                                                                   guint                 voice);
+
+const gchar *             gabc_abc_element_kind_to_string         (GabcAbcElementKind    kind);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GabcAbcTune, gabc_abc_tune_free)
+
+G_END_DECLS
@@ -23,6 +23,7 @@
 #include "git-header.h"
 
 #include "gabc-application.h"
+#include "gabc-batch.h"
 #include "gabc-window.h"
 #include "gabc-prefs-window.h"
 
@@ -62,12 +63,31 @@ gabc_application_activate (GApplication *app)
 	gtk_window_present (window);
 }
 
+/*
+ * gabc --batch runs here, before the application registers, so that no
+ * window is created and no display is needed.
+ */
+static gboolean
+gabc_application_local_command_line (GApplication   *app,
+                                     gchar        ***arguments,
+                                     int            *exit_status)
+{
+	if (g_strv_contains ((const gchar * const *) *arguments, "--batch"))
+	{
+		*exit_status = gabc_batch_command_line (*arguments);
+		return TRUE;
+	}
+
+	return G_APPLICATION_CLASS (gabc_application_parent_class)->local_command_line (app, arguments, exit_status);
+}
+
 static void
 gabc_application_class_init (GabcApplicationClass *klass)
 {
 	GApplicationClass *app_class = G_APPLICATION_CLASS (klass);
 
 	app_class->activate = gabc_application_activate;
+	app_class->local_command_line = gabc_application_local_command_line;
 }
 
 static void
@@ -138,6 +158,10 @@ static const GActionEntry app_actions[] = {
 static void
 gabc_application_init (GabcApplication *self)
 {
+	/* Only here so that --help lists it, see gabc_application_local_command_line (). */
+	g_application_add_main_option (G_APPLICATION (self), "batch", 0, 0, G_OPTION_ARG_NONE,
+	                               "Engrave and convert files without opening a window (see --batch --help)", NULL);
+
 	g_action_map_add_action_entries (G_ACTION_MAP (self),
 	                                 app_actions,
 	                                 G_N_ELEMENTS (app_actions),
@@ -163,6 +187,36 @@ gabc_application_init (GabcApplication *self)
         gtk_application_set_accels_for_action (GTK_APPLICATION (self),
                                          "win.play",
                                          (const char *[]) { "<Ctrl>p", NULL });
+        gtk_application_set_accels_for_action (GTK_APPLICATION (self),
+                                         "win.engrave-tune",
+                                         (const char *[]) { "<Shft><Ctrl>e", NULL });
+        gtk_application_set_accels_for_action (GTK_APPLICATION (self),
+                                         "win.play-tune",
+                                         (const char *[]) { "<Shft><Ctrl>p", NULL });
+        gtk_application_set_accels_for_action (GTK_APPLICATION (self),
+                                         "win.play-from-cursor",
+                                         (const char *[]) { "<Alt>p", NULL });
+        gtk_application_set_accels_for_action (GTK_APPLICATION (self),
+                                         "win.loop-selection",
+                                         (const char *[]) { "<Shft><Alt>p", NULL });
+        gtk_application_set_accels_for_action (GTK_APPLICATION (self),
+                                         "win.stop-playback",
+                                         (const char *[]) { "<Alt>period", NULL });
+        gtk_application_set_accels_for_action (GTK_APPLICATION (self),
+                                         "win.find-similar",
+                                         (const char *[]) { "<Shft><Ctrl>f", NULL });
+        gtk_application_set_accels_for_action (GTK_APPLICATION (self),
+                                         "win.transpose",
+                                         (const char *[]) { "<Ctrl>t", NULL });
+        gtk_application_set_accels_for_action (GTK_APPLICATION (self),
+                                         "win.cancel-render",
+                                         (const char *[]) { "<Ctrl>period", NULL });
+        gtk_application_set_accels_for_action (GTK_APPLICATION (self),
+                                         "win.show-outline",
+                                         (const char *[]) { "F8", NULL });
+        gtk_application_set_accels_for_action (GTK_APPLICATION (self),
+                                         "win.show-preview",
+                                         (const char *[]) { "F9", NULL });
         gtk_application_set_accels_for_action (GTK_APPLICATION (self),
                                          "win.open-log",
                                          (const char *[]) { "<Ctrl>l", NULL });
@@ -0,0 +1,381 @@
+/* gabc-audio-sink.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Audio outputs for the built-in player.
+ *
+ * The device sink plays through the sound server with libpulse-simple,
+ * which PipeWire also provides, asking for a short buffer so a note is
+ * heard soon after it is played; gabc is built without it if the library
+ * isn't found and the player then isn't available.  The WAV sink writes a
+ * file and the null sink throws the samples away, either at once or at the
+ * pace of a real device, so the player can be run and timed without
+ * sound.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#if HAVE_PULSE
+#include <pulse/error.h>
+#include <pulse/simple.h>
+#endif
+
+#include "gabc-audio-sink.h"
+
+/* What the device sink asks the server to keep buffered. */
+#define GABC_AUDIO_SINK_LATENCY   (30 * 1000)
+
+#define GABC_AUDIO_SINK_WAV_HEADER_SIZE 44
+
+typedef enum {
+  GABC_AUDIO_SINK_DEVICE,
+  GABC_AUDIO_SINK_WAV,
+  GABC_AUDIO_SINK_NULL,
+} GabcAudioSinkKind;
+
+struct _GabcAudioSink
+{
+  GabcAudioSinkKind  kind;
+  guint              rate;
+  guint64            n_frames;
+
+  /* null */
+  gboolean           paced;
+  gint64             start_time;
+
+  /* wav */
+  FILE              *file;
+  gchar             *path;
+
+#if HAVE_PULSE
+  pa_simple         *pulse;
+#endif
+};
+
+
+static GabcAudioSink *
+gabc_audio_sink_new (GabcAudioSinkKind kind,
+                     guint             rate)
+{
+  GabcAudioSink *sink;
+
+  sink = g_new0 (GabcAudioSink, 1);
+  sink->kind = kind;
+  sink->rate = rate;
+
+  return sink;
+}
+
+
+/*
+ * The default output of the sound server.  Fails with
+ * G_IO_ERROR_NOT_SUPPORTED if gabc was built without libpulse-simple.
+ */
+GabcAudioSink *
+gabc_audio_sink_new_device (guint    rate,
+                            GError **error)
+{
+#if HAVE_PULSE
+  pa_sample_spec spec = { PA_SAMPLE_S16LE, rate, 1 };
+  pa_buffer_attr attr;
+  GabcAudioSink *sink;
+  pa_simple *pulse;
+  gint pulse_error;
+
+  attr.maxlength = (guint32) -1;
+  attr.tlength = pa_usec_to_bytes (GABC_AUDIO_SINK_LATENCY, &spec);
+  attr.prebuf = (guint32) -1;
+  attr.minreq = (guint32) -1;
+  attr.fragsize = (guint32) -1;
+
+  pulse = pa_simple_new (NULL, "gabc", PA_STREAM_PLAYBACK, NULL, "Tune playback",
+                         &spec, NULL, &attr, &pulse_error);
+  if (pulse == NULL)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "Could not open the audio output: %s", pa_strerror (pulse_error));
+      return NULL;
+    }
+
+  sink = gabc_audio_sink_new (GABC_AUDIO_SINK_DEVICE, rate);
+  sink->pulse = pulse;
+
+  return sink;
+#else
+  g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                       "gabc was built without audio output");
+  return NULL;
+#endif
+}
+
+
+static void
+gabc_audio_sink_put_le16 (guint8  *p,
+                          guint16  value)
+{
+  p[0] = value & 0xff;
+  p[1] = value >> 8;
+}
+
+
+static void
+gabc_audio_sink_put_le32 (guint8  *p,
+                          guint32  value)
+{
+  gabc_audio_sink_put_le16 (p, value & 0xffff);
+  gabc_audio_sink_put_le16 (p + 2, value >> 16);
+}
+
+
+/*
+ * Write the RIFF header at the start of the file, with the sizes of the
+ * frames written so far.
+ */
+static gboolean
+gabc_audio_sink_write_wav_header (GabcAudioSink  *sink,
+                                  GError        **error)
+{
+  guint8 header [GABC_AUDIO_SINK_WAV_HEADER_SIZE];
+  guint32 data_size = MIN (sink->n_frames * 2, G_MAXUINT32 - GABC_AUDIO_SINK_WAV_HEADER_SIZE);
+
+  memcpy (header, "RIFF", 4);
+  gabc_audio_sink_put_le32 (header + 4, data_size + GABC_AUDIO_SINK_WAV_HEADER_SIZE - 8);
+  memcpy (header + 8, "WAVEfmt ", 8);
+  gabc_audio_sink_put_le32 (header + 16, 16);                   /* fmt chunk size */
+  gabc_audio_sink_put_le16 (header + 20, 1);                    /* PCM */
+  gabc_audio_sink_put_le16 (header + 22, 1);                    /* channels */
+  gabc_audio_sink_put_le32 (header + 24, sink->rate);
+  gabc_audio_sink_put_le32 (header + 28, sink->rate * 2);       /* bytes a second */
+  gabc_audio_sink_put_le16 (header + 32, 2);                    /* bytes a frame */
+  gabc_audio_sink_put_le16 (header + 34, 16);                   /* bits a sample */
+  memcpy (header + 36, "data", 4);
+  gabc_audio_sink_put_le32 (header + 40, data_size);
+
+  if (fseek (sink->file, 0, SEEK_SET) != 0 ||
+      fwrite (header, sizeof (header), 1, sink->file) != 1 ||
+      fseek (sink->file, 0, SEEK_END) != 0 ||
+      fflush (sink->file) != 0)
+    {
+      gint saved_errno = errno;
+
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                   "Could not write %s: %s", sink->path, g_strerror (saved_errno));
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+
+/*
+ * A 16 bit mono WAV file at path.  The header is brought up to date by
+ * gabc_audio_sink_drain () and gabc_audio_sink_free ().
+ */
+GabcAudioSink *
+gabc_audio_sink_new_wav (const gchar  *path,
+                         guint         rate,
+                         GError      **error)
+{
+  GabcAudioSink *sink;
+  FILE *file;
+
+  file = g_fopen (path, "wb");
+  if (file == NULL)
+    {
+      gint saved_errno = errno;
+
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                   "Could not create %s: %s", path, g_strerror (saved_errno));
+      return NULL;
+    }
+
+  sink = gabc_audio_sink_new (GABC_AUDIO_SINK_WAV, rate);
+  sink->file = file;
+  sink->path = g_strdup (path);
+
+  if (!gabc_audio_sink_write_wav_header (sink, error))
+    {
+      gabc_audio_sink_free (sink);
+      return NULL;
+    }
+
+  return sink;
+}
+
+
+/*
+ * Discards everything.  A paced sink blocks in each write until the frames
+ * would have been played by a real device.
+ */
+GabcAudioSink *
+gabc_audio_sink_new_null (guint    rate,
+                          gboolean paced)
+{
+  GabcAudioSink *sink;
+
+  sink = gabc_audio_sink_new (GABC_AUDIO_SINK_NULL, rate);
+  sink->paced = paced;
+
+  return sink;
+}
+
+
+guint
+gabc_audio_sink_get_rate (GabcAudioSink *sink)
+{
+  return sink->rate;
+}
+
+
+gboolean
+gabc_audio_sink_write (GabcAudioSink  *sink,
+                       const gint16   *frames,
+                       gsize           n_frames,
+                       GError        **error)
+{
+  gint64 due;
+  gint64 now;
+  gsize i;
+
+  switch (sink->kind)
+    {
+    case GABC_AUDIO_SINK_DEVICE:
+#if HAVE_PULSE
+      {
+        gint pulse_error;
+
+        if (pa_simple_write (sink->pulse, frames, n_frames * sizeof (gint16), &pulse_error) < 0)
+          {
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                         "Could not play audio: %s", pa_strerror (pulse_error));
+            return FALSE;
+          }
+      }
+#endif
+      break;
+
+    case GABC_AUDIO_SINK_WAV:
+      for (i = 0; i < n_frames; i++)
+        {
+          guint8 sample [2];
+
+          gabc_audio_sink_put_le16 (sample, (guint16) frames[i]);
+          if (fwrite (sample, sizeof (sample), 1, sink->file) != 1)
+            {
+              gint saved_errno = errno;
+
+              g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                           "Could not write %s: %s", sink->path, g_strerror (saved_errno));
+              return FALSE;
+            }
+        }
+      break;
+
+    case GABC_AUDIO_SINK_NULL:
+      if (!sink->paced)
+        break;
+      if (sink->start_time == 0)
+        sink->start_time = g_get_monotonic_time ();
+      due = sink->start_time + (gint64) ((sink->n_frames + n_frames) * G_USEC_PER_SEC / sink->rate);
+      now = g_get_monotonic_time ();
+      if (due > now)
+        g_usleep (due - now);
+      break;
+
+    default:
+      g_assert_not_reached ();
+    }
+
+  sink->n_frames += n_frames;
+
+  return TRUE;
+}
+
+
+/*
+ * Wait until everything written has been played, or is in the file.
+ */
+gboolean
+gabc_audio_sink_drain (GabcAudioSink  *sink,
+                       GError        **error)
+{
+  switch (sink->kind)
+    {
+    case GABC_AUDIO_SINK_DEVICE:
+#if HAVE_PULSE
+      {
+        gint pulse_error;
+
+        if (pa_simple_drain (sink->pulse, &pulse_error) < 0)
+          {
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                         "Could not play audio: %s", pa_strerror (pulse_error));
+            return FALSE;
+          }
+      }
+#endif
+      return TRUE;
+
+    case GABC_AUDIO_SINK_WAV:
+      return gabc_audio_sink_write_wav_header (sink, error);
+
+    case GABC_AUDIO_SINK_NULL:
+      return TRUE;
+
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+
+/*
+ * Anything not yet played by a device is dropped.
+ */
+void
+gabc_audio_sink_free (GabcAudioSink *sink)
+{
+  switch (sink->kind)
+    {
+    case GABC_AUDIO_SINK_DEVICE:
+#if HAVE_PULSE
+      pa_simple_flush (sink->pulse, NULL);
+      pa_simple_free (sink->pulse);
+#endif
+      break;
+
+    case GABC_AUDIO_SINK_WAV:
+      gabc_audio_sink_write_wav_header (sink, NULL);
+      fclose (sink->file);
+      g_free (sink->path);
+      break;
+
+    case GABC_AUDIO_SINK_NULL:
+    default:
+      break;
+    }
+
+  g_free (sink);
+}
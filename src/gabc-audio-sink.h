@@ -0,0 +1,57 @@
+/* gabc-audio-sink.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Where the built-in player's samples go: signed 16 bit mono frames.
+ * Writes block for as long as the sink needs, which is what paces
+ * playback.
+ */
+typedef struct _GabcAudioSink GabcAudioSink;
+
+GabcAudioSink *           gabc_audio_sink_new_device              (guint             rate,
+                                                                   GError          **error);
+
+GabcAudioSink *           gabc_audio_sink_new_wav                 (const gchar      *path,
+                                                                   guint             rate,
+                                                                   GError          **error);
+
+GabcAudioSink *           gabc_audio_sink_new_null                (guint             rate,
+                                                                   gboolean          paced);
+
+guint                     gabc_audio_sink_get_rate                (GabcAudioSink    *sink);
+
+gboolean                  gabc_audio_sink_write                   (GabcAudioSink    *sink,
+                                                                   const gint16     *frames,
+                                                                   gsize             n_frames,
+                                                                   GError          **error);
+
+gboolean                  gabc_audio_sink_drain                   (GabcAudioSink    *sink,
+                                                                   GError          **error);
+
+void                      gabc_audio_sink_free                    (GabcAudioSink    *sink);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GabcAudioSink, gabc_audio_sink_free)
+
+G_END_DECLS
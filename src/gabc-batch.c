@@ -0,0 +1,1016 @@
+/* gabc-batch.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Headless engraving and MIDI conversion (gabc --batch).
+ *
+ * Every .abc file given, or found under a directory given, is split into
+ * its tunes and each tune is engraved and/or converted on its own.  The jobs
+ * go through the shared GabcRenderService, so they take the same options as
+ * the GUI's renders and count against the same limit on tools running at
+ * once (the number of CPUs by default).  No more tunes are handed to it
+ * than it has slots, and input files are only read and split as those
+ * slots free up, so the size of the archive does not matter.  Each job's time
+ * is printed as it finishes and the failures are listed at the end.
+ *
+ * The window uses the same pool for its "Export All Tunes as MIDI" action,
+ * feeding it the buffer text rather than a file and following its progress
+ * through the "job-finished" signal.
+ *
+ * With a transposition set, each input is first transposed and written out
+ * as "<name>-transposed+N.abc", and the tunes are split from that text, so
+ * the engraved and MIDI files are of the transposed tunes.
+ *
+ * Nothing here touches GTK, so it runs without a display.
+ */
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "gabc-batch.h"
+#include "gabc-diagnostic.h"
+#include "gabc-preprocessor.h"
+#include "gabc-render-service.h"
+#include "gabc-transpose.h"
+
+typedef struct {
+  gchar     *path;          /* file to read, or the name of a text input */
+  gchar     *contents;      /* NULL until read */
+  gchar     *working_dir;
+} GabcBatchInput;
+
+typedef struct {
+  gchar     *input_path;
+  guint      number;
+  gboolean   midi;
+  gchar     *text;
+  gchar     *output_path;
+  gchar     *working_dir;
+  gchar     *abc_path;
+  gint64     start_time;
+} GabcBatchUnit;
+
+struct _GabcBatch
+{
+  GObject                       parent_instance;
+
+  GSettings                    *settings;
+  GabcPreprocessor             *preprocessor;
+  GabcRenderService            *service;
+  gchar                        *output_dir;
+  gboolean                      engrave;
+  gboolean                      midi;
+  gint                          semitones;
+
+  GQueue                        inputs;       /* GabcBatchInput not yet split */
+  GQueue                        units;        /* tunes of the current input waiting for a worker */
+  gchar                        *tmp_dir;
+  guint                         serial;
+
+  GTask                        *task;
+  guint                         n_running;
+  guint                         n_jobs;
+  gint64                        start_time;
+  gint64                        job_time;
+  GPtrArray                    *failures;
+};
+
+G_DEFINE_FINAL_TYPE (GabcBatch, gabc_batch, G_TYPE_OBJECT)
+
+enum {
+  JOB_FINISHED,
+  N_SIGNALS
+};
+
+static guint signals [N_SIGNALS];
+
+static void gabc_batch_fill_workers (GabcBatch *self);
+
+
+static void
+gabc_batch_input_free (GabcBatchInput *input)
+{
+  g_free (input->path);
+  g_free (input->contents);
+  g_free (input->working_dir);
+  g_free (input);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GabcBatchInput, gabc_batch_input_free)
+
+
+static void
+gabc_batch_unit_free (GabcBatchUnit *unit)
+{
+  if (unit->abc_path != NULL)
+    g_unlink (unit->abc_path);
+
+  g_free (unit->input_path);
+  g_free (unit->text);
+  g_free (unit->output_path);
+  g_free (unit->working_dir);
+  g_free (unit->abc_path);
+  g_free (unit);
+}
+
+
+static void
+gabc_batch_finalize (GObject *object)
+{
+  GabcBatch *self = GABC_BATCH (object);
+
+  g_clear_object (&self->settings);
+  g_clear_object (&self->preprocessor);
+  g_clear_object (&self->service);
+  g_free (self->output_dir);
+  g_queue_clear_full (&self->inputs, (GDestroyNotify) gabc_batch_input_free);
+  g_queue_clear_full (&self->units, (GDestroyNotify) gabc_batch_unit_free);
+  if (self->tmp_dir != NULL)
+    g_rmdir (self->tmp_dir);
+  g_free (self->tmp_dir);
+  g_ptr_array_unref (self->failures);
+  g_clear_object (&self->task);
+
+  G_OBJECT_CLASS (gabc_batch_parent_class)->finalize (object);
+}
+
+
+static void
+gabc_batch_class_init (GabcBatchClass *klass)
+{
+  G_OBJECT_CLASS (klass)->finalize = gabc_batch_finalize;
+
+  /*
+   * Emitted as each tool finishes with the input it came from, the tune's
+   * X: number, the tool, the output path, the time the job took in
+   * microseconds and, if it failed, the reason (NULL on success).
+   * Cancelled jobs are not reported.
+   */
+  signals [JOB_FINISHED] =
+    g_signal_new ("job-finished",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE,
+                  6,
+                  G_TYPE_STRING,
+                  G_TYPE_UINT,
+                  G_TYPE_STRING,
+                  G_TYPE_STRING,
+                  G_TYPE_INT64,
+                  G_TYPE_STRING);
+}
+
+
+static void
+gabc_batch_init (GabcBatch *self)
+{
+  g_queue_init (&self->inputs);
+  g_queue_init (&self->units);
+  self->failures = g_ptr_array_new_with_free_func (g_free);
+  self->engrave = TRUE;
+  self->midi = TRUE;
+}
+
+
+GabcBatch *
+gabc_batch_new (GSettings *settings)
+{
+  GabcBatch *self;
+
+  g_return_val_if_fail (G_IS_SETTINGS (settings), NULL);
+
+  self = g_object_new (GABC_TYPE_BATCH, NULL);
+  self->settings = g_object_ref (settings);
+  self->preprocessor = gabc_preprocessor_new (settings);
+  self->service = g_object_ref (gabc_render_service_get_default ());
+
+  return self;
+}
+
+
+/*
+ * Write everything to output_dir rather than next to each input file.
+ */
+void
+gabc_batch_set_output_dir (GabcBatch   *self,
+                           const gchar *output_dir)
+{
+  g_free (self->output_dir);
+  self->output_dir = g_strdup (output_dir);
+}
+
+
+/*
+ * Sets the limit of the shared render service, so it applies to every
+ * render in the process, not only this batch's.
+ */
+void
+gabc_batch_set_max_jobs (GabcBatch *self,
+                         guint      max_jobs)
+{
+  gabc_render_service_set_max_jobs (self->service, max_jobs);
+}
+
+
+void
+gabc_batch_set_outputs (GabcBatch *self,
+                        gboolean   engrave,
+                        gboolean   midi)
+{
+  self->engrave = engrave;
+  self->midi = midi;
+}
+
+
+/*
+ * Transpose every input by semitones before it is engraved or converted,
+ * keeping the transposed abc next to the other output.
+ */
+void
+gabc_batch_set_transpose (GabcBatch *self,
+                          gint       semitones)
+{
+  self->semitones = semitones;
+}
+
+
+static void
+gabc_batch_add_failure (GabcBatch   *self,
+                        const gchar *format,
+                        ...) G_GNUC_PRINTF (2, 3);
+
+static void
+gabc_batch_add_failure (GabcBatch   *self,
+                        const gchar *format,
+                        ...)
+{
+  va_list args;
+
+  va_start (args, format);
+  g_ptr_array_add (self->failures, g_strdup_vprintf (format, args));
+  va_end (args);
+}
+
+
+static gint
+gabc_batch_compare_names (gconstpointer a,
+                          gconstpointer b)
+{
+  return g_strcmp0 (*(const gchar * const *) a, *(const gchar * const *) b);
+}
+
+
+static void
+gabc_batch_add_directory (GabcBatch   *self,
+                          const gchar *path)
+{
+  g_autoptr (GPtrArray) names = g_ptr_array_new_with_free_func (g_free);
+  g_autoptr (GError) error = NULL;
+  GDir *dir;
+  const gchar *name;
+  guint i;
+
+  dir = g_dir_open (path, 0, &error);
+  if (dir == NULL)
+    {
+      gabc_batch_add_failure (self, "%s: %s", path, error->message);
+      return;
+    }
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    g_ptr_array_add (names, g_strdup (name));
+  g_dir_close (dir);
+
+  /* Keep the order of the output stable from run to run. */
+  g_ptr_array_sort (names, gabc_batch_compare_names);
+
+  for (i = 0; i < names->len; i++)
+    {
+      g_autofree gchar *child = g_build_filename (path, g_ptr_array_index (names, i), NULL);
+
+      if (g_file_test (child, G_FILE_TEST_IS_DIR))
+        gabc_batch_add_directory (self, child);
+      else if (g_str_has_suffix (child, ".abc"))
+        gabc_batch_add_path (self, child);
+    }
+}
+
+
+/*
+ * Queue an .abc file, or every .abc file under a directory.
+ */
+void
+gabc_batch_add_path (GabcBatch   *self,
+                     const gchar *path)
+{
+  GabcBatchInput *input;
+
+  if (g_file_test (path, G_FILE_TEST_IS_DIR))
+    {
+      gabc_batch_add_directory (self, path);
+      return;
+    }
+
+  input = g_new0 (GabcBatchInput, 1);
+  input->path = g_strdup (path);
+  input->working_dir = g_path_get_dirname (path);
+  g_queue_push_tail (&self->inputs, input);
+}
+
+
+/*
+ * Queue abc text that is not (or not only) in a file, such as an edited
+ * buffer.  name is used to name the output files, which go to the output
+ * directory, so one must be set.  The tools run in working_dir.
+ */
+void
+gabc_batch_add_text (GabcBatch   *self,
+                     const gchar *name,
+                     const gchar *text,
+                     const gchar *working_dir)
+{
+  GabcBatchInput *input;
+
+  g_return_if_fail (self->output_dir != NULL);
+
+  input = g_new0 (GabcBatchInput, 1);
+  input->path = g_strdup (name);
+  input->contents = g_strdup (text);
+  input->working_dir = g_strdup (working_dir);
+  g_queue_push_tail (&self->inputs, input);
+}
+
+
+static gchar *
+gabc_batch_get_output_path (GabcBatch   *self,
+                            const gchar *input_path,
+                            const gchar *tune_name,
+                            const gchar *extension)
+{
+  g_autofree gchar *dir = NULL;
+  g_autofree gchar *basename = NULL;
+  g_autofree gchar *name = NULL;
+
+  dir = self->output_dir != NULL ? g_strdup (self->output_dir) : g_path_get_dirname (input_path);
+  basename = g_path_get_basename (input_path);
+  if (g_str_has_suffix (basename, ".abc"))
+    basename[strlen (basename) - 4] = '\0';
+
+  name = g_strconcat (basename, "-", tune_name, extension, NULL);
+  return g_build_filename (dir, name, NULL);
+}
+
+
+static void
+gabc_batch_queue_tune (GabcBatch      *self,
+                       GabcBatchInput *input,
+                       guint           number,
+                       const gchar    *tune_name,
+                       const gchar    *text)
+{
+  GabcBatchUnit *unit;
+  guint i;
+
+  for (i = 0; i < 2; i++)
+    {
+      gboolean midi = (i == 1);
+
+      if ((midi && !self->midi) || (!midi && !self->engrave))
+        continue;
+
+      unit = g_new0 (GabcBatchUnit, 1);
+      unit->input_path = g_strdup (input->path);
+      unit->number = number;
+      unit->midi = midi;
+      unit->text = g_strdup (text);
+      unit->output_path = gabc_batch_get_output_path (self, input->path, tune_name, midi ? ".mid" : ".ps");
+      unit->working_dir = g_strdup (input->working_dir);
+      g_queue_push_tail (&self->units, unit);
+    }
+}
+
+
+/*
+ * Replace the input's contents with their transposition and write that out,
+ * reporting it like a tool job.  The tunes split from it are then named
+ * after the transposed file.
+ */
+static void
+gabc_batch_transpose_input (GabcBatch      *self,
+                            GabcBatchInput *input)
+{
+  g_autoptr (GError) error = NULL;
+  g_autofree gchar *suffix = NULL;
+  g_autofree gchar *output_path = NULL;
+  gchar *transposed;
+  gint64 start_time = g_get_monotonic_time ();
+  gint64 elapsed;
+
+  transposed = gabc_transpose_text (input->contents, strlen (input->contents), self->semitones);
+  g_free (input->contents);
+  input->contents = transposed;
+
+  suffix = g_strdup_printf ("transposed%+d", self->semitones);
+  output_path = gabc_batch_get_output_path (self, input->path, suffix, ".abc");
+  g_file_set_contents (output_path, input->contents, -1, &error);
+
+  elapsed = g_get_monotonic_time () - start_time;
+  self->job_time += elapsed;
+  self->n_jobs++;
+
+  if (error != NULL)
+    gabc_batch_add_failure (self, "%s (transpose): %s", input->path, error->message);
+
+  g_signal_emit (self, signals [JOB_FINISHED], 0,
+                 input->path,
+                 0,
+                 "transpose",
+                 output_path,
+                 elapsed,
+                 error != NULL ? error->message : NULL);
+
+  if (error == NULL)
+    {
+      g_free (input->path);
+      input->path = g_steal_pointer (&output_path);
+    }
+}
+
+
+/*
+ * Split the next input into tunes.  Each tune keeps the file header (the
+ * text before the first X:) in front of it, as the tunebook does for the
+ * current-tune actions.  Returns FALSE when there are no inputs left.
+ */
+static gboolean
+gabc_batch_split_next_input (GabcBatch *self)
+{
+  g_autoptr (GabcBatchInput) input = NULL;
+  g_autofree gchar *header = NULL;
+  g_autoptr (GArray) starts = NULL;
+  g_autoptr (GHashTable) names = NULL;
+  g_autoptr (GError) error = NULL;
+  const gchar *contents;
+  const gchar *line;
+  gsize length;
+  guint i;
+
+  input = g_queue_pop_head (&self->inputs);
+  if (input == NULL)
+    return FALSE;
+
+  if (input->contents == NULL &&
+      !g_file_get_contents (input->path, &input->contents, NULL, &error))
+    {
+      gabc_batch_add_failure (self, "%s: %s", input->path, error->message);
+      return TRUE;
+    }
+
+  if (self->semitones != 0)
+    gabc_batch_transpose_input (self, input);
+
+  contents = input->contents;
+  length = strlen (contents);
+
+  starts = g_array_new (FALSE, FALSE, sizeof (gsize));
+  line = contents;
+  while (line != NULL)
+    {
+      if (line[0] == 'X' && line[1] == ':')
+        {
+          gsize offset = line - contents;
+          g_array_append_val (starts, offset);
+        }
+
+      line = strchr (line, '\n');
+      if (line != NULL)
+        line++;
+    }
+
+  if (starts->len == 0)
+    {
+      gabc_batch_add_failure (self, "%s: no tunes found", input->path);
+      return TRUE;
+    }
+
+  header = g_strndup (contents, g_array_index (starts, gsize, 0));
+  names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  for (i = 0; i < starts->len; i++)
+    {
+      gsize start = g_array_index (starts, gsize, i);
+      gsize end = i + 1 < starts->len ? g_array_index (starts, gsize, i + 1) : length;
+      g_autofree gchar *tune = g_strndup (contents + start, end - start);
+      g_autofree gchar *text = g_strconcat (header, tune, NULL);
+      gchar *tune_name;
+      guint number;
+
+      number = g_ascii_strtoull (contents + start + 2, NULL, 10);
+
+      /* X: numbers are not always unique within a file. */
+      tune_name = g_strdup_printf ("X%u", number);
+      if (g_hash_table_contains (names, tune_name))
+        {
+          g_free (tune_name);
+          tune_name = g_strdup_printf ("X%u-%u", number, i + 1);
+        }
+      g_hash_table_add (names, tune_name);
+
+      gabc_batch_queue_tune (self, input, number, tune_name, text);
+    }
+
+  return TRUE;
+}
+
+
+static gboolean
+gabc_batch_append_text (const gchar  *data,
+                        gsize         length,
+                        gpointer      user_data,
+                        GError      **error)
+{
+  g_string_append_len (user_data, data, length);
+  return TRUE;
+}
+
+
+static GabcRenderJob *
+gabc_batch_new_ps_job (GabcBatch     *self,
+                       GabcBatchUnit *unit)
+{
+  g_autoptr (GStrvBuilder) builder = g_strv_builder_new ();
+  g_auto (GStrv) argv = NULL;
+  g_autofree gchar *page_numbering_mode = NULL;
+
+  page_numbering_mode = g_settings_get_string (self->settings, "abcm2ps-page-numbering");
+
+  g_strv_builder_add (builder, "abcm2ps");
+  g_strv_builder_addv (builder, (const char **) gabc_render_service_get_options (self->service, "abcm2ps"));
+  g_strv_builder_add_many (builder, "-N", page_numbering_mode, "-O", unit->output_path, unit->abc_path, NULL);
+  argv = g_strv_builder_end (builder);
+
+  return gabc_render_job_new ((const gchar * const *) argv, unit->working_dir);
+}
+
+
+static GabcRenderJob *
+gabc_batch_new_midi_job (GabcBatch     *self,
+                         GabcBatchUnit *unit)
+{
+  g_autoptr (GStrvBuilder) builder = g_strv_builder_new ();
+  g_auto (GStrv) argv = NULL;
+
+  g_strv_builder_add_many (builder, "abc2midi", unit->abc_path, "-o", unit->output_path, NULL);
+  g_strv_builder_addv (builder, (const char **) gabc_render_service_get_options (self->service, "abc2midi"));
+  argv = g_strv_builder_end (builder);
+
+  return gabc_render_job_new ((const gchar * const *) argv, unit->working_dir);
+}
+
+
+/*
+ * First line of the tool's output that counts as an error, or NULL.
+ */
+static gchar *
+gabc_batch_get_error_line (GabcRenderJob *job)
+{
+  const gchar *outputs[2];
+  guint i;
+
+  outputs[0] = gabc_render_job_get_standard_error (job);
+  outputs[1] = gabc_render_job_get_standard_output (job);
+
+  for (i = 0; i < G_N_ELEMENTS (outputs); i++)
+    {
+      g_auto (GStrv) lines = g_strsplit (outputs[i], "\n", -1);
+      guint j;
+
+      for (j = 0; lines[j] != NULL; j++)
+        {
+          if (gabc_diagnostic_get_severity (lines[j]) == GABC_LOG_SEVERITY_ERROR)
+            return g_strdup (g_strstrip (lines[j]));
+        }
+    }
+
+  return NULL;
+}
+
+
+/*
+ * Why a job that ran failed, for the summary, or NULL if it worked.  Both
+ * tools fail on a non-zero exit status.  abc2midi also fails on any error
+ * in its output, as it often exits with 0 regardless; the window judges
+ * MIDI conversions the same way.
+ */
+static gchar *
+gabc_batch_get_failure (GabcRenderJob *job,
+                        gboolean       midi)
+{
+  gint exit_status = gabc_render_job_get_exit_status (job);
+  gchar *error_line;
+
+  if (!midi && exit_status == 0)
+    return NULL;
+
+  error_line = gabc_batch_get_error_line (job);
+  if (error_line != NULL || exit_status == 0)
+    return error_line;
+
+  return g_strdup_printf ("exit status %d", exit_status);
+}
+
+
+static void
+gabc_batch_job_cb (GObject      *source_object,
+                   GAsyncResult *result,
+                   gpointer      user_data)
+{
+  GabcRenderJob *job = GABC_RENDER_JOB (source_object);
+  GabcBatchUnit *unit = user_data;
+  GabcBatch *self = g_object_get_data (source_object, "gabc-batch");
+  g_autoptr (GError) error = NULL;
+  g_autofree gchar *reason = NULL;
+  gint64 elapsed;
+  gboolean succeeded;
+
+  elapsed = g_get_monotonic_time () - unit->start_time;
+  self->n_running--;
+
+  succeeded = gabc_render_job_run_finish (job, result, &error);
+
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      gabc_batch_unit_free (unit);
+      gabc_batch_fill_workers (self);
+      return;
+    }
+
+  self->job_time += elapsed;
+  self->n_jobs++;
+
+  if (!succeeded)
+    reason = g_strdup (error->message);
+  else
+    reason = gabc_batch_get_failure (job, unit->midi);
+
+  if (reason != NULL)
+    gabc_batch_add_failure (self, "%s X:%u (%s): %s",
+                            unit->input_path, unit->number,
+                            gabc_render_job_get_tool (job), reason);
+
+  g_signal_emit (self, signals [JOB_FINISHED], 0,
+                 unit->input_path,
+                 unit->number,
+                 gabc_render_job_get_tool (job),
+                 unit->output_path,
+                 elapsed,
+                 reason);
+
+  gabc_batch_unit_free (unit);
+  gabc_batch_fill_workers (self);
+}
+
+
+static void
+gabc_batch_start_unit (GabcBatch     *self,
+                       GabcBatchUnit *unit)
+{
+  g_autoptr (GabcRenderJob) job = NULL;
+  g_autoptr (GString) text = NULL;
+  g_autoptr (GError) error = NULL;
+  g_autofree gchar *name = NULL;
+
+  name = g_strdup_printf ("%u.abc", ++self->serial);
+  unit->abc_path = g_build_filename (self->tmp_dir, name, NULL);
+
+  text = g_string_new (NULL);
+  gabc_preprocessor_reset (self->preprocessor);
+  if (!gabc_preprocessor_process (self->preprocessor,
+                                  unit->midi ? GABC_PREPROCESSOR_TARGET_ABC2MIDI : GABC_PREPROCESSOR_TARGET_ABCM2PS,
+                                  unit->text, TRUE, NULL,
+                                  gabc_batch_append_text, text, &error) ||
+      !g_file_set_contents (unit->abc_path, text->str, text->len, &error))
+    {
+      gabc_batch_add_failure (self, "%s X:%u: %s", unit->input_path, unit->number, error->message);
+      gabc_batch_unit_free (unit);
+      return;
+    }
+
+  g_clear_pointer (&unit->text, g_free);
+
+  job = unit->midi ? gabc_batch_new_midi_job (self, unit) : gabc_batch_new_ps_job (self, unit);
+  g_object_set_data (G_OBJECT (job), "gabc-batch", self);
+
+  self->n_running++;
+  unit->start_time = g_get_monotonic_time ();
+  gabc_render_service_run_async (self->service, job, g_task_get_cancellable (self->task), gabc_batch_job_cb, unit);
+}
+
+
+/*
+ * Hand queued work to the render service until each of its slots has a job
+ * of ours, splitting more inputs as the queue runs dry.  Completes the task once everything has finished, or
+ * once the running jobs have unwound after a cancel.
+ */
+static void
+gabc_batch_fill_workers (GabcBatch *self)
+{
+  GCancellable *cancellable = g_task_get_cancellable (self->task);
+  g_autoptr (GTask) task = NULL;
+
+  while (self->n_running < gabc_render_service_get_max_jobs (self->service) &&
+         !g_cancellable_is_cancelled (cancellable))
+    {
+      GabcBatchUnit *unit = g_queue_pop_head (&self->units);
+
+      if (unit == NULL)
+        {
+          if (gabc_batch_split_next_input (self))
+            continue;
+          break;
+        }
+
+      gabc_batch_start_unit (self, unit);
+    }
+
+  if (self->n_running > 0)
+    return;
+
+  if (!g_cancellable_is_cancelled (cancellable) &&
+      !(g_queue_is_empty (&self->units) && g_queue_is_empty (&self->inputs)))
+    return;
+
+  task = g_steal_pointer (&self->task);
+  if (!g_task_return_error_if_cancelled (task))
+    g_task_return_boolean (task, TRUE);
+}
+
+
+/*
+ * Process everything queued through the render service.  The task
+ * succeeds once every job has run, whether or not they all worked; see
+ * gabc_batch_get_n_failures ().
+ */
+void
+gabc_batch_run_async (GabcBatch           *self,
+                      GCancellable        *cancellable,
+                      GAsyncReadyCallback  callback,
+                      gpointer             user_data)
+{
+  g_autoptr (GTask) task = NULL;
+  GError *error = NULL;
+
+  g_return_if_fail (GABC_IS_BATCH (self));
+  g_return_if_fail (self->task == NULL);
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, gabc_batch_run_async);
+
+  if (self->output_dir != NULL)
+    g_mkdir_with_parents (self->output_dir, 0755);
+
+  if (self->tmp_dir == NULL)
+    self->tmp_dir = g_dir_make_tmp ("gabc-batch-XXXXXX", &error);
+  if (self->tmp_dir == NULL)
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  self->task = g_steal_pointer (&task);
+  self->start_time = g_get_monotonic_time ();
+
+  gabc_batch_fill_workers (self);
+}
+
+
+gboolean
+gabc_batch_run_finish (GabcBatch     *self,
+                       GAsyncResult  *result,
+                       GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, self), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+
+/*
+ * n_total only counts the tunes of the inputs split so far; inputs are split
+ * as the workers reach them.
+ */
+void
+gabc_batch_get_progress (GabcBatch *self,
+                         guint     *n_done,
+                         guint     *n_total)
+{
+  if (n_done != NULL)
+    *n_done = self->n_jobs;
+  if (n_total != NULL)
+    *n_total = self->n_jobs + self->n_running + self->units.length;
+}
+
+
+guint
+gabc_batch_get_n_failures (GabcBatch *self)
+{
+  return self->failures->len;
+}
+
+
+/*
+ * One line per failure: the tune (or input), the tool and the reason.
+ */
+GStrv
+gabc_batch_dup_failures (GabcBatch *self)
+{
+  GStrv failures;
+  guint i;
+
+  failures = g_new0 (gchar *, self->failures->len + 1);
+  for (i = 0; i < self->failures->len; i++)
+    failures[i] = g_strdup (g_ptr_array_index (self->failures, i));
+
+  return failures;
+}
+
+
+/*
+ * COMMAND LINE
+ */
+typedef struct {
+  GMainLoop *loop;
+  GAsyncResult *result;
+} batch_run_data_t;
+
+
+static void
+gabc_batch_command_line_job_finished_cb (GabcBatch   *batch,
+                                         const gchar *input_path,
+                                         guint        number,
+                                         const gchar *tool,
+                                         const gchar *output_path,
+                                         gint64       elapsed,
+                                         const gchar *reason,
+                                         gpointer     user_data)
+{
+  /* Transposition works on whole files, so there is no X: to show. */
+  if (g_strcmp0 (tool, "transpose") == 0)
+    {
+      g_print ("%8.1f ms  %-6s  %s  %s -> %s\n",
+               elapsed / 1000.0,
+               reason == NULL ? "ok" : "FAILED",
+               tool,
+               input_path,
+               output_path);
+      return;
+    }
+
+  g_print ("%8.1f ms  %-6s  %s  %s X:%u -> %s\n",
+           elapsed / 1000.0,
+           reason == NULL ? "ok" : "FAILED",
+           tool,
+           input_path,
+           number,
+           output_path);
+}
+
+
+static void
+gabc_batch_command_line_run_cb (GObject      *source_object,
+                                GAsyncResult *result,
+                                gpointer      user_data)
+{
+  batch_run_data_t *run_data = user_data;
+
+  run_data->result = g_object_ref (result);
+  g_main_loop_quit (run_data->loop);
+}
+
+
+static void
+gabc_batch_print_summary (GabcBatch *self)
+{
+  gint64 wall_time = g_get_monotonic_time () - self->start_time;
+  guint i;
+
+  g_print ("\n%u jobs on %u workers in %.2f s (%.1f ms per job, %.2f s of tool time)\n",
+           self->n_jobs,
+           gabc_render_service_get_max_jobs (self->service),
+           wall_time / 1000000.0,
+           self->n_jobs > 0 ? self->job_time / 1000.0 / self->n_jobs : 0.0,
+           self->job_time / 1000000.0);
+
+  if (self->failures->len == 0)
+    return;
+
+  g_printerr ("\n%u failures:\n", self->failures->len);
+  for (i = 0; i < self->failures->len; i++)
+    g_printerr ("  %s\n", (const gchar *) g_ptr_array_index (self->failures, i));
+}
+
+
+/*
+ * Entry point for `gabc --batch [OPTION…] FILE|DIR…`, called before the
+ * application registers so no window (and no display) is needed.  Returns
+ * the exit status: 0 if every job succeeded, 1 otherwise.
+ */
+gint
+gabc_batch_command_line (gchar **arguments)
+{
+  g_auto (GStrv) args = g_strdupv (arguments);
+  g_autoptr (GOptionContext) context = NULL;
+  g_autoptr (GSettings) settings = NULL;
+  g_autoptr (GabcBatch) batch = NULL;
+  g_autoptr (GError) error = NULL;
+  g_autofree gchar *output_dir = NULL;
+  g_auto (GStrv) paths = NULL;
+  batch_run_data_t run_data = { NULL, NULL };
+  gboolean batch_mode = FALSE;
+  gboolean no_engrave = FALSE;
+  gboolean no_midi = FALSE;
+  gboolean finished;
+  gint semitones = 0;
+  gint jobs = 0;
+  guint i;
+
+  const GOptionEntry entries[] = {
+    { "batch", 0, 0, G_OPTION_ARG_NONE, &batch_mode, "Engrave and convert without opening a window", NULL },
+    { "output-dir", 'o', 0, G_OPTION_ARG_FILENAME, &output_dir, "Write the output to DIR instead of next to each file", "DIR" },
+    { "jobs", 'j', 0, G_OPTION_ARG_INT, &jobs, "Run N tools at once (default: number of CPUs)", "N" },
+    { "no-engrave", 0, 0, G_OPTION_ARG_NONE, &no_engrave, "Do not run abcm2ps", NULL },
+    { "no-midi", 0, 0, G_OPTION_ARG_NONE, &no_midi, "Do not run abc2midi", NULL },
+    { "transpose", 't', 0, G_OPTION_ARG_INT, &semitones, "Transpose the tunes by N semitones first", "N" },
+    { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &paths, NULL, "FILE|DIR…" },
+    { NULL }
+  };
+
+  context = g_option_context_new ("— engrave, convert and transpose abc files");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse_strv (context, &args, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return 1;
+    }
+
+  if (paths == NULL || paths[0] == NULL)
+    {
+      g_printerr ("No input files given\n");
+      return 1;
+    }
+
+  settings = g_settings_new ("me.pm.m0dns.gabc");
+  batch = gabc_batch_new (settings);
+
+  gabc_batch_set_output_dir (batch, output_dir);
+  gabc_batch_set_outputs (batch, !no_engrave, !no_midi);
+  gabc_batch_set_transpose (batch, semitones);
+  if (jobs > 0)
+    gabc_batch_set_max_jobs (batch, jobs);
+
+  for (i = 0; paths[i] != NULL; i++)
+    gabc_batch_add_path (batch, paths[i]);
+
+  g_signal_connect (batch, "job-finished",
+                    G_CALLBACK (gabc_batch_command_line_job_finished_cb), NULL);
+
+  run_data.loop = g_main_loop_new (NULL, FALSE);
+  gabc_batch_run_async (batch, NULL, gabc_batch_command_line_run_cb, &run_data);
+  g_main_loop_run (run_data.loop);
+  g_main_loop_unref (run_data.loop);
+
+  finished = gabc_batch_run_finish (batch, run_data.result, &error);
+  g_object_unref (run_data.result);
+
+  if (!finished)
+    {
+      g_printerr ("%s\n", error->message);
+      return 1;
+    }
+
+  gabc_batch_print_summary (batch);
+
+  return gabc_batch_get_n_failures (batch) == 0 ? 0 : 1;
+}
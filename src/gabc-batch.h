@@ -0,0 +1,72 @@
+/* gabc-batch.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define GABC_TYPE_BATCH (gabc_batch_get_type())
+
+G_DECLARE_FINAL_TYPE (GabcBatch, gabc_batch, GABC, BATCH, GObject)
+
+GabcBatch                *gabc_batch_new                          (GSettings   *settings);
+
+void                      gabc_batch_set_output_dir               (GabcBatch   *self,
+                                                                   const gchar *output_dir);
+
+void                      gabc_batch_set_max_jobs                 (GabcBatch   *self,
+                                                                   guint        max_jobs);
+
+void                      gabc_batch_set_outputs                  (GabcBatch   *self,
+                                                                   gboolean     engrave,
+                                                                   gboolean     midi);
+
+void                      gabc_batch_set_transpose                (GabcBatch   *self,
+                                                                   gint         semitones);
+
+void                      gabc_batch_add_path                     (GabcBatch   *self,
+                                                                   const gchar *path);
+
+void                      gabc_batch_add_text                     (GabcBatch   *self,
+                                                                   const gchar *name,
+                                                                   const gchar *text,
+                                                                   const gchar *working_dir);
+
+void                      gabc_batch_run_async                    (GabcBatch           *self,
+                                                                   GCancellable        *cancellable,
+                                                                   GAsyncReadyCallback  callback,
+                                                                   gpointer             user_data);
+
+gboolean                  gabc_batch_run_finish                   (GabcBatch     *self,
+                                                                   GAsyncResult  *result,
+                                                                   GError       **error);
+
+void                      gabc_batch_get_progress                 (GabcBatch   *self,
+                                                                   guint       *n_done,
+                                                                   guint       *n_total);
+
+guint                     gabc_batch_get_n_failures               (GabcBatch   *self);
+
+GStrv                     gabc_batch_dup_failures                 (GabcBatch   *self);
+
+gint                      gabc_batch_command_line                 (gchar     **arguments);
+
+G_END_DECLS
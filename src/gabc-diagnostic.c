@@ -0,0 +1,143 @@
+/* gabc-diagnostic.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Recognises the error and warning lines of the two tools;
+ *
+ *   abcm2ps    <file>:<line>:<column>: error: <message>
+ *              <file>:<line>: warning: <message>
+ *   abc2midi   Error in line-char <line>-<column> : <message>
+ *              Warning in line <line> : <message>
+ *
+ * Lines are numbered from 1 and columns from 0 by both tools.  Parsing is
+ * one line at a time, so it can run on the output as it arrives.
+ */
+
+#include "gabc-diagnostic.h"
+
+static GRegex *
+gabc_diagnostic_get_abcm2ps_regex (void)
+{
+  static GRegex *regex = NULL;
+
+  if (regex == NULL)
+    regex = g_regex_new ("^[^:]*:(\\d+):(?:(\\d+):)?\\s*(error|warning)\\s*:?\\s*(.*)$",
+                         G_REGEX_CASELESS | G_REGEX_OPTIMIZE, 0, NULL);
+
+  return regex;
+}
+
+
+static GRegex *
+gabc_diagnostic_get_abc2midi_regex (void)
+{
+  static GRegex *regex = NULL;
+
+  if (regex == NULL)
+    regex = g_regex_new ("^\\s*(error|warning) in line(?:-char)? (\\d+)(?:-(\\d+))?\\s*:?\\s*(.*)$",
+                         G_REGEX_CASELESS | G_REGEX_OPTIMIZE, 0, NULL);
+
+  return regex;
+}
+
+
+static void
+gabc_diagnostic_fill (GabcDiagnostic *diagnostic,
+                      GMatchInfo     *match_info,
+                      gint            severity_group,
+                      gint            line_group,
+                      gint            column_group,
+                      gint            message_group)
+{
+  g_autofree gchar *severity = g_match_info_fetch (match_info, severity_group);
+  g_autofree gchar *line = g_match_info_fetch (match_info, line_group);
+  g_autofree gchar *column = g_match_info_fetch (match_info, column_group);
+  guint64 line_number;
+
+  diagnostic->severity = g_ascii_strcasecmp (severity, "error") == 0 ? GABC_LOG_SEVERITY_ERROR
+                                                                     : GABC_LOG_SEVERITY_WARNING;
+
+  line_number = g_ascii_strtoull (line, NULL, 10);
+  diagnostic->line = line_number > 0 ? (guint) MIN (line_number, G_MAXUINT) : 0;
+  if (diagnostic->line > 0)
+    diagnostic->line--;
+
+  diagnostic->column = column != NULL && *column != '\0' ? (guint) MIN (g_ascii_strtoull (column, NULL, 10), G_MAXUINT) : 0;
+  diagnostic->message = g_match_info_fetch (match_info, message_group);
+}
+
+
+/*
+ * Returns TRUE and fills in diagnostic if text is an error or warning with
+ * a position.  Free the message with gabc_diagnostic_clear ().
+ */
+gboolean
+gabc_diagnostic_parse (const gchar    *text,
+                       GabcDiagnostic *diagnostic)
+{
+  g_autoptr (GMatchInfo) match_info = NULL;
+
+  g_return_val_if_fail (diagnostic != NULL, FALSE);
+
+  if (text == NULL)
+    return FALSE;
+
+  if (g_regex_match (gabc_diagnostic_get_abc2midi_regex (), text, 0, &match_info))
+    {
+      gabc_diagnostic_fill (diagnostic, match_info, 1, 2, 3, 4);
+      return TRUE;
+    }
+  g_clear_pointer (&match_info, g_match_info_unref);
+
+  if (g_regex_match (gabc_diagnostic_get_abcm2ps_regex (), text, 0, &match_info))
+    {
+      gabc_diagnostic_fill (diagnostic, match_info, 3, 1, 2, 4);
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+
+void
+gabc_diagnostic_clear (GabcDiagnostic *diagnostic)
+{
+  g_clear_pointer (&diagnostic->message, g_free);
+}
+
+
+/*
+ * How a line of tool output counts: as parsed if it is a diagnostic, and
+ * by the words in it otherwise.  This is what the window counts errors by.
+ */
+GabcLogSeverity
+gabc_diagnostic_get_severity (const gchar *text)
+{
+  GabcDiagnostic diagnostic = { 0 };
+  GabcLogSeverity severity;
+
+  if (!gabc_diagnostic_parse (text, &diagnostic))
+    return gabc_log_severity_from_text (text);
+
+  severity = diagnostic.severity;
+  gabc_diagnostic_clear (&diagnostic);
+
+  return severity;
+}
@@ -0,0 +1,53 @@
+/* gabc-diagnostic.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <glib.h>
+
+#include "gabc-log-record.h"
+
+G_BEGIN_DECLS
+
+/*
+ * An error or warning from abcm2ps or abc2midi, at a position in the file
+ * the tool read.  line and column are counted from 0.
+ */
+typedef struct {
+  GabcLogSeverity  severity;
+  guint            line;
+  guint            column;
+  gchar           *message;
+} GabcDiagnostic;
+
+/*
+ * Text tags underlining problems in the tunebook, shared by the tools'
+ * diagnostics and the validator's checks.
+ */
+#define GABC_DIAGNOSTIC_TAG_ERROR   "gabc-diagnostic-error"
+#define GABC_DIAGNOSTIC_TAG_WARNING "gabc-diagnostic-warning"
+
+gboolean                  gabc_diagnostic_parse                   (const gchar    *text,
+                                                                   GabcDiagnostic *diagnostic);
+
+void                      gabc_diagnostic_clear                   (GabcDiagnostic *diagnostic);
+
+GabcLogSeverity           gabc_diagnostic_get_severity            (const gchar    *text);
+
+G_END_DECLS
@@ -0,0 +1,298 @@
+/* gabc-engraving-window.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Window showing the engraved tunebook, in place of an external viewer.
+ *
+ * Each engrave has abcm2ps write SVG, one file per page, under its own
+ * names (engraving-<serial>-NNN.svg), so a killed abcm2ps can never write
+ * over the pages on show.  The page view rasterises and caches the pages;
+ * the files of older engraves are removed once a newer one is shown.
+ */
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "gabc-engraving-window.h"
+#include "gabc-page-view.h"
+
+#define GABC_ENGRAVING_WINDOW_FILE_PREFIX "engraving-"
+#define GABC_ENGRAVING_WINDOW_ZOOM_STEP 1.25
+
+struct _GabcEngravingWindow
+{
+  AdwWindow                     parent_instance;
+
+  AdwWindowTitle               *window_title;
+  GtkButton                    *zoom_button;
+  GabcPageView                 *page_view;
+
+  gchar                        *directory;
+  guint                         serial;
+};
+
+G_DEFINE_FINAL_TYPE (GabcEngravingWindow, gabc_engraving_window, ADW_TYPE_WINDOW)
+
+
+static gint
+gabc_engraving_window_compare_names (gconstpointer a,
+                                     gconstpointer b)
+{
+  return g_strcmp0 (*(const gchar * const *) a, *(const gchar * const *) b);
+}
+
+
+/*
+ * Delete the files of every engrave except the one whose names start with
+ * keep_prefix (all of them if it is NULL).
+ */
+static void
+gabc_engraving_window_remove_files (GabcEngravingWindow *self,
+                                    const gchar         *keep_prefix)
+{
+  GDir *dir;
+  const gchar *name;
+
+  dir = g_dir_open (self->directory, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      g_autofree gchar *path = NULL;
+
+      if (!g_str_has_prefix (name, GABC_ENGRAVING_WINDOW_FILE_PREFIX) ||
+          (keep_prefix != NULL && g_str_has_prefix (name, keep_prefix)))
+        continue;
+
+      path = g_build_filename (self->directory, name, NULL);
+      g_unlink (path);
+    }
+  g_dir_close (dir);
+}
+
+
+static void
+gabc_engraving_window_zoom_changed_cb (GabcPageView        *page_view,
+                                       GParamSpec          *pspec,
+                                       GabcEngravingWindow *self)
+{
+  g_autofree gchar *label = NULL;
+
+  label = g_strdup_printf ("%.0f%%", gabc_page_view_get_zoom (page_view) * 100);
+  gtk_button_set_label (self->zoom_button, label);
+}
+
+
+static void
+gabc_engraving_window_n_pages_changed_cb (GabcPageView        *page_view,
+                                          GParamSpec          *pspec,
+                                          GabcEngravingWindow *self)
+{
+  guint n_pages = gabc_page_view_get_n_pages (page_view);
+  g_autofree gchar *subtitle = NULL;
+
+  subtitle = g_strdup_printf (n_pages == 1 ? "%u page" : "%u pages", n_pages);
+  adw_window_title_set_subtitle (self->window_title, subtitle);
+}
+
+
+static void
+gabc_engraving_window_zoom_in (GtkWidget   *widget,
+                               const gchar *action_name,
+                               GVariant    *parameter)
+{
+  GabcEngravingWindow *self = GABC_ENGRAVING_WINDOW (widget);
+
+  gabc_page_view_set_zoom (self->page_view,
+                           gabc_page_view_get_zoom (self->page_view) * GABC_ENGRAVING_WINDOW_ZOOM_STEP);
+}
+
+
+static void
+gabc_engraving_window_zoom_out (GtkWidget   *widget,
+                                const gchar *action_name,
+                                GVariant    *parameter)
+{
+  GabcEngravingWindow *self = GABC_ENGRAVING_WINDOW (widget);
+
+  gabc_page_view_set_zoom (self->page_view,
+                           gabc_page_view_get_zoom (self->page_view) / GABC_ENGRAVING_WINDOW_ZOOM_STEP);
+}
+
+
+static void
+gabc_engraving_window_zoom_reset (GtkWidget   *widget,
+                                  const gchar *action_name,
+                                  GVariant    *parameter)
+{
+  GabcEngravingWindow *self = GABC_ENGRAVING_WINDOW (widget);
+
+  gabc_page_view_set_zoom (self->page_view, 1.0);
+}
+
+
+static void
+gabc_engraving_window_dispose (GObject *object)
+{
+  GabcEngravingWindow *self = GABC_ENGRAVING_WINDOW (object);
+
+  if (self->directory != NULL)
+    gabc_engraving_window_remove_files (self, NULL);
+
+  gtk_widget_dispose_template (GTK_WIDGET (self), GABC_TYPE_ENGRAVING_WINDOW);
+
+  G_OBJECT_CLASS (gabc_engraving_window_parent_class)->dispose (object);
+}
+
+
+static void
+gabc_engraving_window_finalize (GObject *object)
+{
+  GabcEngravingWindow *self = GABC_ENGRAVING_WINDOW (object);
+
+  g_free (self->directory);
+
+  G_OBJECT_CLASS (gabc_engraving_window_parent_class)->finalize (object);
+}
+
+
+static void
+gabc_engraving_window_class_init (GabcEngravingWindowClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+
+  object_class->dispose = gabc_engraving_window_dispose;
+  object_class->finalize = gabc_engraving_window_finalize;
+
+  gtk_widget_class_set_template_from_resource (widget_class,
+                                               "/me/pm/m0dns/gabc/gabc-engraving-window.ui");
+
+  gtk_widget_class_bind_template_child (widget_class,
+                                        GabcEngravingWindow,
+                                        window_title);
+  gtk_widget_class_bind_template_child (widget_class,
+                                        GabcEngravingWindow,
+                                        zoom_button);
+  gtk_widget_class_bind_template_child (widget_class,
+                                        GabcEngravingWindow,
+                                        page_view);
+
+  gtk_widget_class_install_action (widget_class, "engraving.zoom-in", NULL, gabc_engraving_window_zoom_in);
+  gtk_widget_class_install_action (widget_class, "engraving.zoom-out", NULL, gabc_engraving_window_zoom_out);
+  gtk_widget_class_install_action (widget_class, "engraving.zoom-reset", NULL, gabc_engraving_window_zoom_reset);
+
+  gtk_widget_class_add_binding_action (widget_class, GDK_KEY_plus, GDK_CONTROL_MASK, "engraving.zoom-in", NULL);
+  gtk_widget_class_add_binding_action (widget_class, GDK_KEY_equal, GDK_CONTROL_MASK, "engraving.zoom-in", NULL);
+  gtk_widget_class_add_binding_action (widget_class, GDK_KEY_minus, GDK_CONTROL_MASK, "engraving.zoom-out", NULL);
+  gtk_widget_class_add_binding_action (widget_class, GDK_KEY_0, GDK_CONTROL_MASK, "engraving.zoom-reset", NULL);
+
+  g_type_ensure (GABC_TYPE_PAGE_VIEW);
+}
+
+
+static void
+gabc_engraving_window_init (GabcEngravingWindow *self)
+{
+  gtk_widget_init_template (GTK_WIDGET (self));
+
+  self->directory = g_build_filename (g_get_user_cache_dir (), "gabc", "engraving", NULL);
+
+  g_signal_connect (self->page_view, "notify::zoom",
+                    G_CALLBACK (gabc_engraving_window_zoom_changed_cb), self);
+  g_signal_connect (self->page_view, "notify::n-pages",
+                    G_CALLBACK (gabc_engraving_window_n_pages_changed_cb), self);
+}
+
+
+GabcEngravingWindow *
+gabc_engraving_window_new (GtkWindow *parent)
+{
+  return g_object_new (GABC_TYPE_ENGRAVING_WINDOW,
+                       "transient-for", parent,
+                       NULL);
+}
+
+
+/*
+ * The path to give abcm2ps -O for the next engrave.  With -v it puts the
+ * page number in front of the extension.
+ */
+gchar *
+gabc_engraving_window_get_output_path (GabcEngravingWindow *self)
+{
+  g_autofree gchar *name = NULL;
+
+  g_return_val_if_fail (GABC_IS_ENGRAVING_WINDOW (self), NULL);
+
+  g_mkdir_with_parents (self->directory, 0700);
+  name = g_strdup_printf (GABC_ENGRAVING_WINDOW_FILE_PREFIX "%u-.svg", ++self->serial);
+
+  return g_build_filename (self->directory, name, NULL);
+}
+
+
+/*
+ * Show the pages abcm2ps wrote for output_path and bring the window up.
+ * Returns FALSE, leaving the old pages up, if it wrote none.
+ */
+gboolean
+gabc_engraving_window_show_output (GabcEngravingWindow *self,
+                                   const gchar         *output_path)
+{
+  g_autoptr (GPtrArray) paths = NULL;
+  g_autofree gchar *prefix = NULL;
+  GDir *dir;
+  const gchar *name;
+
+  g_return_val_if_fail (GABC_IS_ENGRAVING_WINDOW (self), FALSE);
+
+  prefix = g_path_get_basename (output_path);
+  if (g_str_has_suffix (prefix, ".svg"))
+    prefix[strlen (prefix) - 4] = '\0';
+
+  dir = g_dir_open (self->directory, 0, NULL);
+  if (dir == NULL)
+    return FALSE;
+
+  paths = g_ptr_array_new_with_free_func (g_free);
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      if (g_str_has_prefix (name, prefix) && g_str_has_suffix (name, ".svg"))
+        g_ptr_array_add (paths, g_build_filename (self->directory, name, NULL));
+    }
+  g_dir_close (dir);
+
+  if (paths->len == 0)
+    return FALSE;
+
+  /* abcm2ps numbers the pages with leading zeros. */
+  g_ptr_array_sort (paths, gabc_engraving_window_compare_names);
+  g_ptr_array_add (paths, NULL);
+
+  gabc_page_view_set_pages (self->page_view, (const gchar * const *) paths->pdata);
+  gabc_engraving_window_remove_files (self, prefix);
+
+  gtk_window_present (GTK_WINDOW (self));
+
+  return TRUE;
+}
@@ -0,0 +1,39 @@
+/* gabc-engraving-window.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gtk/gtk.h>
+#include <adwaita.h>
+
+G_BEGIN_DECLS
+
+#define GABC_TYPE_ENGRAVING_WINDOW (gabc_engraving_window_get_type())
+
+G_DECLARE_FINAL_TYPE (GabcEngravingWindow, gabc_engraving_window, GABC, ENGRAVING_WINDOW, AdwWindow)
+
+GabcEngravingWindow      *gabc_engraving_window_new               (GtkWindow           *parent);
+
+gchar *                   gabc_engraving_window_get_output_path   (GabcEngravingWindow *self);
+
+gboolean                  gabc_engraving_window_show_output       (GabcEngravingWindow *self,
+                                                                   const gchar         *output_path);
+
+G_END_DECLS
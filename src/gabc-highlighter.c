@@ -0,0 +1,484 @@
+/* gabc-highlighter.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Syntax highlighting for the tunebook with GabcAbcLexer, in place of the
+ * regex grammar in abc.lang.
+ *
+ * Edits mark the tunes they touch as invalid, as reported by the tune
+ * index's "tunes-edited" (the lexer restarts at every X: line, so a tune is
+ * always safe to re-lex on its own).  The invalid
+ * region is re-lexed from an idle callback a block of lines at a time,
+ * within a time budget, and the tokens are applied as text tags styled from
+ * the buffer's style scheme.
+ */
+
+#include <string.h>
+
+#include "gabc-abc-lexer.h"
+#include "gabc-highlighter.h"
+
+#define GABC_HIGHLIGHTER_BLOCK_LINES 256
+#define GABC_HIGHLIGHTER_IDLE_BUDGET (5 * G_TIME_SPAN_MILLISECOND)
+
+struct _GabcHighlighter
+{
+  GObject                       parent_instance;
+
+  GtkTextBuffer                *buffer;
+  GabcTuneIndex                *tune_index;
+  GtkTextTag                   *tags [GABC_ABC_N_TOKEN_KINDS];
+  gboolean                      enabled;
+
+  GtkSourceRegion              *invalid_region;
+  GtkTextMark                  *resume_mark;
+  GabcAbcLexer                  resume_lexer;
+  guint                         idle_id;
+
+  gulong                        style_scheme_id;
+};
+
+G_DEFINE_FINAL_TYPE (GabcHighlighter, gabc_highlighter, G_TYPE_OBJECT)
+
+typedef struct {
+  GabcHighlighter  *highlighter;
+  const gchar      *line;
+  GtkTextIter       line_start;
+  gint              kind;
+  gsize             start;
+  gsize             end;
+} highlight_line_data_t;
+
+/*
+ * Style scheme ids for each token kind, best first.  They follow abc.lang
+ * where it has an equivalent.
+ */
+static const gchar * const style_ids [GABC_ABC_N_TOKEN_KINDS][3] = {
+  [GABC_ABC_TOKEN_COMMENT]      = { "def:comment", NULL },
+  [GABC_ABC_TOKEN_DIRECTIVE]    = { "def:preprocessor", "def:comment", NULL },
+  [GABC_ABC_TOKEN_FIELD]        = { "def:identifier", NULL },
+  [GABC_ABC_TOKEN_LYRICS]       = { "def:string", NULL },
+  [GABC_ABC_TOKEN_TEXT]         = { "def:string", NULL },
+  [GABC_ABC_TOKEN_NOTE]         = { "def:keyword", NULL },
+  [GABC_ABC_TOKEN_REST]         = { "def:keyword", NULL },
+  [GABC_ABC_TOKEN_BAR]          = { "def:shebang", "def:preprocessor", NULL },
+  [GABC_ABC_TOKEN_DECORATION]   = { "def:inline-code", "def:special-char", NULL },
+  [GABC_ABC_TOKEN_CHORD_SYMBOL] = { "def:string", NULL },
+  [GABC_ABC_TOKEN_ANNOTATION]   = { "def:comment", NULL },
+  [GABC_ABC_TOKEN_INLINE_FIELD] = { "def:identifier", NULL },
+  [GABC_ABC_TOKEN_TUPLET]       = { "def:special-char", "def:keyword", NULL },
+};
+
+static void gabc_highlighter_queue_update (GabcHighlighter *self);
+
+
+static void
+gabc_highlighter_update_styles (GabcHighlighter *self)
+{
+  GtkSourceStyleScheme *scheme;
+  guint kind;
+  guint i;
+
+  scheme = gtk_source_buffer_get_style_scheme (GTK_SOURCE_BUFFER (self->buffer));
+
+  for (kind = 0; kind < GABC_ABC_N_TOKEN_KINDS; kind++)
+    {
+      GtkSourceStyle *style = NULL;
+
+      for (i = 0; scheme != NULL && style == NULL && style_ids[kind][i] != NULL; i++)
+        style = gtk_source_style_scheme_get_style (scheme, style_ids[kind][i]);
+
+      gtk_source_style_apply (NULL, self->tags[kind]);
+      if (style != NULL)
+        gtk_source_style_apply (style, self->tags[kind]);
+    }
+}
+
+
+static void
+gabc_highlighter_style_scheme_cb (GtkSourceBuffer *buffer,
+                                  GParamSpec      *pspec,
+                                  GabcHighlighter *self)
+{
+  gabc_highlighter_update_styles (self);
+}
+
+
+static void
+gabc_highlighter_remove_tags (GabcHighlighter   *self,
+                              const GtkTextIter *start,
+                              const GtkTextIter *end)
+{
+  guint kind;
+
+  for (kind = 0; kind < GABC_ABC_N_TOKEN_KINDS; kind++)
+    gtk_text_buffer_remove_tag (self->buffer, self->tags[kind], start, end);
+}
+
+
+/*
+ * Mark the edited tunes from start to end as needing to be lexed again.
+ */
+static void
+gabc_highlighter_tunes_edited_cb (GabcTuneIndex   *tune_index,
+                                  GtkTextIter     *start,
+                                  GtkTextIter     *end,
+                                  GabcHighlighter *self)
+{
+  if (!self->enabled)
+    return;
+
+  gtk_source_region_add_subregion (self->invalid_region, start, end);
+  gabc_highlighter_queue_update (self);
+}
+
+
+static void
+gabc_highlighter_flush_token (highlight_line_data_t *data)
+{
+  GtkTextIter start;
+  GtkTextIter end;
+
+  if (data->kind < 0)
+    return;
+
+  start = data->line_start;
+  end = data->line_start;
+  gtk_text_iter_set_line_index (&start, data->start);
+  gtk_text_iter_set_line_index (&end, data->end);
+  gtk_text_buffer_apply_tag (data->highlighter->buffer, data->highlighter->tags[data->kind], &start, &end);
+
+  data->kind = -1;
+}
+
+
+/*
+ * Tokens of the same kind with only spaces between them go in as one tag,
+ * which saves a great many tags on music lines.
+ */
+static void
+gabc_highlighter_token_cb (GabcAbcTokenKind  kind,
+                           gsize             start,
+                           gsize             end,
+                           gpointer          user_data)
+{
+  highlight_line_data_t *data = user_data;
+  gsize i;
+
+  if (data->kind == (gint) kind)
+    {
+      for (i = data->end; i < start && data->line[i] == ' '; i++)
+        ;
+      if (i == start)
+        {
+          data->end = end;
+          return;
+        }
+    }
+
+  gabc_highlighter_flush_token (data);
+
+  data->kind = kind;
+  data->start = start;
+  data->end = end;
+}
+
+
+/*
+ * Lex and tag up to a block of lines from start (at the start of a line)
+ * towards limit.  start is moved on to where it stopped.
+ */
+static void
+gabc_highlighter_highlight_block (GabcHighlighter   *self,
+                                  GabcAbcLexer      *lexer,
+                                  GtkTextIter       *start,
+                                  const GtkTextIter *limit)
+{
+  highlight_line_data_t data = { self, NULL, { 0, }, -1, 0, 0 };
+  g_autofree gchar *text = NULL;
+  GtkTextIter block_end;
+  const gchar *line;
+
+  block_end = *start;
+  gtk_text_iter_forward_lines (&block_end, GABC_HIGHLIGHTER_BLOCK_LINES);
+  if (gtk_text_iter_compare (&block_end, limit) > 0)
+    {
+      block_end = *limit;
+      if (!gtk_text_iter_starts_line (&block_end))
+        gtk_text_iter_forward_line (&block_end);
+    }
+
+  gabc_highlighter_remove_tags (self, start, &block_end);
+
+  text = gtk_text_buffer_get_slice (self->buffer, start, &block_end, TRUE);
+  data.line_start = *start;
+
+  for (line = text; ; )
+    {
+      gsize length = strcspn (line, "\r\n");
+
+      data.line = line;
+      gabc_abc_lexer_lex_line (lexer, line, length, gabc_highlighter_token_cb, &data);
+      gabc_highlighter_flush_token (&data);
+
+      line += length;
+      if (*line == '\0')
+        break;
+      line += (line[0] == '\r' && line[1] == '\n') ? 2 : 1;
+      if (*line == '\0')
+        break;
+
+      gtk_text_iter_forward_line (&data.line_start);
+    }
+
+  *start = block_end;
+}
+
+
+/*
+ * Lex the first invalid block.  Returns FALSE if there was nothing to do.
+ */
+static gboolean
+gabc_highlighter_update_block (GabcHighlighter *self)
+{
+  GtkSourceRegionIter region_iter;
+  GtkTextIter start;
+  GtkTextIter end;
+  GtkTextIter resume;
+  GtkTextIter tune_start;
+  GabcAbcLexer lexer;
+
+  gtk_source_region_get_start_region_iter (self->invalid_region, &region_iter);
+  if (!gtk_source_region_iter_get_subregion (&region_iter, &start, &end))
+    return FALSE;
+
+  gtk_text_iter_set_line_offset (&start, 0);
+  gtk_text_buffer_get_iter_at_mark (self->buffer, &resume, self->resume_mark);
+
+  if (gtk_text_iter_equal (&start, &resume))
+    {
+      lexer = self->resume_lexer;
+    }
+  else
+    {
+      /*
+       * Back up to the start of the tune, where the lexer state is known,
+       * and take the lines in between along with the rest.
+       */
+      gabc_abc_lexer_init (&lexer);
+      gabc_tune_index_get_bounds_at_offset (self->tune_index,
+                                            gtk_text_iter_get_offset (&start),
+                                            &tune_start, NULL);
+
+      if (gtk_text_iter_compare (&tune_start, &start) < 0)
+        {
+          gtk_source_region_add_subregion (self->invalid_region, &tune_start, &start);
+          start = tune_start;
+        }
+    }
+
+  resume = start;
+  gabc_highlighter_highlight_block (self, &lexer, &resume, &end);
+
+  gtk_source_region_subtract_subregion (self->invalid_region, &start, &resume);
+  gtk_text_buffer_move_mark (self->buffer, self->resume_mark, &resume);
+  self->resume_lexer = lexer;
+
+  return TRUE;
+}
+
+
+static gboolean
+gabc_highlighter_update_cb (gpointer user_data)
+{
+  GabcHighlighter *self = GABC_HIGHLIGHTER (user_data);
+  gint64 deadline = g_get_monotonic_time () + GABC_HIGHLIGHTER_IDLE_BUDGET;
+
+  while (gabc_highlighter_update_block (self))
+    {
+      if (g_get_monotonic_time () >= deadline)
+        return G_SOURCE_CONTINUE;
+    }
+
+  self->idle_id = 0;
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+gabc_highlighter_queue_update (GabcHighlighter *self)
+{
+  if (self->idle_id == 0)
+    self->idle_id = g_idle_add (gabc_highlighter_update_cb, self);
+}
+
+
+static void
+gabc_highlighter_dispose (GObject *object)
+{
+  GabcHighlighter *self = GABC_HIGHLIGHTER (object);
+
+  g_clear_handle_id (&self->idle_id, g_source_remove);
+
+  if (self->buffer != NULL)
+    {
+      g_clear_signal_handler (&self->style_scheme_id, self->buffer);
+      if (self->resume_mark != NULL)
+        gtk_text_buffer_delete_mark (self->buffer, self->resume_mark);
+      g_object_remove_weak_pointer (G_OBJECT (self->buffer), (gpointer *) &self->buffer);
+      self->buffer = NULL;
+    }
+  self->resume_mark = NULL;
+
+  g_clear_object (&self->invalid_region);
+  g_clear_object (&self->tune_index);
+
+  G_OBJECT_CLASS (gabc_highlighter_parent_class)->dispose (object);
+}
+
+
+static void
+gabc_highlighter_class_init (GabcHighlighterClass *klass)
+{
+  G_OBJECT_CLASS (klass)->dispose = gabc_highlighter_dispose;
+}
+
+
+static void
+gabc_highlighter_init (GabcHighlighter *self)
+{
+  gabc_abc_lexer_init (&self->resume_lexer);
+}
+
+
+/*
+ * The highlighter starts disabled.  It keeps a weak reference to buffer,
+ * which would normally own it.
+ */
+GabcHighlighter *
+gabc_highlighter_new (GtkSourceBuffer *buffer,
+                      GabcTuneIndex   *tune_index)
+{
+  GabcHighlighter *self;
+  GtkTextIter start;
+  guint kind;
+
+  g_return_val_if_fail (GTK_SOURCE_IS_BUFFER (buffer), NULL);
+
+  self = g_object_new (GABC_TYPE_HIGHLIGHTER, NULL);
+  self->buffer = GTK_TEXT_BUFFER (buffer);
+  g_object_add_weak_pointer (G_OBJECT (buffer), (gpointer *) &self->buffer);
+  self->tune_index = g_object_ref (tune_index);
+
+  for (kind = 0; kind < GABC_ABC_N_TOKEN_KINDS; kind++)
+    {
+      g_autofree gchar *name = g_strconcat ("gabc-abc-", gabc_abc_token_kind_to_string (kind), NULL);
+
+      self->tags[kind] = gtk_text_buffer_create_tag (self->buffer, name, NULL);
+    }
+  gabc_highlighter_update_styles (self);
+
+  gtk_text_buffer_get_start_iter (self->buffer, &start);
+  self->resume_mark = gtk_text_buffer_create_mark (self->buffer, NULL, &start, TRUE);
+  self->invalid_region = gtk_source_region_new (self->buffer);
+
+  g_signal_connect_object (tune_index, "tunes-edited",
+                           G_CALLBACK (gabc_highlighter_tunes_edited_cb),
+                           self, 0);
+  self->style_scheme_id = g_signal_connect (buffer, "notify::style-scheme",
+                                            G_CALLBACK (gabc_highlighter_style_scheme_cb),
+                                            self);
+
+  return self;
+}
+
+
+/*
+ * Turning the highlighter on highlights the whole buffer in the
+ * background; turning it off removes its tags.
+ */
+void
+gabc_highlighter_set_enabled (GabcHighlighter *self,
+                              gboolean         enabled)
+{
+  GtkTextIter start;
+  GtkTextIter end;
+
+  g_return_if_fail (GABC_IS_HIGHLIGHTER (self));
+
+  enabled = !!enabled;
+  if (self->enabled == enabled)
+    return;
+
+  self->enabled = enabled;
+
+  gtk_text_buffer_get_bounds (self->buffer, &start, &end);
+  g_clear_object (&self->invalid_region);
+  self->invalid_region = gtk_source_region_new (self->buffer);
+  gtk_text_buffer_move_mark (self->buffer, self->resume_mark, &start);
+  gabc_abc_lexer_init (&self->resume_lexer);
+
+  if (enabled)
+    {
+      gtk_source_region_add_subregion (self->invalid_region, &start, &end);
+      gabc_highlighter_queue_update (self);
+    }
+  else
+    {
+      g_clear_handle_id (&self->idle_id, g_source_remove);
+      gabc_highlighter_remove_tags (self, &start, &end);
+    }
+}
+
+
+gboolean
+gabc_highlighter_get_enabled (GabcHighlighter *self)
+{
+  return self->enabled;
+}
+
+
+/*
+ * Bring the highlighting up to date from the start of the buffer up to
+ * at least end now, rather than waiting for the idle callback.
+ */
+void
+gabc_highlighter_ensure (GabcHighlighter   *self,
+                         const GtkTextIter *start,
+                         const GtkTextIter *end)
+{
+  GtkSourceRegionIter region_iter;
+  GtkTextIter subregion_start;
+
+  g_return_if_fail (GABC_IS_HIGHLIGHTER (self));
+
+  if (!self->enabled)
+    return;
+
+  for (;;)
+    {
+      gtk_source_region_get_start_region_iter (self->invalid_region, &region_iter);
+      if (!gtk_source_region_iter_get_subregion (&region_iter, &subregion_start, NULL) ||
+          gtk_text_iter_compare (&subregion_start, end) >= 0)
+        break;
+
+      gabc_highlighter_update_block (self);
+    }
+}
@@ -0,0 +1,45 @@
+/* gabc-highlighter.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <gtk/gtk.h>
+#include <gtksourceview/gtksource.h>
+
+#include "gabc-tune-index.h"
+
+G_BEGIN_DECLS
+
+#define GABC_TYPE_HIGHLIGHTER (gabc_highlighter_get_type())
+
+G_DECLARE_FINAL_TYPE (GabcHighlighter, gabc_highlighter, GABC, HIGHLIGHTER, GObject)
+
+GabcHighlighter          *gabc_highlighter_new                    (GtkSourceBuffer *buffer,
+                                                                   GabcTuneIndex   *tune_index);
+
+void                      gabc_highlighter_set_enabled            (GabcHighlighter *self,
+                                                                   gboolean         enabled);
+
+gboolean                  gabc_highlighter_get_enabled            (GabcHighlighter *self);
+
+void                      gabc_highlighter_ensure                 (GabcHighlighter   *self,
+                                                                   const GtkTextIter *start,
+                                                                   const GtkTextIter *end);
+
+G_END_DECLS
@@ -0,0 +1,198 @@
+/* gabc-line-map.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Maps lines of a generated file (the scratch file) back to the lines of
+ * the buffer they came from, so tool messages can be shown in the right
+ * place.
+ *
+ * The map is built as the file is written: the writer says where in the
+ * source it is, then how many lines it copied, inserted or skipped.  Runs
+ * of copied lines cost nothing, so a map only holds one segment for each
+ * jump, insertion or skip, not one per line.  Lines are counted from 0.
+ */
+
+#include "gabc-line-map.h"
+
+typedef struct {
+  guint output_start;
+  guint source_start;
+  gboolean inserted;     /* every line in the segment maps to source_start */
+} GabcLineMapSegment;
+
+struct _GabcLineMap
+{
+  GObject                       parent_instance;
+
+  GArray                       *segments;     /* sorted by output_start */
+  guint                         output_line;  /* next line to be written */
+  guint                         source_line;  /* next line to be read */
+};
+
+G_DEFINE_FINAL_TYPE (GabcLineMap, gabc_line_map, G_TYPE_OBJECT)
+
+
+static void
+gabc_line_map_finalize (GObject *object)
+{
+  GabcLineMap *self = GABC_LINE_MAP (object);
+
+  g_array_unref (self->segments);
+
+  G_OBJECT_CLASS (gabc_line_map_parent_class)->finalize (object);
+}
+
+
+static void
+gabc_line_map_class_init (GabcLineMapClass *klass)
+{
+  G_OBJECT_CLASS (klass)->finalize = gabc_line_map_finalize;
+}
+
+
+static void
+gabc_line_map_init (GabcLineMap *self)
+{
+  self->segments = g_array_new (FALSE, FALSE, sizeof (GabcLineMapSegment));
+}
+
+
+GabcLineMap *
+gabc_line_map_new (void)
+{
+  return g_object_new (GABC_TYPE_LINE_MAP, NULL);
+}
+
+
+void
+gabc_line_map_set_source_line (GabcLineMap *self,
+                               guint        source_line)
+{
+  self->source_line = source_line;
+}
+
+
+static void
+gabc_line_map_add_segment (GabcLineMap *self,
+                           guint        source_start,
+                           gboolean     inserted)
+{
+  GabcLineMapSegment segment = { self->output_line, source_start, inserted };
+
+  /* A segment that was never written to is replaced. */
+  if (self->segments->len > 0 &&
+      g_array_index (self->segments, GabcLineMapSegment, self->segments->len - 1).output_start == self->output_line)
+    g_array_index (self->segments, GabcLineMapSegment, self->segments->len - 1) = segment;
+  else
+    g_array_append_val (self->segments, segment);
+}
+
+
+/*
+ * n_lines lines were copied from the source to the output.
+ */
+void
+gabc_line_map_copy_lines (GabcLineMap *self,
+                          guint        n_lines)
+{
+  const GabcLineMapSegment *last = NULL;
+
+  if (n_lines == 0)
+    return;
+
+  if (self->segments->len > 0)
+    last = &g_array_index (self->segments, GabcLineMapSegment, self->segments->len - 1);
+
+  /* Extend the last segment if the copy carries straight on from it. */
+  if (last == NULL || last->inserted ||
+      last->source_start + (self->output_line - last->output_start) != self->source_line)
+    gabc_line_map_add_segment (self, self->source_line, FALSE);
+
+  self->output_line += n_lines;
+  self->source_line += n_lines;
+}
+
+
+/*
+ * n_lines lines that are not in the source were written.  They map to the
+ * source line before them.
+ */
+void
+gabc_line_map_insert_lines (GabcLineMap *self,
+                            guint        n_lines)
+{
+  if (n_lines == 0)
+    return;
+
+  gabc_line_map_add_segment (self, self->source_line > 0 ? self->source_line - 1 : 0, TRUE);
+  self->output_line += n_lines;
+}
+
+
+/*
+ * n_lines lines of the source were left out of the output.
+ */
+void
+gabc_line_map_skip_lines (GabcLineMap *self,
+                          guint        n_lines)
+{
+  self->source_line += n_lines;
+}
+
+
+/*
+ * Lines past the end of what was recorded carry on from the last segment,
+ * which covers a final line with no newline.  Returns FALSE if nothing has
+ * been recorded.
+ */
+gboolean
+gabc_line_map_lookup (GabcLineMap *self,
+                      guint        output_line,
+                      guint       *source_line)
+{
+  const GabcLineMapSegment *segment;
+  guint low = 0;
+  guint high = self->segments->len;
+
+  if (high == 0)
+    return FALSE;
+
+  /* Last segment starting at or before output_line. */
+  while (high - low > 1)
+    {
+      guint middle = low + (high - low) / 2;
+
+      if (g_array_index (self->segments, GabcLineMapSegment, middle).output_start <= output_line)
+        low = middle;
+      else
+        high = middle;
+    }
+
+  segment = &g_array_index (self->segments, GabcLineMapSegment, low);
+  if (output_line < segment->output_start)
+    return FALSE;
+
+  if (segment->inserted)
+    *source_line = segment->source_start;
+  else
+    *source_line = segment->source_start + (output_line - segment->output_start);
+
+  return TRUE;
+}
@@ -0,0 +1,48 @@
+/* gabc-line-map.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define GABC_TYPE_LINE_MAP (gabc_line_map_get_type())
+
+G_DECLARE_FINAL_TYPE (GabcLineMap, gabc_line_map, GABC, LINE_MAP, GObject)
+
+GabcLineMap              *gabc_line_map_new                       (void);
+
+void                      gabc_line_map_set_source_line           (GabcLineMap *self,
+                                                                   guint        source_line);
+
+void                      gabc_line_map_copy_lines                (GabcLineMap *self,
+                                                                   guint        n_lines);
+
+void                      gabc_line_map_insert_lines              (GabcLineMap *self,
+                                                                   guint        n_lines);
+
+void                      gabc_line_map_skip_lines                (GabcLineMap *self,
+                                                                   guint        n_lines);
+
+gboolean                  gabc_line_map_lookup                    (GabcLineMap *self,
+                                                                   guint        output_line,
+                                                                   guint       *source_line);
+
+G_END_DECLS
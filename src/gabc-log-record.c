@@ -0,0 +1,143 @@
+/* gabc-log-record.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * One line (or message) in the log.  Records are immutable once created.
+ */
+
+#include <string.h>
+
+#include "gabc-log-record.h"
+
+struct _GabcLogRecord
+{
+  GObject                       parent_instance;
+
+  gint64                        timestamp;    /* wall clock, microseconds */
+  gchar                        *tool;
+  guint                         job_id;
+  GabcLogSeverity               severity;
+  gchar                        *text;
+};
+
+G_DEFINE_FINAL_TYPE (GabcLogRecord, gabc_log_record, G_TYPE_OBJECT)
+
+
+static void
+gabc_log_record_finalize (GObject *object)
+{
+  GabcLogRecord *self = GABC_LOG_RECORD (object);
+
+  g_free (self->tool);
+  g_free (self->text);
+
+  G_OBJECT_CLASS (gabc_log_record_parent_class)->finalize (object);
+}
+
+
+static void
+gabc_log_record_class_init (GabcLogRecordClass *klass)
+{
+  G_OBJECT_CLASS (klass)->finalize = gabc_log_record_finalize;
+}
+
+
+static void
+gabc_log_record_init (GabcLogRecord *self)
+{
+}
+
+
+/*
+ * tool is NULL for gabc's own messages and job_id is 0 when the record
+ * does not come from a GabcRenderJob.
+ */
+GabcLogRecord *
+gabc_log_record_new (const gchar     *tool,
+                     guint            job_id,
+                     GabcLogSeverity  severity,
+                     const gchar     *text)
+{
+  GabcLogRecord *self;
+
+  self = g_object_new (GABC_TYPE_LOG_RECORD, NULL);
+  self->timestamp = g_get_real_time ();
+  self->tool = g_strdup (tool);
+  self->job_id = job_id;
+  self->severity = severity;
+  self->text = g_strdup (text != NULL ? text : "");
+
+  return self;
+}
+
+
+gint64
+gabc_log_record_get_timestamp (GabcLogRecord *self)
+{
+  return self->timestamp;
+}
+
+
+const gchar *
+gabc_log_record_get_tool (GabcLogRecord *self)
+{
+  return self->tool;
+}
+
+
+guint
+gabc_log_record_get_job_id (GabcLogRecord *self)
+{
+  return self->job_id;
+}
+
+
+GabcLogSeverity
+gabc_log_record_get_severity (GabcLogRecord *self)
+{
+  return self->severity;
+}
+
+
+const gchar *
+gabc_log_record_get_text (GabcLogRecord *self)
+{
+  return self->text;
+}
+
+
+/*
+ * Neither tool marks its output consistently, so go by the words abcm2ps
+ * and abc2midi put in front of their messages.
+ */
+GabcLogSeverity
+gabc_log_severity_from_text (const gchar *text)
+{
+  if (text == NULL)
+    return GABC_LOG_SEVERITY_INFO;
+
+  if (strstr (text, "Error") != NULL || strstr (text, "error") != NULL)
+    return GABC_LOG_SEVERITY_ERROR;
+
+  if (strstr (text, "Warning") != NULL || strstr (text, "warning") != NULL)
+    return GABC_LOG_SEVERITY_WARNING;
+
+  return GABC_LOG_SEVERITY_INFO;
+}
@@ -0,0 +1,53 @@
+/* gabc-log-record.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+  GABC_LOG_SEVERITY_INFO,
+  GABC_LOG_SEVERITY_WARNING,
+  GABC_LOG_SEVERITY_ERROR,
+} GabcLogSeverity;
+
+#define GABC_TYPE_LOG_RECORD (gabc_log_record_get_type())
+
+G_DECLARE_FINAL_TYPE (GabcLogRecord, gabc_log_record, GABC, LOG_RECORD, GObject)
+
+GabcLogRecord            *gabc_log_record_new                     (const gchar     *tool,
+                                                                   guint            job_id,
+                                                                   GabcLogSeverity  severity,
+                                                                   const gchar     *text);
+
+gint64                    gabc_log_record_get_timestamp           (GabcLogRecord *self);
+
+const gchar *             gabc_log_record_get_tool                (GabcLogRecord *self);
+
+guint                     gabc_log_record_get_job_id              (GabcLogRecord *self);
+
+GabcLogSeverity           gabc_log_record_get_severity            (GabcLogRecord *self);
+
+const gchar *             gabc_log_record_get_text                (GabcLogRecord *self);
+
+GabcLogSeverity           gabc_log_severity_from_text             (const gchar   *text);
+
+G_END_DECLS
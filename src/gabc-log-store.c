@@ -0,0 +1,212 @@
+/* gabc-log-store.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * The log, as a GListModel of GabcLogRecords.
+ *
+ * Records live in a ring buffer of fixed capacity.  Once it is full each
+ * new record replaces the oldest one, so appending costs the same and the
+ * log takes the same memory however long gabc has been running.  Item 0 is
+ * always the oldest record still held.
+ */
+
+#include "gabc-log-store.h"
+
+#define GABC_LOG_STORE_MIN_CAPACITY 16
+
+struct _GabcLogStore
+{
+  GObject                       parent_instance;
+
+  GabcLogRecord               **records;
+  guint                         capacity;
+  guint                         head;         /* index of the oldest record */
+  guint                         n_records;
+};
+
+static void gabc_log_store_list_model_init (GListModelInterface *iface);
+
+G_DEFINE_FINAL_TYPE_WITH_CODE (GabcLogStore, gabc_log_store, G_TYPE_OBJECT,
+                               G_IMPLEMENT_INTERFACE (G_TYPE_LIST_MODEL, gabc_log_store_list_model_init))
+
+
+static GType
+gabc_log_store_get_item_type (GListModel *list)
+{
+  return GABC_TYPE_LOG_RECORD;
+}
+
+
+static guint
+gabc_log_store_get_n_items (GListModel *list)
+{
+  return GABC_LOG_STORE (list)->n_records;
+}
+
+
+static gpointer
+gabc_log_store_get_item (GListModel *list,
+                         guint       position)
+{
+  GabcLogStore *self = GABC_LOG_STORE (list);
+
+  if (position >= self->n_records)
+    return NULL;
+
+  return g_object_ref (self->records[(self->head + position) % self->capacity]);
+}
+
+
+static void
+gabc_log_store_list_model_init (GListModelInterface *iface)
+{
+  iface->get_item_type = gabc_log_store_get_item_type;
+  iface->get_n_items = gabc_log_store_get_n_items;
+  iface->get_item = gabc_log_store_get_item;
+}
+
+
+/*
+ * Drop the n oldest records without telling anyone.
+ */
+static void
+gabc_log_store_drop_oldest (GabcLogStore *self,
+                            guint         n)
+{
+  while (n-- > 0 && self->n_records > 0)
+    {
+      g_clear_object (&self->records[self->head]);
+      self->head = (self->head + 1) % self->capacity;
+      self->n_records--;
+    }
+}
+
+
+static void
+gabc_log_store_finalize (GObject *object)
+{
+  GabcLogStore *self = GABC_LOG_STORE (object);
+
+  gabc_log_store_drop_oldest (self, self->n_records);
+  g_free (self->records);
+
+  G_OBJECT_CLASS (gabc_log_store_parent_class)->finalize (object);
+}
+
+
+static void
+gabc_log_store_class_init (GabcLogStoreClass *klass)
+{
+  G_OBJECT_CLASS (klass)->finalize = gabc_log_store_finalize;
+}
+
+
+static void
+gabc_log_store_init (GabcLogStore *self)
+{
+}
+
+
+GabcLogStore *
+gabc_log_store_new (guint capacity)
+{
+  GabcLogStore *self;
+
+  self = g_object_new (GABC_TYPE_LOG_STORE, NULL);
+  self->capacity = MAX (capacity, GABC_LOG_STORE_MIN_CAPACITY);
+  self->records = g_new0 (GabcLogRecord *, self->capacity);
+
+  return self;
+}
+
+
+void
+gabc_log_store_append (GabcLogStore    *self,
+                       const gchar     *tool,
+                       guint            job_id,
+                       GabcLogSeverity  severity,
+                       const gchar     *text)
+{
+  gboolean full = (self->n_records == self->capacity);
+
+  if (full)
+    gabc_log_store_drop_oldest (self, 1);
+
+  self->records[(self->head + self->n_records) % self->capacity] =
+    gabc_log_record_new (tool, job_id, severity, text);
+  self->n_records++;
+
+  if (full)
+    g_list_model_items_changed (G_LIST_MODEL (self), 0, 1, 0);
+  g_list_model_items_changed (G_LIST_MODEL (self), self->n_records - 1, 0, 1);
+}
+
+
+void
+gabc_log_store_clear (GabcLogStore *self)
+{
+  guint n_records = self->n_records;
+
+  gabc_log_store_drop_oldest (self, n_records);
+  self->head = 0;
+
+  if (n_records > 0)
+    g_list_model_items_changed (G_LIST_MODEL (self), 0, n_records, 0);
+}
+
+
+guint
+gabc_log_store_get_capacity (GabcLogStore *self)
+{
+  return self->capacity;
+}
+
+
+/*
+ * Shrinking drops the oldest records that no longer fit.
+ */
+void
+gabc_log_store_set_capacity (GabcLogStore *self,
+                             guint         capacity)
+{
+  GabcLogRecord **records;
+  guint n_dropped;
+  guint i;
+
+  capacity = MAX (capacity, GABC_LOG_STORE_MIN_CAPACITY);
+  if (capacity == self->capacity)
+    return;
+
+  n_dropped = self->n_records > capacity ? self->n_records - capacity : 0;
+  gabc_log_store_drop_oldest (self, n_dropped);
+
+  /* Unroll the ring into the new array, oldest first. */
+  records = g_new0 (GabcLogRecord *, capacity);
+  for (i = 0; i < self->n_records; i++)
+    records[i] = self->records[(self->head + i) % self->capacity];
+
+  g_free (self->records);
+  self->records = records;
+  self->capacity = capacity;
+  self->head = 0;
+
+  if (n_dropped > 0)
+    g_list_model_items_changed (G_LIST_MODEL (self), 0, n_dropped, 0);
+}
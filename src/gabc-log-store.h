@@ -0,0 +1,47 @@
+/* gabc-log-store.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <gio/gio.h>
+
+#include "gabc-log-record.h"
+
+G_BEGIN_DECLS
+
+#define GABC_TYPE_LOG_STORE (gabc_log_store_get_type())
+
+G_DECLARE_FINAL_TYPE (GabcLogStore, gabc_log_store, GABC, LOG_STORE, GObject)
+
+GabcLogStore             *gabc_log_store_new                      (guint            capacity);
+
+void                      gabc_log_store_append                   (GabcLogStore    *self,
+                                                                   const gchar     *tool,
+                                                                   guint            job_id,
+                                                                   GabcLogSeverity  severity,
+                                                                   const gchar     *text);
+
+void                      gabc_log_store_clear                    (GabcLogStore    *self);
+
+guint                     gabc_log_store_get_capacity             (GabcLogStore    *self);
+
+void                      gabc_log_store_set_capacity             (GabcLogStore    *self,
+                                                                   guint            capacity);
+
+G_END_DECLS
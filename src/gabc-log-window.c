@@ -2,51 +2,355 @@
 
 #include "gabc-window.h"
 #include "gabc-log-window.h"
+#include "gabc-log-store.h"
+#include "gabc-render-stats.h"
+
+/* How often the timings page refreshes while it is on screen, in seconds. */
+#define GABC_LOG_WINDOW_STATS_INTERVAL 1
 
 struct _GabcLogWindow
 {
   AdwWindow parent;
 
-  GtkTextBuffer *log_buffer;
+  AdwViewStack  *log_stack;
+  GtkListView   *log_list_view;
   GtkButton     *log_clear_button;
+  GtkButton     *stats_export_button;
+  GtkLabel      *stats_label;
 
+  GabcLogStore  *log_store;
+  GSettings     *settings;
+  guint          scroll_source_id;
+  guint          stats_source_id;
 };
 
 G_DEFINE_TYPE (GabcLogWindow, gabc_log_window, ADW_TYPE_WINDOW)
 
+
+/*
+ * Follow the end of the log, but only if the user hasn't scrolled back to
+ * read something.  Done from an idle so a burst of tool output scrolls once.
+ */
+static gboolean
+gabc_log_window_scroll_to_end (gpointer user_data)
+{
+  GabcLogWindow *self = GABC_LOG_WINDOW (user_data);
+  guint n_items;
+
+  self->scroll_source_id = 0;
+
+  n_items = g_list_model_get_n_items (G_LIST_MODEL (self->log_store));
+  if (n_items > 0)
+    gtk_list_view_scroll_to (self->log_list_view, n_items - 1, GTK_LIST_SCROLL_NONE, NULL);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+gabc_log_window_items_changed_cb (GListModel    *model,
+                                  guint          position,
+                                  guint          removed,
+                                  guint          added,
+                                  GabcLogWindow *self)
+{
+  GtkAdjustment *vadjustment;
+
+  if (added == 0 || self->scroll_source_id != 0)
+    return;
+
+  vadjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (self->log_list_view));
+  if (vadjustment != NULL &&
+      gtk_adjustment_get_value (vadjustment) + gtk_adjustment_get_page_size (vadjustment) <
+      gtk_adjustment_get_upper (vadjustment) - 1.0)
+    return;
+
+  self->scroll_source_id = g_idle_add (gabc_log_window_scroll_to_end, self);
+}
+
+
+void
+gabc_log_window_append_record (GabcLogWindow   *self,
+                               const gchar     *tool,
+                               guint            job_id,
+                               GabcLogSeverity  severity,
+                               const gchar     *text)
+{
+  g_autofree gchar *line = NULL;
+
+  if (text == NULL)
+    return;
+
+  line = g_strdup (text);
+  g_strchomp (line);
+  gabc_log_store_append (self->log_store, tool, job_id, severity, line);
+}
+
+
 void
 gabc_log_window_append_to_log (GabcLogWindow *self, char *text)
 {
-  if (text != NULL)
-  {
-    gtk_text_buffer_insert_at_cursor (self->log_buffer, text, -1);
-    gtk_text_buffer_insert_at_cursor (self->log_buffer, "\n", -1);
-  }
+  gabc_log_window_append_record (self, NULL, 0, gabc_log_severity_from_text (text), text);
+}
+
+/*
+ * TIMINGS
+ */
+static gchar *
+gabc_log_window_format_value (GabcRenderMetric metric,
+                              guint64          value)
+{
+  const gchar *unit = gabc_render_metric_get_unit (metric);
+
+  if (g_str_equal (unit, "us"))
+    return g_strdup_printf ("%.1f ms", value / 1000.0);
+  else if (g_str_equal (unit, "bytes"))
+    return g_format_size (value);
+  else if (g_str_equal (unit, "kB"))
+    return g_format_size (value * 1024);
+  else
+    return g_strdup_printf ("%" G_GUINT64_FORMAT, value);
 }
 
+
+static void
+gabc_log_window_update_stats (GabcLogWindow *self)
+{
+  GabcRenderStats *stats = gabc_render_stats_get_default ();
+  g_autoptr (GString) text = g_string_new (NULL);
+  const gdouble percentiles[] = { 50.0, 95.0, 99.0 };
+  guint metric;
+  guint i;
+
+  g_string_append_printf (text, "%-12s %7s %10s %10s %10s\n", "", "count", "p50", "p95", "p99");
+
+  for (metric = 0; metric < GABC_RENDER_N_METRICS; metric++)
+    {
+      g_string_append_printf (text, "%-12s %7u",
+                              gabc_render_metric_get_name (metric),
+                              gabc_render_stats_get_count (stats, metric));
+
+      for (i = 0; i < G_N_ELEMENTS (percentiles); i++)
+        {
+          g_autofree gchar *value = NULL;
+
+          value = gabc_log_window_format_value (metric, gabc_render_stats_get_percentile (stats, metric, percentiles[i]));
+          g_string_append_printf (text, " %10s", value);
+        }
+
+      g_string_append_c (text, '\n');
+    }
+
+  gtk_label_set_text (self->stats_label, text->str);
+}
+
+
+static gboolean
+gabc_log_window_stats_timeout_cb (gpointer user_data)
+{
+  gabc_log_window_update_stats (GABC_LOG_WINDOW (user_data));
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+static void
+gabc_log_window_export_stats_cb (GObject      *source_object,
+                                 GAsyncResult *result,
+                                 gpointer      user_data)
+{
+  GabcLogWindow *self = GABC_LOG_WINDOW (user_data);
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (GError) error = NULL;
+  g_autofree gchar *json = NULL;
+  g_autofree gchar *path = NULL;
+
+  file = gtk_file_dialog_save_finish (GTK_FILE_DIALOG (source_object), result, NULL);
+  if (file == NULL)
+    return;
+
+  json = gabc_render_stats_to_json (gabc_render_stats_get_default ());
+  path = g_file_get_path (file);
+  if (!g_file_set_contents (path, json, -1, &error))
+    gabc_log_window_append_record (self, NULL, 0, GABC_LOG_SEVERITY_ERROR, error->message);
+}
+
+
+static void
+gabc_log_window_export_stats (GtkButton     *button,
+                              GabcLogWindow *self)
+{
+  g_autoptr (GtkFileDialog) dialog = gtk_file_dialog_new ();
+
+  gtk_file_dialog_set_initial_name (dialog, "gabc-timings.json");
+  gtk_file_dialog_save (dialog,
+                        GTK_WINDOW (self),
+                        NULL,
+                        gabc_log_window_export_stats_cb,
+                        self);
+}
+
+
+/*
+ * The clear button clears whichever page is showing.
+ */
 static void
 gabc_log_window_clear_log (GtkWidget *widget,
                            gpointer   data)
 {
   GabcLogWindow *self = GABC_LOG_WINDOW (data);
   g_assert (GABC_IS_LOG_WINDOW (self));
-  gtk_text_buffer_set_text (self->log_buffer, "", -1);
+
+  if (g_strcmp0 (adw_view_stack_get_visible_child_name (self->log_stack), "timings") == 0)
+    {
+      gabc_render_stats_reset (gabc_render_stats_get_default ());
+      gabc_log_window_update_stats (self);
+      return;
+    }
+
+  gabc_log_store_clear (self->log_store);
+}
+
+
+static void
+gabc_log_window_map (GtkWidget *widget)
+{
+  GabcLogWindow *self = GABC_LOG_WINDOW (widget);
+
+  GTK_WIDGET_CLASS (gabc_log_window_parent_class)->map (widget);
+
+  gabc_log_window_update_stats (self);
+  self->stats_source_id = g_timeout_add_seconds (GABC_LOG_WINDOW_STATS_INTERVAL,
+                                                 gabc_log_window_stats_timeout_cb,
+                                                 self);
+}
+
+
+static void
+gabc_log_window_unmap (GtkWidget *widget)
+{
+  GabcLogWindow *self = GABC_LOG_WINDOW (widget);
+
+  g_clear_handle_id (&self->stats_source_id, g_source_remove);
+
+  GTK_WIDGET_CLASS (gabc_log_window_parent_class)->unmap (widget);
+}
+
+
+static void
+gabc_log_window_setup_row (GtkSignalListItemFactory *factory,
+                           GtkListItem              *list_item,
+                           gpointer                  user_data)
+{
+  GtkWidget *label;
+
+  label = gtk_label_new (NULL);
+  gtk_label_set_xalign (GTK_LABEL (label), 0.0);
+  gtk_label_set_wrap (GTK_LABEL (label), TRUE);
+  gtk_label_set_wrap_mode (GTK_LABEL (label), PANGO_WRAP_WORD_CHAR);
+  gtk_widget_add_css_class (label, "monospace");
+  gtk_widget_set_margin_start (label, 6);
+  gtk_widget_set_margin_end (label, 6);
+
+  gtk_list_item_set_child (list_item, label);
+}
+
+
+static void
+gabc_log_window_bind_row (GtkSignalListItemFactory *factory,
+                          GtkListItem              *list_item,
+                          gpointer                  user_data)
+{
+  GtkWidget *label = gtk_list_item_get_child (list_item);
+  GabcLogRecord *record = gtk_list_item_get_item (list_item);
+  g_autoptr (GDateTime) date_time = NULL;
+  g_autofree gchar *time_text = NULL;
+  g_autofree gchar *text = NULL;
+
+  date_time = g_date_time_new_from_unix_local (gabc_log_record_get_timestamp (record) / G_USEC_PER_SEC);
+  time_text = g_date_time_format (date_time, "%H:%M:%S");
+
+  if (gabc_log_record_get_tool (record) != NULL)
+    text = g_strdup_printf ("%s %s[%u] %s", time_text,
+                            gabc_log_record_get_tool (record),
+                            gabc_log_record_get_job_id (record),
+                            gabc_log_record_get_text (record));
+  else
+    text = g_strdup_printf ("%s %s", time_text, gabc_log_record_get_text (record));
+
+  gtk_label_set_text (GTK_LABEL (label), text);
+
+  gtk_widget_remove_css_class (label, "error");
+  gtk_widget_remove_css_class (label, "warning");
+  switch (gabc_log_record_get_severity (record))
+    {
+    case GABC_LOG_SEVERITY_ERROR:
+      gtk_widget_add_css_class (label, "error");
+      break;
+    case GABC_LOG_SEVERITY_WARNING:
+      gtk_widget_add_css_class (label, "warning");
+      break;
+    case GABC_LOG_SEVERITY_INFO:
+    default:
+      break;
+    }
+}
+
+
+static void
+gabc_log_window_max_records_changed_cb (GSettings     *settings,
+                                        const gchar   *key,
+                                        GabcLogWindow *self)
+{
+  gabc_log_store_set_capacity (self->log_store, g_settings_get_uint (settings, key));
 }
 
 
 static void
 gabc_log_window_init (GabcLogWindow *self)
 {
+  GtkListItemFactory *factory;
+  GtkSelectionModel *selection;
+
   gtk_widget_init_template (GTK_WIDGET (self));
 
+  self->settings = g_settings_new ("me.pm.m0dns.gabc");
+  self->log_store = gabc_log_store_new (g_settings_get_uint (self->settings, "log-max-records"));
+  g_signal_connect (self->settings, "changed::log-max-records",
+                    G_CALLBACK (gabc_log_window_max_records_changed_cb), self);
+
+  /* Only the rows on screen ever have widgets. */
+  factory = gtk_signal_list_item_factory_new ();
+  g_signal_connect (factory, "setup", G_CALLBACK (gabc_log_window_setup_row), NULL);
+  g_signal_connect (factory, "bind", G_CALLBACK (gabc_log_window_bind_row), NULL);
+  gtk_list_view_set_factory (self->log_list_view, factory);
+  g_object_unref (factory);
+
+  selection = GTK_SELECTION_MODEL (gtk_no_selection_new (g_object_ref (G_LIST_MODEL (self->log_store))));
+  gtk_list_view_set_model (self->log_list_view, selection);
+  g_object_unref (selection);
+
+  g_signal_connect (self->log_store, "items-changed", G_CALLBACK (gabc_log_window_items_changed_cb), self);
+
   g_signal_connect (self->log_clear_button, "clicked", G_CALLBACK (gabc_log_window_clear_log), self);
+  g_signal_connect (self->stats_export_button, "clicked", G_CALLBACK (gabc_log_window_export_stats), self);
 }
 
 static void
 gabc_log_window_dispose (GObject *gobject)
 {
+  GabcLogWindow *self = GABC_LOG_WINDOW (gobject);
+
+  g_clear_handle_id (&self->scroll_source_id, g_source_remove);
+  g_clear_handle_id (&self->stats_source_id, g_source_remove);
+
   gtk_widget_dispose_template (GTK_WIDGET (gobject), GABC_LOG_WINDOW_TYPE);
 
+  if (self->log_store != NULL)
+    g_signal_handlers_disconnect_by_data (self->log_store, self);
+  g_clear_object (&self->log_store);
+  g_clear_object (&self->settings);
+
   G_OBJECT_CLASS (gabc_log_window_parent_class)->dispose (gobject);
 }
 
@@ -58,16 +362,27 @@ gabc_log_window_class_init (GabcLogWindowClass *klass)
   G_OBJECT_CLASS (klass)->dispose = gabc_log_window_dispose;
 
   widget_class = GTK_WIDGET_CLASS (klass);
+  widget_class->map = gabc_log_window_map;
+  widget_class->unmap = gabc_log_window_unmap;
 
   gtk_widget_class_set_template_from_resource (widget_class,
                                                "/me/pm/m0dns/gabc/gabc-log-window.ui");
 
   gtk_widget_class_bind_template_child (widget_class,
                                         GabcLogWindow,
-                                        log_buffer);
+                                        log_list_view);
   gtk_widget_class_bind_template_child (widget_class,
                                         GabcLogWindow,
                                         log_clear_button);
+  gtk_widget_class_bind_template_child (widget_class,
+                                        GabcLogWindow,
+                                        log_stack);
+  gtk_widget_class_bind_template_child (widget_class,
+                                        GabcLogWindow,
+                                        stats_export_button);
+  gtk_widget_class_bind_template_child (widget_class,
+                                        GabcLogWindow,
+                                        stats_label);
 
 }
 
@@ -5,6 +5,8 @@
 #include <gtk/gtk.h>
 #include <adwaita.h>
 
+#include "gabc-log-record.h"
+
 G_BEGIN_DECLS
 
 #define GABC_LOG_WINDOW_TYPE (gabc_log_window_get_type ())
@@ -16,4 +18,11 @@ GabcLogWindow        *gabc_log_window_new          (AdwApplicationWindow *win);
 void
 gabc_log_window_append_to_log (GabcLogWindow *self, gchar *text);
 
+void
+gabc_log_window_append_record (GabcLogWindow   *self,
+                               const gchar     *tool,
+                               guint            job_id,
+                               GabcLogSeverity  severity,
+                               const gchar     *text);
+
 G_END_DECLS
@@ -0,0 +1,499 @@
+/* gabc-melody.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Melodies reduced to what a player recognises a tune by: the rise and fall
+ * between its notes.
+ *
+ * Pitches are worked out the way abc defines them, from the note letter,
+ * octave marks, the key signature and any accidentals earlier in the bar,
+ * then only the differences between them are kept.  That makes every tune
+ * its own canonical key: the same tune in G and in A gives the same
+ * intervals, so it doesn't matter how its K: field is written or whether
+ * it is right.
+ */
+
+#include <string.h>
+
+#include "gabc-melody.h"
+
+#define GABC_MELODY_MAX_INTERVAL 12
+#define GABC_MELODY_NO_ACCIDENTAL G_MAXINT8
+#define GABC_MELODY_PADDING       G_MAXINT8
+
+static const gchar letters [] = "CDEFGAB";
+
+/* Semitones above C of each letter C to B. */
+static const gint8 naturals [7] = { 0, 2, 4, 5, 7, 9, 11 };
+
+
+static gint
+gabc_melody_letter_index (gchar letter)
+{
+  const gchar *p = strchr (letters, g_ascii_toupper (letter));
+
+  return (p != NULL && letter != '\0') ? p - letters : -1;
+}
+
+
+/*
+ * Sharps (positive) or flats (negative) in the signature of a mode,
+ * from its name in a K: field.
+ */
+static gint
+gabc_melody_mode_offset (const gchar *mode)
+{
+  static const struct {
+    const gchar *name;
+    gint         offset;
+  } modes [] = {
+    { "maj", 0 }, { "ion", 0 }, { "min", -3 }, { "aeo", -3 },
+    { "mix", -1 }, { "dor", -2 }, { "phr", -4 }, { "lyd", 1 }, { "loc", -5 },
+  };
+  guint i;
+
+  if ((mode[0] == 'm' || mode[0] == 'M') && !g_ascii_isalpha (mode[1]))
+    return -3;
+
+  for (i = 0; i < G_N_ELEMENTS (modes); i++)
+    if (g_ascii_strncasecmp (mode, modes[i].name, 3) == 0)
+      return modes[i].offset;
+
+  return 0;
+}
+
+
+/*
+ * Read the tonic and mode from the value of a K: field ("D", "Ador",
+ * "Bb minor").  letter is 0 to 6 for C to B, accidental is -1, 0 or 1, and
+ * sharps is the number of sharps (negative for flats) in the signature.
+ * end is set to just past the tonic.  Returns FALSE if there is no tonic,
+ * as in "none", "HP" or "clef=bass".
+ */
+gboolean
+gabc_melody_parse_key (const gchar  *key,
+                       gint         *letter,
+                       gint         *accidental,
+                       gint         *sharps,
+                       const gchar **end)
+{
+  /* Major key signatures of each letter. */
+  static const gint8 major_sharps [7] = { 0, 2, 4, -1, 1, 3, 5 };
+  const gchar *p = key;
+  gint tonic;
+  gint tonic_accidental = 0;
+
+  while (*p == ' ')
+    p++;
+
+  tonic = gabc_melody_letter_index (*p);
+  if (tonic < 0 || g_ascii_islower (*p))
+    return FALSE;
+  p++;
+
+  if (*p == '#' || *p == 'b')
+    {
+      tonic_accidental = (*p == '#') ? 1 : -1;
+      p++;
+    }
+
+  if (letter != NULL)
+    *letter = tonic;
+  if (accidental != NULL)
+    *accidental = tonic_accidental;
+  if (end != NULL)
+    *end = p;
+
+  while (*p == ' ')
+    p++;
+  if (sharps != NULL)
+    *sharps = CLAMP (major_sharps[tonic] + 7 * tonic_accidental + gabc_melody_mode_offset (p), -7, 7);
+
+  return TRUE;
+}
+
+
+/*
+ * Set the key signature from the value of a K: field ("D", "Ador",
+ * "Bb minor", "G exp ^f").  Anything unrecognised is C major.
+ */
+void
+gabc_melody_set_key (GabcMelody  *melody,
+                     const gchar *key)
+{
+  /* The order sharps are added. */
+  static const gint8 sharp_order [7] = { 3, 0, 4, 1, 5, 2, 6 };
+  const gchar *p = key;
+  gint sharps;
+  gint i;
+
+  memset (melody->key, 0, sizeof (melody->key));
+
+  if (key == NULL)
+    return;
+
+  while (*p == ' ')
+    p++;
+
+  /* Highland pipes: "HP" has no signature, "Hp" is written with one. */
+  if (p[0] == 'H' && p[1] == 'p')
+    {
+      melody->key[3] = 1;
+      melody->key[0] = 1;
+      return;
+    }
+
+  if (!gabc_melody_parse_key (p, NULL, NULL, &sharps, &p))
+    return;
+
+  for (i = 0; i < ABS (sharps); i++)
+    {
+      if (sharps > 0)
+        melody->key[sharp_order[i]] = 1;
+      else
+        melody->key[sharp_order[6 - i]] = -1;
+    }
+
+  /* Explicit accidentals, as in "K:D exp ^f" or "K:Ador =f". */
+  for (; *p != '\0'; p++)
+    {
+      gint accidental;
+      gint letter;
+
+      if (*p != '^' && *p != '_' && *p != '=')
+        continue;
+
+      accidental = (*p == '^') ? 1 : (*p == '_') ? -1 : 0;
+      if (p[1] == p[0] && *p != '=')
+        {
+          accidental *= 2;
+          p++;
+        }
+
+      letter = gabc_melody_letter_index (p[1]);
+      if (letter >= 0)
+        melody->key[letter] = accidental;
+    }
+}
+
+
+void
+gabc_melody_init (GabcMelody  *melody,
+                  const gchar *key)
+{
+  memset (melody, 0, sizeof (GabcMelody));
+  memset (melody->bar, GABC_MELODY_NO_ACCIDENTAL, sizeof (melody->bar));
+  melody->previous = -1;
+  gabc_melody_set_key (melody, key);
+}
+
+
+gboolean
+gabc_melody_is_full (const GabcMelody *melody)
+{
+  return melody->n_intervals == GABC_MELODY_MAX_INTERVALS;
+}
+
+
+static void
+gabc_melody_add_pitch (GabcMelody *melody,
+                       gint        pitch)
+{
+  gint interval;
+
+  if (melody->previous >= 0 && !gabc_melody_is_full (melody))
+    {
+      interval = CLAMP (pitch - melody->previous, -GABC_MELODY_MAX_INTERVAL, GABC_MELODY_MAX_INTERVAL);
+      if (interval != 0)
+        melody->intervals[melody->n_intervals++] = interval;
+    }
+
+  melody->previous = pitch;
+}
+
+
+/*
+ * The MIDI pitch of a note token (optional accidentals, a letter, octave
+ * marks and a length), taking the key signature and any accidentals earlier
+ * in the bar into account and recording its own.  Returns -1 for a token
+ * that isn't a note, such as a chord bracket or a bare length.  If
+ * length_start is not NULL, the offset of the note's length is stored there.
+ */
+gint
+gabc_melody_get_pitch (GabcMelody  *melody,
+                       const gchar *text,
+                       gsize        length,
+                       gsize       *length_start)
+{
+  gint accidental = 0;
+  gboolean explicit_accidental = FALSE;
+  gint natural;
+  gint letter;
+  gsize i = 0;
+
+  for (; i < length && (text[i] == '^' || text[i] == '_' || text[i] == '='); i++)
+    {
+      accidental += (text[i] == '^') ? 1 : (text[i] == '_') ? -1 : 0;
+      explicit_accidental = TRUE;
+    }
+
+  /* A bare length, as in "A3/2" split at the slash. */
+  if (i >= length || (letter = gabc_melody_letter_index (text[i])) < 0)
+    return -1;
+
+  natural = (g_ascii_islower (text[i]) ? 72 : 60) + naturals[letter];
+  for (i++; i < length; i++)
+    {
+      if (text[i] == '\'')
+        natural += 12;
+      else if (text[i] == ',')
+        natural -= 12;
+      else
+        break;
+    }
+  natural = CLAMP (natural, 0, 127);
+
+  if (length_start != NULL)
+    *length_start = i;
+
+  if (explicit_accidental)
+    melody->bar[natural] = accidental;
+  else if (melody->bar[natural] != GABC_MELODY_NO_ACCIDENTAL)
+    accidental = melody->bar[natural];
+  else
+    accidental = melody->key[letter];
+
+  return CLAMP (natural + accidental, 0, 127);
+}
+
+
+/*
+ * text is a note token.  Only the first note of a chord is taken as the
+ * melody.
+ */
+static void
+gabc_melody_add_note (GabcMelody  *melody,
+                      const gchar *text,
+                      gsize        length)
+{
+  gint pitch;
+
+  if (text[0] == '[')
+    {
+      melody->in_chord = TRUE;
+      melody->chord_note_seen = FALSE;
+      return;
+    }
+  if (text[0] == ']')
+    {
+      melody->in_chord = FALSE;
+      return;
+    }
+
+  pitch = gabc_melody_get_pitch (melody, text, length, NULL);
+  if (pitch < 0)
+    return;
+
+  if (melody->in_chord)
+    {
+      if (melody->chord_note_seen)
+        return;
+      melody->chord_note_seen = TRUE;
+    }
+
+  gabc_melody_add_pitch (melody, pitch);
+}
+
+
+/*
+ * Feed one token from GabcAbcLexer.  K: fields, inline or not, change the
+ * key from there on.
+ */
+void
+gabc_melody_add_token (GabcMelody       *melody,
+                       GabcAbcTokenKind  kind,
+                       const gchar      *text,
+                       gsize             length)
+{
+  g_autofree gchar *key = NULL;
+
+  switch (kind)
+    {
+    case GABC_ABC_TOKEN_NOTE:
+      gabc_melody_add_note (melody, text, length);
+      break;
+
+    case GABC_ABC_TOKEN_BAR:
+      memset (melody->bar, GABC_MELODY_NO_ACCIDENTAL, sizeof (melody->bar));
+      break;
+
+    case GABC_ABC_TOKEN_FIELD:
+      if (length >= 2 && text[0] == 'K' && text[1] == ':')
+        {
+          key = g_strndup (text + 2, length - 2);
+          gabc_melody_set_key (melody, key);
+        }
+      break;
+
+    case GABC_ABC_TOKEN_INLINE_FIELD:
+      if (length >= 4 && text[1] == 'K')
+        {
+          key = g_strndup (text + 3, length - 4);
+          gabc_melody_set_key (melody, key);
+        }
+      break;
+
+    case GABC_ABC_TOKEN_COMMENT:
+    case GABC_ABC_TOKEN_DIRECTIVE:
+    case GABC_ABC_TOKEN_LYRICS:
+    case GABC_ABC_TOKEN_TEXT:
+    case GABC_ABC_TOKEN_REST:
+    case GABC_ABC_TOKEN_DECORATION:
+    case GABC_ABC_TOKEN_CHORD_SYMBOL:
+    case GABC_ABC_TOKEN_ANNOTATION:
+    case GABC_ABC_TOKEN_TUPLET:
+    case GABC_ABC_N_TOKEN_KINDS:
+    default:
+      break;
+    }
+}
+
+
+typedef struct {
+  GabcMelody  *melody;
+  const gchar *line;
+} melody_text_data_t;
+
+
+static void
+gabc_melody_token_cb (GabcAbcTokenKind  kind,
+                      gsize             start,
+                      gsize             end,
+                      gpointer          user_data)
+{
+  melody_text_data_t *data = user_data;
+
+  gabc_melody_add_token (data->melody, kind, data->line + start, end - start);
+}
+
+
+/*
+ * Add the notes in a piece of abc, such as a selection in the editor.  It
+ * is read as tune body unless it has its own X: line.
+ */
+void
+gabc_melody_add_text (GabcMelody  *melody,
+                      const gchar *text,
+                      gssize       length)
+{
+  const gchar *end;
+  const gchar *line;
+  melody_text_data_t data;
+  GabcAbcLexer lexer;
+
+  if (length < 0)
+    length = strlen (text);
+  end = text + length;
+
+  gabc_abc_lexer_init (&lexer);
+  lexer.section = GABC_ABC_LEXER_TUNE_BODY;
+  data.melody = melody;
+
+  for (line = text; line < end && !gabc_melody_is_full (melody); )
+    {
+      const gchar *line_end = memchr (line, '\n', end - line);
+      const gchar *next = (line_end != NULL) ? line_end + 1 : end;
+      gsize line_length;
+
+      if (line_end == NULL)
+        line_end = end;
+      line_length = line_end - line;
+      if (line_length > 0 && line[line_length - 1] == '\r')
+        line_length--;
+
+      data.line = line;
+      gabc_abc_lexer_lex_line (&lexer, line, line_length, gabc_melody_token_cb, &data);
+      line = next;
+    }
+}
+
+
+/*
+ * The GABC_MELODY_NGRAM intervals from position as letters, 'a' for an
+ * octave down to 'y' for an octave up, followed by a nul.
+ */
+void
+gabc_melody_get_ngram (const GabcMelody *melody,
+                       guint             position,
+                       gchar            *ngram)
+{
+  guint i;
+
+  g_return_if_fail (position + GABC_MELODY_NGRAM <= melody->n_intervals);
+
+  for (i = 0; i < GABC_MELODY_NGRAM; i++)
+    ngram[i] = 'a' + GABC_MELODY_MAX_INTERVAL + melody->intervals[position + i];
+  ngram[GABC_MELODY_NGRAM] = '\0';
+}
+
+
+/*
+ * How many of the query's intervals line up with intervals, with the query
+ * slid along to wherever it fits best; the earliest such place is stored
+ * in offset.  The inner loop compares whole fixed size arrays, which
+ * compilers turn into a handful of vector instructions, so scoring
+ * thousands of candidates takes well under a millisecond.
+ */
+guint
+gabc_melody_score (const GabcMelody *query,
+                   const gint8      *intervals,
+                   guint             n_intervals,
+                   guint            *offset)
+{
+  /* Past its end the query is 0 and this is padding, so neither matches. */
+  gint8 padded [2 * GABC_MELODY_MAX_INTERVALS];
+  guint best = 0;
+  guint best_offset = 0;
+  guint o;
+  guint i;
+
+  n_intervals = MIN (n_intervals, GABC_MELODY_MAX_INTERVALS);
+  memcpy (padded, intervals, n_intervals);
+  memset (padded + n_intervals, GABC_MELODY_PADDING, sizeof (padded) - n_intervals);
+
+  for (o = 0; o < n_intervals && n_intervals - o > best; o++)
+    {
+      guint matches = 0;
+
+      for (i = 0; i < GABC_MELODY_MAX_INTERVALS; i++)
+        matches += (query->intervals[i] == padded[o + i]);
+
+      if (matches > best)
+        {
+          best = matches;
+          best_offset = o;
+        }
+    }
+
+  if (offset != NULL)
+    *offset = best_offset;
+
+  return best;
+}
@@ -0,0 +1,87 @@
+/* gabc-melody.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <glib.h>
+
+#include "gabc-abc-lexer.h"
+
+G_BEGIN_DECLS
+
+/* Intervals kept for a melody, and in each n-gram of the melody index. */
+#define GABC_MELODY_MAX_INTERVALS 64
+#define GABC_MELODY_NGRAM         4
+
+/*
+ * The start of a melody as the intervals between its notes, in semitones
+ * clamped to an octave either way.  Repeated notes are dropped, so the
+ * intervals are never 0 and a tune reads the same in any key and whether
+ * a note is played as a crotchet or two quavers.
+ *
+ * Intervals past n_intervals are 0 so whole arrays can be compared.
+ */
+typedef struct {
+  gint8     key [7];                  /* accidental of each letter C to B */
+  gint8     bar [128];                /* accidentals set in the bar, by natural pitch */
+  gint      previous;                 /* pitch of the last note, or -1 */
+  gboolean  in_chord;
+  gboolean  chord_note_seen;
+  guint     n_intervals;
+  gint8     intervals [GABC_MELODY_MAX_INTERVALS];
+} GabcMelody;
+
+void                      gabc_melody_init                        (GabcMelody       *melody,
+                                                                   const gchar      *key);
+
+gboolean                  gabc_melody_parse_key                   (const gchar      *key,
+                                                                   gint             *letter,
+                                                                   gint             *accidental,
+                                                                   gint             *sharps,
+                                                                   const gchar     **end);
+
+void                      gabc_melody_set_key                     (GabcMelody       *melody,
+                                                                   const gchar      *key);
+
+gint                      gabc_melody_get_pitch                   (GabcMelody       *melody,
+                                                                   const gchar      *text,
+                                                                   gsize             length,
+                                                                   gsize            *length_start);
+
+void                      gabc_melody_add_token                   (GabcMelody       *melody,
+                                                                   GabcAbcTokenKind  kind,
+                                                                   const gchar      *text,
+                                                                   gsize             length);
+
+void                      gabc_melody_add_text                    (GabcMelody       *melody,
+                                                                   const gchar      *text,
+                                                                   gssize            length);
+
+gboolean                  gabc_melody_is_full                     (const GabcMelody *melody);
+
+void                      gabc_melody_get_ngram                   (const GabcMelody *melody,
+                                                                   guint             position,
+                                                                   gchar            *ngram);
+
+guint                     gabc_melody_score                       (const GabcMelody *query,
+                                                                   const gint8      *intervals,
+                                                                   guint             n_intervals,
+                                                                   guint            *offset);
+
+G_END_DECLS
@@ -0,0 +1,449 @@
+/* gabc-midi-sequence.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * abc turned into MIDI note events for the built-in player.
+ *
+ * Each tune in the text is parsed with gabc_abc_tune_parse (), which has
+ * already worked out pitches with the key signature and accidentals and
+ * note lengths with broken rhythm, tuplets and chords.  Its elements are
+ * turned into items (notes, chords, rests and bar lines) timed at the
+ * tempo in force, and the items are then played out in order, following
+ * repeats and numbered endings, as note on and note off events.
+ *
+ * This is the part of abc that matters for hearing a tune while editing
+ * it: note lengths, broken rhythm, tuplets, chords, ties, rests, repeats
+ * and endings, and the K:, L:, M:, Q: and V: fields, inline or not.  Grace
+ * notes, decorations, chord symbols and %%MIDI directives are left out and
+ * only the first voice of a tune is played.
+ */
+
+#include <string.h>
+
+#include "gabc-abc-parser.h"
+#include "gabc-midi-sequence.h"
+
+#define GABC_MIDI_SEQUENCE_MAX_CHORD     8
+#define GABC_MIDI_SEQUENCE_DEFAULT_BPM   120.0     /* crotchets a minute */
+#define GABC_MIDI_SEQUENCE_ARTICULATION  0.9       /* of a note's length sounded */
+#define GABC_MIDI_SEQUENCE_VELOCITY      80
+#define GABC_MIDI_SEQUENCE_ACCENT        100       /* the first note of a bar */
+
+typedef enum {
+  GABC_MIDI_ITEM_NOTES,                /* a note, a chord or a rest */
+  GABC_MIDI_ITEM_BAR,
+  GABC_MIDI_ITEM_TUNE,                 /* an X: line */
+} GabcMidiItemKind;
+
+typedef struct {
+  GabcMidiItemKind  kind;
+  guint             offset;
+  gdouble           duration;          /* microseconds */
+  guint8            n_pitches;         /* 0 for a rest */
+  guint8            pitches [GABC_MIDI_SEQUENCE_MAX_CHORD];
+  gboolean          tied;
+  gboolean          accent;
+  gboolean          start_repeat;
+  gboolean          end_repeat;
+  guint             endings;           /* bit n set for an ending numbered n */
+} GabcMidiItem;
+
+
+/*
+ * "1/4=120", "\"Allegro\" 1/4=120" or the old "120"; the parser has
+ * already worked out the beat.
+ */
+static gdouble
+gabc_midi_sequence_get_whole_note (const GabcAbcTune    *tune,
+                                   const GabcAbcElement *element,
+                                   gdouble               whole_note)
+{
+  const gchar *value = gabc_abc_tune_get_string (tune, element) + 2;
+  const gchar *equals = strchr (value, '=');
+  gdouble bpm;
+
+  bpm = g_ascii_strtod (equals != NULL ? equals + 1 : value, NULL);
+  if (bpm <= 0 || element->duration == 0)
+    return whole_note;
+
+  return 60.0 * G_USEC_PER_SEC * GABC_ABC_TICKS_PER_WHOLE / (bpm * element->duration);
+}
+
+
+/*
+ * Turn the elements of one tune into items.  Only notes that start
+ * between from and to get an item, but everything before from still
+ * counts for the tempo.
+ */
+static void
+gabc_midi_sequence_add_tune (GArray            *items,
+                             const GabcAbcTune *tune,
+                             gsize              base,
+                             gsize              from,
+                             gsize              to)
+{
+  GabcMidiItem tune_item = { GABC_MIDI_ITEM_TUNE, base, };
+  gdouble whole_note = 60.0 * G_USEC_PER_SEC / (GABC_MIDI_SEQUENCE_DEFAULT_BPM / 4);
+  gboolean bar_start = TRUE;
+  guint voice = 0;
+  guint i;
+
+  g_array_append_val (items, tune_item);
+
+  for (i = 0; i < tune->n_elements; i++)
+    {
+      const GabcAbcElement *element = &tune->elements[i];
+      GabcMidiItem item = { GABC_MIDI_ITEM_NOTES, base + element->offset, };
+      gboolean in_range = item.offset >= from && item.offset < to;
+      guint j;
+
+      switch ((GabcAbcElementKind) element->kind)
+        {
+        case GABC_ABC_ELEMENT_FIELD:
+          if (gabc_abc_tune_get_string (tune, element)[0] == 'Q')
+            whole_note = gabc_midi_sequence_get_whole_note (tune, element, whole_note);
+          continue;
+
+        case GABC_ABC_ELEMENT_VOICE:
+          voice = element->data.voice;
+          continue;
+
+        case GABC_ABC_ELEMENT_NOTE:
+          if (element->flags & (GABC_ABC_ELEMENT_GRACE | GABC_ABC_ELEMENT_IN_CHORD))
+            continue;
+          item.n_pitches = 1;
+          item.pitches[0] = element->data.note.pitch;
+          item.tied = (element->flags & GABC_ABC_ELEMENT_TIED) != 0;
+          break;
+
+        case GABC_ABC_ELEMENT_CHORD:
+          if (element->flags & GABC_ABC_ELEMENT_GRACE)
+            continue;
+          item.tied = (element->flags & GABC_ABC_ELEMENT_TIED) != 0;
+          for (j = 1; j <= element->data.n_notes && i + j < tune->n_elements; j++)
+            {
+              const GabcAbcElement *note = &tune->elements[i + j];
+
+              if (note->kind != GABC_ABC_ELEMENT_NOTE || !(note->flags & GABC_ABC_ELEMENT_IN_CHORD))
+                break;
+              if (item.n_pitches < GABC_MIDI_SEQUENCE_MAX_CHORD)
+                item.pitches[item.n_pitches++] = note->data.note.pitch;
+              if (note->flags & GABC_ABC_ELEMENT_TIED)
+                item.tied = TRUE;
+            }
+          break;
+
+        case GABC_ABC_ELEMENT_REST:
+          break;
+
+        case GABC_ABC_ELEMENT_BAR:
+          bar_start = TRUE;
+          if (voice != 0 || !in_range)
+            continue;
+          item.kind = GABC_MIDI_ITEM_BAR;
+          item.start_repeat = (element->data.bar.flags & GABC_ABC_BAR_START_REPEAT) != 0;
+          item.end_repeat = (element->data.bar.flags & GABC_ABC_BAR_END_REPEAT) != 0;
+          item.endings = element->data.bar.endings;
+          g_array_append_val (items, item);
+          continue;
+
+        case GABC_ABC_ELEMENT_TUPLET:
+        case GABC_ABC_ELEMENT_DECORATION:
+        case GABC_ABC_ELEMENT_CHORD_SYMBOL:
+        case GABC_ABC_ELEMENT_ANNOTATION:
+        case GABC_ABC_ELEMENT_LYRICS:
+        case GABC_ABC_ELEMENT_DIRECTIVE:
+        case GABC_ABC_ELEMENT_SLUR_START:
+        case GABC_ABC_ELEMENT_SLUR_END:
+        case GABC_ABC_N_ELEMENT_KINDS:
+        default:
+          continue;
+        }
+
+      if (voice != 0)
+        continue;
+
+      item.duration = element->duration * whole_note / GABC_ABC_TICKS_PER_WHOLE;
+      item.accent = bar_start;
+      bar_start = FALSE;
+
+      if (in_range)
+        g_array_append_val (items, item);
+    }
+}
+
+
+static void
+gabc_midi_sequence_add_event (GabcMidiSequence  *sequence,
+                              gdouble            time,
+                              GabcMidiEventType  type,
+                              guint8             pitch,
+                              guint8             velocity,
+                              guint              offset)
+{
+  GabcMidiEvent event = { (gint64) (time + 0.5), type, pitch, velocity, offset };
+
+  g_array_append_val (sequence->events, event);
+}
+
+
+static void
+gabc_midi_sequence_release (GabcMidiSequence *sequence,
+                            gboolean         *held,
+                            const guint8     *keep,
+                            guint             n_keep,
+                            gdouble           time,
+                            guint             offset)
+{
+  guint pitch;
+
+  for (pitch = 0; pitch < 128; pitch++)
+    if (held[pitch] && (n_keep == 0 || memchr (keep, pitch, n_keep) == NULL))
+      {
+        gabc_midi_sequence_add_event (sequence, time, GABC_MIDI_NOTE_OFF, pitch, 0, offset);
+        held[pitch] = FALSE;
+      }
+}
+
+
+static void
+gabc_midi_sequence_play_notes (GabcMidiSequence   *sequence,
+                               const GabcMidiItem *item,
+                               gboolean           *held,
+                               gdouble             time)
+{
+  guint8 velocity = item->accent ? GABC_MIDI_SEQUENCE_ACCENT : GABC_MIDI_SEQUENCE_VELOCITY;
+  guint i;
+
+  /* Tied notes carry on into this one if it has the same pitch. */
+  gabc_midi_sequence_release (sequence, held, item->pitches, item->n_pitches, time, item->offset);
+
+  for (i = 0; i < item->n_pitches; i++)
+    {
+      guint8 pitch = item->pitches[i];
+
+      if (!held[pitch])
+        gabc_midi_sequence_add_event (sequence, time, GABC_MIDI_NOTE_ON, pitch, velocity, item->offset);
+
+      held[pitch] = item->tied;
+      if (!item->tied)
+        gabc_midi_sequence_add_event (sequence, time + item->duration * GABC_MIDI_SEQUENCE_ARTICULATION,
+                                      GABC_MIDI_NOTE_OFF, pitch, 0, item->offset);
+    }
+}
+
+
+/*
+ * Walk the items in playing order.  A repeat goes back once to the last
+ * start repeat, or to the end of the last repeated section.  Bars with
+ * ending numbers that don't match the time through are skipped up to the
+ * next ending or repeat sign.
+ */
+static void
+gabc_midi_sequence_play_items (GabcMidiSequence *sequence,
+                               GArray           *items)
+{
+  gboolean held [128] = { FALSE, };
+  guint repeat_start = 0;
+  gboolean repeated = FALSE;
+  gboolean skipping = FALSE;
+  guint pass = 1;
+  gdouble time = 0;
+  guint i = 0;
+
+  while (i < items->len)
+    {
+      const GabcMidiItem *item = &g_array_index (items, GabcMidiItem, i);
+
+      switch (item->kind)
+        {
+        case GABC_MIDI_ITEM_TUNE:
+          gabc_midi_sequence_release (sequence, held, NULL, 0, time, item->offset);
+          repeat_start = i + 1;
+          repeated = FALSE;
+          skipping = FALSE;
+          pass = 1;
+          break;
+
+        case GABC_MIDI_ITEM_BAR:
+          if (skipping && ((item->endings & (1u << pass)) != 0 || item->start_repeat || item->end_repeat))
+            skipping = FALSE;
+          if (skipping)
+            break;
+
+          if (item->end_repeat && !repeated)
+            {
+              i = repeat_start;
+              repeated = TRUE;
+              pass = 2;
+              continue;
+            }
+
+          if (item->endings != 0 && (item->endings & (1u << pass)) == 0)
+            skipping = TRUE;
+
+          if (item->end_repeat)
+            {
+              repeat_start = i + 1;
+              repeated = FALSE;
+              pass = 1;
+            }
+          if (item->start_repeat)
+            {
+              repeat_start = i + 1;
+              repeated = FALSE;
+              pass = 1;
+            }
+          break;
+
+        case GABC_MIDI_ITEM_NOTES:
+          if (skipping)
+            break;
+          gabc_midi_sequence_play_notes (sequence, item, held, time);
+          time += item->duration;
+          break;
+
+        default:
+          g_assert_not_reached ();
+        }
+
+      i++;
+    }
+
+  gabc_midi_sequence_release (sequence, held, NULL, 0, time, 0);
+  sequence->duration = (gint64) time;
+}
+
+
+static gint
+gabc_midi_sequence_compare_events (gconstpointer a,
+                                   gconstpointer b)
+{
+  const GabcMidiEvent *event_a = a;
+  const GabcMidiEvent *event_b = b;
+
+  if (event_a->time != event_b->time)
+    return (event_a->time > event_b->time) - (event_a->time < event_b->time);
+
+  /* Notes end before the next ones start. */
+  if (event_a->type != event_b->type)
+    return event_a->type == GABC_MIDI_NOTE_OFF ? -1 : 1;
+
+  return (event_a->offset > event_b->offset) - (event_a->offset < event_b->offset);
+}
+
+
+static GabcMidiSequence *
+gabc_midi_sequence_new_from_items (GArray *items)
+{
+  GabcMidiSequence *sequence;
+
+  sequence = g_new0 (GabcMidiSequence, 1);
+  sequence->events = g_array_new (FALSE, FALSE, sizeof (GabcMidiEvent));
+  gabc_midi_sequence_play_items (sequence, items);
+  g_array_sort (sequence->events, gabc_midi_sequence_compare_events);
+
+  return sequence;
+}
+
+
+/*
+ * Build the sequence for the notes of text that start between from and to,
+ * which are byte offsets; pass 0 and length for all of it.  Everything
+ * before from still counts for the key, lengths and tempo, so playback can
+ * start at the cursor or loop over a selection.  Text without an X: line
+ * is read as tune body; otherwise anything before the first X: is the file
+ * header and is left out.
+ */
+GabcMidiSequence *
+gabc_midi_sequence_new (const gchar *text,
+                        gsize        length,
+                        gsize        from,
+                        gsize        to)
+{
+  g_autoptr (GArray) items = NULL;
+  const gchar *end = text + length;
+  const gchar *tune_start;
+  const gchar *line;
+  gboolean has_tunes;
+
+  has_tunes = (length >= 2 && text[0] == 'X' && text[1] == ':') ||
+              g_strstr_len (text, length, "\nX:") != NULL;
+
+  items = g_array_new (FALSE, FALSE, sizeof (GabcMidiItem));
+
+  /* Split the text at each X: line and parse the tunes one by one. */
+  for (tune_start = line = text; line <= end; )
+    {
+      const gchar *line_end = memchr (line, '\n', end - line);
+
+      if (line == end || (line > tune_start && end - line >= 2 && line[0] == 'X' && line[1] == ':'))
+        {
+          if (!has_tunes || (tune_start[0] == 'X' && tune_start[1] == ':'))
+            {
+              g_autoptr (GabcAbcTune) tune = gabc_abc_tune_parse (tune_start, line - tune_start);
+
+              gabc_midi_sequence_add_tune (items, tune, tune_start - text, from, to);
+            }
+          tune_start = line;
+        }
+
+      if (line == end)
+        break;
+      line = (line_end != NULL) ? line_end + 1 : end;
+    }
+
+  return gabc_midi_sequence_new_from_items (items);
+}
+
+
+/*
+ * The same for tunes that have already been parsed, which follow one
+ * another in the text.  from and to count bytes from the start of the
+ * first tune, as do the offsets of the events.
+ */
+GabcMidiSequence *
+gabc_midi_sequence_new_for_tunes (const GabcAbcTune * const *tunes,
+                                  guint                      n_tunes,
+                                  gsize                      from,
+                                  gsize                      to)
+{
+  g_autoptr (GArray) items = NULL;
+  gsize base = 0;
+  guint i;
+
+  items = g_array_new (FALSE, FALSE, sizeof (GabcMidiItem));
+
+  for (i = 0; i < n_tunes; i++)
+    {
+      gabc_midi_sequence_add_tune (items, tunes[i], base, from, to);
+      base += tunes[i]->length;
+    }
+
+  return gabc_midi_sequence_new_from_items (items);
+}
+
+
+void
+gabc_midi_sequence_free (GabcMidiSequence *sequence)
+{
+  g_array_unref (sequence->events);
+  g_free (sequence);
+}
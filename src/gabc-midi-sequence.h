@@ -0,0 +1,68 @@
+/* gabc-midi-sequence.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <glib.h>
+
+#include "gabc-abc-parser.h"
+
+G_BEGIN_DECLS
+
+typedef enum {
+  GABC_MIDI_NOTE_OFF = 0x80,
+  GABC_MIDI_NOTE_ON  = 0x90,
+} GabcMidiEventType;
+
+/*
+ * offset is the byte offset of the note's token in the text the sequence
+ * was built from, so playback can be followed in the editor.
+ */
+typedef struct {
+  gint64    time;                     /* microseconds from the start */
+  guint8    type;
+  guint8    pitch;
+  guint8    velocity;
+  guint     offset;
+} GabcMidiEvent;
+
+/*
+ * The notes of some abc as timed MIDI note events, sorted by time, with
+ * repeats played out.  duration runs to the end of the last note or rest.
+ */
+typedef struct {
+  GArray   *events;                   /* GabcMidiEvent */
+  gint64    duration;
+} GabcMidiSequence;
+
+GabcMidiSequence         *gabc_midi_sequence_new                  (const gchar      *text,
+                                                                   gsize             length,
+                                                                   gsize             from,
+                                                                   gsize             to);
+
+GabcMidiSequence         *gabc_midi_sequence_new_for_tunes        (const GabcAbcTune * const *tunes,
+                                                                   guint                      n_tunes,
+                                                                   gsize                      from,
+                                                                   gsize                      to);
+
+void                      gabc_midi_sequence_free                 (GabcMidiSequence *sequence);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GabcMidiSequence, gabc_midi_sequence_free)
+
+G_END_DECLS
@@ -0,0 +1,945 @@
+/* gabc-page-view.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Scrolling view of engraved pages, drawn from rasterised copies.
+ *
+ * The pages are the SVG files abcm2ps writes with -v, one per page.  Each
+ * is known by a checksum of its contents, so after a new engrave only the
+ * pages that came out differently are drawn again; the rest are found in
+ * the cache as they were.  Pages are rasterised on worker threads at the
+ * current zoom and screen scale: those on screen first, then
+ * GABC_PAGE_VIEW_PREFETCH pages either side so paging on finds them ready.
+ * Pages further away are not rasterised at all.
+ *
+ * Rasters are kept in a least recently used cache of at most
+ * GABC_PAGE_VIEW_CACHE_SIZE bytes.  Until its raster at the new zoom (or its
+ * new content) arrives, a page is drawn from the raster it had, scaled, or
+ * as a blank sheet, so zooming and re-engraving never flash.
+ *
+ * The view scrolls itself (GtkScrollable) and only draws what is on screen,
+ * so a long tunebook costs no more to scroll than a short one.
+ */
+
+#include <math.h>
+
+#include "gabc-page-view.h"
+
+#define GABC_PAGE_VIEW_PREFETCH 2
+#define GABC_PAGE_VIEW_CACHE_SIZE (256 * 1024 * 1024)
+#define GABC_PAGE_VIEW_SPACING 12
+#define GABC_PAGE_VIEW_MIN_ZOOM 0.25
+#define GABC_PAGE_VIEW_MAX_ZOOM 4.0
+#define GABC_PAGE_VIEW_ZOOM_STEP 1.1
+
+typedef struct {
+  gchar        *path;
+  gchar        *checksum;     /* of the file's contents */
+  gint          width;        /* at zoom 1 */
+  gint          height;
+  gdouble       y;            /* top edge at the current zoom */
+  GdkTexture   *texture;      /* raster being drawn, only kept near the view */
+  gint          texture_width;/* its width if it is current, else 0 */
+} GabcPageViewPage;
+
+typedef struct {
+  gchar        *key;          /* <checksum>@<width> */
+  GdkTexture   *texture;
+  gsize         size;
+} GabcPageViewEntry;
+
+typedef struct {
+  gchar        *path;
+  gchar        *key;
+  gint          width;
+  gint          height;
+} GabcPageViewRaster;
+
+struct _GabcPageView
+{
+  GtkWidget                     parent_instance;
+
+  GtkAdjustment                *hadjustment;
+  GtkAdjustment                *vadjustment;
+  guint                         hscroll_policy : 1;
+  guint                         vscroll_policy : 1;
+
+  GPtrArray                    *pages;        /* GabcPageViewPage */
+  gdouble                       zoom;
+  gdouble                       content_width;
+  gdouble                       content_height;
+
+  GCancellable                 *load_cancellable;    /* of the pages being read */
+  GCancellable                 *raster_cancellable;  /* only cancelled on dispose */
+
+  GQueue                        lru;          /* GabcPageViewEntry, most recently used at the head */
+  GHashTable                   *entries;      /* key -> GList link in lru */
+  gsize                         cache_size;
+
+  GQueue                        wanted;       /* GabcPageViewRaster not started yet, most wanted first */
+  GHashTable                   *in_flight;    /* keys being rasterised */
+  GHashTable                   *failed;       /* paths that could not be rasterised */
+  guint                         n_running;
+  guint                         max_running;
+};
+
+G_DEFINE_FINAL_TYPE_WITH_CODE (GabcPageView, gabc_page_view, GTK_TYPE_WIDGET,
+                               G_IMPLEMENT_INTERFACE (GTK_TYPE_SCROLLABLE, NULL))
+
+enum {
+  PROP_0,
+  PROP_ZOOM,
+  PROP_N_PAGES,
+  N_PROPS,
+
+  /* GtkScrollable */
+  PROP_HADJUSTMENT = N_PROPS,
+  PROP_VADJUSTMENT,
+  PROP_HSCROLL_POLICY,
+  PROP_VSCROLL_POLICY
+};
+
+static GParamSpec *properties [N_PROPS];
+
+static void gabc_page_view_update (GabcPageView *self);
+
+
+static void
+gabc_page_view_page_free (GabcPageViewPage *page)
+{
+  g_free (page->path);
+  g_free (page->checksum);
+  g_clear_object (&page->texture);
+  g_free (page);
+}
+
+
+static void
+gabc_page_view_entry_free (GabcPageViewEntry *entry)
+{
+  g_free (entry->key);
+  g_object_unref (entry->texture);
+  g_free (entry);
+}
+
+
+static void
+gabc_page_view_raster_free (GabcPageViewRaster *raster)
+{
+  g_free (raster->path);
+  g_free (raster->key);
+  g_free (raster);
+}
+
+
+/*
+ * THE CACHE
+ */
+static GdkTexture *
+gabc_page_view_cache_lookup (GabcPageView *self,
+                             const gchar  *key)
+{
+  GList *link = g_hash_table_lookup (self->entries, key);
+
+  if (link == NULL)
+    return NULL;
+
+  g_queue_unlink (&self->lru, link);
+  g_queue_push_head_link (&self->lru, link);
+
+  return ((GabcPageViewEntry *) link->data)->texture;
+}
+
+
+static void
+gabc_page_view_cache_insert (GabcPageView *self,
+                             const gchar  *key,
+                             GdkTexture   *texture)
+{
+  GabcPageViewEntry *entry;
+
+  if (g_hash_table_contains (self->entries, key))
+    return;
+
+  entry = g_new0 (GabcPageViewEntry, 1);
+  entry->key = g_strdup (key);
+  entry->texture = g_object_ref (texture);
+  entry->size = (gsize) gdk_texture_get_width (texture) * gdk_texture_get_height (texture) * 4;
+
+  g_queue_push_head (&self->lru, entry);
+  g_hash_table_insert (self->entries, entry->key, self->lru.head);
+  self->cache_size += entry->size;
+
+  /* Pages being drawn hold their own reference, so they stay up. */
+  while (self->cache_size > GABC_PAGE_VIEW_CACHE_SIZE && self->lru.length > 1)
+    {
+      GabcPageViewEntry *oldest = g_queue_pop_tail (&self->lru);
+
+      g_hash_table_remove (self->entries, oldest->key);
+      self->cache_size -= oldest->size;
+      gabc_page_view_entry_free (oldest);
+    }
+}
+
+
+/*
+ * RASTERISING
+ */
+static gint
+gabc_page_view_get_raster_width (GabcPageView     *self,
+                                 GabcPageViewPage *page)
+{
+  return (gint) ceil (page->width * self->zoom * gtk_widget_get_scale_factor (GTK_WIDGET (self)));
+}
+
+
+static void
+gabc_page_view_raster_thread (GTask        *task,
+                              gpointer      source_object,
+                              gpointer      task_data,
+                              GCancellable *cancellable)
+{
+  GabcPageViewRaster *raster = task_data;
+  g_autoptr (GdkPixbuf) pixbuf = NULL;
+  g_autoptr (GdkPixbuf) paper = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  GError *error = NULL;
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  pixbuf = gdk_pixbuf_new_from_file_at_scale (raster->path, raster->width, raster->height, FALSE, &error);
+  if (pixbuf == NULL)
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  /* abcm2ps leaves the paper transparent. */
+  paper = gdk_pixbuf_composite_color_simple (pixbuf,
+                                             gdk_pixbuf_get_width (pixbuf),
+                                             gdk_pixbuf_get_height (pixbuf),
+                                             GDK_INTERP_NEAREST, 255, 8,
+                                             0xffffffff, 0xffffffff);
+  bytes = gdk_pixbuf_read_pixel_bytes (paper);
+
+  g_task_return_pointer (task,
+                         gdk_memory_texture_new (gdk_pixbuf_get_width (paper),
+                                                 gdk_pixbuf_get_height (paper),
+                                                 gdk_pixbuf_get_has_alpha (paper) ? GDK_MEMORY_R8G8B8A8
+                                                                                  : GDK_MEMORY_R8G8B8,
+                                                 bytes,
+                                                 gdk_pixbuf_get_rowstride (paper)),
+                         g_object_unref);
+}
+
+
+static void
+gabc_page_view_raster_cb (GObject      *source_object,
+                          GAsyncResult *result,
+                          gpointer      user_data)
+{
+  GabcPageView *self = GABC_PAGE_VIEW (source_object);
+  GabcPageViewRaster *raster = g_task_get_task_data (G_TASK (result));
+  g_autoptr (GdkTexture) texture = NULL;
+  g_autoptr (GError) error = NULL;
+
+  texture = g_task_propagate_pointer (G_TASK (result), &error);
+
+  /* The view has been disposed of. */
+  if (g_cancellable_is_cancelled (self->raster_cancellable))
+    return;
+
+  self->n_running--;
+  g_hash_table_remove (self->in_flight, raster->key);
+
+  if (texture != NULL)
+    gabc_page_view_cache_insert (self, raster->key, texture);
+  else
+    g_hash_table_add (self->failed, g_strdup (raster->path));
+
+  gabc_page_view_update (self);
+}
+
+
+static void
+gabc_page_view_start_rasters (GabcPageView *self)
+{
+  GabcPageViewRaster *raster;
+
+  while (self->n_running < self->max_running &&
+         (raster = g_queue_pop_head (&self->wanted)) != NULL)
+    {
+      g_autoptr (GTask) task = NULL;
+
+      /* Two pages can come out the same, blank ones say. */
+      if (g_hash_table_contains (self->in_flight, raster->key))
+        {
+          gabc_page_view_raster_free (raster);
+          continue;
+        }
+
+      g_hash_table_add (self->in_flight, g_strdup (raster->key));
+      self->n_running++;
+
+      task = g_task_new (self, self->raster_cancellable, gabc_page_view_raster_cb, NULL);
+      g_task_set_source_tag (task, gabc_page_view_start_rasters);
+      g_task_set_task_data (task, raster, (GDestroyNotify) gabc_page_view_raster_free);
+      g_task_run_in_thread (task, gabc_page_view_raster_thread);
+    }
+}
+
+
+/*
+ * Draw the page from the cache if it is there, or ask for it.
+ */
+static void
+gabc_page_view_want_page (GabcPageView     *self,
+                          GabcPageViewPage *page)
+{
+  GabcPageViewRaster *raster;
+  GdkTexture *texture;
+  g_autofree gchar *key = NULL;
+  gint width = gabc_page_view_get_raster_width (self, page);
+
+  if (page->texture != NULL && page->texture_width == width)
+    return;
+
+  key = g_strdup_printf ("%s@%d", page->checksum, width);
+
+  texture = gabc_page_view_cache_lookup (self, key);
+  if (texture != NULL)
+    {
+      g_set_object (&page->texture, texture);
+      page->texture_width = width;
+      gtk_widget_queue_draw (GTK_WIDGET (self));
+      return;
+    }
+
+  if (g_hash_table_contains (self->in_flight, key) || g_hash_table_contains (self->failed, page->path))
+    return;
+
+  raster = g_new0 (GabcPageViewRaster, 1);
+  raster->path = g_strdup (page->path);
+  raster->key = g_steal_pointer (&key);
+  raster->width = width;
+  raster->height = (gint) ceil (page->height * self->zoom * gtk_widget_get_scale_factor (GTK_WIDGET (self)));
+  g_queue_push_tail (&self->wanted, raster);
+}
+
+
+/*
+ * Work out which pages are on screen and rasterise those, then the pages
+ * around them.  Rasters of pages further away are let go; the cache still
+ * has them.  Called whenever the view scrolls, zooms or gets new pages.
+ */
+static void
+gabc_page_view_update (GabcPageView *self)
+{
+  gdouble top;
+  gdouble bottom;
+  guint first;
+  guint last;
+  guint start;
+  guint end;
+  guint i;
+
+  g_queue_clear_full (&self->wanted, (GDestroyNotify) gabc_page_view_raster_free);
+
+  if (self->pages->len == 0)
+    return;
+
+  top = self->vadjustment != NULL ? gtk_adjustment_get_value (self->vadjustment) : 0;
+  bottom = top + gtk_widget_get_height (GTK_WIDGET (self));
+
+  for (first = 0; first + 1 < self->pages->len; first++)
+    {
+      GabcPageViewPage *page = g_ptr_array_index (self->pages, first);
+
+      if (page->y + page->height * self->zoom >= top)
+        break;
+    }
+
+  for (last = first; last + 1 < self->pages->len; last++)
+    {
+      GabcPageViewPage *page = g_ptr_array_index (self->pages, last + 1);
+
+      if (page->y > bottom)
+        break;
+    }
+
+  start = first > GABC_PAGE_VIEW_PREFETCH ? first - GABC_PAGE_VIEW_PREFETCH : 0;
+  end = MIN (last + GABC_PAGE_VIEW_PREFETCH, self->pages->len - 1);
+
+  for (i = 0; i < self->pages->len; i++)
+    {
+      GabcPageViewPage *page = g_ptr_array_index (self->pages, i);
+
+      if (i < start || i > end)
+        g_clear_object (&page->texture);
+    }
+
+  /* On screen first, then the pages below, which is the usual way to go. */
+  for (i = first; i <= end; i++)
+    gabc_page_view_want_page (self, g_ptr_array_index (self->pages, i));
+  for (i = first; i-- > start; )
+    gabc_page_view_want_page (self, g_ptr_array_index (self->pages, i));
+
+  gabc_page_view_start_rasters (self);
+}
+
+
+/*
+ * LAYOUT AND SCROLLING
+ */
+static void
+gabc_page_view_layout (GabcPageView *self)
+{
+  gdouble y = GABC_PAGE_VIEW_SPACING;
+  gdouble width = 0;
+  guint i;
+
+  for (i = 0; i < self->pages->len; i++)
+    {
+      GabcPageViewPage *page = g_ptr_array_index (self->pages, i);
+
+      page->y = y;
+      y += page->height * self->zoom + GABC_PAGE_VIEW_SPACING;
+      width = MAX (width, page->width * self->zoom);
+    }
+
+  self->content_width = width + 2 * GABC_PAGE_VIEW_SPACING;
+  self->content_height = y;
+}
+
+
+static void
+gabc_page_view_configure_adjustment (GtkAdjustment *adjustment,
+                                     gdouble        content_size,
+                                     gint           view_size)
+{
+  gdouble upper = MAX (content_size, view_size);
+
+  if (adjustment == NULL)
+    return;
+
+  gtk_adjustment_configure (adjustment,
+                            CLAMP (gtk_adjustment_get_value (adjustment), 0, upper - view_size),
+                            0,
+                            upper,
+                            view_size * 0.1,
+                            view_size * 0.9,
+                            view_size);
+}
+
+
+static void
+gabc_page_view_configure_adjustments (GabcPageView *self)
+{
+  gabc_page_view_configure_adjustment (self->hadjustment, self->content_width,
+                                       gtk_widget_get_width (GTK_WIDGET (self)));
+  gabc_page_view_configure_adjustment (self->vadjustment, self->content_height,
+                                       gtk_widget_get_height (GTK_WIDGET (self)));
+}
+
+
+static void
+gabc_page_view_adjustment_value_changed_cb (GtkAdjustment *adjustment,
+                                            GabcPageView  *self)
+{
+  gtk_widget_queue_draw (GTK_WIDGET (self));
+  gabc_page_view_update (self);
+}
+
+
+static void
+gabc_page_view_set_adjustment (GabcPageView   *self,
+                               GtkAdjustment **adjustment_pointer,
+                               GtkAdjustment  *adjustment)
+{
+  if (adjustment == *adjustment_pointer)
+    return;
+
+  if (*adjustment_pointer != NULL)
+    {
+      g_signal_handlers_disconnect_by_data (*adjustment_pointer, self);
+      g_clear_object (adjustment_pointer);
+    }
+
+  if (adjustment == NULL)
+    adjustment = gtk_adjustment_new (0, 0, 0, 0, 0, 0);
+
+  *adjustment_pointer = g_object_ref_sink (adjustment);
+  g_signal_connect (adjustment, "value-changed",
+                    G_CALLBACK (gabc_page_view_adjustment_value_changed_cb), self);
+
+  gabc_page_view_configure_adjustments (self);
+}
+
+
+static gboolean
+gabc_page_view_scroll_cb (GtkEventControllerScroll *controller,
+                          gdouble                   dx,
+                          gdouble                   dy,
+                          GabcPageView             *self)
+{
+  GdkModifierType state = gtk_event_controller_get_current_event_state (GTK_EVENT_CONTROLLER (controller));
+
+  /* Ctrl+scroll zooms, everything else scrolls as usual. */
+  if (!(state & GDK_CONTROL_MASK) || dy == 0)
+    return FALSE;
+
+  gabc_page_view_set_zoom (self, dy < 0 ? self->zoom * GABC_PAGE_VIEW_ZOOM_STEP
+                                        : self->zoom / GABC_PAGE_VIEW_ZOOM_STEP);
+  return TRUE;
+}
+
+
+static void
+gabc_page_view_scale_factor_changed_cb (GabcPageView *self,
+                                        GParamSpec   *pspec,
+                                        gpointer      user_data)
+{
+  gabc_page_view_update (self);
+}
+
+
+/*
+ * LOADING PAGES
+ */
+static void
+gabc_page_view_load_thread (GTask        *task,
+                            gpointer      source_object,
+                            gpointer      task_data,
+                            GCancellable *cancellable)
+{
+  const gchar * const *paths = task_data;
+  g_autoptr (GPtrArray) pages = NULL;
+  guint i;
+
+  pages = g_ptr_array_new_with_free_func ((GDestroyNotify) gabc_page_view_page_free);
+
+  for (i = 0; paths[i] != NULL; i++)
+    {
+      GabcPageViewPage *page;
+      g_autofree gchar *contents = NULL;
+      GError *error = NULL;
+      gsize length;
+
+      if (g_task_return_error_if_cancelled (task))
+        return;
+
+      if (!g_file_get_contents (paths[i], &contents, &length, &error))
+        {
+          g_task_return_error (task, error);
+          return;
+        }
+
+      page = g_new0 (GabcPageViewPage, 1);
+      page->path = g_strdup (paths[i]);
+      page->checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA1, (const guchar *) contents, length);
+      g_ptr_array_add (pages, page);
+
+      if (gdk_pixbuf_get_file_info (paths[i], &page->width, &page->height) == NULL)
+        {
+          g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                                   "Could not read the size of page %s", paths[i]);
+          return;
+        }
+    }
+
+  g_task_return_pointer (task, g_steal_pointer (&pages), (GDestroyNotify) g_ptr_array_unref);
+}
+
+
+static void
+gabc_page_view_load_cb (GObject      *source_object,
+                        GAsyncResult *result,
+                        gpointer      user_data)
+{
+  GabcPageView *self = GABC_PAGE_VIEW (source_object);
+  g_autoptr (GPtrArray) pages = NULL;
+  g_autoptr (GError) error = NULL;
+  guint i;
+
+  pages = g_task_propagate_pointer (G_TASK (result), &error);
+
+  /* Superseded by newer pages, or the view has gone. */
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return;
+
+  g_clear_object (&self->load_cancellable);
+
+  if (pages == NULL)
+    {
+      g_warning ("%s", error->message);
+      pages = g_ptr_array_new_with_free_func ((GDestroyNotify) gabc_page_view_page_free);
+    }
+
+  /* Until their own come in, changed pages show what was there before. */
+  for (i = 0; i < MIN (pages->len, self->pages->len); i++)
+    {
+      GabcPageViewPage *page = g_ptr_array_index (pages, i);
+      GabcPageViewPage *old_page = g_ptr_array_index (self->pages, i);
+
+      page->texture = g_steal_pointer (&old_page->texture);
+    }
+
+  g_ptr_array_unref (self->pages);
+  self->pages = g_steal_pointer (&pages);
+  g_hash_table_remove_all (self->failed);
+
+  gabc_page_view_layout (self);
+  gabc_page_view_configure_adjustments (self);
+  gtk_widget_queue_resize (GTK_WIDGET (self));
+  gabc_page_view_update (self);
+
+  g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_N_PAGES]);
+}
+
+
+/*
+ * GTKWIDGET
+ */
+static void
+gabc_page_view_measure (GtkWidget      *widget,
+                        GtkOrientation  orientation,
+                        gint            for_size,
+                        gint           *minimum,
+                        gint           *natural,
+                        gint           *minimum_baseline,
+                        gint           *natural_baseline)
+{
+  GabcPageView *self = GABC_PAGE_VIEW (widget);
+
+  *minimum = 0;
+  *natural = (gint) ceil (orientation == GTK_ORIENTATION_HORIZONTAL ? self->content_width
+                                                                    : self->content_height);
+}
+
+
+static void
+gabc_page_view_size_allocate (GtkWidget *widget,
+                              gint       width,
+                              gint       height,
+                              gint       baseline)
+{
+  GabcPageView *self = GABC_PAGE_VIEW (widget);
+
+  gabc_page_view_configure_adjustments (self);
+  gabc_page_view_update (self);
+}
+
+
+static void
+gabc_page_view_snapshot (GtkWidget   *widget,
+                         GtkSnapshot *snapshot)
+{
+  GabcPageView *self = GABC_PAGE_VIEW (widget);
+  const GdkRGBA paper = { 1.0, 1.0, 1.0, 1.0 };
+  gdouble x_offset = self->hadjustment != NULL ? gtk_adjustment_get_value (self->hadjustment) : 0;
+  gdouble y_offset = self->vadjustment != NULL ? gtk_adjustment_get_value (self->vadjustment) : 0;
+  gdouble view_width = MAX (self->content_width, gtk_widget_get_width (widget));
+  gint height = gtk_widget_get_height (widget);
+  guint i;
+
+  for (i = 0; i < self->pages->len; i++)
+    {
+      GabcPageViewPage *page = g_ptr_array_index (self->pages, i);
+      gdouble page_width = page->width * self->zoom;
+      gdouble page_height = page->height * self->zoom;
+      graphene_rect_t bounds;
+
+      if (page->y + page_height < y_offset)
+        continue;
+      if (page->y > y_offset + height)
+        break;
+
+      graphene_rect_init (&bounds,
+                          floor ((view_width - page_width) / 2 - x_offset),
+                          floor (page->y - y_offset),
+                          page_width,
+                          page_height);
+
+      gtk_snapshot_append_color (snapshot, &paper, &bounds);
+      if (page->texture != NULL)
+        gtk_snapshot_append_texture (snapshot, page->texture, &bounds);
+    }
+}
+
+
+/*
+ * GOBJECT
+ */
+static void
+gabc_page_view_get_property (GObject    *object,
+                             guint       prop_id,
+                             GValue     *value,
+                             GParamSpec *pspec)
+{
+  GabcPageView *self = GABC_PAGE_VIEW (object);
+
+  switch (prop_id)
+    {
+    case PROP_ZOOM:
+      g_value_set_double (value, self->zoom);
+      break;
+    case PROP_N_PAGES:
+      g_value_set_uint (value, self->pages->len);
+      break;
+    case PROP_HADJUSTMENT:
+      g_value_set_object (value, self->hadjustment);
+      break;
+    case PROP_VADJUSTMENT:
+      g_value_set_object (value, self->vadjustment);
+      break;
+    case PROP_HSCROLL_POLICY:
+      g_value_set_enum (value, self->hscroll_policy);
+      break;
+    case PROP_VSCROLL_POLICY:
+      g_value_set_enum (value, self->vscroll_policy);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+
+static void
+gabc_page_view_set_property (GObject      *object,
+                             guint         prop_id,
+                             const GValue *value,
+                             GParamSpec   *pspec)
+{
+  GabcPageView *self = GABC_PAGE_VIEW (object);
+
+  switch (prop_id)
+    {
+    case PROP_ZOOM:
+      gabc_page_view_set_zoom (self, g_value_get_double (value));
+      break;
+    case PROP_HADJUSTMENT:
+      gabc_page_view_set_adjustment (self, &self->hadjustment, g_value_get_object (value));
+      break;
+    case PROP_VADJUSTMENT:
+      gabc_page_view_set_adjustment (self, &self->vadjustment, g_value_get_object (value));
+      break;
+    case PROP_HSCROLL_POLICY:
+      self->hscroll_policy = g_value_get_enum (value);
+      gtk_widget_queue_resize (GTK_WIDGET (self));
+      break;
+    case PROP_VSCROLL_POLICY:
+      self->vscroll_policy = g_value_get_enum (value);
+      gtk_widget_queue_resize (GTK_WIDGET (self));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+
+static void
+gabc_page_view_dispose (GObject *object)
+{
+  GabcPageView *self = GABC_PAGE_VIEW (object);
+
+  if (self->load_cancellable != NULL)
+    g_cancellable_cancel (self->load_cancellable);
+  g_cancellable_cancel (self->raster_cancellable);
+
+  g_queue_clear_full (&self->wanted, (GDestroyNotify) gabc_page_view_raster_free);
+
+  if (self->hadjustment != NULL)
+    g_signal_handlers_disconnect_by_data (self->hadjustment, self);
+  g_clear_object (&self->hadjustment);
+  if (self->vadjustment != NULL)
+    g_signal_handlers_disconnect_by_data (self->vadjustment, self);
+  g_clear_object (&self->vadjustment);
+
+  G_OBJECT_CLASS (gabc_page_view_parent_class)->dispose (object);
+}
+
+
+static void
+gabc_page_view_finalize (GObject *object)
+{
+  GabcPageView *self = GABC_PAGE_VIEW (object);
+
+  g_clear_object (&self->load_cancellable);
+  g_clear_object (&self->raster_cancellable);
+  g_ptr_array_unref (self->pages);
+  g_queue_clear_full (&self->lru, (GDestroyNotify) gabc_page_view_entry_free);
+  g_hash_table_unref (self->entries);
+  g_hash_table_unref (self->in_flight);
+  g_hash_table_unref (self->failed);
+
+  G_OBJECT_CLASS (gabc_page_view_parent_class)->finalize (object);
+}
+
+
+static void
+gabc_page_view_class_init (GabcPageViewClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+
+  object_class->get_property = gabc_page_view_get_property;
+  object_class->set_property = gabc_page_view_set_property;
+  object_class->dispose = gabc_page_view_dispose;
+  object_class->finalize = gabc_page_view_finalize;
+
+  widget_class->measure = gabc_page_view_measure;
+  widget_class->size_allocate = gabc_page_view_size_allocate;
+  widget_class->snapshot = gabc_page_view_snapshot;
+
+  properties [PROP_ZOOM] =
+    g_param_spec_double ("zoom", NULL, NULL,
+                         GABC_PAGE_VIEW_MIN_ZOOM, GABC_PAGE_VIEW_MAX_ZOOM, 1.0,
+                         G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+
+  properties [PROP_N_PAGES] =
+    g_param_spec_uint ("n-pages", NULL, NULL,
+                       0, G_MAXUINT, 0,
+                       G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (object_class, N_PROPS, properties);
+
+  g_object_class_override_property (object_class, PROP_HADJUSTMENT, "hadjustment");
+  g_object_class_override_property (object_class, PROP_VADJUSTMENT, "vadjustment");
+  g_object_class_override_property (object_class, PROP_HSCROLL_POLICY, "hscroll-policy");
+  g_object_class_override_property (object_class, PROP_VSCROLL_POLICY, "vscroll-policy");
+
+  gtk_widget_class_set_css_name (widget_class, "pageview");
+}
+
+
+static void
+gabc_page_view_init (GabcPageView *self)
+{
+  GtkEventController *controller;
+
+  self->pages = g_ptr_array_new_with_free_func ((GDestroyNotify) gabc_page_view_page_free);
+  self->zoom = 1.0;
+  self->raster_cancellable = g_cancellable_new ();
+
+  g_queue_init (&self->lru);
+  g_queue_init (&self->wanted);
+  self->entries = g_hash_table_new (g_str_hash, g_str_equal);
+  self->in_flight = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  self->failed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  self->max_running = MAX (g_get_num_processors () / 2, 1);
+
+  gtk_widget_set_overflow (GTK_WIDGET (self), GTK_OVERFLOW_HIDDEN);
+
+  controller = gtk_event_controller_scroll_new (GTK_EVENT_CONTROLLER_SCROLL_VERTICAL);
+  g_signal_connect (controller, "scroll", G_CALLBACK (gabc_page_view_scroll_cb), self);
+  gtk_widget_add_controller (GTK_WIDGET (self), controller);
+
+  g_signal_connect (self, "notify::scale-factor",
+                    G_CALLBACK (gabc_page_view_scale_factor_changed_cb), NULL);
+}
+
+
+GtkWidget *
+gabc_page_view_new (void)
+{
+  return g_object_new (GABC_TYPE_PAGE_VIEW, NULL);
+}
+
+
+/*
+ * Show the given SVG pages, in order.  They are read on a worker thread
+ * and replace the pages showing once that is done; pages that came out
+ * the same as any seen before come straight from the cache.
+ */
+void
+gabc_page_view_set_pages (GabcPageView        *self,
+                          const gchar * const *paths)
+{
+  g_autoptr (GTask) task = NULL;
+
+  g_return_if_fail (GABC_IS_PAGE_VIEW (self));
+  g_return_if_fail (paths != NULL);
+
+  if (self->load_cancellable != NULL)
+    {
+      g_cancellable_cancel (self->load_cancellable);
+      g_clear_object (&self->load_cancellable);
+    }
+  self->load_cancellable = g_cancellable_new ();
+
+  task = g_task_new (self, self->load_cancellable, gabc_page_view_load_cb, NULL);
+  g_task_set_source_tag (task, gabc_page_view_set_pages);
+  g_task_set_task_data (task, g_strdupv ((gchar **) paths), (GDestroyNotify) g_strfreev);
+  g_task_run_in_thread (task, gabc_page_view_load_thread);
+}
+
+
+guint
+gabc_page_view_get_n_pages (GabcPageView *self)
+{
+  g_return_val_if_fail (GABC_IS_PAGE_VIEW (self), 0);
+
+  return self->pages->len;
+}
+
+
+gdouble
+gabc_page_view_get_zoom (GabcPageView *self)
+{
+  g_return_val_if_fail (GABC_IS_PAGE_VIEW (self), 1.0);
+
+  return self->zoom;
+}
+
+
+/*
+ * Zoom about the middle of the view.  Pages are drawn scaled from the
+ * rasters they have until those at the new size are ready.
+ */
+void
+gabc_page_view_set_zoom (GabcPageView *self,
+                         gdouble       zoom)
+{
+  gdouble middle = 0.5;
+  gdouble page_size;
+
+  g_return_if_fail (GABC_IS_PAGE_VIEW (self));
+
+  page_size = gtk_widget_get_height (GTK_WIDGET (self));
+  zoom = CLAMP (zoom, GABC_PAGE_VIEW_MIN_ZOOM, GABC_PAGE_VIEW_MAX_ZOOM);
+  if (zoom == self->zoom)
+    return;
+
+  if (self->vadjustment != NULL && self->content_height > 0)
+    middle = (gtk_adjustment_get_value (self->vadjustment) + page_size / 2) / self->content_height;
+
+  self->zoom = zoom;
+  gabc_page_view_layout (self);
+  gabc_page_view_configure_adjustments (self);
+
+  if (self->vadjustment != NULL)
+    gtk_adjustment_set_value (self->vadjustment, middle * self->content_height - page_size / 2);
+
+  gtk_widget_queue_resize (GTK_WIDGET (self));
+  gabc_page_view_update (self);
+
+  g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_ZOOM]);
+}
@@ -0,0 +1,43 @@
+/* gabc-page-view.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define GABC_TYPE_PAGE_VIEW (gabc_page_view_get_type())
+
+G_DECLARE_FINAL_TYPE (GabcPageView, gabc_page_view, GABC, PAGE_VIEW, GtkWidget)
+
+GtkWidget                *gabc_page_view_new                      (void);
+
+void                      gabc_page_view_set_pages                (GabcPageView       *self,
+                                                                   const gchar * const *paths);
+
+guint                     gabc_page_view_get_n_pages              (GabcPageView       *self);
+
+gdouble                   gabc_page_view_get_zoom                 (GabcPageView       *self);
+
+void                      gabc_page_view_set_zoom                 (GabcPageView       *self,
+                                                                   gdouble             zoom);
+
+G_END_DECLS
@@ -0,0 +1,412 @@
+/* gabc-player.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * The built-in player: a GabcMidiSequence played through GabcSynth on an
+ * audio thread of its own.
+ *
+ * The main thread converts the sequence's events to frame times and feeds
+ * them to the audio thread through a single producer, single consumer
+ * ring that only uses atomic loads and stores, topping it up from a
+ * timeout, and starting the sequence over when looping.  The audio thread
+ * renders a few milliseconds at a time, applying each event at its exact
+ * frame, and blocks writing to the sink, which is what keeps it in time.
+ * It never allocates or takes a lock, so it can't be held up by the main
+ * thread.
+ *
+ * Stopping sets a flag the audio thread checks after each block and joins
+ * it.  Playback that ends by itself, or fails, is noticed by the timeout.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#ifdef G_OS_UNIX
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "gabc-player.h"
+#include "gabc-synth.h"
+
+#define GABC_PLAYER_BLOCK           256         /* frames, about 5 ms */
+#define GABC_PLAYER_QUEUE_SIZE      1024        /* events, a power of 2 */
+#define GABC_PLAYER_TICK_INTERVAL   20          /* ms */
+
+typedef struct {
+  gint64            frame;
+  guint8            type;
+  guint8            pitch;
+  guint8            velocity;
+} GabcPlayerEvent;
+
+/*
+ * Everything the audio thread uses.  head is only written by the main
+ * thread and tail only by the audio thread.
+ */
+typedef struct {
+  GabcPlayerEvent   queue [GABC_PLAYER_QUEUE_SIZE];
+  gint              head;
+  gint              tail;
+
+  gint              stopping;
+  gint              end_of_stream;     /* every event is queued */
+  gint64            end_frame;         /* set before end_of_stream */
+  gint              done;
+  GError           *error;             /* set before done */
+
+  GThread          *thread;
+  GabcAudioSink    *sink;
+  GabcSynth         synth;
+  gfloat            samples [GABC_PLAYER_BLOCK];
+  gint16            frames [GABC_PLAYER_BLOCK];
+} GabcPlayerSession;
+
+struct _GabcPlayer
+{
+  GObject                       parent_instance;
+
+  GabcPlayerSession            *session;
+  GabcMidiSequence             *sequence;
+  gboolean                      loop;
+  guint                         next_event;
+  gint64                        loop_start;   /* frame the sequence started on */
+  guint                         tick_id;
+};
+
+G_DEFINE_FINAL_TYPE (GabcPlayer, gabc_player, G_TYPE_OBJECT)
+
+enum {
+  FINISHED,
+  N_SIGNALS
+};
+
+static guint signals [N_SIGNALS];
+
+
+static gboolean
+gabc_player_session_push (GabcPlayerSession     *session,
+                          const GabcPlayerEvent *event)
+{
+  guint head = g_atomic_int_get (&session->head);
+  guint tail = g_atomic_int_get (&session->tail);
+
+  if (head - tail == GABC_PLAYER_QUEUE_SIZE)
+    return FALSE;
+
+  session->queue[head & (GABC_PLAYER_QUEUE_SIZE - 1)] = *event;
+  g_atomic_int_set (&session->head, head + 1);
+
+  return TRUE;
+}
+
+
+static const GabcPlayerEvent *
+gabc_player_session_peek (GabcPlayerSession *session)
+{
+  guint head = g_atomic_int_get (&session->head);
+  guint tail = g_atomic_int_get (&session->tail);
+
+  if (head == tail)
+    return NULL;
+
+  return &session->queue[tail & (GABC_PLAYER_QUEUE_SIZE - 1)];
+}
+
+
+static void
+gabc_player_session_pop (GabcPlayerSession *session)
+{
+  g_atomic_int_set (&session->tail, (guint) g_atomic_int_get (&session->tail) + 1);
+}
+
+
+/*
+ * Ask for real-time scheduling; without the privileges for it the thread
+ * just runs at normal priority.
+ */
+static void
+gabc_player_session_raise_priority (void)
+{
+#ifdef G_OS_UNIX
+  struct sched_param param = { 0, };
+
+  param.sched_priority = sched_get_priority_min (SCHED_FIFO);
+  pthread_setschedparam (pthread_self (), SCHED_FIFO, &param);
+#endif
+}
+
+
+static gboolean
+gabc_player_session_is_finished (GabcPlayerSession *session,
+                                 gint64             frame)
+{
+  return g_atomic_int_get (&session->end_of_stream) &&
+         gabc_player_session_peek (session) == NULL &&
+         frame >= session->end_frame &&
+         gabc_synth_is_silent (&session->synth);
+}
+
+
+static gpointer
+gabc_player_session_thread (gpointer user_data)
+{
+  GabcPlayerSession *session = user_data;
+  GError *error = NULL;
+  gint64 frame = 0;
+  gsize i;
+
+  gabc_player_session_raise_priority ();
+
+  while (!g_atomic_int_get (&session->stopping))
+    {
+      gsize done = 0;
+
+      while (done < GABC_PLAYER_BLOCK)
+        {
+          const GabcPlayerEvent *event;
+          gsize next = GABC_PLAYER_BLOCK;
+
+          while ((event = gabc_player_session_peek (session)) != NULL)
+            {
+              if (event->frame > frame + (gint64) done)
+                {
+                  next = MIN (event->frame - frame, GABC_PLAYER_BLOCK);
+                  break;
+                }
+
+              if (event->type == GABC_MIDI_NOTE_ON)
+                gabc_synth_note_on (&session->synth, event->pitch, event->velocity);
+              else
+                gabc_synth_note_off (&session->synth, event->pitch);
+              gabc_player_session_pop (session);
+            }
+
+          gabc_synth_render (&session->synth, session->samples + done, next - done);
+          done = next;
+        }
+
+      for (i = 0; i < GABC_PLAYER_BLOCK; i++)
+        session->frames[i] = (gint16) (session->samples[i] * G_MAXINT16);
+
+      if (!gabc_audio_sink_write (session->sink, session->frames, GABC_PLAYER_BLOCK, &error))
+        break;
+      frame += GABC_PLAYER_BLOCK;
+
+      if (gabc_player_session_is_finished (session, frame))
+        {
+          gabc_audio_sink_drain (session->sink, &error);
+          break;
+        }
+    }
+
+  session->error = error;
+  g_atomic_int_set (&session->done, TRUE);
+
+  return NULL;
+}
+
+
+static void
+gabc_player_session_free (GabcPlayerSession *session)
+{
+  g_atomic_int_set (&session->stopping, TRUE);
+  g_thread_join (session->thread);
+
+  gabc_audio_sink_free (session->sink);
+  g_clear_error (&session->error);
+  g_free (session);
+}
+
+
+/*
+ * Queue as many events as fit, going round again when looping.
+ */
+static void
+gabc_player_feed (GabcPlayer *self)
+{
+  GabcPlayerSession *session = self->session;
+  GArray *events = self->sequence->events;
+  guint rate = gabc_audio_sink_get_rate (session->sink);
+  gint64 duration = self->sequence->duration * rate / G_USEC_PER_SEC;
+
+  if (g_atomic_int_get (&session->end_of_stream))
+    return;
+
+  for (;;)
+    {
+      const GabcMidiEvent *midi_event;
+      GabcPlayerEvent event;
+
+      if (self->next_event == events->len)
+        {
+          if (!self->loop || duration == 0)
+            {
+              session->end_frame = self->loop_start + duration;
+              g_atomic_int_set (&session->end_of_stream, TRUE);
+              return;
+            }
+
+          self->loop_start += duration;
+          self->next_event = 0;
+        }
+
+      midi_event = &g_array_index (events, GabcMidiEvent, self->next_event);
+      event.frame = self->loop_start + midi_event->time * rate / G_USEC_PER_SEC;
+      event.type = midi_event->type;
+      event.pitch = midi_event->pitch;
+      event.velocity = midi_event->velocity;
+
+      if (!gabc_player_session_push (session, &event))
+        return;
+      self->next_event++;
+    }
+}
+
+
+static void
+gabc_player_finish (GabcPlayer *self)
+{
+  g_autoptr (GError) error = NULL;
+
+  g_clear_handle_id (&self->tick_id, g_source_remove);
+  g_clear_pointer (&self->sequence, gabc_midi_sequence_free);
+
+  if (g_atomic_int_get (&self->session->done))
+    error = g_steal_pointer (&self->session->error);
+  g_clear_pointer (&self->session, gabc_player_session_free);
+
+  g_signal_emit (self, signals [FINISHED], 0, error);
+}
+
+
+static gboolean
+gabc_player_tick_cb (gpointer user_data)
+{
+  GabcPlayer *self = user_data;
+
+  if (g_atomic_int_get (&self->session->done))
+    {
+      self->tick_id = 0;
+      gabc_player_finish (self);
+      return G_SOURCE_REMOVE;
+    }
+
+  gabc_player_feed (self);
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+static void
+gabc_player_dispose (GObject *object)
+{
+  GabcPlayer *self = GABC_PLAYER (object);
+
+  gabc_player_stop (self);
+
+  G_OBJECT_CLASS (gabc_player_parent_class)->dispose (object);
+}
+
+
+static void
+gabc_player_class_init (GabcPlayerClass *klass)
+{
+  G_OBJECT_CLASS (klass)->dispose = gabc_player_dispose;
+
+  /*
+   * Emitted when playback stops, whether it came to the end, failed or
+   * gabc_player_stop () was called.  The error is NULL unless it failed.
+   */
+  signals [FINISHED] =
+    g_signal_new ("finished",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE,
+                  1,
+                  G_TYPE_ERROR);
+}
+
+
+static void
+gabc_player_init (GabcPlayer *self)
+{
+}
+
+
+GabcPlayer *
+gabc_player_new (void)
+{
+  return g_object_new (GABC_TYPE_PLAYER, NULL);
+}
+
+
+/*
+ * Play sequence through sink, taking ownership of both, after stopping
+ * whatever was playing.  With loop set the sequence is played over and
+ * over until gabc_player_stop () is called.
+ */
+void
+gabc_player_play (GabcPlayer       *self,
+                  GabcMidiSequence *sequence,
+                  GabcAudioSink    *sink,
+                  gboolean          loop)
+{
+  GabcPlayerSession *session;
+
+  gabc_player_stop (self);
+
+  session = g_new0 (GabcPlayerSession, 1);
+  session->sink = sink;
+  gabc_synth_init (&session->synth, gabc_audio_sink_get_rate (sink));
+
+  self->session = session;
+  self->sequence = sequence;
+  self->loop = loop;
+  self->next_event = 0;
+  self->loop_start = 0;
+
+  /* Fill the queue first, so the first notes are there when it starts. */
+  gabc_player_feed (self);
+  session->thread = g_thread_new ("gabc-player", gabc_player_session_thread, session);
+
+  self->tick_id = g_timeout_add (GABC_PLAYER_TICK_INTERVAL, gabc_player_tick_cb, self);
+}
+
+
+void
+gabc_player_stop (GabcPlayer *self)
+{
+  if (self->session == NULL)
+    return;
+
+  gabc_player_finish (self);
+}
+
+
+gboolean
+gabc_player_is_playing (GabcPlayer *self)
+{
+  return self->session != NULL;
+}
@@ -0,0 +1,47 @@
+/* gabc-player.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <glib-object.h>
+
+#include "gabc-audio-sink.h"
+#include "gabc-midi-sequence.h"
+
+G_BEGIN_DECLS
+
+/* The rate the player's sinks are opened at. */
+#define GABC_PLAYER_RATE 48000
+
+#define GABC_TYPE_PLAYER (gabc_player_get_type())
+
+G_DECLARE_FINAL_TYPE (GabcPlayer, gabc_player, GABC, PLAYER, GObject)
+
+GabcPlayer               *gabc_player_new                         (void);
+
+void                      gabc_player_play                        (GabcPlayer       *self,
+                                                                   GabcMidiSequence *sequence,
+                                                                   GabcAudioSink    *sink,
+                                                                   gboolean          loop);
+
+void                      gabc_player_stop                        (GabcPlayer       *self);
+
+gboolean                  gabc_player_is_playing                  (GabcPlayer       *self);
+
+G_END_DECLS
@@ -10,16 +10,30 @@ struct _GabcPrefsWindow
 
   GSettings *settings;
   GtkWidget *dark_btn;
+  GtkWidget *built_in_viewer_switch;
+  GtkWidget *built_in_player_switch;
   GtkWidget *file_launcher_always_ask_btn;
+  GtkWidget *native_highlighting_switch;
+  GtkWidget *validate_while_typing_switch;
+  GtkWidget *render_cache_size_row;
+  GtkWidget *log_max_records_row;
   GtkWidget *abcm2ps_errors_switch;
   GtkWidget *abcm2ps_page_number_combo;
 
   GtkWidget *abc2midi_barfly_mode_combo;
   GtkWidget *abc2midi_midi_program_combo;
+  GtkWidget *abc2midi_tempo_row;
+  GtkWidget *abc2midi_transpose_row;
+  GtkWidget *abc2midi_chordprog_row;
+  GtkWidget *abc2midi_drone_switch;
 
   AdwActionRow *abcm2ps_fmt_file_action_row;
   GtkButton *abcm2ps_fmt_clear_btn;
   GtkButton *abcm2ps_fmt_file_btn;
+
+  AdwActionRow *search_directories_action_row;
+  GtkButton *search_directories_clear_btn;
+  GtkButton *search_directories_add_btn;
 };
 
 
@@ -46,6 +60,19 @@ static void
 gabc_prefs_set_fmt_file_path (GtkWidget *widget,
                                 gpointer   user_data);
 
+static void
+gabc_prefs_add_search_directory (GtkWidget *widget,
+                                 gpointer   user_data);
+
+static void
+gabc_prefs_clear_search_directories (GtkWidget *widget,
+                                     gpointer   user_data);
+
+static gboolean
+search_directories_to_subtitle (GValue   *value,
+                                GVariant *variant,
+                                gpointer  user_data);
+
 G_DEFINE_TYPE (GabcPrefsWindow, gabc_prefs_window, ADW_TYPE_PREFERENCES_DIALOG)
 
 
@@ -59,10 +86,42 @@ gabc_prefs_window_init (GabcPrefsWindow *self)
                    self->dark_btn, "active",
                    G_SETTINGS_BIND_DEFAULT);
 
+  g_settings_bind (self->settings, "built-in-viewer",
+                   self->built_in_viewer_switch, "active",
+                   G_SETTINGS_BIND_DEFAULT);
+
+  g_settings_bind (self->settings, "built-in-player",
+                   self->built_in_player_switch, "active",
+                   G_SETTINGS_BIND_DEFAULT);
+
   g_settings_bind (self->settings, "file-launcher-always-ask",
                    self->file_launcher_always_ask_btn, "active",
                    G_SETTINGS_BIND_DEFAULT);
 
+  g_settings_bind (self->settings, "native-highlighting",
+                   self->native_highlighting_switch, "active",
+                   G_SETTINGS_BIND_DEFAULT);
+
+  g_settings_bind (self->settings, "validate-while-typing",
+                   self->validate_while_typing_switch, "active",
+                   G_SETTINGS_BIND_DEFAULT);
+
+  g_settings_bind_with_mapping (self->settings, "search-directories",
+                                self->search_directories_action_row, "subtitle",
+                                G_SETTINGS_BIND_GET,
+                                search_directories_to_subtitle,
+                                NULL,
+                                NULL,
+                                NULL);
+
+  g_settings_bind (self->settings, "render-cache-max-size",
+                   self->render_cache_size_row, "value",
+                   G_SETTINGS_BIND_DEFAULT);
+
+  g_settings_bind (self->settings, "log-max-records",
+                   self->log_max_records_row, "value",
+                   G_SETTINGS_BIND_DEFAULT);
+
   g_settings_bind (self->settings, "abcm2ps-show-errors",
                    self->abcm2ps_errors_switch, "active",
                    G_SETTINGS_BIND_DEFAULT);
@@ -83,9 +142,27 @@ gabc_prefs_window_init (GabcPrefsWindow *self)
                    self->abc2midi_midi_program_combo, "active-id",
                    G_SETTINGS_BIND_DEFAULT);
 
+  g_settings_bind (self->settings, "abc2midi-tempo",
+                   self->abc2midi_tempo_row, "value",
+                   G_SETTINGS_BIND_DEFAULT);
+
+  g_settings_bind (self->settings, "abc2midi-transpose",
+                   self->abc2midi_transpose_row, "value",
+                   G_SETTINGS_BIND_DEFAULT);
+
+  g_settings_bind (self->settings, "abc2midi-chordprog",
+                   self->abc2midi_chordprog_row, "value",
+                   G_SETTINGS_BIND_DEFAULT);
+
+  g_settings_bind (self->settings, "abc2midi-drone",
+                   self->abc2midi_drone_switch, "active",
+                   G_SETTINGS_BIND_DEFAULT);
+
   //g_assert (GABC_IS_PREFS_WINDOW (self));
   g_signal_connect (self->abcm2ps_fmt_file_btn, "clicked", G_CALLBACK (gabc_prefs_set_fmt_file_path), self);
   g_signal_connect (self->abcm2ps_fmt_clear_btn, "clicked", G_CALLBACK (gabc_prefs_clear_fmt_file_path), self);
+  g_signal_connect (self->search_directories_add_btn, "clicked", G_CALLBACK (gabc_prefs_add_search_directory), self);
+  g_signal_connect (self->search_directories_clear_btn, "clicked", G_CALLBACK (gabc_prefs_clear_search_directories), self);
 
   /*
    music_dir_btn.clicked.connect (() => {
@@ -119,7 +196,16 @@ gabc_prefs_window_class_init (GabcPrefsWindowClass *klass)
   gtk_widget_class_set_template_from_resource (GTK_WIDGET_CLASS (klass),
                                                "/me/pm/m0dns/gabc/gabc-prefs-window.ui");
   gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), GabcPrefsWindow, dark_btn);
+  gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), GabcPrefsWindow, built_in_viewer_switch);
+  gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), GabcPrefsWindow, built_in_player_switch);
   gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), GabcPrefsWindow, file_launcher_always_ask_btn);
+  gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), GabcPrefsWindow, native_highlighting_switch);
+  gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), GabcPrefsWindow, validate_while_typing_switch);
+  gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), GabcPrefsWindow, search_directories_action_row);
+  gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), GabcPrefsWindow, search_directories_clear_btn);
+  gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), GabcPrefsWindow, search_directories_add_btn);
+  gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), GabcPrefsWindow, render_cache_size_row);
+  gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), GabcPrefsWindow, log_max_records_row);
   gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), GabcPrefsWindow, abcm2ps_errors_switch);
   gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), GabcPrefsWindow, abcm2ps_fmt_file_action_row);
   gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), GabcPrefsWindow, abcm2ps_fmt_clear_btn);
@@ -127,6 +213,10 @@ gabc_prefs_window_class_init (GabcPrefsWindowClass *klass)
   gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), GabcPrefsWindow, abcm2ps_page_number_combo);
   gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), GabcPrefsWindow, abc2midi_barfly_mode_combo);
   gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), GabcPrefsWindow, abc2midi_midi_program_combo);
+  gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), GabcPrefsWindow, abc2midi_tempo_row);
+  gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), GabcPrefsWindow, abc2midi_transpose_row);
+  gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), GabcPrefsWindow, abc2midi_chordprog_row);
+  gtk_widget_class_bind_template_child (GTK_WIDGET_CLASS (klass), GabcPrefsWindow, abc2midi_drone_switch);
 }
 
 
@@ -223,3 +313,82 @@ file_open_cb (GObject       *file_dialog,
   g_object_unref (file_dialog);
 }
 
+
+
+static gboolean
+search_directories_to_subtitle (GValue   *value,
+                                GVariant *variant,
+                                gpointer  user_data)
+{
+  g_autofree const gchar **directories = g_variant_get_strv (variant, NULL);
+  g_autofree gchar *subtitle = NULL;
+
+  if (directories[0] == NULL)
+    subtitle = g_strdup ("None");
+  else
+    subtitle = g_strjoinv ("\n", (gchar **) directories);
+
+  g_value_set_string (value, subtitle);
+
+  return TRUE;
+}
+
+
+static void
+search_directory_select_cb (GObject       *file_dialog,
+                            GAsyncResult  *res,
+                            gpointer       data)
+{
+  GabcPrefsWindow *self = GABC_PREFS_WINDOW (data);
+  g_autoptr (GFile) folder = gtk_file_dialog_select_folder_finish (GTK_FILE_DIALOG (file_dialog),
+                                                                   res,
+                                                                   NULL);
+  if (folder != NULL)
+    {
+      g_autofree gchar *path = g_file_get_path (folder);
+      g_auto (GStrv) directories = g_settings_get_strv (self->settings, "search-directories");
+      g_autoptr (GStrvBuilder) builder = NULL;
+      g_auto (GStrv) new_directories = NULL;
+
+      if (path != NULL && !g_strv_contains ((const gchar * const *) directories, path))
+        {
+          builder = g_strv_builder_new ();
+          g_strv_builder_addv (builder, (const gchar **) directories);
+          g_strv_builder_add (builder, path);
+          new_directories = g_strv_builder_end (builder);
+          g_settings_set_strv (self->settings, "search-directories",
+                               (const gchar * const *) new_directories);
+        }
+    }
+
+  g_object_unref (file_dialog);
+  g_object_unref (self);
+}
+
+
+static void
+gabc_prefs_add_search_directory (GtkWidget *widget,
+                                 gpointer   user_data)
+{
+  GabcPrefsWindow *self = GABC_PREFS_WINDOW (user_data);
+  GtkFileDialog *gfd;
+
+  gfd = gtk_file_dialog_new ();
+  gtk_file_dialog_set_title (gfd, "Add Tune Search Folder");
+
+  gtk_file_dialog_select_folder (gfd,
+                                 GTK_WINDOW (gtk_widget_get_root (GTK_WIDGET (self))),
+                                 NULL,
+                                 search_directory_select_cb,
+                                 g_object_ref (self));
+}
+
+
+static void
+gabc_prefs_clear_search_directories (GtkWidget *widget,
+                                     gpointer   user_data)
+{
+  GabcPrefsWindow *self = GABC_PREFS_WINDOW (user_data);
+
+  g_settings_set_strv (self->settings, "search-directories", NULL);
+}
@@ -0,0 +1,373 @@
+/* gabc-preprocessor.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Transforms applied to the abc text on its way to the scratch file.
+ *
+ * The rules come from the abc2midi settings and are compiled into two
+ * things: the block of directives to insert after the K: line that ends
+ * each tune header (not after key changes in the body), and the set of %%
+ * directive names to drop (a %%beginX name drops the whole block up to
+ * %%endX).  Both hold their place however the text is split into pieces.  They are rebuilt
+ * only after one of the settings has changed.  Applying them is a single
+ * scan over the lines of the text whatever the number of active rules, and
+ * unchanged runs of text are handed to the writer as they are, without
+ * copying.
+ */
+
+#include <string.h>
+
+#include "gabc-preprocessor.h"
+
+struct _GabcPreprocessor
+{
+  GObject                       parent_instance;
+
+  GSettings                    *settings;
+  gboolean                      stale;
+
+  gchar                        *injection;        /* NULL if nothing to insert */
+  guint                         n_injection_lines;
+  GHashTable                   *strip_directives; /* names without the leading %% */
+
+  GString                      *directive;        /* name on the current line */
+  GString                      *block_end;        /* empty unless in a stripped block */
+  gboolean                      in_tune_header;   /* between an X: and its first K: */
+};
+
+G_DEFINE_FINAL_TYPE (GabcPreprocessor, gabc_preprocessor, G_TYPE_OBJECT)
+
+
+static void
+gabc_preprocessor_finalize (GObject *object)
+{
+  GabcPreprocessor *self = GABC_PREPROCESSOR (object);
+
+  g_clear_object (&self->settings);
+  g_free (self->injection);
+  g_hash_table_unref (self->strip_directives);
+  g_string_free (self->directive, TRUE);
+  g_string_free (self->block_end, TRUE);
+
+  G_OBJECT_CLASS (gabc_preprocessor_parent_class)->finalize (object);
+}
+
+
+static void
+gabc_preprocessor_class_init (GabcPreprocessorClass *klass)
+{
+  G_OBJECT_CLASS (klass)->finalize = gabc_preprocessor_finalize;
+}
+
+
+static void
+gabc_preprocessor_init (GabcPreprocessor *self)
+{
+  self->strip_directives = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  self->directive = g_string_new (NULL);
+  self->block_end = g_string_new (NULL);
+  self->stale = TRUE;
+}
+
+
+static void
+gabc_preprocessor_settings_changed_cb (GabcPreprocessor *self,
+                                       const gchar      *key)
+{
+  self->stale = TRUE;
+}
+
+
+GabcPreprocessor *
+gabc_preprocessor_new (GSettings *settings)
+{
+  GabcPreprocessor *self;
+
+  g_return_val_if_fail (G_IS_SETTINGS (settings), NULL);
+
+  self = g_object_new (GABC_TYPE_PREPROCESSOR, NULL);
+  self->settings = g_object_ref (settings);
+
+  g_signal_connect_object (settings, "changed",
+                           G_CALLBACK (gabc_preprocessor_settings_changed_cb),
+                           self, G_CONNECT_SWAPPED);
+
+  return self;
+}
+
+
+static void
+gabc_preprocessor_compile (GabcPreprocessor *self)
+{
+  GString *injection;
+  g_auto (GStrv) strip_directives = NULL;
+  gint midi_program;
+  gint transpose;
+  gint chordprog;
+  guint tempo;
+  guint i;
+
+  injection = g_string_new (NULL);
+
+  midi_program = g_settings_get_enum (self->settings, "abc2midi-midi-program");
+  if (midi_program < 128)
+    g_string_append_printf (injection, "\n%%%%MIDI program %d", midi_program);
+
+  transpose = g_settings_get_int (self->settings, "abc2midi-transpose");
+  if (transpose != 0)
+    g_string_append_printf (injection, "\n%%%%MIDI transpose %d", transpose);
+
+  chordprog = g_settings_get_int (self->settings, "abc2midi-chordprog");
+  if (chordprog >= 0)
+    g_string_append_printf (injection, "\n%%%%MIDI chordprog %d", chordprog);
+
+  if (g_settings_get_boolean (self->settings, "abc2midi-drone"))
+    g_string_append (injection, "\n%%MIDI droneon");
+
+  tempo = g_settings_get_uint (self->settings, "abc2midi-tempo");
+  if (tempo > 0)
+    g_string_append_printf (injection, "\nQ:1/4=%u", tempo);
+
+  g_clear_pointer (&self->injection, g_free);
+  self->n_injection_lines = 0;
+  for (i = 0; i < injection->len; i++)
+    if (injection->str[i] == '\n')
+      self->n_injection_lines++;
+
+  if (injection->len > 0)
+    self->injection = g_string_free (injection, FALSE);
+  else
+    g_string_free (injection, TRUE);
+
+  g_hash_table_remove_all (self->strip_directives);
+  strip_directives = g_settings_get_strv (self->settings, "abc2midi-strip-directives");
+  for (i = 0; strip_directives[i] != NULL; i++)
+    {
+      const gchar *name = strip_directives[i];
+
+      /* Accept the names with or without their %%. */
+      if (g_str_has_prefix (name, "%%"))
+        name += 2;
+      if (*name != '\0')
+        g_hash_table_add (self->strip_directives, g_strdup (name));
+    }
+
+  self->stale = FALSE;
+}
+
+
+/*
+ * Forget any stripped %%begin block or tune header left open by the last
+ * text processed.  Call before each new file.
+ */
+void
+gabc_preprocessor_reset (GabcPreprocessor *self)
+{
+  g_return_if_fail (GABC_IS_PREPROCESSOR (self));
+
+  g_string_truncate (self->block_end, 0);
+  self->in_tune_header = FALSE;
+}
+
+
+/*
+ * Copy the name of the %% directive on the line into self->directive,
+ * reusing its buffer.  Returns FALSE if the line is not a directive.
+ */
+static gboolean
+gabc_preprocessor_read_directive (GabcPreprocessor *self,
+                                  const gchar      *line,
+                                  const gchar      *eol)
+{
+  const gchar *name_end;
+
+  if (line[0] != '%' || line[1] != '%')
+    return FALSE;
+
+  line += 2;
+  for (name_end = line; name_end < eol && !g_ascii_isspace (*name_end); name_end++)
+    ;
+
+  g_string_truncate (self->directive, 0);
+  g_string_append_len (self->directive, line, name_end - line);
+  return TRUE;
+}
+
+
+static gboolean
+gabc_preprocessor_is_stripped (GabcPreprocessor *self,
+                               const gchar      *line,
+                               const gchar      *eol)
+{
+  if (self->block_end->len > 0)
+    {
+      if (gabc_preprocessor_read_directive (self, line, eol) &&
+          g_string_equal (self->directive, self->block_end))
+        g_string_truncate (self->block_end, 0);
+      return TRUE;
+    }
+
+  if (!gabc_preprocessor_read_directive (self, line, eol) ||
+      !g_hash_table_contains (self->strip_directives, self->directive->str))
+    return FALSE;
+
+  if (g_str_has_prefix (self->directive->str, "begin"))
+    {
+      g_string_assign (self->block_end, "end");
+      g_string_append (self->block_end, self->directive->str + strlen ("begin"));
+    }
+
+  return TRUE;
+}
+
+
+static gboolean
+gabc_preprocessor_write (GabcPreprocessorWriteFunc   write_func,
+                         const gchar                *start,
+                         const gchar                *end,
+                         gpointer                    user_data,
+                         GError                    **error)
+{
+  if (end <= start)
+    return TRUE;
+
+  return write_func (start, end - start, user_data, error);
+}
+
+
+static guint
+gabc_preprocessor_count_lines (const gchar *text)
+{
+  guint n_lines = 0;
+
+  while ((text = strchr (text, '\n')) != NULL)
+    {
+      n_lines++;
+      text++;
+    }
+
+  return n_lines;
+}
+
+
+/*
+ * Run text through the rules for target, passing the result to write_func.
+ * starts_line says whether text begins at the start of a line, so the text
+ * can be fed in pieces as long as no piece ends part way through a line
+ * that a rule applies to; a stripped %%begin block may span pieces.  If
+ * line_map is not NULL the lines copied, inserted and dropped, including
+ * each line of a stripped block, are recorded in it.
+ */
+gboolean
+gabc_preprocessor_process (GabcPreprocessor           *self,
+                           GabcPreprocessorTarget      target,
+                           const gchar                *text,
+                           gboolean                    starts_line,
+                           GabcLineMap                *line_map,
+                           GabcPreprocessorWriteFunc   write_func,
+                           gpointer                    user_data,
+                           GError                    **error)
+{
+  const gchar *pending = text;
+  const gchar *line = text;
+  const gchar *eol;
+  const gchar *next;
+  gboolean strip;
+  gboolean stripped;
+  gboolean header_key;
+  guint n_copied = 0;
+
+  g_return_val_if_fail (GABC_IS_PREPROCESSOR (self), FALSE);
+
+  if (self->stale)
+    gabc_preprocessor_compile (self);
+
+  strip = g_hash_table_size (self->strip_directives) > 0;
+
+  if (target != GABC_PREPROCESSOR_TARGET_ABC2MIDI || (self->injection == NULL && !strip))
+    {
+      if (line_map != NULL)
+        gabc_line_map_copy_lines (line_map, gabc_preprocessor_count_lines (text));
+      return gabc_preprocessor_write (write_func, text, text + strlen (text), user_data, error);
+    }
+
+  while (*line != '\0')
+    {
+      eol = strchr (line, '\n');
+      next = eol != NULL ? eol + 1 : line + strlen (line);
+      if (eol == NULL)
+        eol = next;
+
+      /* Checked first, as a stripped block may hold X: and K: lines. */
+      stripped = starts_line && strip && gabc_preprocessor_is_stripped (self, line, eol);
+
+      header_key = FALSE;
+      if (starts_line && !stripped && line[1] == ':')
+        {
+          if (line[0] == 'X')
+            self->in_tune_header = TRUE;
+          else if (line[0] == 'K' && self->in_tune_header)
+            {
+              self->in_tune_header = FALSE;
+              header_key = TRUE;
+            }
+        }
+
+      if (stripped)
+        {
+          if (!gabc_preprocessor_write (write_func, pending, line, user_data, error))
+            return FALSE;
+          pending = next;
+
+          if (line_map != NULL)
+            {
+              gabc_line_map_copy_lines (line_map, n_copied);
+              gabc_line_map_skip_lines (line_map, 1);
+              n_copied = 0;
+            }
+        }
+      else if (header_key && self->injection != NULL)
+        {
+          if (!gabc_preprocessor_write (write_func, pending, eol, user_data, error) ||
+              !write_func (self->injection, strlen (self->injection), user_data, error))
+            return FALSE;
+          pending = eol;
+
+          if (line_map != NULL)
+            {
+              gabc_line_map_copy_lines (line_map, n_copied + 1);
+              gabc_line_map_insert_lines (line_map, self->n_injection_lines);
+              n_copied = 0;
+            }
+        }
+      else if (*eol == '\n')
+        {
+          n_copied++;
+        }
+
+      line = next;
+      starts_line = TRUE;
+    }
+
+  if (line_map != NULL)
+    gabc_line_map_copy_lines (line_map, n_copied);
+
+  return gabc_preprocessor_write (write_func, pending, line, user_data, error);
+}
@@ -0,0 +1,63 @@
+/* gabc-preprocessor.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <gio/gio.h>
+
+#include "gabc-line-map.h"
+
+G_BEGIN_DECLS
+
+/*
+ * The tool the scratch file is being written for.  Only the abc2midi
+ * target has rules; abcm2ps gets the text unchanged.
+ */
+typedef enum {
+  GABC_PREPROCESSOR_TARGET_ABCM2PS,
+  GABC_PREPROCESSOR_TARGET_ABC2MIDI,
+} GabcPreprocessorTarget;
+
+/*
+ * Receives the processed text, in pieces.  Returns FALSE and sets error to
+ * stop processing.
+ */
+typedef gboolean (*GabcPreprocessorWriteFunc) (const gchar  *data,
+                                               gsize         length,
+                                               gpointer      user_data,
+                                               GError      **error);
+
+#define GABC_TYPE_PREPROCESSOR (gabc_preprocessor_get_type())
+
+G_DECLARE_FINAL_TYPE (GabcPreprocessor, gabc_preprocessor, GABC, PREPROCESSOR, GObject)
+
+GabcPreprocessor         *gabc_preprocessor_new                   (GSettings *settings);
+
+void                      gabc_preprocessor_reset                 (GabcPreprocessor           *self);
+
+gboolean                  gabc_preprocessor_process               (GabcPreprocessor           *self,
+                                                                   GabcPreprocessorTarget      target,
+                                                                   const gchar                *text,
+                                                                   gboolean                    starts_line,
+                                                                   GabcLineMap                *line_map,
+                                                                   GabcPreprocessorWriteFunc   write_func,
+                                                                   gpointer                    user_data,
+                                                                   GError                    **error);
+
+G_END_DECLS
@@ -0,0 +1,508 @@
+/* gabc-preview-pane.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Live engraving of the tune under the cursor.
+ *
+ * Edits and cursor moves into another tune restart a short timer; when it
+ * fires the tune is written to its own file and engraved by abcm2ps as SVG,
+ * one file per page, which are shown as GtkPictures.  Starting a render
+ * cancels the one before it, so however fast the typing only the newest
+ * text is ever drawn.  Nothing is done while the pane is hidden.
+ *
+ * Each render uses its own file names (preview-<serial>-...) so a killed
+ * abcm2ps can never write over the pages of the render that replaced it.
+ * Older files are removed once a newer render has been shown.
+ */
+
+#include <glib/gstdio.h>
+
+#include "gabc-preview-pane.h"
+#include "gabc-render-job.h"
+#include "gabc-render-service.h"
+
+#define GABC_PREVIEW_PANE_DEBOUNCE_MS 400
+#define GABC_PREVIEW_PANE_FILE_PREFIX "preview-"
+
+struct _GabcPreviewPane
+{
+  GtkWidget                     parent_instance;
+
+  GtkWidget                    *message_label;
+  GtkWidget                    *page_box;
+
+  GabcTunebook                 *tunebook;
+  GSettings                    *settings;
+  gchar                        *directory;
+
+  guint                         debounce_id;
+  GCancellable                 *cancellable;   /* of the render in flight */
+  guint                         serial;
+  GtkTextMark                  *tune_mark;     /* start of the tune last rendered, owned */
+  gboolean                      stale;         /* something changed while unmapped */
+};
+
+G_DEFINE_FINAL_TYPE (GabcPreviewPane, gabc_preview_pane, GTK_TYPE_WIDGET)
+
+typedef struct {
+  GabcPreviewPane *preview_pane;
+  GCancellable *cancellable;
+  gchar *prefix;
+} preview_cb_data_t;
+
+static void gabc_preview_pane_schedule (GabcPreviewPane *self);
+
+
+static void
+gabc_preview_pane_set_message (GabcPreviewPane *self,
+                               const gchar     *message)
+{
+  gtk_label_set_text (GTK_LABEL (self->message_label), message);
+  gtk_widget_set_visible (self->message_label, message != NULL);
+}
+
+
+static void
+gabc_preview_pane_clear_pages (GabcPreviewPane *self)
+{
+  GtkWidget *child;
+
+  while ((child = gtk_widget_get_first_child (self->page_box)) != NULL)
+    gtk_box_remove (GTK_BOX (self->page_box), child);
+}
+
+
+/*
+ * Delete the files of every render except the one whose names start with
+ * keep_prefix (all of them if it is NULL).
+ */
+static void
+gabc_preview_pane_remove_files (GabcPreviewPane *self,
+                                const gchar     *keep_prefix)
+{
+  GDir *dir;
+  const gchar *name;
+
+  dir = g_dir_open (self->directory, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      g_autofree gchar *path = NULL;
+
+      if (!g_str_has_prefix (name, GABC_PREVIEW_PANE_FILE_PREFIX) ||
+          (keep_prefix != NULL && g_str_has_prefix (name, keep_prefix)))
+        continue;
+
+      path = g_build_filename (self->directory, name, NULL);
+      g_unlink (path);
+    }
+  g_dir_close (dir);
+}
+
+
+static gint
+gabc_preview_pane_compare_names (gconstpointer a,
+                                 gconstpointer b)
+{
+  return g_strcmp0 (*(const gchar * const *) a, *(const gchar * const *) b);
+}
+
+
+/*
+ * Replace the pictures with the pages written by the render with prefix.
+ * Returns FALSE, leaving the old pages up, if it wrote none.
+ */
+static gboolean
+gabc_preview_pane_show_pages (GabcPreviewPane *self,
+                              const gchar     *prefix)
+{
+  g_autoptr (GPtrArray) names = NULL;
+  GDir *dir;
+  const gchar *name;
+  guint i;
+
+  dir = g_dir_open (self->directory, 0, NULL);
+  if (dir == NULL)
+    return FALSE;
+
+  names = g_ptr_array_new_with_free_func (g_free);
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      if (g_str_has_prefix (name, prefix) && g_str_has_suffix (name, ".svg"))
+        g_ptr_array_add (names, g_strdup (name));
+    }
+  g_dir_close (dir);
+
+  if (names->len == 0)
+    return FALSE;
+
+  /* abcm2ps numbers the pages with leading zeros. */
+  g_ptr_array_sort (names, gabc_preview_pane_compare_names);
+
+  gabc_preview_pane_clear_pages (self);
+
+  for (i = 0; i < names->len; i++)
+    {
+      g_autofree gchar *path = g_build_filename (self->directory, g_ptr_array_index (names, i), NULL);
+      GtkWidget *picture;
+
+      picture = gtk_picture_new_for_filename (path);
+      gtk_picture_set_content_fit (GTK_PICTURE (picture), GTK_CONTENT_FIT_CONTAIN);
+      gtk_box_append (GTK_BOX (self->page_box), picture);
+    }
+
+  return TRUE;
+}
+
+
+static void
+gabc_preview_pane_render_cb (GObject      *source_object,
+                             GAsyncResult *result,
+                             gpointer      user_data)
+{
+  preview_cb_data_t *cb_data = user_data;
+  GabcPreviewPane *self = cb_data->preview_pane;
+  GabcRenderJob *job = GABC_RENDER_JOB (source_object);
+  g_autoptr (GError) error = NULL;
+  gboolean succeeded;
+
+  succeeded = gabc_render_job_run_finish (job, result, &error);
+
+  /* A cancelled render was superseded by a newer one, or the pane has gone. */
+  if (!g_cancellable_is_cancelled (cb_data->cancellable))
+    {
+      g_clear_object (&self->cancellable);
+
+      if (!succeeded)
+        gabc_preview_pane_set_message (self, error->message);
+      else if (!gabc_preview_pane_show_pages (self, cb_data->prefix))
+        gabc_preview_pane_set_message (self, "abcm2ps did not produce any pages");
+      else
+        gabc_preview_pane_set_message (self, NULL);
+
+      gabc_preview_pane_remove_files (self, cb_data->prefix);
+    }
+
+  g_object_unref (cb_data->preview_pane);
+  g_object_unref (cb_data->cancellable);
+  g_free (cb_data->prefix);
+  g_free (cb_data);
+}
+
+
+static gchar *
+gabc_preview_pane_get_path (GabcPreviewPane *self,
+                            const gchar     *prefix,
+                            const gchar     *extension)
+{
+  g_autofree gchar *name = g_strconcat (prefix, extension, NULL);
+
+  return g_build_filename (self->directory, name, NULL);
+}
+
+
+static void
+gabc_preview_pane_render (GabcPreviewPane *self)
+{
+  GtkTextBuffer *buffer = GTK_TEXT_BUFFER (self->tunebook);
+  GabcTuneIndex *tune_index;
+  GabcRenderJob *job;
+  preview_cb_data_t *cb_data;
+  GtkTextIter iter;
+  guint position;
+  g_autofree gchar *prefix = NULL;
+  g_autofree gchar *abc_path = NULL;
+  g_autofree gchar *svg_path = NULL;
+  g_autofree gchar *working_dir = NULL;
+  g_autoptr (GError) error = NULL;
+  g_autoptr (GStrvBuilder) builder = NULL;
+  g_auto (GStrv) argv = NULL;
+
+  if (!gtk_widget_get_mapped (GTK_WIDGET (self)))
+    {
+      self->stale = TRUE;
+      return;
+    }
+  self->stale = FALSE;
+
+  /* Whatever is still being engraved is out of date now. */
+  if (self->cancellable != NULL)
+    {
+      g_cancellable_cancel (self->cancellable);
+      g_clear_object (&self->cancellable);
+    }
+
+  tune_index = gabc_tunebook_get_tune_index (self->tunebook);
+  if (gabc_tune_index_get_n_tunes (tune_index) == 0)
+    {
+      g_clear_object (&self->tune_mark);
+      gabc_preview_pane_clear_pages (self);
+      gabc_preview_pane_set_message (self, "No tunes to preview");
+      return;
+    }
+
+  /* In the file header, show the first tune. */
+  gtk_text_buffer_get_iter_at_mark (buffer, &iter, gtk_text_buffer_get_insert (buffer));
+  if (!gabc_tune_index_lookup_offset (tune_index, gtk_text_iter_get_offset (&iter), &position))
+    position = 0;
+  g_set_object (&self->tune_mark, gabc_tune_index_get_tune (tune_index, position)->start_mark);
+
+  g_mkdir_with_parents (self->directory, 0700);
+  prefix = g_strdup_printf (GABC_PREVIEW_PANE_FILE_PREFIX "%u-", ++self->serial);
+  abc_path = gabc_preview_pane_get_path (self, prefix, ".abc");
+  svg_path = gabc_preview_pane_get_path (self, prefix, ".svg");
+
+  if (!gabc_tunebook_write_tunes_to_file (self->tunebook, GABC_PREPROCESSOR_TARGET_ABCM2PS,
+                                          position, position, abc_path, &error))
+    {
+      gabc_preview_pane_set_message (self, error->message);
+      return;
+    }
+
+  builder = g_strv_builder_new ();
+  g_strv_builder_add_many (builder, "abcm2ps", "-v", NULL);
+  g_strv_builder_addv (builder, (const char **) gabc_render_service_get_options (gabc_render_service_get_default (), "abcm2ps"));
+  g_strv_builder_add_many (builder, "-O", svg_path, abc_path, NULL);
+  argv = g_strv_builder_end (builder);
+
+  working_dir = gabc_tunebook_get_working_dir (self->tunebook);
+  job = gabc_render_job_new ((const gchar * const *) argv, working_dir);
+
+  self->cancellable = g_cancellable_new ();
+
+  cb_data = g_new0 (preview_cb_data_t, 1);
+  cb_data->preview_pane = g_object_ref (self);
+  cb_data->cancellable = g_object_ref (self->cancellable);
+  cb_data->prefix = g_steal_pointer (&prefix);
+
+  gabc_render_service_run_async (gabc_render_service_get_default (), job,
+                                 self->cancellable, gabc_preview_pane_render_cb, cb_data);
+  g_object_unref (job);
+}
+
+
+static gboolean
+gabc_preview_pane_debounce_cb (gpointer user_data)
+{
+  GabcPreviewPane *self = GABC_PREVIEW_PANE (user_data);
+
+  self->debounce_id = 0;
+  gabc_preview_pane_render (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+/*
+ * (Re)start the typing timer.  Only the last of a burst of changes leads
+ * to a render.
+ */
+static void
+gabc_preview_pane_schedule (GabcPreviewPane *self)
+{
+  if (self->tunebook == NULL)
+    return;
+
+  g_clear_handle_id (&self->debounce_id, g_source_remove);
+  self->debounce_id = g_timeout_add (GABC_PREVIEW_PANE_DEBOUNCE_MS,
+                                     gabc_preview_pane_debounce_cb,
+                                     self);
+}
+
+
+static void
+gabc_preview_pane_buffer_changed_cb (GtkTextBuffer   *buffer,
+                                     GabcPreviewPane *self)
+{
+  gabc_preview_pane_schedule (self);
+}
+
+
+static void
+gabc_preview_pane_cursor_moved_cb (GtkTextBuffer   *buffer,
+                                   GParamSpec      *pspec,
+                                   GabcPreviewPane *self)
+{
+  GabcTuneIndex *tune_index = gabc_tunebook_get_tune_index (self->tunebook);
+  GtkTextIter iter;
+  guint position;
+
+  if (gabc_tune_index_get_n_tunes (tune_index) == 0)
+    return;
+
+  gtk_text_buffer_get_iter_at_mark (buffer, &iter, gtk_text_buffer_get_insert (buffer));
+  if (!gabc_tune_index_lookup_offset (tune_index, gtk_text_iter_get_offset (&iter), &position))
+    position = 0;
+
+  if (gabc_tune_index_get_tune (tune_index, position)->start_mark != self->tune_mark)
+    gabc_preview_pane_schedule (self);
+}
+
+
+static void
+gabc_preview_pane_settings_changed_cb (GSettings       *settings,
+                                       const gchar     *key,
+                                       GabcPreviewPane *self)
+{
+  if (g_str_has_prefix (key, "abcm2ps-"))
+    gabc_preview_pane_schedule (self);
+}
+
+
+static void
+gabc_preview_pane_map (GtkWidget *widget)
+{
+  GabcPreviewPane *self = GABC_PREVIEW_PANE (widget);
+
+  GTK_WIDGET_CLASS (gabc_preview_pane_parent_class)->map (widget);
+
+  if (self->stale)
+    gabc_preview_pane_schedule (self);
+}
+
+
+static void
+gabc_preview_pane_dispose (GObject *object)
+{
+  GabcPreviewPane *self = GABC_PREVIEW_PANE (object);
+  GtkWidget *child;
+
+  gabc_preview_pane_set_tunebook (self, NULL);
+
+  if (self->cancellable != NULL)
+    {
+      g_cancellable_cancel (self->cancellable);
+      g_clear_object (&self->cancellable);
+    }
+
+  if (self->directory != NULL)
+    gabc_preview_pane_remove_files (self, NULL);
+
+  g_clear_object (&self->settings);
+
+  while ((child = gtk_widget_get_first_child (GTK_WIDGET (self))) != NULL)
+    gtk_widget_unparent (child);
+
+  G_OBJECT_CLASS (gabc_preview_pane_parent_class)->dispose (object);
+}
+
+
+static void
+gabc_preview_pane_finalize (GObject *object)
+{
+  GabcPreviewPane *self = GABC_PREVIEW_PANE (object);
+
+  g_free (self->directory);
+
+  G_OBJECT_CLASS (gabc_preview_pane_parent_class)->finalize (object);
+}
+
+
+static void
+gabc_preview_pane_class_init (GabcPreviewPaneClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+
+  object_class->dispose = gabc_preview_pane_dispose;
+  object_class->finalize = gabc_preview_pane_finalize;
+
+  widget_class->map = gabc_preview_pane_map;
+
+  gtk_widget_class_set_layout_manager_type (widget_class, GTK_TYPE_BOX_LAYOUT);
+  gtk_widget_class_set_css_name (widget_class, "preview");
+}
+
+
+static void
+gabc_preview_pane_init (GabcPreviewPane *self)
+{
+  GtkWidget *scrolled_window;
+
+  gtk_orientable_set_orientation (GTK_ORIENTABLE (gtk_widget_get_layout_manager (GTK_WIDGET (self))),
+                                  GTK_ORIENTATION_VERTICAL);
+
+  self->message_label = gtk_label_new (NULL);
+  gtk_label_set_wrap (GTK_LABEL (self->message_label), TRUE);
+  gtk_widget_set_margin_top (self->message_label, 6);
+  gtk_widget_set_margin_bottom (self->message_label, 6);
+  gtk_widget_add_css_class (self->message_label, "dim-label");
+  gtk_widget_set_visible (self->message_label, FALSE);
+  gtk_widget_set_parent (self->message_label, GTK_WIDGET (self));
+
+  self->page_box = gtk_box_new (GTK_ORIENTATION_VERTICAL, 12);
+
+  scrolled_window = gtk_scrolled_window_new ();
+  gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolled_window),
+                                  GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+  gtk_scrolled_window_set_child (GTK_SCROLLED_WINDOW (scrolled_window), self->page_box);
+  gtk_widget_set_vexpand (scrolled_window, TRUE);
+  gtk_widget_set_hexpand (scrolled_window, TRUE);
+  gtk_widget_set_parent (scrolled_window, GTK_WIDGET (self));
+
+  self->directory = g_build_filename (g_get_user_cache_dir (), "gabc", "preview", NULL);
+  self->settings = g_settings_new ("me.pm.m0dns.gabc");
+  g_signal_connect_object (self->settings, "changed",
+                           G_CALLBACK (gabc_preview_pane_settings_changed_cb),
+                           self, 0);
+
+  self->stale = TRUE;
+}
+
+
+GtkWidget *
+gabc_preview_pane_new (void)
+{
+  return g_object_new (GABC_TYPE_PREVIEW_PANE, NULL);
+}
+
+
+void
+gabc_preview_pane_set_tunebook (GabcPreviewPane *self,
+                                GabcTunebook    *tunebook)
+{
+  g_return_if_fail (GABC_IS_PREVIEW_PANE (self));
+
+  if (self->tunebook == tunebook)
+    return;
+
+  g_clear_handle_id (&self->debounce_id, g_source_remove);
+
+  if (self->tunebook != NULL)
+    {
+      g_signal_handlers_disconnect_by_data (self->tunebook, self);
+      g_clear_object (&self->tunebook);
+    }
+
+  g_clear_object (&self->tune_mark);
+
+  if (tunebook == NULL)
+    return;
+
+  self->tunebook = g_object_ref (tunebook);
+  g_signal_connect (tunebook, "changed",
+                    G_CALLBACK (gabc_preview_pane_buffer_changed_cb), self);
+  g_signal_connect (tunebook, "notify::cursor-position",
+                    G_CALLBACK (gabc_preview_pane_cursor_moved_cb), self);
+
+  gabc_preview_pane_schedule (self);
+}
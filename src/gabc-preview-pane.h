@@ -0,0 +1,37 @@
+/* gabc-preview-pane.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <gtk/gtk.h>
+
+#include "gabc-tunebook.h"
+
+G_BEGIN_DECLS
+
+#define GABC_TYPE_PREVIEW_PANE (gabc_preview_pane_get_type())
+
+G_DECLARE_FINAL_TYPE (GabcPreviewPane, gabc_preview_pane, GABC, PREVIEW_PANE, GtkWidget)
+
+GtkWidget                *gabc_preview_pane_new                   (void);
+
+void                      gabc_preview_pane_set_tunebook          (GabcPreviewPane *self,
+                                                                   GabcTunebook    *tunebook);
+
+G_END_DECLS
@@ -0,0 +1,374 @@
+/* gabc-render-cache.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Content addressed cache of rendered .ps and .mid files.
+ *
+ * Entries are plain files named <key>.<extension> in the cache directory,
+ * where the key is a hash of the abc text and every setting that affects the
+ * output (built by the caller).  Each tool writes to a temporary file of its
+ * own, which is renamed onto the entry once the tool succeeds, so two renders
+ * of the same text (one cancelled, say) never touch each other's output and
+ * an entry is never seen half written.  Least recently used
+ * entries are removed once the total size goes over the limit; the order
+ * survives restarts through the files' modification times.
+ */
+
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include "gabc-render-cache.h"
+
+#define GABC_RENDER_CACHE_DEFAULT_MAX_SIZE (64 * 1024 * 1024)
+#define GABC_RENDER_CACHE_TEMP_PREFIX "tmp-"
+
+/* Temporary files this old were left by a crash, not a running render. */
+#define GABC_RENDER_CACHE_TEMP_MAX_AGE (24 * 60 * 60)
+
+typedef struct {
+  gchar   *name;
+  guint64  size;
+  gint64   mtime;
+} GabcRenderCacheEntry;
+
+struct _GabcRenderCache
+{
+  GObject                       parent_instance;
+
+  gchar                        *directory;
+  guint64                       max_size;
+  guint64                       size;
+
+  GQueue                        lru;          /* most recently used at the head */
+  GHashTable                   *entries;      /* name -> GList link in lru */
+
+  guint                         hits;
+  guint                         misses;
+  guint                         evictions;
+  guint                         serial;
+};
+
+G_DEFINE_FINAL_TYPE (GabcRenderCache, gabc_render_cache, G_TYPE_OBJECT)
+
+
+static void
+gabc_render_cache_entry_free (GabcRenderCacheEntry *entry)
+{
+  g_free (entry->name);
+  g_free (entry);
+}
+
+
+static gchar *
+gabc_render_cache_get_entry_name (const gchar *key, const gchar *extension)
+{
+  return g_strconcat (key, ".", extension, NULL);
+}
+
+
+static void
+gabc_render_cache_remove_link (GabcRenderCache *self, GList *link)
+{
+  GabcRenderCacheEntry *entry = link->data;
+
+  self->size -= entry->size;
+  g_hash_table_remove (self->entries, entry->name);
+  g_queue_delete_link (&self->lru, link);
+  gabc_render_cache_entry_free (entry);
+}
+
+
+/*
+ * Drop least recently used entries until the cache fits, always keeping
+ * the most recent one (which the caller is usually about to open).
+ */
+static void
+gabc_render_cache_evict (GabcRenderCache *self)
+{
+  while (self->size > self->max_size && self->lru.length > 1)
+    {
+      GList *link = self->lru.tail;
+      GabcRenderCacheEntry *entry = link->data;
+      g_autofree gchar *path = g_build_filename (self->directory, entry->name, NULL);
+
+      g_unlink (path);
+      gabc_render_cache_remove_link (self, link);
+      self->evictions++;
+    }
+}
+
+
+static gint
+gabc_render_cache_compare_mtime (gconstpointer a,
+                                 gconstpointer b,
+                                 gpointer      user_data)
+{
+  const GabcRenderCacheEntry *entry_a = a;
+  const GabcRenderCacheEntry *entry_b = b;
+
+  /* Newest first. */
+  return (entry_a->mtime < entry_b->mtime) - (entry_a->mtime > entry_b->mtime);
+}
+
+
+static void
+gabc_render_cache_load (GabcRenderCache *self)
+{
+  GDir *dir;
+  const gchar *name;
+  GList *link;
+
+  dir = g_dir_open (self->directory, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      g_autofree gchar *path = g_build_filename (self->directory, name, NULL);
+      GStatBuf buf;
+      GabcRenderCacheEntry *entry;
+
+      if (g_stat (path, &buf) != 0 || !S_ISREG (buf.st_mode))
+        continue;
+
+      /* Other instances may be rendering into theirs right now. */
+      if (g_str_has_prefix (name, GABC_RENDER_CACHE_TEMP_PREFIX))
+        {
+          if (buf.st_mtime < g_get_real_time () / G_USEC_PER_SEC - GABC_RENDER_CACHE_TEMP_MAX_AGE)
+            g_unlink (path);
+          continue;
+        }
+
+      entry = g_new0 (GabcRenderCacheEntry, 1);
+      entry->name = g_strdup (name);
+      entry->size = buf.st_size;
+      entry->mtime = buf.st_mtime;
+      g_queue_push_tail (&self->lru, entry);
+      self->size += entry->size;
+    }
+  g_dir_close (dir);
+
+  g_queue_sort (&self->lru, gabc_render_cache_compare_mtime, NULL);
+
+  for (link = self->lru.head; link != NULL; link = link->next)
+    g_hash_table_insert (self->entries, ((GabcRenderCacheEntry *) link->data)->name, link);
+}
+
+
+static void
+gabc_render_cache_finalize (GObject *object)
+{
+  GabcRenderCache *self = GABC_RENDER_CACHE (object);
+
+  g_hash_table_unref (self->entries);
+  g_queue_clear_full (&self->lru, (GDestroyNotify) gabc_render_cache_entry_free);
+  g_free (self->directory);
+
+  G_OBJECT_CLASS (gabc_render_cache_parent_class)->finalize (object);
+}
+
+
+static void
+gabc_render_cache_class_init (GabcRenderCacheClass *klass)
+{
+  G_OBJECT_CLASS (klass)->finalize = gabc_render_cache_finalize;
+}
+
+
+static void
+gabc_render_cache_init (GabcRenderCache *self)
+{
+  g_queue_init (&self->lru);
+  self->entries = g_hash_table_new (g_str_hash, g_str_equal);
+  self->max_size = GABC_RENDER_CACHE_DEFAULT_MAX_SIZE;
+}
+
+
+GabcRenderCache *
+gabc_render_cache_new (const gchar *directory)
+{
+  GabcRenderCache *self;
+
+  self = g_object_new (GABC_TYPE_RENDER_CACHE, NULL);
+  self->directory = g_strdup (directory);
+  gabc_render_cache_load (self);
+
+  return self;
+}
+
+
+/*
+ * The cache shared by all windows, in $XDG_CACHE_HOME/gabc/render.
+ */
+GabcRenderCache *
+gabc_render_cache_get_default (void)
+{
+  static GabcRenderCache *default_cache = NULL;
+
+  if (default_cache == NULL)
+    {
+      g_autofree gchar *directory = g_build_filename (g_get_user_cache_dir (), "gabc", "render", NULL);
+      default_cache = gabc_render_cache_new (directory);
+    }
+
+  return default_cache;
+}
+
+
+void
+gabc_render_cache_set_max_size (GabcRenderCache *self,
+                                guint64          max_size)
+{
+  self->max_size = max_size;
+  gabc_render_cache_evict (self);
+}
+
+
+/*
+ * Returns the path of the cached output for key, or NULL on a miss.
+ */
+gchar *
+gabc_render_cache_lookup (GabcRenderCache *self,
+                          const gchar     *key,
+                          const gchar     *extension)
+{
+  g_autofree gchar *name = gabc_render_cache_get_entry_name (key, extension);
+  gchar *path;
+  GList *link;
+
+  link = g_hash_table_lookup (self->entries, name);
+  if (link == NULL)
+    {
+      self->misses++;
+      return NULL;
+    }
+
+  path = g_build_filename (self->directory, name, NULL);
+
+  /* Someone may have cleaned the cache directory behind our back. */
+  if (!g_file_test (path, G_FILE_TEST_IS_REGULAR))
+    {
+      gabc_render_cache_remove_link (self, link);
+      g_free (path);
+      self->misses++;
+      return NULL;
+    }
+
+  g_queue_unlink (&self->lru, link);
+  g_queue_push_head_link (&self->lru, link);
+  g_utime (path, NULL);
+
+  self->hits++;
+  return path;
+}
+
+
+/*
+ * A new temporary file for a tool to write the output for key to, unique to
+ * this render.  Pass it to gabc_render_cache_commit () once it has been
+ * written successfully or to gabc_render_cache_discard () if it failed.
+ */
+gchar *
+gabc_render_cache_get_temp_path (GabcRenderCache *self,
+                                 const gchar     *key,
+                                 const gchar     *extension)
+{
+  g_autofree gchar *name = NULL;
+
+  g_mkdir_with_parents (self->directory, 0700);
+
+  /* The tools go by the extension, so it stays at the end. */
+  name = g_strdup_printf (GABC_RENDER_CACHE_TEMP_PREFIX "%d-%u-%s.%s",
+                          (gint) getpid (), ++self->serial, key, extension);
+
+  return g_build_filename (self->directory, name, NULL);
+}
+
+
+/*
+ * Move temp_path onto the entry for key.  Returns the path of the entry, or
+ * NULL, leaving temp_path where it is, if it could not be moved.
+ */
+gchar *
+gabc_render_cache_commit (GabcRenderCache *self,
+                          const gchar     *key,
+                          const gchar     *extension,
+                          const gchar     *temp_path)
+{
+  g_autofree gchar *name = gabc_render_cache_get_entry_name (key, extension);
+  g_autofree gchar *path = g_build_filename (self->directory, name, NULL);
+  GabcRenderCacheEntry *entry;
+  GStatBuf buf;
+  GList *link;
+
+  link = g_hash_table_lookup (self->entries, name);
+  if (link != NULL)
+    gabc_render_cache_remove_link (self, link);
+
+  if (g_rename (temp_path, path) != 0 || g_stat (path, &buf) != 0)
+    return NULL;
+
+  entry = g_new0 (GabcRenderCacheEntry, 1);
+  entry->name = g_steal_pointer (&name);
+  entry->size = buf.st_size;
+  entry->mtime = buf.st_mtime;
+
+  g_queue_push_head (&self->lru, entry);
+  g_hash_table_insert (self->entries, entry->name, self->lru.head);
+  self->size += entry->size;
+
+  gabc_render_cache_evict (self);
+
+  return g_steal_pointer (&path);
+}
+
+
+/*
+ * Remove the temporary file of a render that failed or was cancelled.  The
+ * entry for its key, and any other render of it, are left alone.
+ */
+void
+gabc_render_cache_discard (GabcRenderCache *self,
+                           const gchar     *temp_path)
+{
+  g_unlink (temp_path);
+}
+
+
+/*
+ * Any of the out parameters may be NULL.
+ */
+void
+gabc_render_cache_get_stats (GabcRenderCache *self,
+                             guint           *hits,
+                             guint           *misses,
+                             guint           *evictions,
+                             guint64         *size)
+{
+  if (hits != NULL)
+    *hits = self->hits;
+  if (misses != NULL)
+    *misses = self->misses;
+  if (evictions != NULL)
+    *evictions = self->evictions;
+  if (size != NULL)
+    *size = self->size;
+}
@@ -0,0 +1,59 @@
+/* gabc-render-cache.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define GABC_TYPE_RENDER_CACHE (gabc_render_cache_get_type())
+
+G_DECLARE_FINAL_TYPE (GabcRenderCache, gabc_render_cache, GABC, RENDER_CACHE, GObject)
+
+GabcRenderCache          *gabc_render_cache_get_default           (void);
+
+GabcRenderCache          *gabc_render_cache_new                   (const gchar     *directory);
+
+void                      gabc_render_cache_set_max_size          (GabcRenderCache *self,
+                                                                   guint64          max_size);
+
+gchar *                   gabc_render_cache_lookup                (GabcRenderCache *self,
+                                                                   const gchar     *key,
+                                                                   const gchar     *extension);
+
+gchar *                   gabc_render_cache_get_temp_path         (GabcRenderCache *self,
+                                                                   const gchar     *key,
+                                                                   const gchar     *extension);
+
+gchar *                   gabc_render_cache_commit                (GabcRenderCache *self,
+                                                                   const gchar     *key,
+                                                                   const gchar     *extension,
+                                                                   const gchar     *temp_path);
+
+void                      gabc_render_cache_discard               (GabcRenderCache *self,
+                                                                   const gchar     *temp_path);
+
+void                      gabc_render_cache_get_stats             (GabcRenderCache *self,
+                                                                   guint           *hits,
+                                                                   guint           *misses,
+                                                                   guint           *evictions,
+                                                                   guint64         *size);
+
+G_END_DECLS
@@ -0,0 +1,395 @@
+/* gabc-render-job.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * A single run of one of the external tools (abcm2ps or abc2midi).
+ *
+ * The child is started with GSubprocess and its stdout/stderr pipes are read
+ * a line at a time on the main loop, so the UI is never blocked waiting for
+ * the tool.  Each line is emitted through the "output-line" signal as it
+ * arrives and is also collected so callers can inspect the whole output once
+ * the job has finished.  Cancelling the GCancellable passed to
+ * gabc_render_job_run_async () kills the child.
+ */
+
+#include "gabc-render-job.h"
+#include "gabc-render-stats.h"
+
+struct _GabcRenderJob
+{
+  GObject                       parent_instance;
+
+  guint                         id;
+  GStrv                         argv;
+  gchar                        *program;
+  gchar                        *working_dir;
+
+  GSubprocess                  *subprocess;
+  gint64                        start_time;
+  GDataInputStream             *stdout_stream;
+  GDataInputStream             *stderr_stream;
+  GString                      *standard_output;
+  GString                      *standard_error;
+  gint                          exit_status;
+
+  GTask                        *task;
+  gulong                        cancelled_id;
+  guint                         n_pending;
+  GError                       *error;
+};
+
+G_DEFINE_FINAL_TYPE (GabcRenderJob, gabc_render_job, G_TYPE_OBJECT)
+
+enum {
+  OUTPUT_LINE,
+  N_SIGNALS
+};
+
+static guint signals [N_SIGNALS];
+
+static guint next_job_id = 1;
+
+static void gabc_render_job_read_line (GabcRenderJob *self, GDataInputStream *stream);
+
+
+static void
+gabc_render_job_finalize (GObject *object)
+{
+  GabcRenderJob *self = GABC_RENDER_JOB (object);
+
+  g_strfreev (self->argv);
+  g_free (self->program);
+  g_free (self->working_dir);
+  g_clear_object (&self->subprocess);
+  g_clear_object (&self->stdout_stream);
+  g_clear_object (&self->stderr_stream);
+  g_string_free (self->standard_output, TRUE);
+  g_string_free (self->standard_error, TRUE);
+  g_clear_object (&self->task);
+  g_clear_error (&self->error);
+
+  G_OBJECT_CLASS (gabc_render_job_parent_class)->finalize (object);
+}
+
+
+static void
+gabc_render_job_class_init (GabcRenderJobClass *klass)
+{
+  G_OBJECT_CLASS (klass)->finalize = gabc_render_job_finalize;
+
+  /*
+   * Emitted for every line the tool writes, as soon as it is read.
+   * The line has no trailing newline and is valid UTF-8.
+   */
+  signals [OUTPUT_LINE] =
+    g_signal_new ("output-line",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE,
+                  2,
+                  G_TYPE_STRING,
+                  G_TYPE_BOOLEAN);
+}
+
+
+static void
+gabc_render_job_init (GabcRenderJob *self)
+{
+  self->id = next_job_id++;
+  self->standard_output = g_string_new (NULL);
+  self->standard_error = g_string_new (NULL);
+  self->exit_status = -1;
+}
+
+
+GabcRenderJob *
+gabc_render_job_new (const gchar * const *argv,
+                     const gchar         *working_dir)
+{
+  GabcRenderJob *self;
+
+  g_return_val_if_fail (argv != NULL && argv[0] != NULL, NULL);
+
+  self = g_object_new (GABC_TYPE_RENDER_JOB, NULL);
+  self->argv = g_strdupv ((gchar **) argv);
+  self->working_dir = g_strdup (working_dir);
+
+  return self;
+}
+
+
+/*
+ * Run program (usually the tool's full path) instead of looking argv[0] up
+ * in PATH.  argv[0] is still what the tool is called in the output.
+ */
+void
+gabc_render_job_set_program (GabcRenderJob *self,
+                             const gchar   *program)
+{
+  g_return_if_fail (GABC_IS_RENDER_JOB (self));
+
+  g_free (self->program);
+  self->program = g_strdup (program);
+}
+
+
+static void
+gabc_render_job_cancelled_cb (GCancellable  *cancellable,
+                              GabcRenderJob *self)
+{
+  if (self->subprocess != NULL)
+    g_subprocess_force_exit (self->subprocess);
+}
+
+
+/*
+ * Called once for each of the three outstanding operations (two pipes and
+ * the child exit).  The task completes when all of them are done so that
+ * no output is lost between the child exiting and its pipes draining.
+ */
+static void
+gabc_render_job_operation_done (GabcRenderJob *self)
+{
+  g_autoptr (GTask) task = NULL;
+
+  g_assert (self->n_pending > 0);
+
+  if (--self->n_pending > 0)
+    return;
+
+  task = g_steal_pointer (&self->task);
+
+  g_cancellable_disconnect (g_task_get_cancellable (task), self->cancelled_id);
+  self->cancelled_id = 0;
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  if (self->error != NULL)
+    g_task_return_error (task, g_steal_pointer (&self->error));
+  else
+    g_task_return_boolean (task, TRUE);
+}
+
+
+static void
+gabc_render_job_read_line_cb (GObject      *source_object,
+                              GAsyncResult *result,
+                              gpointer      user_data)
+{
+  GabcRenderJob *self = GABC_RENDER_JOB (user_data);
+  GDataInputStream *stream = G_DATA_INPUT_STREAM (source_object);
+  gboolean is_stderr = (stream == self->stderr_stream);
+  g_autofree gchar *line = NULL;
+  g_autofree gchar *valid_line = NULL;
+  g_autoptr (GError) error = NULL;
+
+  line = g_data_input_stream_read_line_finish (stream, result, NULL, &error);
+
+  if (line == NULL)
+    {
+      /* EOF, a failed read (the job's error) or one cancelled with the job. */
+      if (error != NULL && self->error == NULL &&
+          !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        self->error = g_steal_pointer (&error);
+
+      gabc_render_job_operation_done (self);
+      g_object_unref (self);
+      return;
+    }
+
+  valid_line = g_utf8_make_valid (line, -1);
+
+  g_string_append (is_stderr ? self->standard_error : self->standard_output, valid_line);
+  g_string_append_c (is_stderr ? self->standard_error : self->standard_output, '\n');
+
+  g_signal_emit (self, signals [OUTPUT_LINE], 0, valid_line, is_stderr);
+
+  gabc_render_job_read_line (self, stream);
+  g_object_unref (self);
+}
+
+
+static void
+gabc_render_job_read_line (GabcRenderJob    *self,
+                           GDataInputStream *stream)
+{
+  g_data_input_stream_read_line_async (stream,
+                                       G_PRIORITY_DEFAULT,
+                                       g_task_get_cancellable (self->task),
+                                       gabc_render_job_read_line_cb,
+                                       g_object_ref (self));
+}
+
+
+static void
+gabc_render_job_wait_cb (GObject      *source_object,
+                         GAsyncResult *result,
+                         gpointer      user_data)
+{
+  GabcRenderJob *self = GABC_RENDER_JOB (user_data);
+  GSubprocess *subprocess = G_SUBPROCESS (source_object);
+  GError *error = NULL;
+
+  if (g_subprocess_wait_finish (subprocess, result, &error))
+    {
+      if (g_subprocess_get_if_exited (subprocess))
+        self->exit_status = g_subprocess_get_exit_status (subprocess);
+    }
+  else if (self->error == NULL)
+    {
+      self->error = error;
+    }
+  else
+    {
+      g_clear_error (&error);
+    }
+
+  gabc_render_stats_add_time (gabc_render_stats_get_default (), GABC_RENDER_METRIC_TOOL,
+                              self->start_time, g_get_monotonic_time ());
+
+  gabc_render_job_operation_done (self);
+  g_object_unref (self);
+}
+
+
+void
+gabc_render_job_run_async (GabcRenderJob       *self,
+                           GCancellable        *cancellable,
+                           GAsyncReadyCallback  callback,
+                           gpointer             user_data)
+{
+  g_autoptr (GSubprocessLauncher) launcher = NULL;
+  g_autofree const gchar **spawn_argv = NULL;
+  GError *error = NULL;
+  gint64 spawn_time;
+
+  g_return_if_fail (GABC_IS_RENDER_JOB (self));
+  g_return_if_fail (self->task == NULL);
+  g_return_if_fail (self->subprocess == NULL);
+
+  self->task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (self->task, gabc_render_job_run_async);
+
+  /* Don't pay for a fork that would be killed straight away. */
+  if (g_task_return_error_if_cancelled (self->task))
+    {
+      g_clear_object (&self->task);
+      return;
+    }
+
+  spawn_argv = g_memdup2 (self->argv, (g_strv_length (self->argv) + 1) * sizeof (gchar *));
+  if (self->program != NULL)
+    spawn_argv[0] = self->program;
+
+  launcher = g_subprocess_launcher_new (G_SUBPROCESS_FLAGS_STDOUT_PIPE |
+                                        G_SUBPROCESS_FLAGS_STDERR_PIPE);
+  if (self->working_dir != NULL)
+    g_subprocess_launcher_set_cwd (launcher, self->working_dir);
+
+  spawn_time = g_get_monotonic_time ();
+  self->subprocess = g_subprocess_launcher_spawnv (launcher,
+                                                   (const gchar * const *) spawn_argv,
+                                                   &error);
+  if (self->subprocess == NULL)
+    {
+      g_autoptr (GTask) task = g_steal_pointer (&self->task);
+      g_task_return_error (task, error);
+      return;
+    }
+
+  self->start_time = g_get_monotonic_time ();
+  gabc_render_stats_add_time (gabc_render_stats_get_default (), GABC_RENDER_METRIC_SPAWN,
+                              spawn_time, self->start_time);
+
+  self->stdout_stream = g_data_input_stream_new (g_subprocess_get_stdout_pipe (self->subprocess));
+  self->stderr_stream = g_data_input_stream_new (g_subprocess_get_stderr_pipe (self->subprocess));
+
+  self->n_pending = 3;
+
+  g_subprocess_wait_async (self->subprocess,
+                           NULL,
+                           gabc_render_job_wait_cb,
+                           g_object_ref (self));
+
+  gabc_render_job_read_line (self, self->stdout_stream);
+  gabc_render_job_read_line (self, self->stderr_stream);
+
+  /* Connect last: if the cancellable is already cancelled this kills the
+   * child immediately and the pending operations unwind on their own. */
+  if (cancellable != NULL)
+    self->cancelled_id = g_cancellable_connect (cancellable,
+                                                G_CALLBACK (gabc_render_job_cancelled_cb),
+                                                self,
+                                                NULL);
+}
+
+
+gboolean
+gabc_render_job_run_finish (GabcRenderJob  *self,
+                            GAsyncResult   *result,
+                            GError        **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, self), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+
+guint
+gabc_render_job_get_id (GabcRenderJob *self)
+{
+  return self->id;
+}
+
+
+const gchar *
+gabc_render_job_get_tool (GabcRenderJob *self)
+{
+  return self->argv[0];
+}
+
+
+/*
+ * Returns the exit status of the tool, or -1 if it did not exit normally
+ * (killed, cancelled or never started).
+ */
+gint
+gabc_render_job_get_exit_status (GabcRenderJob *self)
+{
+  return self->exit_status;
+}
+
+
+const gchar *
+gabc_render_job_get_standard_output (GabcRenderJob *self)
+{
+  return self->standard_output->str;
+}
+
+
+const gchar *
+gabc_render_job_get_standard_error (GabcRenderJob *self)
+{
+  return self->standard_error->str;
+}
@@ -0,0 +1,55 @@
+/* gabc-render-job.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define GABC_TYPE_RENDER_JOB (gabc_render_job_get_type())
+
+G_DECLARE_FINAL_TYPE (GabcRenderJob, gabc_render_job, GABC, RENDER_JOB, GObject)
+
+GabcRenderJob            *gabc_render_job_new                     (const gchar * const *argv,
+                                                                   const gchar         *working_dir);
+
+void                      gabc_render_job_set_program             (GabcRenderJob       *self,
+                                                                   const gchar         *program);
+
+void                      gabc_render_job_run_async               (GabcRenderJob       *self,
+                                                                   GCancellable        *cancellable,
+                                                                   GAsyncReadyCallback  callback,
+                                                                   gpointer             user_data);
+
+gboolean                  gabc_render_job_run_finish              (GabcRenderJob       *self,
+                                                                   GAsyncResult        *result,
+                                                                   GError             **error);
+
+guint                     gabc_render_job_get_id                  (GabcRenderJob *self);
+
+const gchar *             gabc_render_job_get_tool                (GabcRenderJob *self);
+
+gint                      gabc_render_job_get_exit_status         (GabcRenderJob *self);
+
+const gchar *             gabc_render_job_get_standard_output     (GabcRenderJob *self);
+
+const gchar *             gabc_render_job_get_standard_error      (GabcRenderJob *self);
+
+G_END_DECLS
@@ -0,0 +1,395 @@
+/* gabc-render-service.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Runs the render jobs of every window, a few at a time.
+ *
+ * abcm2ps and abc2midi read one set of files and exit, so they can't be
+ * kept running between renders.  What can be kept is everything gabc does
+ * around each spawn: the tools are looked up in PATH once and run by their
+ * full path, and the options that come from the preferences are built once
+ * and rebuilt only when a preference changes.  Jobs beyond max_jobs wait
+ * in a queue rather than all forking at once.
+ *
+ * Every job's wait in the queue and run time are reported through the
+ * "job-finished" signal, and running totals through
+ * gabc_render_service_get_stats ().
+ */
+
+#include "gabc-render-service.h"
+#include "gabc-render-stats.h"
+
+typedef struct {
+  GabcRenderService    *service;
+  GabcRenderJob        *job;
+  GCancellable         *cancellable;
+  GAsyncReadyCallback   callback;
+  gpointer              user_data;
+  gint64                queued_time;
+  gint64                start_time;
+} GabcRenderServiceRequest;
+
+struct _GabcRenderService
+{
+  GObject                       parent_instance;
+
+  GSettings                    *settings;
+  GHashTable                   *programs;     /* tool -> full path */
+  GHashTable                   *options;      /* tool -> GStrv */
+
+  GQueue                        queue;        /* GabcRenderServiceRequest */
+  guint                         n_running;
+  guint                         max_jobs;
+
+  guint                         n_jobs;
+  guint                         max_queue_depth;
+  gint64                        total_latency;
+};
+
+G_DEFINE_FINAL_TYPE (GabcRenderService, gabc_render_service, G_TYPE_OBJECT)
+
+enum {
+  JOB_FINISHED,
+  N_SIGNALS
+};
+
+static guint signals [N_SIGNALS];
+
+static void gabc_render_service_dispatch (GabcRenderService *self);
+
+
+static void
+gabc_render_service_request_free (GabcRenderServiceRequest *request)
+{
+  g_object_unref (request->job);
+  g_clear_object (&request->cancellable);
+  g_free (request);
+}
+
+
+static void
+gabc_render_service_settings_changed_cb (GSettings         *settings,
+                                         const gchar       *key,
+                                         GabcRenderService *self)
+{
+  /* The keys are named after the tool they are passed to. */
+  if (g_str_has_prefix (key, "abcm2ps-"))
+    g_hash_table_remove (self->options, "abcm2ps");
+  else if (g_str_has_prefix (key, "abc2midi-"))
+    g_hash_table_remove (self->options, "abc2midi");
+}
+
+
+static void
+gabc_render_service_finalize (GObject *object)
+{
+  GabcRenderService *self = GABC_RENDER_SERVICE (object);
+
+  g_queue_clear_full (&self->queue, (GDestroyNotify) gabc_render_service_request_free);
+  g_hash_table_unref (self->programs);
+  g_hash_table_unref (self->options);
+  g_clear_object (&self->settings);
+
+  G_OBJECT_CLASS (gabc_render_service_parent_class)->finalize (object);
+}
+
+
+static void
+gabc_render_service_class_init (GabcRenderServiceClass *klass)
+{
+  G_OBJECT_CLASS (klass)->finalize = gabc_render_service_finalize;
+
+  /*
+   * Emitted when a job has finished, before its callback is called, with
+   * the microseconds it spent waiting in the queue and running.
+   */
+  signals [JOB_FINISHED] =
+    g_signal_new ("job-finished",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE,
+                  3,
+                  GABC_TYPE_RENDER_JOB,
+                  G_TYPE_INT64,
+                  G_TYPE_INT64);
+}
+
+
+static void
+gabc_render_service_init (GabcRenderService *self)
+{
+  g_queue_init (&self->queue);
+  self->programs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  self->options = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_strfreev);
+  self->max_jobs = g_get_num_processors ();
+}
+
+
+GabcRenderService *
+gabc_render_service_new (GSettings *settings)
+{
+  GabcRenderService *self;
+
+  g_return_val_if_fail (G_IS_SETTINGS (settings), NULL);
+
+  self = g_object_new (GABC_TYPE_RENDER_SERVICE, NULL);
+  self->settings = g_object_ref (settings);
+  g_signal_connect_object (settings, "changed",
+                           G_CALLBACK (gabc_render_service_settings_changed_cb),
+                           self, 0);
+
+  return self;
+}
+
+
+/*
+ * The service shared by all windows.
+ */
+GabcRenderService *
+gabc_render_service_get_default (void)
+{
+  static GabcRenderService *default_service = NULL;
+
+  if (default_service == NULL)
+    {
+      g_autoptr (GSettings) settings = g_settings_new ("me.pm.m0dns.gabc");
+      default_service = gabc_render_service_new (settings);
+    }
+
+  return default_service;
+}
+
+
+void
+gabc_render_service_set_max_jobs (GabcRenderService *self,
+                                  guint              max_jobs)
+{
+  self->max_jobs = MAX (max_jobs, 1);
+  gabc_render_service_dispatch (self);
+}
+
+
+guint
+gabc_render_service_get_max_jobs (GabcRenderService *self)
+{
+  return self->max_jobs;
+}
+
+
+static GStrv
+gabc_render_service_build_options (GabcRenderService *self,
+                                   const gchar       *tool)
+{
+  g_autoptr (GStrvBuilder) builder = g_strv_builder_new ();
+
+  if (g_strcmp0 (tool, "abcm2ps") == 0)
+    {
+      g_autofree gchar *fmt_file_path = g_settings_get_string (self->settings, "abcm2ps-fmt-file-path");
+
+      if (g_settings_get_boolean (self->settings, "abcm2ps-show-errors"))
+        g_strv_builder_add (builder, "-i");
+
+      if (fmt_file_path[0] != '\0')
+        {
+          g_strv_builder_add (builder, "-F");
+          g_strv_builder_add (builder, fmt_file_path);
+        }
+    }
+  else if (g_strcmp0 (tool, "abc2midi") == 0)
+    {
+      gint barfly_mode = g_settings_get_enum (self->settings, "abc2midi-barfly-mode");
+
+      if (barfly_mode != 0)
+        {
+          g_autofree gchar *barfly_text = g_strdup_printf ("%d", barfly_mode);
+
+          g_strv_builder_add (builder, "-BF");
+          g_strv_builder_add (builder, barfly_text);
+        }
+    }
+
+  return g_strv_builder_end (builder);
+}
+
+
+/*
+ * The options from the preferences that every run of tool takes, to go
+ * straight after the tool's name.  Page numbering isn't included as the
+ * preview doesn't use it.  The array belongs to the service and is only
+ * valid until the preferences change; copy what you keep.
+ */
+const gchar * const *
+gabc_render_service_get_options (GabcRenderService *self,
+                                 const gchar       *tool)
+{
+  GStrv options;
+
+  g_return_val_if_fail (GABC_IS_RENDER_SERVICE (self), NULL);
+
+  options = g_hash_table_lookup (self->options, tool);
+  if (options == NULL)
+    {
+      options = gabc_render_service_build_options (self, tool);
+      g_hash_table_insert (self->options, g_strdup (tool), options);
+    }
+
+  return (const gchar * const *) options;
+}
+
+
+/*
+ * Full path of tool, looked up in PATH the first time and again only if
+ * the program has gone away since.
+ */
+static const gchar *
+gabc_render_service_get_program (GabcRenderService *self,
+                                 const gchar       *tool)
+{
+  const gchar *program;
+  gchar *found;
+
+  program = g_hash_table_lookup (self->programs, tool);
+  if (program != NULL && g_file_test (program, G_FILE_TEST_IS_EXECUTABLE))
+    return program;
+
+  found = g_find_program_in_path (tool);
+  if (found == NULL)
+    {
+      g_hash_table_remove (self->programs, tool);
+      return NULL;
+    }
+
+  g_hash_table_insert (self->programs, g_strdup (tool), found);
+
+  return found;
+}
+
+
+static void
+gabc_render_service_job_cb (GObject      *source_object,
+                            GAsyncResult *result,
+                            gpointer      user_data)
+{
+  GabcRenderServiceRequest *request = user_data;
+  GabcRenderService *self = request->service;
+  gint64 end_time = g_get_monotonic_time ();
+  gint64 wait_time = request->start_time - request->queued_time;
+  gint64 run_time = end_time - request->start_time;
+
+  self->n_running--;
+  self->n_jobs++;
+  self->total_latency += end_time - request->queued_time;
+
+  gabc_render_stats_add_time (gabc_render_stats_get_default (), GABC_RENDER_METRIC_QUEUE,
+                              request->queued_time, request->start_time);
+
+  g_signal_emit (self, signals [JOB_FINISHED], 0, request->job, wait_time, run_time);
+
+  if (request->callback != NULL)
+    request->callback (source_object, result, request->user_data);
+
+  gabc_render_service_request_free (request);
+
+  gabc_render_service_dispatch (self);
+}
+
+
+/*
+ * Start queued jobs while there are free slots.
+ */
+static void
+gabc_render_service_dispatch (GabcRenderService *self)
+{
+  while (self->n_running < self->max_jobs && self->queue.length > 0)
+    {
+      GabcRenderServiceRequest *request = g_queue_pop_head (&self->queue);
+      const gchar *program;
+
+      program = gabc_render_service_get_program (self, gabc_render_job_get_tool (request->job));
+      if (program != NULL)
+        gabc_render_job_set_program (request->job, program);
+
+      request->start_time = g_get_monotonic_time ();
+      self->n_running++;
+
+      gabc_render_job_run_async (request->job,
+                                 request->cancellable,
+                                 gabc_render_service_job_cb,
+                                 request);
+    }
+}
+
+
+/*
+ * Queue job to be run with gabc_render_job_run_async () once a slot is
+ * free.  callback is called with the job as its source object, so finish
+ * it with gabc_render_job_run_finish () as usual.  A job cancelled while
+ * it is queued finishes without starting the tool.
+ */
+void
+gabc_render_service_run_async (GabcRenderService   *self,
+                               GabcRenderJob       *job,
+                               GCancellable        *cancellable,
+                               GAsyncReadyCallback  callback,
+                               gpointer             user_data)
+{
+  GabcRenderServiceRequest *request;
+
+  g_return_if_fail (GABC_IS_RENDER_SERVICE (self));
+  g_return_if_fail (GABC_IS_RENDER_JOB (job));
+
+  request = g_new0 (GabcRenderServiceRequest, 1);
+  request->service = self;
+  request->job = g_object_ref (job);
+  request->cancellable = cancellable != NULL ? g_object_ref (cancellable) : NULL;
+  request->callback = callback;
+  request->user_data = user_data;
+  request->queued_time = g_get_monotonic_time ();
+
+  g_queue_push_tail (&self->queue, request);
+  self->max_queue_depth = MAX (self->max_queue_depth, self->queue.length);
+
+  gabc_render_service_dispatch (self);
+}
+
+
+/*
+ * Any of the out parameters may be NULL.  mean_latency is from queueing
+ * to finishing, in microseconds.
+ */
+void
+gabc_render_service_get_stats (GabcRenderService *self,
+                               guint             *n_jobs,
+                               guint             *queue_depth,
+                               guint             *max_queue_depth,
+                               gint64            *mean_latency)
+{
+  if (n_jobs != NULL)
+    *n_jobs = self->n_jobs;
+  if (queue_depth != NULL)
+    *queue_depth = self->queue.length;
+  if (max_queue_depth != NULL)
+    *max_queue_depth = self->max_queue_depth;
+  if (mean_latency != NULL)
+    *mean_latency = self->n_jobs > 0 ? self->total_latency / self->n_jobs : 0;
+}
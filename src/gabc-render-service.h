@@ -0,0 +1,56 @@
+/* gabc-render-service.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <gio/gio.h>
+
+#include "gabc-render-job.h"
+
+G_BEGIN_DECLS
+
+#define GABC_TYPE_RENDER_SERVICE (gabc_render_service_get_type())
+
+G_DECLARE_FINAL_TYPE (GabcRenderService, gabc_render_service, GABC, RENDER_SERVICE, GObject)
+
+GabcRenderService        *gabc_render_service_new                 (GSettings           *settings);
+
+GabcRenderService        *gabc_render_service_get_default         (void);
+
+void                      gabc_render_service_set_max_jobs        (GabcRenderService   *self,
+                                                                   guint                max_jobs);
+
+guint                     gabc_render_service_get_max_jobs        (GabcRenderService   *self);
+
+const gchar * const *     gabc_render_service_get_options         (GabcRenderService   *self,
+                                                                   const gchar         *tool);
+
+void                      gabc_render_service_run_async           (GabcRenderService   *self,
+                                                                   GabcRenderJob       *job,
+                                                                   GCancellable        *cancellable,
+                                                                   GAsyncReadyCallback  callback,
+                                                                   gpointer             user_data);
+
+void                      gabc_render_service_get_stats           (GabcRenderService   *self,
+                                                                   guint               *n_jobs,
+                                                                   guint               *queue_depth,
+                                                                   guint               *max_queue_depth,
+                                                                   gint64              *mean_latency);
+
+G_END_DECLS
@@ -0,0 +1,337 @@
+/* gabc-render-stats.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Where the time goes in a render, kept as a histogram per metric.
+ *
+ * Recording is a couple of atomic increments, so it is cheap enough to
+ * leave on all the time and safe from the threads that do the indexing
+ * and scratch writes.  Values below 16 have a bucket each; above that
+ * each power of two is split in 8, so a percentile is within 1/8 of the
+ * true value whatever the scale.  Percentiles report the top of their
+ * bucket.
+ *
+ * When gabc is built with sysprof-capture, every timed phase is also sent
+ * to sysprof as a mark in the "gabc" group, so a recorded session shows
+ * the renders alongside everything else the machine was doing.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#ifdef G_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+#if HAVE_SYSPROF
+#include <sysprof-capture.h>
+#endif
+
+#include "gabc-render-stats.h"
+
+#define GABC_RENDER_STATS_SUB_BUCKETS 8
+
+/* Enough for any guint64: the exponent tops out at 60. */
+#define GABC_RENDER_STATS_N_BUCKETS (61 * GABC_RENDER_STATS_SUB_BUCKETS + 2 * GABC_RENDER_STATS_SUB_BUCKETS)
+
+typedef struct {
+  gint      count;
+  gint      buckets[GABC_RENDER_STATS_N_BUCKETS];
+} GabcRenderHistogram;
+
+struct _GabcRenderStats
+{
+  GObject                       parent_instance;
+
+  GabcRenderHistogram           histograms[GABC_RENDER_N_METRICS];
+};
+
+G_DEFINE_FINAL_TYPE (GabcRenderStats, gabc_render_stats, G_TYPE_OBJECT)
+
+static const struct {
+  const gchar *name;
+  const gchar *unit;
+} metrics[GABC_RENDER_N_METRICS] = {
+  { "export", "us" },
+  { "preprocess", "us" },
+  { "write", "us" },
+  { "queue", "us" },
+  { "spawn", "us" },
+  { "tool", "us" },
+  { "launch", "us" },
+  { "output-size", "bytes" },
+  { "buffer-size", "chars" },
+  { "peak-rss", "kB" },
+};
+
+
+static void
+gabc_render_stats_class_init (GabcRenderStatsClass *klass)
+{
+}
+
+
+static void
+gabc_render_stats_init (GabcRenderStats *self)
+{
+}
+
+
+/*
+ * The statistics for the whole process.
+ */
+GabcRenderStats *
+gabc_render_stats_get_default (void)
+{
+  static GabcRenderStats *default_stats = NULL;
+
+  if (g_once_init_enter (&default_stats))
+    g_once_init_leave (&default_stats, g_object_new (GABC_TYPE_RENDER_STATS, NULL));
+
+  return default_stats;
+}
+
+
+const gchar *
+gabc_render_metric_get_name (GabcRenderMetric metric)
+{
+  g_return_val_if_fail (metric < GABC_RENDER_N_METRICS, NULL);
+
+  return metrics[metric].name;
+}
+
+
+const gchar *
+gabc_render_metric_get_unit (GabcRenderMetric metric)
+{
+  g_return_val_if_fail (metric < GABC_RENDER_N_METRICS, NULL);
+
+  return metrics[metric].unit;
+}
+
+
+static guint
+gabc_render_stats_get_bucket (guint64 value)
+{
+  guint exponent = 0;
+
+  while ((value >> exponent) >= 2 * GABC_RENDER_STATS_SUB_BUCKETS)
+    exponent++;
+
+  return exponent * GABC_RENDER_STATS_SUB_BUCKETS + (guint) (value >> exponent);
+}
+
+
+/*
+ * The largest value that falls in bucket.
+ */
+static guint64
+gabc_render_stats_get_bucket_top (guint bucket)
+{
+  guint exponent;
+  guint64 mantissa;
+
+  if (bucket < 2 * GABC_RENDER_STATS_SUB_BUCKETS)
+    return bucket;
+
+  exponent = bucket / GABC_RENDER_STATS_SUB_BUCKETS - 1;
+  mantissa = bucket - exponent * GABC_RENDER_STATS_SUB_BUCKETS;
+
+  return ((mantissa + 1) << exponent) - 1;
+}
+
+
+void
+gabc_render_stats_add (GabcRenderStats  *self,
+                       GabcRenderMetric  metric,
+                       guint64           value)
+{
+  GabcRenderHistogram *histogram;
+
+  g_return_if_fail (GABC_IS_RENDER_STATS (self));
+  g_return_if_fail (metric < GABC_RENDER_N_METRICS);
+
+  histogram = &self->histograms[metric];
+  g_atomic_int_inc (&histogram->buckets[gabc_render_stats_get_bucket (value)]);
+  g_atomic_int_inc (&histogram->count);
+}
+
+
+/*
+ * Add the time between two g_get_monotonic_time () readings.
+ */
+void
+gabc_render_stats_add_time (GabcRenderStats  *self,
+                            GabcRenderMetric  metric,
+                            gint64            start_time,
+                            gint64            end_time)
+{
+  gint64 duration = MAX (end_time - start_time, 0);
+
+  gabc_render_stats_add (self, metric, duration);
+
+#if HAVE_SYSPROF
+  /* The monotonic clock is sysprof's clock, in nanoseconds. */
+  sysprof_collector_mark (start_time * 1000, duration * 1000, "gabc", metrics[metric].name, NULL);
+#endif
+}
+
+
+/*
+ * Add the most memory the process has used so far.  Does nothing where
+ * the system doesn't say.
+ */
+void
+gabc_render_stats_sample_peak_rss (GabcRenderStats *self)
+{
+#ifdef G_OS_UNIX
+  struct rusage usage;
+
+  if (getrusage (RUSAGE_SELF, &usage) == 0)
+    gabc_render_stats_add (self, GABC_RENDER_METRIC_PEAK_RSS, usage.ru_maxrss);
+#endif
+}
+
+
+guint
+gabc_render_stats_get_count (GabcRenderStats  *self,
+                             GabcRenderMetric  metric)
+{
+  g_return_val_if_fail (metric < GABC_RENDER_N_METRICS, 0);
+
+  return g_atomic_int_get (&self->histograms[metric].count);
+}
+
+
+/*
+ * The value percentile per cent of the values added were at or below, so
+ * 50 for the median and 100 for the largest.  0 if nothing was added.
+ */
+guint64
+gabc_render_stats_get_percentile (GabcRenderStats  *self,
+                                  GabcRenderMetric  metric,
+                                  gdouble           percentile)
+{
+  GabcRenderHistogram *histogram;
+  guint64 rank;
+  guint64 seen = 0;
+  guint count;
+  guint i;
+
+  g_return_val_if_fail (metric < GABC_RENDER_N_METRICS, 0);
+
+  histogram = &self->histograms[metric];
+  count = g_atomic_int_get (&histogram->count);
+  if (count == 0)
+    return 0;
+
+  rank = (guint64) (CLAMP (percentile, 0.0, 100.0) / 100.0 * count + 0.5);
+  rank = CLAMP (rank, 1, count);
+
+  for (i = 0; i < GABC_RENDER_STATS_N_BUCKETS; i++)
+    {
+      seen += g_atomic_int_get (&histogram->buckets[i]);
+      if (seen >= rank)
+        return gabc_render_stats_get_bucket_top (i);
+    }
+
+  /* Another thread added to the count but not yet to a bucket. */
+  for (i = GABC_RENDER_STATS_N_BUCKETS; i > 0; i--)
+    if (g_atomic_int_get (&histogram->buckets[i - 1]) > 0)
+      return gabc_render_stats_get_bucket_top (i - 1);
+
+  return 0;
+}
+
+
+void
+gabc_render_stats_reset (GabcRenderStats *self)
+{
+  guint metric;
+  guint i;
+
+  for (metric = 0; metric < GABC_RENDER_N_METRICS; metric++)
+    {
+      g_atomic_int_set (&self->histograms[metric].count, 0);
+      for (i = 0; i < GABC_RENDER_STATS_N_BUCKETS; i++)
+        g_atomic_int_set (&self->histograms[metric].buckets[i], 0);
+    }
+}
+
+
+/*
+ * Everything recorded, as
+ *
+ *   {
+ *     "export": { "unit": "us", "count": ..., "p50": ..., "p95": ..., "p99": ..., "max": ...,
+ *                 "buckets": [ [ <top>, <count> ], ... ] },
+ *     ...
+ *   }
+ *
+ * with only the buckets that have something in them.
+ */
+gchar *
+gabc_render_stats_to_json (GabcRenderStats *self)
+{
+  GString *json = g_string_new ("{");
+  guint metric;
+  guint i;
+
+  for (metric = 0; metric < GABC_RENDER_N_METRICS; metric++)
+    {
+      GabcRenderHistogram *histogram = &self->histograms[metric];
+      gboolean first = TRUE;
+
+      g_string_append_printf (json,
+                              "%s\n  \"%s\": { \"unit\": \"%s\", \"count\": %u, "
+                              "\"p50\": %" G_GUINT64_FORMAT ", \"p95\": %" G_GUINT64_FORMAT ", "
+                              "\"p99\": %" G_GUINT64_FORMAT ", \"max\": %" G_GUINT64_FORMAT ",\n"
+                              "    \"buckets\": [",
+                              metric > 0 ? "," : "",
+                              metrics[metric].name,
+                              metrics[metric].unit,
+                              gabc_render_stats_get_count (self, metric),
+                              gabc_render_stats_get_percentile (self, metric, 50.0),
+                              gabc_render_stats_get_percentile (self, metric, 95.0),
+                              gabc_render_stats_get_percentile (self, metric, 99.0),
+                              gabc_render_stats_get_percentile (self, metric, 100.0));
+
+      for (i = 0; i < GABC_RENDER_STATS_N_BUCKETS; i++)
+        {
+          gint count = g_atomic_int_get (&histogram->buckets[i]);
+
+          if (count == 0)
+            continue;
+
+          g_string_append_printf (json, "%s[ %" G_GUINT64_FORMAT ", %d ]",
+                                  first ? " " : ", ",
+                                  gabc_render_stats_get_bucket_top (i),
+                                  count);
+          first = FALSE;
+        }
+
+      g_string_append (json, " ] }");
+    }
+
+  g_string_append (json, "\n}\n");
+
+  return g_string_free (json, FALSE);
+}
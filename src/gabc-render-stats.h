@@ -0,0 +1,75 @@
+/* gabc-render-stats.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/*
+ * What is measured for each render.  Times are in microseconds.
+ */
+typedef enum {
+  GABC_RENDER_METRIC_EXPORT,          /* copying the text out of the buffer */
+  GABC_RENDER_METRIC_PREPROCESS,      /* rewriting it for the tool */
+  GABC_RENDER_METRIC_WRITE,           /* writing the scratch file */
+  GABC_RENDER_METRIC_QUEUE,           /* waiting for a free render slot */
+  GABC_RENDER_METRIC_SPAWN,           /* starting the tool */
+  GABC_RENDER_METRIC_TOOL,            /* the tool running, start to exit */
+  GABC_RENDER_METRIC_LAUNCH,          /* handing the output to a viewer */
+  GABC_RENDER_METRIC_OUTPUT_SIZE,     /* bytes */
+  GABC_RENDER_METRIC_BUFFER_SIZE,     /* characters */
+  GABC_RENDER_METRIC_PEAK_RSS,        /* kilobytes */
+  GABC_RENDER_N_METRICS
+} GabcRenderMetric;
+
+#define GABC_TYPE_RENDER_STATS (gabc_render_stats_get_type())
+
+G_DECLARE_FINAL_TYPE (GabcRenderStats, gabc_render_stats, GABC, RENDER_STATS, GObject)
+
+GabcRenderStats          *gabc_render_stats_get_default           (void);
+
+const gchar *             gabc_render_metric_get_name             (GabcRenderMetric  metric);
+
+const gchar *             gabc_render_metric_get_unit             (GabcRenderMetric  metric);
+
+void                      gabc_render_stats_add                   (GabcRenderStats  *self,
+                                                                   GabcRenderMetric  metric,
+                                                                   guint64           value);
+
+void                      gabc_render_stats_add_time              (GabcRenderStats  *self,
+                                                                   GabcRenderMetric  metric,
+                                                                   gint64            start_time,
+                                                                   gint64            end_time);
+
+void                      gabc_render_stats_sample_peak_rss       (GabcRenderStats  *self);
+
+guint                     gabc_render_stats_get_count             (GabcRenderStats  *self,
+                                                                   GabcRenderMetric  metric);
+
+guint64                   gabc_render_stats_get_percentile        (GabcRenderStats  *self,
+                                                                   GabcRenderMetric  metric,
+                                                                   gdouble           percentile);
+
+void                      gabc_render_stats_reset                 (GabcRenderStats  *self);
+
+gchar *                   gabc_render_stats_to_json               (GabcRenderStats  *self);
+
+G_END_DECLS
@@ -0,0 +1,1516 @@
+/* gabc-search-index.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Search across the tunes in a set of directories.
+ *
+ * The index is a single GVariant file under $XDG_CACHE_HOME/gabc/search,
+ * mapped rather than read when the application starts:
+ *
+ *   files   (path, mtime, size) of every .abc file that was indexed
+ *   docs    one record per tune: its file, line, X: number, the first T:,
+ *           C:, R:, K:, M: and O: fields, the start of its melody and the
+ *           intervals of its first notes (see GabcMelody)
+ *   terms   every term, sorted, with the tunes it occurs in as a
+ *           delta/varint encoded list of doc numbers
+ *
+ * Terms are the normalised words of the T:, C:, R:, K:, M: and O: fields
+ * prefixed with the (lower case) field letter ("t:kesh"), and every run of
+ * four notes of the melody, reduced to their letters ("n:gabd").  Searching
+ * is a binary search for each query word in the sorted terms, so it takes
+ * milliseconds however big the index.
+ *
+ * Each run of GABC_MELODY_NGRAM intervals at the start of the melody is a
+ * term too ("i:ooln").  They find the candidates for a similarity search,
+ * which are then ranked by comparing their intervals with the query's.
+ *
+ * Updates run in a thread.  Files whose mtime and size haven't changed keep
+ * their docs and postings from the old index; only new and changed files
+ * are read.  The directories are watched with GFileMonitor and an update is
+ * queued shortly after anything in them changes.
+ */
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "gabc-abc-lexer.h"
+#include "gabc-search-index.h"
+
+#define GABC_SEARCH_INDEX_VERSION 2
+#define GABC_SEARCH_INDEX_FORMAT  "(ua(sxt)a(uuusssssssay)a(say))"
+#define GABC_SEARCH_INDEX_DOC     "(uuusssssssay)"
+
+/* Fields that are indexed, in the order they appear in a doc record. */
+#define GABC_SEARCH_INDEX_FIELDS  "TCRKMO"
+
+/* Notes in each n-gram term, and notes kept in each doc record. */
+#define GABC_SEARCH_INDEX_NGRAM   4
+#define GABC_SEARCH_INDEX_INCIPIT 64
+
+#define GABC_SEARCH_INDEX_UPDATE_DELAY 2
+
+/* Tunes sharing the most n-grams with a melody that are scored in full. */
+#define GABC_SEARCH_INDEX_SIMILAR_CANDIDATES 2000
+
+enum {
+  DOC_FILE,
+  DOC_LINE,
+  DOC_NUMBER,
+  DOC_TITLE,
+  DOC_COMPOSER,
+  DOC_RHYTHM,
+  DOC_KEY,
+  DOC_METER,
+  DOC_ORIGIN,
+  DOC_NOTES,
+  DOC_INTERVALS,
+  N_DOC_FIELDS
+};
+
+struct _GabcSearchIndex
+{
+  GObject                       parent_instance;
+
+  gchar                        *index_path;
+  GVariant                     *snapshot;
+  GVariant                     *files;
+  GVariant                     *docs;
+  GVariant                     *terms;
+
+  GStrv                         directories;
+  GHashTable                   *monitors;     /* directory path -> GFileMonitor */
+
+  GCancellable                 *cancellable;
+  gboolean                      updating;
+  gboolean                      update_pending;
+  guint                         update_source_id;
+};
+
+G_DEFINE_FINAL_TYPE (GabcSearchIndex, gabc_search_index, G_TYPE_OBJECT)
+
+enum {
+  UPDATED,
+  N_SIGNALS
+};
+
+static guint signals [N_SIGNALS];
+
+typedef struct {
+  gchar   *path;
+  gint64   mtime;
+  guint64  size;
+} scanned_file_t;
+
+typedef struct {
+  GStrv       directories;
+  gchar      *index_path;
+  GVariant   *old_snapshot;
+  GPtrArray  *scanned_directories;
+  GVariant   *snapshot;
+} update_data_t;
+
+typedef struct {
+  const gchar *line;
+  GString     *notes;
+  GabcMelody   melody;
+} note_collect_data_t;
+
+typedef struct {
+  guint32  doc;
+  guint    hits;
+  guint    score;
+  guint    offset;
+} similar_candidate_t;
+
+
+void
+gabc_search_result_free (GabcSearchResult *result)
+{
+  g_free (result->path);
+  g_free (result->title);
+  g_free (result->composer);
+  g_free (result->rhythm);
+  g_free (result->key);
+  g_free (result->meter);
+  g_free (result->origin);
+  g_free (result);
+}
+
+
+static void
+scanned_file_free (scanned_file_t *file)
+{
+  g_free (file->path);
+  g_free (file);
+}
+
+
+static void
+update_data_free (update_data_t *data)
+{
+  g_strfreev (data->directories);
+  g_free (data->index_path);
+  g_clear_pointer (&data->old_snapshot, g_variant_unref);
+  g_clear_pointer (&data->scanned_directories, g_ptr_array_unref);
+  g_clear_pointer (&data->snapshot, g_variant_unref);
+  g_free (data);
+}
+
+
+/*
+ * Lower case, without accents, with everything but letters and digits
+ * turned into single spaces between words.
+ */
+static gchar *
+gabc_search_index_normalise (const gchar *text,
+                             gssize       length)
+{
+  g_autofree gchar *decomposed = NULL;
+  GString *normalised;
+  const gchar *p;
+
+  decomposed = g_utf8_normalize (text, length, G_NORMALIZE_ALL);
+  if (decomposed == NULL)
+    return g_strdup ("");
+
+  normalised = g_string_sized_new (strlen (decomposed));
+
+  for (p = decomposed; *p != '\0'; p = g_utf8_next_char (p))
+    {
+      gunichar c = g_utf8_get_char (p);
+
+      if (g_unichar_ismark (c))
+        continue;
+
+      if (g_unichar_isalnum (c))
+        g_string_append_unichar (normalised, g_unichar_tolower (c));
+      else if (normalised->len > 0 && normalised->str[normalised->len - 1] != ' ')
+        g_string_append_c (normalised, ' ');
+    }
+
+  if (normalised->len > 0 && normalised->str[normalised->len - 1] == ' ')
+    g_string_truncate (normalised, normalised->len - 1);
+
+  return g_string_free (normalised, FALSE);
+}
+
+
+/*
+ * Reduce notes to their letters, lower case: "^F,2 G/A" -> "fga".
+ */
+static gchar *
+gabc_search_index_normalise_notes (const gchar *text)
+{
+  GString *notes = g_string_new (NULL);
+  const gchar *p;
+
+  for (p = text; *p != '\0'; p++)
+    if (strchr ("abcdefgABCDEFG", *p) != NULL)
+      g_string_append_c (notes, g_ascii_tolower (*p));
+
+  return g_string_free (notes, FALSE);
+}
+
+
+/*
+ * POSTINGS
+ */
+static void
+gabc_search_index_add_posting (GHashTable  *terms,
+                               const gchar *term,
+                               guint32      doc)
+{
+  GArray *docs = g_hash_table_lookup (terms, term);
+
+  if (docs == NULL)
+    {
+      docs = g_array_new (FALSE, FALSE, sizeof (guint32));
+      g_hash_table_insert (terms, g_strdup (term), docs);
+    }
+
+  if (docs->len == 0 || g_array_index (docs, guint32, docs->len - 1) != doc)
+    g_array_append_val (docs, doc);
+}
+
+
+static void
+gabc_search_index_encode_postings (GArray     *docs,
+                                   GByteArray *encoded)
+{
+  guint32 previous = 0;
+  guint i;
+
+  for (i = 0; i < docs->len; i++)
+    {
+      guint32 delta = g_array_index (docs, guint32, i) - previous;
+      guint8 byte;
+
+      previous = g_array_index (docs, guint32, i);
+      while (delta >= 0x80)
+        {
+          byte = (delta & 0x7F) | 0x80;
+          g_byte_array_append (encoded, &byte, 1);
+          delta >>= 7;
+        }
+      byte = delta;
+      g_byte_array_append (encoded, &byte, 1);
+    }
+}
+
+
+/*
+ * Append the docs in an encoded postings list to docs.
+ */
+static void
+gabc_search_index_decode_postings (GVariant *postings,
+                                   GArray   *docs)
+{
+  const guint8 *data;
+  gsize length;
+  gsize i = 0;
+  guint32 doc = 0;
+
+  data = g_variant_get_fixed_array (postings, &length, sizeof (guint8));
+
+  while (i < length)
+    {
+      guint32 delta = 0;
+      guint shift = 0;
+
+      while (i < length && (data[i] & 0x80) != 0 && shift < 28)
+        {
+          delta |= (guint32) (data[i++] & 0x7F) << shift;
+          shift += 7;
+        }
+      if (i < length)
+        delta |= (guint32) data[i++] << shift;
+
+      doc += delta;
+      g_array_append_val (docs, doc);
+    }
+}
+
+
+static gint
+gabc_search_index_compare_doc (gconstpointer a,
+                               gconstpointer b)
+{
+  guint32 doc_a = *(const guint32 *) a;
+  guint32 doc_b = *(const guint32 *) b;
+
+  return (doc_a > doc_b) - (doc_a < doc_b);
+}
+
+
+static gint
+gabc_search_index_compare_strings (gconstpointer a,
+                                   gconstpointer b)
+{
+  return strcmp (*(const gchar * const *) a, *(const gchar * const *) b);
+}
+
+
+/*
+ * Sort and remove duplicates.
+ */
+static void
+gabc_search_index_sort_docs (GArray *docs)
+{
+  guint i;
+  guint n = 0;
+
+  g_array_sort (docs, gabc_search_index_compare_doc);
+
+  for (i = 0; i < docs->len; i++)
+    if (n == 0 || g_array_index (docs, guint32, n - 1) != g_array_index (docs, guint32, i))
+      g_array_index (docs, guint32, n++) = g_array_index (docs, guint32, i);
+
+  g_array_set_size (docs, n);
+}
+
+
+/*
+ * READING TUNES
+ */
+static void
+gabc_search_index_note_cb (GabcAbcTokenKind  kind,
+                           gsize             start,
+                           gsize             end,
+                           gpointer          user_data)
+{
+  note_collect_data_t *data = user_data;
+  gsize i;
+
+  gabc_melody_add_token (&data->melody, kind, data->line + start, end - start);
+
+  if (kind != GABC_ABC_TOKEN_NOTE)
+    return;
+
+  /* Chord brackets and bare lengths come through as notes too. */
+  for (i = start; i < end; i++)
+    if (strchr ("abcdefgABCDEFG", data->line[i]) != NULL && data->line[i] != '\0')
+      {
+        g_string_append_c (data->notes, g_ascii_tolower (data->line[i]));
+        return;
+      }
+}
+
+
+static void
+gabc_search_index_add_words (GHashTable  *terms,
+                             gchar        field,
+                             const gchar *value,
+                             guint32      doc)
+{
+  g_autofree gchar *normalised = gabc_search_index_normalise (value, -1);
+  g_auto (GStrv) words = g_strsplit (normalised, " ", -1);
+  guint i;
+
+  for (i = 0; words[i] != NULL; i++)
+    {
+      g_autofree gchar *term = NULL;
+
+      if (words[i][0] == '\0')
+        continue;
+
+      term = g_strdup_printf ("%c:%s", g_ascii_tolower (field), words[i]);
+      gabc_search_index_add_posting (terms, term, doc);
+    }
+}
+
+
+/*
+ * Index the tune in lines [first, last) as doc.
+ */
+static void
+gabc_search_index_add_tune (GVariantBuilder  *docs,
+                            GHashTable       *terms,
+                            guint32           doc,
+                            guint32           file,
+                            gchar           **lines,
+                            guint             first,
+                            guint             last)
+{
+  gchar *fields [sizeof (GABC_SEARCH_INDEX_FIELDS) - 1] = { NULL, };
+  g_autofree gchar *incipit = NULL;
+  note_collect_data_t data;
+  GabcAbcLexer lexer;
+  guint number;
+  guint i;
+
+  data.notes = g_string_new (NULL);
+  gabc_melody_init (&data.melody, NULL);
+  gabc_abc_lexer_init (&lexer);
+  number = (guint) g_ascii_strtoull (lines[first] + 2, NULL, 10);
+
+  for (i = first; i < last; i++)
+    {
+      gchar *line = lines[i];
+      const gchar *field;
+      gboolean in_header = (lexer.section != GABC_ABC_LEXER_TUNE_BODY);
+      gsize length;
+
+      g_strchomp (line);
+      length = strlen (line);
+
+      if (in_header && length >= 2 && line[1] == ':' && line[0] != '\0' &&
+          (field = strchr (GABC_SEARCH_INDEX_FIELDS, line[0])) != NULL)
+        {
+          const gchar *comment = strchr (line, '%');
+          gchar *value;
+
+          value = g_strndup (line + 2, (comment != NULL ? comment : line + length) - (line + 2));
+          g_strstrip (value);
+          gabc_search_index_add_words (terms, line[0], value, doc);
+
+          if (fields[field - GABC_SEARCH_INDEX_FIELDS] == NULL)
+            fields[field - GABC_SEARCH_INDEX_FIELDS] = value;
+          else
+            g_free (value);
+        }
+
+      data.line = line;
+      gabc_abc_lexer_lex_line (&lexer, line, length, gabc_search_index_note_cb, &data);
+    }
+
+  for (i = 0; i + GABC_SEARCH_INDEX_NGRAM <= data.notes->len; i++)
+    {
+      gchar term [2 + GABC_SEARCH_INDEX_NGRAM + 1] = "n:";
+
+      memcpy (term + 2, data.notes->str + i, GABC_SEARCH_INDEX_NGRAM);
+      term[2 + GABC_SEARCH_INDEX_NGRAM] = '\0';
+      gabc_search_index_add_posting (terms, term, doc);
+    }
+
+  for (i = 0; i + GABC_MELODY_NGRAM <= data.melody.n_intervals; i++)
+    {
+      gchar term [2 + GABC_MELODY_NGRAM + 1] = "i:";
+
+      gabc_melody_get_ngram (&data.melody, i, term + 2);
+      gabc_search_index_add_posting (terms, term, doc);
+    }
+
+  incipit = g_strndup (data.notes->str, GABC_SEARCH_INDEX_INCIPIT);
+  g_string_free (data.notes, TRUE);
+
+  g_variant_builder_add (docs, GABC_SEARCH_INDEX_DOC,
+                         file, first, number,
+                         fields[0] ? fields[0] : "",
+                         fields[1] ? fields[1] : "",
+                         fields[2] ? fields[2] : "",
+                         fields[3] ? fields[3] : "",
+                         fields[4] ? fields[4] : "",
+                         fields[5] ? fields[5] : "",
+                         incipit,
+                         g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE,
+                                                    data.melody.intervals,
+                                                    data.melody.n_intervals,
+                                                    sizeof (gint8)));
+
+  for (i = 0; i < G_N_ELEMENTS (fields); i++)
+    g_free (fields[i]);
+}
+
+
+/*
+ * Index every tune in a file.  Returns the number of docs added.
+ */
+static guint
+gabc_search_index_add_file (GVariantBuilder *docs,
+                            GHashTable      *terms,
+                            guint32          first_doc,
+                            guint32          file,
+                            const gchar     *path)
+{
+  g_autofree gchar *contents = NULL;
+  g_auto (GStrv) lines = NULL;
+  gsize length;
+  guint n_lines;
+  guint start = G_MAXUINT;
+  guint n_docs = 0;
+  guint i;
+
+  if (!g_file_get_contents (path, &contents, &length, NULL))
+    return 0;
+
+  if (!g_utf8_validate (contents, length, NULL))
+    {
+      gchar *valid = g_utf8_make_valid (contents, length);
+
+      g_free (contents);
+      contents = valid;
+    }
+
+  lines = g_strsplit (contents, "\n", -1);
+  n_lines = g_strv_length (lines);
+
+  for (i = 0; i <= n_lines; i++)
+    {
+      gboolean tune_start = (i < n_lines && lines[i][0] == 'X' && lines[i][1] == ':');
+
+      if ((tune_start || i == n_lines) && start != G_MAXUINT)
+        {
+          gabc_search_index_add_tune (docs, terms, first_doc + n_docs, file, lines, start, i);
+          n_docs++;
+        }
+
+      if (tune_start)
+        start = i;
+    }
+
+  return n_docs;
+}
+
+
+/*
+ * UPDATING
+ */
+static void
+gabc_search_index_scan_directory (const gchar *path,
+                                  GPtrArray   *files,
+                                  GPtrArray   *directories)
+{
+  GDir *dir;
+  const gchar *name;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  g_ptr_array_add (directories, g_strdup (path));
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      g_autofree gchar *child = g_build_filename (path, name, NULL);
+      GStatBuf buf;
+
+      /* Symbolic links are followed to files but not to directories, which
+       * could lead round in a loop. */
+      if (name[0] == '.' || g_lstat (child, &buf) != 0)
+        continue;
+      if (S_ISLNK (buf.st_mode) && (g_stat (child, &buf) != 0 || S_ISDIR (buf.st_mode)))
+        continue;
+
+      if (S_ISDIR (buf.st_mode))
+        {
+          gabc_search_index_scan_directory (child, files, directories);
+        }
+      else if (S_ISREG (buf.st_mode) && g_str_has_suffix (name, ".abc"))
+        {
+          scanned_file_t *file = g_new0 (scanned_file_t, 1);
+
+          file->path = g_steal_pointer (&child);
+          file->mtime = buf.st_mtime;
+          file->size = buf.st_size;
+          g_ptr_array_add (files, file);
+        }
+    }
+  g_dir_close (dir);
+}
+
+
+static gint
+gabc_search_index_compare_scanned_files (gconstpointer a,
+                                         gconstpointer b)
+{
+  const scanned_file_t *file_a = *(const scanned_file_t * const *) a;
+  const scanned_file_t *file_b = *(const scanned_file_t * const *) b;
+
+  return strcmp (file_a->path, file_b->path);
+}
+
+
+static void
+gabc_search_index_update_thread (GTask        *task,
+                                 gpointer      source_object,
+                                 gpointer      task_data,
+                                 GCancellable *cancellable)
+{
+  update_data_t *data = task_data;
+  g_autoptr (GPtrArray) files = g_ptr_array_new_with_free_func ((GDestroyNotify) scanned_file_free);
+  g_autoptr (GHashTable) old_files = g_hash_table_new (g_str_hash, g_str_equal);
+  g_autoptr (GHashTable) terms = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_array_unref);
+  g_autoptr (GArray) doc_map = g_array_new (FALSE, TRUE, sizeof (guint32));
+  g_autoptr (GArray) old_first_docs = g_array_new (FALSE, TRUE, sizeof (guint32));
+  g_autoptr (GPtrArray) term_names = NULL;
+  g_autoptr (GVariant) old_files_v = NULL;
+  g_autoptr (GVariant) old_docs_v = NULL;
+  g_autoptr (GVariant) old_terms_v = NULL;
+  g_autoptr (GError) error = NULL;
+  g_autofree gchar *index_dir = NULL;
+  GVariantBuilder files_builder;
+  GVariantBuilder docs_builder;
+  GVariantBuilder terms_builder;
+  guint32 n_docs = 0;
+  guint i;
+
+  data->scanned_directories = g_ptr_array_new_with_free_func (g_free);
+  for (i = 0; data->directories[i] != NULL; i++)
+    gabc_search_index_scan_directory (data->directories[i], files, data->scanned_directories);
+  g_ptr_array_sort (files, gabc_search_index_compare_scanned_files);
+
+  if (data->old_snapshot != NULL)
+    {
+      old_files_v = g_variant_get_child_value (data->old_snapshot, 1);
+      old_docs_v = g_variant_get_child_value (data->old_snapshot, 2);
+      old_terms_v = g_variant_get_child_value (data->old_snapshot, 3);
+
+      for (i = 0; i < g_variant_n_children (old_files_v); i++)
+        {
+          const gchar *path;
+
+          g_variant_get_child (old_files_v, i, "(&sxt)", &path, NULL, NULL);
+          g_hash_table_insert (old_files, (gpointer) path, GUINT_TO_POINTER (i + 1));
+        }
+
+      /* Each file's docs are together, in order; note where each run starts. */
+      g_array_set_size (old_first_docs, g_variant_n_children (old_files_v) + 1);
+      g_array_set_size (doc_map, g_variant_n_children (old_docs_v));
+      for (i = doc_map->len; i > 0; i--)
+        {
+          g_autoptr (GVariant) record = g_variant_get_child_value (old_docs_v, i - 1);
+          g_autoptr (GVariant) record_file = g_variant_get_child_value (record, DOC_FILE);
+          guint32 file = g_variant_get_uint32 (record_file);
+
+          if (file < old_first_docs->len)
+            g_array_index (old_first_docs, guint32, file) = i;
+          g_array_index (doc_map, guint32, i - 1) = G_MAXUINT32;
+        }
+    }
+
+  g_variant_builder_init (&files_builder, G_VARIANT_TYPE ("a(sxt)"));
+  g_variant_builder_init (&docs_builder, G_VARIANT_TYPE ("a" GABC_SEARCH_INDEX_DOC));
+
+  for (i = 0; i < files->len; i++)
+    {
+      scanned_file_t *file = g_ptr_array_index (files, i);
+      guint old_file = GPOINTER_TO_UINT (g_hash_table_lookup (old_files, file->path));
+      gint64 old_mtime = 0;
+      guint64 old_size = 0;
+
+      if (g_cancellable_is_cancelled (cancellable))
+        break;
+
+      g_variant_builder_add (&files_builder, "(sxt)", file->path, file->mtime, file->size);
+
+      if (old_file > 0)
+        g_variant_get_child (old_files_v, old_file - 1, "(&sxt)", NULL, &old_mtime, &old_size);
+
+      if (old_file > 0 && old_mtime == file->mtime && old_size == file->size)
+        {
+          guint doc = g_array_index (old_first_docs, guint32, old_file - 1);
+
+          /* Unchanged: keep its docs, renumbered, and map their postings below. */
+          for (doc = (doc > 0) ? doc - 1 : doc_map->len; doc < doc_map->len; doc++)
+            {
+              g_autoptr (GVariant) record = g_variant_get_child_value (old_docs_v, doc);
+              g_autoptr (GVariant) record_file = g_variant_get_child_value (record, DOC_FILE);
+              g_autoptr (GVariant) renumbered = NULL;
+              GVariant *children [N_DOC_FIELDS];
+              guint field;
+
+              if (g_variant_get_uint32 (record_file) != old_file - 1)
+                break;
+
+              for (field = 0; field < N_DOC_FIELDS; field++)
+                children[field] = g_variant_get_child_value (record, field);
+              g_variant_unref (children[DOC_FILE]);
+              children[DOC_FILE] = g_variant_new_uint32 (i);
+
+              renumbered = g_variant_ref_sink (g_variant_new_tuple (children, N_DOC_FIELDS));
+              g_variant_builder_add_value (&docs_builder, renumbered);
+
+              for (field = 0; field < N_DOC_FIELDS; field++)
+                if (field != DOC_FILE)
+                  g_variant_unref (children[field]);
+
+              g_array_index (doc_map, guint32, doc) = n_docs++;
+            }
+        }
+      else
+        {
+          n_docs += gabc_search_index_add_file (&docs_builder, terms, n_docs, i, file->path);
+        }
+    }
+
+  if (g_task_return_error_if_cancelled (task))
+    {
+      g_variant_builder_clear (&files_builder);
+      g_variant_builder_clear (&docs_builder);
+      return;
+    }
+
+  /* Carry over the postings of the unchanged files. */
+  if (old_terms_v != NULL)
+    {
+      g_autoptr (GArray) docs = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+      for (i = 0; i < g_variant_n_children (old_terms_v); i++)
+        {
+          g_autoptr (GVariant) postings = NULL;
+          const gchar *term;
+          guint j;
+
+          g_variant_get_child (old_terms_v, i, "(&s@ay)", &term, &postings);
+
+          g_array_set_size (docs, 0);
+          gabc_search_index_decode_postings (postings, docs);
+
+          for (j = 0; j < docs->len; j++)
+            {
+              guint32 old_doc = g_array_index (docs, guint32, j);
+
+              if (old_doc < doc_map->len && g_array_index (doc_map, guint32, old_doc) != G_MAXUINT32)
+                gabc_search_index_add_posting (terms, term, g_array_index (doc_map, guint32, old_doc));
+            }
+        }
+    }
+
+  term_names = g_hash_table_get_keys_as_ptr_array (terms);
+  g_ptr_array_sort (term_names, gabc_search_index_compare_strings);
+
+  g_variant_builder_init (&terms_builder, G_VARIANT_TYPE ("a(say)"));
+  for (i = 0; i < term_names->len; i++)
+    {
+      const gchar *term = g_ptr_array_index (term_names, i);
+      GArray *docs = g_hash_table_lookup (terms, term);
+      g_autoptr (GByteArray) encoded = g_byte_array_new ();
+
+      gabc_search_index_sort_docs (docs);
+      gabc_search_index_encode_postings (docs, encoded);
+      g_variant_builder_add (&terms_builder, "(s@ay)", term,
+                             g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE, encoded->data, encoded->len, sizeof (guint8)));
+    }
+
+  data->snapshot = g_variant_ref_sink (g_variant_new ("(ua(sxt)a" GABC_SEARCH_INDEX_DOC "a(say))",
+                                                      GABC_SEARCH_INDEX_VERSION,
+                                                      &files_builder,
+                                                      &docs_builder,
+                                                      &terms_builder));
+
+  index_dir = g_path_get_dirname (data->index_path);
+  g_mkdir_with_parents (index_dir, 0700);
+  if (!g_file_set_contents (data->index_path,
+                            g_variant_get_data (data->snapshot),
+                            g_variant_get_size (data->snapshot),
+                            &error))
+    g_printerr ("Unable to save the search index: %s\n", error->message);
+
+  g_task_return_boolean (task, TRUE);
+}
+
+
+static void
+gabc_search_index_set_snapshot (GabcSearchIndex *self,
+                                GVariant        *snapshot)
+{
+  g_clear_pointer (&self->files, g_variant_unref);
+  g_clear_pointer (&self->docs, g_variant_unref);
+  g_clear_pointer (&self->terms, g_variant_unref);
+  g_clear_pointer (&self->snapshot, g_variant_unref);
+
+  if (snapshot == NULL)
+    return;
+
+  self->snapshot = g_variant_ref (snapshot);
+  self->files = g_variant_get_child_value (snapshot, 1);
+  self->docs = g_variant_get_child_value (snapshot, 2);
+  self->terms = g_variant_get_child_value (snapshot, 3);
+}
+
+
+static void
+gabc_search_index_monitor_changed_cb (GFileMonitor      *monitor,
+                                      GFile             *file,
+                                      GFile             *other_file,
+                                      GFileMonitorEvent  event_type,
+                                      GabcSearchIndex   *self);
+
+
+static void
+gabc_search_index_update_monitors (GabcSearchIndex *self,
+                                   GPtrArray       *directories)
+{
+  g_autoptr (GHashTable) monitors = NULL;
+  guint i;
+
+  monitors = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+
+  for (i = 0; i < directories->len; i++)
+    {
+      const gchar *path = g_ptr_array_index (directories, i);
+      gpointer key;
+      gpointer monitor;
+
+      if (g_hash_table_steal_extended (self->monitors, path, &key, &monitor))
+        {
+          g_hash_table_insert (monitors, key, monitor);
+        }
+      else
+        {
+          g_autoptr (GFile) file = g_file_new_for_path (path);
+
+          monitor = g_file_monitor_directory (file, G_FILE_MONITOR_WATCH_MOVES, NULL, NULL);
+          if (monitor == NULL)
+            continue;
+
+          g_signal_connect_object (monitor, "changed",
+                                   G_CALLBACK (gabc_search_index_monitor_changed_cb), self, 0);
+          g_hash_table_insert (monitors, g_strdup (path), monitor);
+        }
+    }
+
+  /* Whatever is left over is for directories that have gone. */
+  g_hash_table_unref (self->monitors);
+  self->monitors = g_steal_pointer (&monitors);
+}
+
+
+static void
+gabc_search_index_update_cb (GObject      *source_object,
+                             GAsyncResult *result,
+                             gpointer      user_data)
+{
+  GabcSearchIndex *self = GABC_SEARCH_INDEX (source_object);
+  update_data_t *data = g_task_get_task_data (G_TASK (result));
+  g_autoptr (GError) error = NULL;
+
+  self->updating = FALSE;
+
+  if (!g_task_propagate_boolean (G_TASK (result), &error))
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_printerr ("Unable to update the search index: %s\n", error->message);
+      return;
+    }
+
+  gabc_search_index_set_snapshot (self, data->snapshot);
+  gabc_search_index_update_monitors (self, data->scanned_directories);
+
+  g_signal_emit (self, signals [UPDATED], 0);
+
+  if (self->update_pending)
+    {
+      self->update_pending = FALSE;
+      gabc_search_index_update (self);
+    }
+}
+
+
+/*
+ * Bring the index up to date with the directories, in the background.
+ * The "updated" signal is emitted when it is done.
+ */
+void
+gabc_search_index_update (GabcSearchIndex *self)
+{
+  g_autoptr (GTask) task = NULL;
+  update_data_t *data;
+
+  g_return_if_fail (GABC_IS_SEARCH_INDEX (self));
+
+  if (self->directories == NULL)
+    return;
+
+  if (self->updating)
+    {
+      self->update_pending = TRUE;
+      return;
+    }
+
+  g_clear_handle_id (&self->update_source_id, g_source_remove);
+
+  data = g_new0 (update_data_t, 1);
+  data->directories = g_strdupv (self->directories);
+  data->index_path = g_strdup (self->index_path);
+  data->old_snapshot = self->snapshot != NULL ? g_variant_ref (self->snapshot) : NULL;
+
+  self->updating = TRUE;
+
+  task = g_task_new (self, self->cancellable, gabc_search_index_update_cb, NULL);
+  g_task_set_source_tag (task, gabc_search_index_update);
+  g_task_set_task_data (task, data, (GDestroyNotify) update_data_free);
+  g_task_run_in_thread (task, gabc_search_index_update_thread);
+}
+
+
+static gboolean
+gabc_search_index_update_timeout_cb (gpointer user_data)
+{
+  GabcSearchIndex *self = GABC_SEARCH_INDEX (user_data);
+
+  self->update_source_id = 0;
+  gabc_search_index_update (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+/*
+ * Changes usually come in bursts (a save is several events, a copy many),
+ * so wait for things to settle before updating.
+ */
+static void
+gabc_search_index_monitor_changed_cb (GFileMonitor      *monitor,
+                                      GFile             *file,
+                                      GFile             *other_file,
+                                      GFileMonitorEvent  event_type,
+                                      GabcSearchIndex   *self)
+{
+  switch (event_type)
+    {
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+    case G_FILE_MONITOR_EVENT_DELETED:
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+    case G_FILE_MONITOR_EVENT_MOVED_OUT:
+    case G_FILE_MONITOR_EVENT_RENAMED:
+      break;
+
+    case G_FILE_MONITOR_EVENT_CHANGED:
+    case G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED:
+    case G_FILE_MONITOR_EVENT_PRE_UNMOUNT:
+    case G_FILE_MONITOR_EVENT_UNMOUNTED:
+    case G_FILE_MONITOR_EVENT_MOVED:
+    default:
+      return;
+    }
+
+  g_clear_handle_id (&self->update_source_id, g_source_remove);
+  self->update_source_id = g_timeout_add_seconds (GABC_SEARCH_INDEX_UPDATE_DELAY,
+                                                  gabc_search_index_update_timeout_cb,
+                                                  self);
+}
+
+
+/*
+ * SEARCHING
+ */
+
+/*
+ * Index of the first term >= prefix.
+ */
+static gsize
+gabc_search_index_lower_bound (GabcSearchIndex *self,
+                               const gchar     *prefix)
+{
+  gsize low = 0;
+  gsize high = g_variant_n_children (self->terms);
+
+  while (low < high)
+    {
+      gsize middle = low + (high - low) / 2;
+      const gchar *term;
+
+      g_variant_get_child (self->terms, middle, "(&s@ay)", &term, NULL);
+      if (strcmp (term, prefix) < 0)
+        low = middle + 1;
+      else
+        high = middle;
+    }
+
+  return low;
+}
+
+
+/*
+ * The docs of every term starting with prefix (or exactly equal to it),
+ * sorted, appended to docs.
+ */
+static void
+gabc_search_index_lookup (GabcSearchIndex *self,
+                          const gchar     *prefix,
+                          gboolean         exact,
+                          GArray          *docs)
+{
+  gsize n_terms = g_variant_n_children (self->terms);
+  gsize i;
+
+  for (i = gabc_search_index_lower_bound (self, prefix); i < n_terms; i++)
+    {
+      g_autoptr (GVariant) postings = NULL;
+      const gchar *term;
+
+      g_variant_get_child (self->terms, i, "(&s@ay)", &term, &postings);
+      if (exact ? strcmp (term, prefix) != 0 : !g_str_has_prefix (term, prefix))
+        break;
+
+      gabc_search_index_decode_postings (postings, docs);
+    }
+
+  gabc_search_index_sort_docs (docs);
+}
+
+
+/*
+ * Keep only the docs in matches that are also in docs.  A NULL matches
+ * stands for every doc.
+ */
+static GArray *
+gabc_search_index_intersect (GArray *matches,
+                             GArray *docs)
+{
+  guint i = 0;
+  guint j = 0;
+  guint n = 0;
+
+  if (matches == NULL)
+    return g_array_ref (docs);
+
+  while (i < matches->len && j < docs->len)
+    {
+      guint32 a = g_array_index (matches, guint32, i);
+      guint32 b = g_array_index (docs, guint32, j);
+
+      if (a < b)
+        i++;
+      else if (b < a)
+        j++;
+      else
+        {
+          g_array_index (matches, guint32, n++) = a;
+          i++;
+          j++;
+        }
+    }
+
+  g_array_set_size (matches, n);
+  return matches;
+}
+
+
+/*
+ * Field names a query word may be prefixed with, and the field letter they
+ * search.
+ */
+static gchar
+gabc_search_index_parse_field (const gchar  *word,
+                               const gchar **value)
+{
+  static const struct {
+    const gchar *name;
+    gchar        field;
+  } names [] = {
+    { "t", 't' }, { "title", 't' },
+    { "c", 'c' }, { "composer", 'c' },
+    { "r", 'r' }, { "rhythm", 'r' },
+    { "k", 'k' }, { "key", 'k' },
+    { "m", 'm' }, { "meter", 'm' },
+    { "o", 'o' }, { "origin", 'o' },
+    { "n", 'n' }, { "notes", 'n' },
+  };
+  const gchar *colon = strchr (word, ':');
+  guint i;
+
+  *value = word;
+  if (colon == NULL)
+    return '\0';
+
+  for (i = 0; i < G_N_ELEMENTS (names); i++)
+    if (g_ascii_strncasecmp (word, names[i].name, colon - word) == 0 &&
+        names[i].name[colon - word] == '\0')
+      {
+        *value = colon + 1;
+        return names[i].field;
+      }
+
+  return '\0';
+}
+
+
+/*
+ * The docs matching one word of a query, or NULL if it places no
+ * restriction (nothing searchable in it).
+ */
+static GArray *
+gabc_search_index_match_word (GabcSearchIndex *self,
+                              const gchar     *word)
+{
+  g_autofree gchar *normalised = NULL;
+  g_auto (GStrv) parts = NULL;
+  GArray *matches = NULL;
+  const gchar *value;
+  gchar field;
+  guint i;
+
+  field = gabc_search_index_parse_field (word, &value);
+
+  if (field == 'n')
+    {
+      g_autofree gchar *notes = gabc_search_index_normalise_notes (value);
+      gsize n_notes = strlen (notes);
+
+      if (n_notes == 0)
+        return NULL;
+
+      /* Every run of notes in the query must be in the tune. */
+      for (i = 0; i == 0 || i + GABC_SEARCH_INDEX_NGRAM <= n_notes; i++)
+        {
+          g_autoptr (GArray) docs = g_array_new (FALSE, FALSE, sizeof (guint32));
+          g_autofree gchar *term = g_strdup_printf ("n:%.*s", GABC_SEARCH_INDEX_NGRAM, notes + i);
+
+          gabc_search_index_lookup (self, term, n_notes >= GABC_SEARCH_INDEX_NGRAM, docs);
+          matches = gabc_search_index_intersect (matches, docs);
+        }
+
+      return matches;
+    }
+
+  normalised = gabc_search_index_normalise (value, -1);
+  parts = g_strsplit (normalised, " ", -1);
+
+  for (i = 0; parts[i] != NULL; i++)
+    {
+      g_autoptr (GArray) docs = g_array_new (FALSE, FALSE, sizeof (guint32));
+      const gchar *fields = (field != '\0') ? (const gchar[]) { field, '\0' } : "tcrkmo";
+      const gchar *f;
+
+      if (parts[i][0] == '\0')
+        continue;
+
+      for (f = fields; *f != '\0'; f++)
+        {
+          g_autofree gchar *prefix = g_strdup_printf ("%c:%s", *f, parts[i]);
+
+          gabc_search_index_lookup (self, prefix, FALSE, docs);
+        }
+
+      matches = gabc_search_index_intersect (matches, docs);
+    }
+
+  return matches;
+}
+
+
+static GabcSearchResult *
+gabc_search_index_get_result (GabcSearchIndex *self,
+                              guint32          doc)
+{
+  GabcSearchResult *result;
+  const gchar *path;
+  guint32 file;
+
+  result = g_new0 (GabcSearchResult, 1);
+  g_variant_get_child (self->docs, doc, GABC_SEARCH_INDEX_DOC,
+                       &file, &result->line, &result->number,
+                       &result->title, &result->composer, &result->rhythm,
+                       &result->key, &result->meter, &result->origin, NULL, NULL);
+  g_variant_get_child (self->files, file, "(&sxt)", &path, NULL, NULL);
+  result->path = g_strdup (path);
+
+  return result;
+}
+
+
+/*
+ * Find the tunes matching every word of query.  Words match the start of
+ * words in any of the indexed fields; "t:", "c:", "r:", "k:", "m:" and
+ * "o:" (or "title:", "composer:" and so on) restrict a word to one field,
+ * and "n:" (or "notes:") matches a run of notes anywhere in the melody
+ * ("n:GABc").  Returns an array of GabcSearchResult in file order.
+ */
+GPtrArray *
+gabc_search_index_search (GabcSearchIndex *self,
+                          const gchar     *query,
+                          guint            max_results)
+{
+  GPtrArray *results = g_ptr_array_new_with_free_func ((GDestroyNotify) gabc_search_result_free);
+  g_auto (GStrv) words = NULL;
+  g_autoptr (GArray) matches = NULL;
+  guint i;
+
+  g_return_val_if_fail (GABC_IS_SEARCH_INDEX (self), results);
+
+  if (self->snapshot == NULL || query == NULL)
+    return results;
+
+  words = g_strsplit_set (query, " \t", -1);
+  for (i = 0; words[i] != NULL; i++)
+    {
+      g_autoptr (GArray) docs = NULL;
+
+      if (words[i][0] == '\0')
+        continue;
+
+      docs = gabc_search_index_match_word (self, words[i]);
+      if (docs != NULL)
+        matches = gabc_search_index_intersect (matches, docs);
+    }
+
+  for (i = 0; matches != NULL && i < matches->len && i < max_results; i++)
+    {
+      guint32 doc = g_array_index (matches, guint32, i);
+
+      if (doc >= g_variant_n_children (self->docs))
+        break;
+
+      g_ptr_array_add (results, gabc_search_index_get_result (self, doc));
+    }
+
+  return results;
+}
+
+
+/*
+ * Most hits first; the doc number keeps the order stable.
+ */
+static gint
+gabc_search_index_compare_hits (gconstpointer a,
+                                gconstpointer b)
+{
+  const similar_candidate_t *candidate_a = a;
+  const similar_candidate_t *candidate_b = b;
+
+  if (candidate_a->hits != candidate_b->hits)
+    return (candidate_a->hits < candidate_b->hits) - (candidate_a->hits > candidate_b->hits);
+
+  return (candidate_a->doc > candidate_b->doc) - (candidate_a->doc < candidate_b->doc);
+}
+
+
+/*
+ * Best score first, then the closest to the start of the tune.
+ */
+static gint
+gabc_search_index_compare_scores (gconstpointer a,
+                                  gconstpointer b)
+{
+  const similar_candidate_t *candidate_a = a;
+  const similar_candidate_t *candidate_b = b;
+
+  if (candidate_a->score != candidate_b->score)
+    return (candidate_a->score < candidate_b->score) - (candidate_a->score > candidate_b->score);
+
+  if (candidate_a->offset != candidate_b->offset)
+    return (candidate_a->offset > candidate_b->offset) - (candidate_a->offset < candidate_b->offset);
+
+  return gabc_search_index_compare_hits (a, b);
+}
+
+
+/*
+ * Find the tunes whose melodies go like melody, best match first.  The
+ * tunes sharing the most interval n-grams with it are scored with
+ * gabc_melody_score (); each result's similarity is the fraction of the
+ * melody's intervals that lined up.  Returns an array of
+ * GabcSearchResult, empty if the melody is too short to search for.
+ */
+GPtrArray *
+gabc_search_index_find_similar (GabcSearchIndex  *self,
+                                const GabcMelody *melody,
+                                guint             max_results)
+{
+  GPtrArray *results = g_ptr_array_new_with_free_func ((GDestroyNotify) gabc_search_result_free);
+  g_autoptr (GArray) candidates = NULL;
+  g_autoptr (GArray) docs = NULL;
+  g_autofree guint16 *hits = NULL;
+  gchar terms [GABC_MELODY_MAX_INTERVALS][2 + GABC_MELODY_NGRAM + 1];
+  guint n_terms = 0;
+  gsize n_docs;
+  guint i;
+  guint j;
+
+  g_return_val_if_fail (GABC_IS_SEARCH_INDEX (self), results);
+
+  if (self->snapshot == NULL || melody->n_intervals < GABC_MELODY_NGRAM)
+    return results;
+
+  n_docs = g_variant_n_children (self->docs);
+  hits = g_new0 (guint16, n_docs);
+  candidates = g_array_new (FALSE, FALSE, sizeof (similar_candidate_t));
+  docs = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+  for (i = 0; i + GABC_MELODY_NGRAM <= melody->n_intervals; i++)
+    {
+      gchar *term = terms[n_terms];
+
+      term[0] = 'i';
+      term[1] = ':';
+      gabc_melody_get_ngram (melody, i, term + 2);
+
+      /* A phrase played twice shouldn't count twice. */
+      for (j = 0; j < n_terms; j++)
+        if (strcmp (terms[j], term) == 0)
+          break;
+      if (j < n_terms)
+        continue;
+      n_terms++;
+
+      g_array_set_size (docs, 0);
+      gabc_search_index_lookup (self, term, TRUE, docs);
+
+      for (j = 0; j < docs->len; j++)
+        {
+          guint32 doc = g_array_index (docs, guint32, j);
+
+          if (doc >= n_docs)
+            continue;
+
+          if (hits[doc]++ == 0)
+            {
+              similar_candidate_t candidate = { doc, 0, 0, 0 };
+
+              g_array_append_val (candidates, candidate);
+            }
+        }
+    }
+
+  for (i = 0; i < candidates->len; i++)
+    {
+      similar_candidate_t *candidate = &g_array_index (candidates, similar_candidate_t, i);
+
+      candidate->hits = hits[candidate->doc];
+    }
+
+  g_array_sort (candidates, gabc_search_index_compare_hits);
+  g_array_set_size (candidates, MIN (candidates->len, GABC_SEARCH_INDEX_SIMILAR_CANDIDATES));
+
+  for (i = 0; i < candidates->len; i++)
+    {
+      similar_candidate_t *candidate = &g_array_index (candidates, similar_candidate_t, i);
+      g_autoptr (GVariant) record = g_variant_get_child_value (self->docs, candidate->doc);
+      g_autoptr (GVariant) intervals = g_variant_get_child_value (record, DOC_INTERVALS);
+      const gint8 *data;
+      gsize n_intervals;
+
+      data = g_variant_get_fixed_array (intervals, &n_intervals, sizeof (gint8));
+      candidate->score = gabc_melody_score (melody, data, n_intervals, &candidate->offset);
+    }
+
+  g_array_sort (candidates, gabc_search_index_compare_scores);
+
+  for (i = 0; i < candidates->len && i < max_results; i++)
+    {
+      similar_candidate_t *candidate = &g_array_index (candidates, similar_candidate_t, i);
+      GabcSearchResult *result;
+
+      result = gabc_search_index_get_result (self, candidate->doc);
+      result->similarity = (gdouble) MIN (candidate->score, melody->n_intervals) / melody->n_intervals;
+      g_ptr_array_add (results, result);
+    }
+
+  return results;
+}
+
+
+/*
+ * SETUP
+ */
+static void
+gabc_search_index_dispose (GObject *object)
+{
+  GabcSearchIndex *self = GABC_SEARCH_INDEX (object);
+
+  g_cancellable_cancel (self->cancellable);
+  g_clear_handle_id (&self->update_source_id, g_source_remove);
+  g_clear_pointer (&self->monitors, g_hash_table_unref);
+
+  G_OBJECT_CLASS (gabc_search_index_parent_class)->dispose (object);
+}
+
+
+static void
+gabc_search_index_finalize (GObject *object)
+{
+  GabcSearchIndex *self = GABC_SEARCH_INDEX (object);
+
+  gabc_search_index_set_snapshot (self, NULL);
+  g_clear_object (&self->cancellable);
+  g_strfreev (self->directories);
+  g_free (self->index_path);
+
+  G_OBJECT_CLASS (gabc_search_index_parent_class)->finalize (object);
+}
+
+
+static void
+gabc_search_index_class_init (GabcSearchIndexClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = gabc_search_index_dispose;
+  object_class->finalize = gabc_search_index_finalize;
+
+  /*
+   * Emitted when an update has finished and searches see the new index.
+   */
+  signals [UPDATED] =
+    g_signal_new ("updated",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE,
+                  0);
+}
+
+
+static void
+gabc_search_index_init (GabcSearchIndex *self)
+{
+  self->monitors = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+  self->cancellable = g_cancellable_new ();
+}
+
+
+/*
+ * Load the index saved at index_path, if there is one.  Nothing is scanned
+ * until directories are set, and then the saved index is brought up to
+ * date.
+ */
+GabcSearchIndex *
+gabc_search_index_new (const gchar *index_path)
+{
+  GabcSearchIndex *self;
+  GMappedFile *mapped_file;
+
+  self = g_object_new (GABC_TYPE_SEARCH_INDEX, NULL);
+  self->index_path = g_strdup (index_path);
+
+  mapped_file = g_mapped_file_new (index_path, FALSE, NULL);
+  if (mapped_file != NULL)
+    {
+      g_autoptr (GBytes) bytes = g_mapped_file_get_bytes (mapped_file);
+      g_autoptr (GVariant) snapshot = NULL;
+      g_autoptr (GVariant) version = NULL;
+
+      snapshot = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (GABC_SEARCH_INDEX_FORMAT), bytes, FALSE));
+      version = g_variant_get_child_value (snapshot, 0);
+      if (g_variant_get_uint32 (version) == GABC_SEARCH_INDEX_VERSION)
+        gabc_search_index_set_snapshot (self, snapshot);
+
+      g_mapped_file_unref (mapped_file);
+    }
+
+  return self;
+}
+
+
+/*
+ * The index shared by all windows, in $XDG_CACHE_HOME/gabc/search.
+ */
+GabcSearchIndex *
+gabc_search_index_get_default (void)
+{
+  static GabcSearchIndex *default_index = NULL;
+
+  if (default_index == NULL)
+    {
+      g_autofree gchar *path = g_build_filename (g_get_user_cache_dir (), "gabc", "search", "index.gvariant", NULL);
+      default_index = gabc_search_index_new (path);
+    }
+
+  return default_index;
+}
+
+
+/*
+ * Index the .abc files in directories and everything below them, and keep
+ * watching them.  Setting the same directories again does nothing.
+ */
+void
+gabc_search_index_set_directories (GabcSearchIndex     *self,
+                                   const gchar * const *directories)
+{
+  g_return_if_fail (GABC_IS_SEARCH_INDEX (self));
+
+  if (self->directories != NULL && g_strv_equal ((const gchar * const *) self->directories, directories))
+    return;
+
+  g_strfreev (self->directories);
+  self->directories = g_strdupv ((gchar **) directories);
+
+  gabc_search_index_update (self);
+}
+
+
+gboolean
+gabc_search_index_is_updating (GabcSearchIndex *self)
+{
+  return self->updating;
+}
+
+
+guint
+gabc_search_index_get_n_tunes (GabcSearchIndex *self)
+{
+  return self->docs != NULL ? g_variant_n_children (self->docs) : 0;
+}
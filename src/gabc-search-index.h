@@ -0,0 +1,76 @@
+/* gabc-search-index.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <gio/gio.h>
+
+#include "gabc-melody.h"
+
+G_BEGIN_DECLS
+
+/*
+ * One tune found by gabc_search_index_search ().  line is the line of its
+ * X: field in the file, counted from 0.  Fields the tune doesn't have are
+ * empty strings.  similarity is only set by
+ * gabc_search_index_find_similar ().
+ */
+typedef struct {
+  gchar        *path;
+  guint         line;
+  guint         number;
+  gchar        *title;
+  gchar        *composer;
+  gchar        *rhythm;
+  gchar        *key;
+  gchar        *meter;
+  gchar        *origin;
+  gdouble       similarity;
+} GabcSearchResult;
+
+void                      gabc_search_result_free                 (GabcSearchResult *result);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GabcSearchResult, gabc_search_result_free)
+
+#define GABC_TYPE_SEARCH_INDEX (gabc_search_index_get_type())
+
+G_DECLARE_FINAL_TYPE (GabcSearchIndex, gabc_search_index, GABC, SEARCH_INDEX, GObject)
+
+GabcSearchIndex          *gabc_search_index_new                   (const gchar *index_path);
+
+GabcSearchIndex          *gabc_search_index_get_default           (void);
+
+void                      gabc_search_index_set_directories       (GabcSearchIndex     *self,
+                                                                   const gchar * const *directories);
+
+void                      gabc_search_index_update                (GabcSearchIndex *self);
+
+gboolean                  gabc_search_index_is_updating           (GabcSearchIndex *self);
+
+guint                     gabc_search_index_get_n_tunes           (GabcSearchIndex *self);
+
+GPtrArray *               gabc_search_index_search                (GabcSearchIndex *self,
+                                                                   const gchar     *query,
+                                                                   guint            max_results);
+
+GPtrArray *               gabc_search_index_find_similar          (GabcSearchIndex  *self,
+                                                                   const GabcMelody *melody,
+                                                                   guint             max_results);
+
+G_END_DECLS
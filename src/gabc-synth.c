@@ -0,0 +1,230 @@
+/* gabc-synth.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * The built-in player's instrument.
+ *
+ * The wave is a fixed mix of the first few harmonics, with the odd ones
+ * stronger, which reads well enough as a reed or a whistle for following
+ * a tune; it is worked out once into a table and each voice steps through
+ * it at its own rate.  Notes start in 5 ms, fall away to half their level
+ * and die away in about 60 ms once released.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "gabc-synth.h"
+
+#define GABC_SYNTH_TABLE_SIZE     (1 << GABC_SYNTH_TABLE_BITS)
+#define GABC_SYNTH_ATTACK_TIME    0.005
+#define GABC_SYNTH_DECAY_TIME     0.3
+#define GABC_SYNTH_RELEASE_TIME   0.06
+#define GABC_SYNTH_SUSTAIN        0.5f
+#define GABC_SYNTH_SILENCE        0.0001f
+#define GABC_SYNTH_GAIN           0.3f
+
+
+void
+gabc_synth_init (GabcSynth *synth,
+                 guint      rate)
+{
+  static const gdouble harmonics [] = { 1.0, 0.35, 0.55, 0.15, 0.3, 0.08, 0.12 };
+  gdouble peak = 0;
+  guint i;
+  guint h;
+
+  memset (synth, 0, sizeof (GabcSynth));
+  synth->rate = rate;
+
+  /* Time constants of the envelope, as the change per sample. */
+  synth->attack_step = 1.0 / (GABC_SYNTH_ATTACK_TIME * rate);
+  synth->decay_factor = exp (-1.0 / (GABC_SYNTH_DECAY_TIME * rate));
+  synth->release_factor = exp (-1.0 / (GABC_SYNTH_RELEASE_TIME / 4 * rate));
+
+  for (i = 0; i < 128; i++)
+    synth->steps[i] = (guint32) (440.0 * pow (2.0, ((gint) i - 69) / 12.0) / rate * 4294967296.0);
+
+  for (i = 0; i < GABC_SYNTH_TABLE_SIZE; i++)
+    {
+      gdouble sample = 0;
+
+      for (h = 0; h < G_N_ELEMENTS (harmonics); h++)
+        sample += harmonics[h] * sin (2 * G_PI * (h + 1) * i / GABC_SYNTH_TABLE_SIZE);
+      synth->table[i] = sample;
+      peak = MAX (peak, fabs (sample));
+    }
+
+  for (i = 0; i < GABC_SYNTH_TABLE_SIZE; i++)
+    synth->table[i] /= peak;
+}
+
+
+void
+gabc_synth_note_on (GabcSynth *synth,
+                    guint8     pitch,
+                    guint8     velocity)
+{
+  GabcSynthVoice *voice = NULL;
+  guint i;
+
+  if (velocity == 0)
+    {
+      gabc_synth_note_off (synth, pitch);
+      return;
+    }
+
+  /* A free voice, or else the one playing longest. */
+  for (i = 0; i < GABC_SYNTH_N_VOICES; i++)
+    {
+      GabcSynthVoice *candidate = &synth->voices[i];
+
+      if (candidate->state == GABC_SYNTH_VOICE_FREE)
+        {
+          voice = candidate;
+          break;
+        }
+      if (voice == NULL || candidate->age < voice->age)
+        voice = candidate;
+    }
+
+  voice->state = GABC_SYNTH_VOICE_ATTACK;
+  voice->pitch = pitch & 0x7f;
+  voice->phase = 0;
+  voice->step = synth->steps[voice->pitch];
+  voice->level = 0;
+  voice->peak = (velocity & 0x7f) / 127.0f;
+  voice->age = synth->n_notes++;
+}
+
+
+void
+gabc_synth_note_off (GabcSynth *synth,
+                     guint8     pitch)
+{
+  guint i;
+
+  for (i = 0; i < GABC_SYNTH_N_VOICES; i++)
+    {
+      GabcSynthVoice *voice = &synth->voices[i];
+
+      if (voice->state != GABC_SYNTH_VOICE_FREE && voice->pitch == pitch)
+        voice->state = GABC_SYNTH_VOICE_RELEASE;
+    }
+}
+
+
+void
+gabc_synth_all_notes_off (GabcSynth *synth)
+{
+  guint i;
+
+  for (i = 0; i < GABC_SYNTH_N_VOICES; i++)
+    if (synth->voices[i].state != GABC_SYNTH_VOICE_FREE)
+      synth->voices[i].state = GABC_SYNTH_VOICE_RELEASE;
+}
+
+
+gboolean
+gabc_synth_is_silent (const GabcSynth *synth)
+{
+  guint i;
+
+  for (i = 0; i < GABC_SYNTH_N_VOICES; i++)
+    if (synth->voices[i].state != GABC_SYNTH_VOICE_FREE)
+      return FALSE;
+
+  return TRUE;
+}
+
+
+/*
+ * The envelope for one sample, freeing the voice once it is silent.
+ */
+static inline gfloat
+gabc_synth_voice_step (GabcSynth      *synth,
+                       GabcSynthVoice *voice)
+{
+  switch (voice->state)
+    {
+    case GABC_SYNTH_VOICE_ATTACK:
+      voice->level += synth->attack_step * voice->peak;
+      if (voice->level >= voice->peak)
+        {
+          voice->level = voice->peak;
+          voice->state = GABC_SYNTH_VOICE_DECAY;
+        }
+      break;
+
+    case GABC_SYNTH_VOICE_DECAY:
+      voice->level = voice->peak * GABC_SYNTH_SUSTAIN +
+                     (voice->level - voice->peak * GABC_SYNTH_SUSTAIN) * synth->decay_factor;
+      break;
+
+    case GABC_SYNTH_VOICE_RELEASE:
+      voice->level *= synth->release_factor;
+      if (voice->level < GABC_SYNTH_SILENCE)
+        voice->state = GABC_SYNTH_VOICE_FREE;
+      break;
+
+    case GABC_SYNTH_VOICE_FREE:
+    default:
+      voice->level = 0;
+      break;
+    }
+
+  return voice->level;
+}
+
+
+/*
+ * Write n_frames mono samples, between -1 and 1, to buffer.
+ */
+void
+gabc_synth_render (GabcSynth *synth,
+                   gfloat    *buffer,
+                   gsize      n_frames)
+{
+  guint i;
+  gsize n;
+
+  memset (buffer, 0, n_frames * sizeof (gfloat));
+
+  for (i = 0; i < GABC_SYNTH_N_VOICES; i++)
+    {
+      GabcSynthVoice *voice = &synth->voices[i];
+
+      for (n = 0; n < n_frames && voice->state != GABC_SYNTH_VOICE_FREE; n++)
+        {
+          gfloat level = gabc_synth_voice_step (synth, voice);
+
+          buffer[n] += level * synth->table[voice->phase >> (32 - GABC_SYNTH_TABLE_BITS)];
+          voice->phase += voice->step;
+        }
+    }
+
+  /* A soft limit, so that big chords saturate rather than wrap. */
+  for (n = 0; n < n_frames; n++)
+    {
+      gfloat x = CLAMP (buffer[n] * GABC_SYNTH_GAIN, -3.0f, 3.0f);
+
+      buffer[n] = x * (27 + x * x) / (27 + 9 * x * x);
+    }
+}
@@ -0,0 +1,80 @@
+/* gabc-synth.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define GABC_SYNTH_N_VOICES    16
+#define GABC_SYNTH_TABLE_BITS  10
+
+typedef enum {
+  GABC_SYNTH_VOICE_FREE,
+  GABC_SYNTH_VOICE_ATTACK,
+  GABC_SYNTH_VOICE_DECAY,
+  GABC_SYNTH_VOICE_RELEASE,
+} GabcSynthVoiceState;
+
+typedef struct {
+  GabcSynthVoiceState  state;
+  guint8               pitch;
+  guint32              phase;         /* 32 bit fixed point position in the wave table */
+  guint32              step;
+  gfloat               level;
+  gfloat               peak;
+  guint                age;
+} GabcSynthVoice;
+
+/*
+ * A small polyphonic synthesizer: one wave table, an attack, decay and
+ * release envelope per voice, and the oldest voice taken when they run out.
+ * Nothing in it allocates or locks, so it can run on an audio thread.
+ */
+typedef struct {
+  guint           rate;
+  gfloat          attack_step;
+  gfloat          decay_factor;
+  gfloat          release_factor;
+  guint           n_notes;
+  guint32         steps [128];          /* phase step of each MIDI pitch */
+  gfloat          table [1 << GABC_SYNTH_TABLE_BITS];
+  GabcSynthVoice  voices [GABC_SYNTH_N_VOICES];
+} GabcSynth;
+
+void                      gabc_synth_init                         (GabcSynth        *synth,
+                                                                   guint             rate);
+
+void                      gabc_synth_note_on                      (GabcSynth        *synth,
+                                                                   guint8            pitch,
+                                                                   guint8            velocity);
+
+void                      gabc_synth_note_off                     (GabcSynth        *synth,
+                                                                   guint8            pitch);
+
+void                      gabc_synth_all_notes_off                (GabcSynth        *synth);
+
+gboolean                  gabc_synth_is_silent                    (const GabcSynth  *synth);
+
+void                      gabc_synth_render                       (GabcSynth        *synth,
+                                                                   gfloat           *buffer,
+                                                                   gsize             n_frames);
+
+G_END_DECLS
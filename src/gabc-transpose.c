@@ -0,0 +1,452 @@
+/* gabc-transpose.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Transposition by a number of semitones, worked out on the parsed tune
+ * and returned as edits to its text, so a buffer only has to change where
+ * the music does.
+ *
+ * Each K: field with a tonic picks the new key: the one a whole number of
+ * semitones away with the fewest accidentals, keeping the mode, so D goes
+ * up a tone to E and down one to C, and an octave keeps its spelling.  The
+ * change of key sets how far every note letter moves, and each note is
+ * then spelled with the accidental its new pitch needs.  A note that had
+ * no accidental only gets one where the new key signature and the
+ * accidentals already written in the bar don't give it; one that had an
+ * accidental always keeps one, so courtesy accidentals stay.  Chord symbol
+ * roots and basses and the explicit accidentals of K: fields move with the
+ * key.
+ */
+
+#include <string.h>
+
+#include "gabc-melody.h"
+#include "gabc-transpose.h"
+
+static const gchar letters [] = "CDEFGAB";
+
+/* Semitones above C of each letter C to B. */
+static const gint8 naturals [7] = { 0, 2, 4, 5, 7, 9, 11 };
+
+typedef struct {
+  const gchar    *text;
+  gint            semitones;
+  gint            steps;         /* letters each note moves by, octaves included */
+  GabcMelody      output;        /* the key and the bar as they are written out */
+  GArray         *edits;
+  GString        *replacements;
+  GString        *scratch;
+} GabcTranspose;
+
+
+/*
+ * n reduced to the range [low, low + 12).
+ */
+static gint
+gabc_transpose_wrap (gint n,
+                     gint low)
+{
+  return ((n - low) % 12 + 12) % 12 + low;
+}
+
+
+/*
+ * The MIDI pitch of a letter (counted in letters from middle C, 7 to the
+ * octave) without an accidental.
+ */
+static gint
+gabc_transpose_natural (gint step)
+{
+  gint octave = (step >= 0) ? step / 7 : -((6 - step) / 7);
+
+  return 60 + 12 * octave + naturals[step - 7 * octave];
+}
+
+
+/*
+ * Set the key the notes are moved to from the value of a K: field, with
+ * its tonic, or C major for a K: field without one, as the key they are
+ * moved from.
+ */
+static void
+gabc_transpose_set_steps (GabcTranspose *self,
+                          gint           sharps)
+{
+  gint new_sharps;
+  gint letter_shift;
+  gint octaves;
+
+  /* An octave up or down leaves the signature spelled as it was. */
+  if (self->semitones % 12 == 0)
+    new_sharps = sharps;
+  else
+    new_sharps = gabc_transpose_wrap (sharps + 7 * self->semitones, -6);
+
+  /* A fifth, 7 semitones and one more sharp, is 4 letters. */
+  letter_shift = (((new_sharps - sharps) * 4) % 7 + 7) % 7;
+
+  /* As many octaves as bring the letters closest to the semitones. */
+  octaves = self->semitones * 7 - letter_shift * 12 + 42;
+  octaves = (octaves >= 0) ? octaves / 84 : -((83 - octaves) / 84);
+
+  self->steps = letter_shift + 7 * octaves;
+}
+
+
+/*
+ * Write a letter moved by the transposition, and its accidental in the
+ * style of a chord symbol ("#", "b") or of a K: field ("^", "_", "=").
+ * Returns FALSE if no spelling needs less than a double accidental.
+ */
+static gboolean
+gabc_transpose_append_letter (GabcTranspose *self,
+                              GString       *out,
+                              gint           letter,
+                              gint           accidental,
+                              gboolean       chord_symbol,
+                              gboolean       lower)
+{
+  gint pitch_class = naturals[letter] + accidental + self->semitones;
+  gint new_letter = ((letter + self->steps) % 7 + 7) % 7;
+  gint new_accidental = gabc_transpose_wrap (pitch_class - naturals[new_letter], -6);
+  gchar c;
+
+  /* Chords are never spelled with a double accidental; E# up a tone is G. */
+  if (chord_symbol && ABS (new_accidental) > 1)
+    {
+      new_letter = (new_letter + (new_accidental > 0 ? 1 : 6)) % 7;
+      new_accidental = gabc_transpose_wrap (pitch_class - naturals[new_letter], -6);
+    }
+  if (ABS (new_accidental) > 2)
+    return FALSE;
+
+  c = letters[new_letter];
+  if (chord_symbol)
+    {
+      g_string_append_c (out, c);
+      if (new_accidental != 0)
+        g_string_append_c (out, new_accidental > 0 ? '#' : 'b');
+      return TRUE;
+    }
+
+  if (new_accidental == 0)
+    g_string_append_c (out, '=');
+  else
+    g_string_append_len (out, new_accidental > 0 ? "^^" : "__", ABS (new_accidental));
+  g_string_append_c (out, lower ? g_ascii_tolower (c) : c);
+  return TRUE;
+}
+
+
+static void
+gabc_transpose_add_edit (GabcTranspose *self,
+                         guint          offset,
+                         guint          length,
+                         const gchar   *text,
+                         gsize          text_length)
+{
+  GabcTransposeEdit edit;
+
+  if (length == text_length && memcmp (self->text + offset, text, length) == 0)
+    return;
+
+  edit.offset = offset;
+  edit.length = length;
+  edit.new_offset = self->replacements->len;
+  edit.new_length = text_length;
+  g_string_append_len (self->replacements, text, text_length);
+  g_array_append_val (self->edits, edit);
+}
+
+
+/*
+ * A K: field, "K:D" or "[K:D]".  The tonic and any explicit accidentals
+ * are rewritten; the mode and anything else stay as they are.
+ */
+static void
+gabc_transpose_key (GabcTranspose        *self,
+                    const GabcAbcTune    *tune,
+                    const GabcAbcElement *element)
+{
+  const gchar *value = gabc_abc_tune_get_string (tune, element) + 2;
+  const gchar *p;
+  guint offset = element->offset + (self->text[element->offset] == '[' ? 1 : 0) + 2;
+  gint letter;
+  gint accidental;
+  gint sharps;
+
+  if (!gabc_melody_parse_key (value, &letter, &accidental, &sharps, &p))
+    {
+      gabc_transpose_set_steps (self, 0);
+      gabc_melody_set_key (&self->output, value);
+      return;
+    }
+
+  gabc_transpose_set_steps (self, sharps);
+
+  g_string_truncate (self->scratch, 0);
+  g_string_append_len (self->scratch, value, p - value - (accidental != 0 ? 2 : 1));
+  gabc_transpose_append_letter (self, self->scratch, letter, accidental, TRUE, FALSE);
+
+  /* Explicit accidentals are words of their own, as in "K:Ador ^c". */
+  while (*p != '\0')
+    {
+      gsize n = strspn (p, "^_=");
+      const gchar *l = (n > 0 && n <= 2 && p[n] != '\0') ? strchr (letters, g_ascii_toupper (p[n])) : NULL;
+      gint explicit_accidental;
+
+      if (l == NULL || p[-1] != ' ' || (p[n + 1] != '\0' && p[n + 1] != ' '))
+        {
+          g_string_append_c (self->scratch, *p++);
+          continue;
+        }
+
+      explicit_accidental = (p[0] == '^') ? (gint) n : (p[0] == '_') ? -(gint) n : 0;
+      if (!gabc_transpose_append_letter (self, self->scratch, l - letters, explicit_accidental, FALSE, g_ascii_islower (p[n])))
+        g_string_append_len (self->scratch, p, n + 1);
+      p += n + 1;
+    }
+
+  gabc_melody_set_key (&self->output, self->scratch->str);
+  gabc_transpose_add_edit (self, offset, strlen (value), self->scratch->str, self->scratch->len);
+}
+
+
+static void
+gabc_transpose_note (GabcTranspose        *self,
+                     const GabcAbcElement *element)
+{
+  const GabcAbcPitch *note = &element->data.note;
+  const gchar *text = self->text + element->offset;
+  gint pitch = note->pitch + self->semitones;
+  gint step = note->octave * 7 + note->letter + self->steps;
+  gint accidental;
+  gint octave;
+  gsize length;
+  gsize letter_start;
+  gint i;
+
+  /* The accidentals, letter and octave marks, leaving the note length. */
+  length = strspn (text, "^_=");
+  length += 1 + strspn (text + length + 1, "',");
+
+  if (pitch < 0 || pitch > 127)
+    return;
+
+  /* Respelled if the new pitch is more than a double accidental away. */
+  accidental = pitch - gabc_transpose_natural (step);
+  while (ABS (accidental) > 2)
+    {
+      step += (accidental > 0) ? 1 : -1;
+      accidental = pitch - gabc_transpose_natural (step);
+    }
+
+  g_string_truncate (self->scratch, 0);
+  if (accidental == 0)
+    g_string_append_c (self->scratch, '=');
+  else
+    g_string_append_len (self->scratch, accidental > 0 ? "^^" : "__", ABS (accidental));
+  letter_start = self->scratch->len;
+
+  octave = (step >= 0) ? step / 7 : -((6 - step) / 7);
+  if (octave >= 1)
+    {
+      g_string_append_c (self->scratch, g_ascii_tolower (letters[step - 7 * octave]));
+      for (i = 1; i < octave; i++)
+        g_string_append_c (self->scratch, '\'');
+    }
+  else
+    {
+      g_string_append_c (self->scratch, letters[step - 7 * octave]);
+      for (i = 0; i > octave; i--)
+        g_string_append_c (self->scratch, ',');
+    }
+
+  /*
+   * Left without an accidental if it had none and the key and the bar give
+   * the new pitch anyway.  Otherwise the accidental is written, and holds
+   * for the rest of the bar.
+   */
+  if (note->accidental == GABC_ABC_NO_ACCIDENTAL &&
+      gabc_melody_get_pitch (&self->output, self->scratch->str + letter_start,
+                             self->scratch->len - letter_start, NULL) == pitch)
+    g_string_erase (self->scratch, 0, letter_start);
+  else
+    gabc_melody_get_pitch (&self->output, self->scratch->str, self->scratch->len, NULL);
+
+  gabc_transpose_add_edit (self, element->offset, length, self->scratch->str, self->scratch->len);
+}
+
+
+/*
+ * The roots and basses of a chord symbol, as in "Am7" and "D/F#".  Text
+ * that only starts with a letter, such as "Fine", is left alone.
+ */
+static void
+gabc_transpose_chord_symbol (GabcTranspose        *self,
+                             const GabcAbcTune    *tune,
+                             const GabcAbcElement *element)
+{
+  const gchar *symbol = gabc_abc_tune_get_string (tune, element);
+  const gchar *p = symbol;
+
+  g_string_truncate (self->scratch, 0);
+
+  while (*p != '\0')
+    {
+      const gchar *l = strchr (letters, *p);
+      gint accidental = 0;
+      gsize n = 1;
+
+      if (l != NULL && (p == symbol || strchr ("/( ", p[-1]) != NULL))
+        {
+          if (p[1] == '#' || p[1] == 'b')
+            accidental = (p[n++] == '#') ? 1 : -1;
+
+          /* Chord qualities start m(aj), m(in), a(ug), a(dd), d(im) or s(us). */
+          if (!g_ascii_islower (p[n]) || strchr ("mads", p[n]) != NULL)
+            {
+              gabc_transpose_append_letter (self, self->scratch, l - letters, accidental, TRUE, FALSE);
+              p += n;
+              continue;
+            }
+        }
+
+      g_string_append_c (self->scratch, *p++);
+    }
+
+  gabc_transpose_add_edit (self, element->offset + 1, strlen (symbol), self->scratch->str, self->scratch->len);
+}
+
+
+/*
+ * The edits that move tune, parsed from text, by semitones, in the order
+ * they come in the text.  The text they put in is appended to replacements.
+ */
+GArray *
+gabc_transpose_tune (const GabcAbcTune *tune,
+                     const gchar       *text,
+                     gint               semitones,
+                     GString           *replacements)
+{
+  GabcTranspose self;
+  guint i;
+
+  self.text = text;
+  self.semitones = semitones;
+  self.edits = g_array_new (FALSE, FALSE, sizeof (GabcTransposeEdit));
+  self.replacements = replacements;
+  self.scratch = g_string_new (NULL);
+  gabc_melody_init (&self.output, NULL);
+  gabc_transpose_set_steps (&self, 0);
+
+  for (i = 0; i < tune->n_elements && semitones != 0; i++)
+    {
+      const GabcAbcElement *element = &tune->elements[i];
+
+      switch ((GabcAbcElementKind) element->kind)
+        {
+        case GABC_ABC_ELEMENT_FIELD:
+          if (gabc_abc_tune_get_string (tune, element)[0] == 'K')
+            gabc_transpose_key (&self, tune, element);
+          break;
+
+        case GABC_ABC_ELEMENT_NOTE:
+          gabc_transpose_note (&self, element);
+          break;
+
+        case GABC_ABC_ELEMENT_BAR:
+          gabc_melody_add_token (&self.output, GABC_ABC_TOKEN_BAR, "|", 1);
+          break;
+
+        case GABC_ABC_ELEMENT_CHORD_SYMBOL:
+          gabc_transpose_chord_symbol (&self, tune, element);
+          break;
+
+        case GABC_ABC_ELEMENT_VOICE:
+        case GABC_ABC_ELEMENT_REST:
+        case GABC_ABC_ELEMENT_CHORD:
+        case GABC_ABC_ELEMENT_TUPLET:
+        case GABC_ABC_ELEMENT_DECORATION:
+        case GABC_ABC_ELEMENT_ANNOTATION:
+        case GABC_ABC_ELEMENT_LYRICS:
+        case GABC_ABC_ELEMENT_DIRECTIVE:
+        case GABC_ABC_ELEMENT_SLUR_START:
+        case GABC_ABC_ELEMENT_SLUR_END:
+        case GABC_ABC_N_ELEMENT_KINDS:
+        default:
+          break;
+        }
+    }
+
+  g_string_free (self.scratch, TRUE);
+
+  return self.edits;
+}
+
+
+/*
+ * A whole file moved by semitones.  Text before the first X: line is
+ * copied as it is.
+ */
+gchar *
+gabc_transpose_text (const gchar *text,
+                     gsize        length,
+                     gint         semitones)
+{
+  g_autoptr (GString) replacements = g_string_new (NULL);
+  GString *out = g_string_sized_new (length + length / 16);
+  const gchar *end = text + length;
+  const gchar *tune;
+
+  if (length >= 2 && text[0] == 'X' && text[1] == ':')
+    tune = text;
+  else if ((tune = g_strstr_len (text, length, "\nX:")) != NULL)
+    tune++;
+
+  g_string_append_len (out, text, (tune != NULL ? tune : end) - text);
+
+  while (tune != NULL)
+    {
+      const gchar *next = g_strstr_len (tune, end - tune, "\nX:");
+      const gchar *tune_end = (next != NULL) ? next + 1 : end;
+      g_autoptr (GabcAbcTune) parsed = gabc_abc_tune_parse (tune, tune_end - tune);
+      g_autoptr (GArray) edits = NULL;
+      const gchar *copied = tune;
+      guint i;
+
+      g_string_truncate (replacements, 0);
+      edits = gabc_transpose_tune (parsed, tune, semitones, replacements);
+
+      for (i = 0; i < edits->len; i++)
+        {
+          const GabcTransposeEdit *edit = &g_array_index (edits, GabcTransposeEdit, i);
+
+          g_string_append_len (out, copied, tune + edit->offset - copied);
+          g_string_append_len (out, replacements->str + edit->new_offset, edit->new_length);
+          copied = tune + edit->offset + edit->length;
+        }
+      g_string_append_len (out, copied, tune_end - copied);
+
+      tune = (next != NULL) ? next + 1 : NULL;
+    }
+
+  return g_string_free (out, FALSE);
+}
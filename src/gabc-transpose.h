@@ -0,0 +1,49 @@
+/* gabc-transpose.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <glib.h>
+
+#include "gabc-abc-parser.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Replace length bytes of a tune's text from offset, which counts from the
+ * start of the tune, with new_length bytes of the replacement text from
+ * new_offset.
+ */
+typedef struct {
+  guint     offset;
+  guint     length;
+  guint     new_offset;
+  guint     new_length;
+} GabcTransposeEdit;
+
+GArray *                  gabc_transpose_tune                     (const GabcAbcTune *tune,
+                                                                   const gchar       *text,
+                                                                   gint               semitones,
+                                                                   GString           *replacements);
+
+gchar *                   gabc_transpose_text                     (const gchar       *text,
+                                                                   gsize              length,
+                                                                   gint               semitones);
+
+G_END_DECLS
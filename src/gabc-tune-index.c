@@ -0,0 +1,716 @@
+/* gabc-tune-index.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Index of the X: records in a tunebook buffer.
+ *
+ * Each tune is anchored by a left-gravity GtkTextMark at the start of its
+ * X: line, so the text buffer keeps the anchors in place as text is edited
+ * around them and the array of tunes stays sorted by position.  After each
+ * insert or delete only the lines touched by the edit are rescanned; tunes
+ * whose X: line was touched are replaced and the header of the tune the edit
+ * landed in is re-read.  Lookups by offset are a binary search over the
+ * marks and lookups by X: number go through a hash table.
+ *
+ * The parsed form of a tune is kept alongside it once asked for.  Every
+ * edit drops the parsed form of the tunes it landed in, so only those are
+ * parsed again and the rest of the book is left alone.  The same tunes are
+ * passed on through "tunes-edited" to the highlighter and validator, which
+ * keep work of their own per tune.
+ */
+
+#include <string.h>
+
+#include "gabc-tune-index.h"
+
+struct _GabcTuneIndex
+{
+  GObject                       parent_instance;
+
+  GtkTextBuffer                *buffer;
+  GPtrArray                    *tunes;
+  GHashTable                   *numbers;
+
+  gulong                        insert_text_id;
+  gulong                        delete_range_id;
+  guint                         freeze_count;
+};
+
+G_DEFINE_FINAL_TYPE (GabcTuneIndex, gabc_tune_index, G_TYPE_OBJECT)
+
+enum {
+  CHANGED,
+  TUNES_EDITED,
+  N_SIGNALS
+};
+
+static guint signals [N_SIGNALS];
+
+
+static void
+gabc_tune_index_add_number (GabcTuneIndex *self, GabcTuneInfo *tune)
+{
+  GSList *list;
+
+  list = g_hash_table_lookup (self->numbers, GUINT_TO_POINTER (tune->number));
+  g_hash_table_steal (self->numbers, GUINT_TO_POINTER (tune->number));
+  g_hash_table_insert (self->numbers, GUINT_TO_POINTER (tune->number), g_slist_prepend (list, tune));
+}
+
+
+static void
+gabc_tune_index_remove_number (GabcTuneIndex *self, GabcTuneInfo *tune)
+{
+  GSList *list;
+
+  list = g_hash_table_lookup (self->numbers, GUINT_TO_POINTER (tune->number));
+  g_hash_table_steal (self->numbers, GUINT_TO_POINTER (tune->number));
+  list = g_slist_remove (list, tune);
+  if (list != NULL)
+    g_hash_table_insert (self->numbers, GUINT_TO_POINTER (tune->number), list);
+}
+
+
+static void
+gabc_tune_info_clear_fields (GabcTuneInfo *tune)
+{
+  g_clear_pointer (&tune->title, g_free);
+  g_clear_pointer (&tune->key, g_free);
+  g_clear_pointer (&tune->meter, g_free);
+  g_clear_pointer (&tune->rhythm, g_free);
+}
+
+
+static void
+gabc_tune_index_free_tune (GabcTuneIndex *self, GabcTuneInfo *tune)
+{
+  gabc_tune_index_remove_number (self, tune);
+  if (self->buffer != NULL)
+    gtk_text_buffer_delete_mark (self->buffer, tune->start_mark);
+  gabc_tune_info_clear_fields (tune);
+  g_clear_pointer (&tune->parsed, gabc_abc_tune_free);
+  g_free (tune);
+}
+
+
+static gint
+gabc_tune_index_get_tune_offset (GabcTuneIndex *self, guint position)
+{
+  GabcTuneInfo *tune = g_ptr_array_index (self->tunes, position);
+  GtkTextIter iter;
+
+  gtk_text_buffer_get_iter_at_mark (self->buffer, &iter, tune->start_mark);
+  return gtk_text_iter_get_offset (&iter);
+}
+
+
+/*
+ * Returns the position of the first tune starting at or after offset.
+ */
+static guint
+gabc_tune_index_lower_bound (GabcTuneIndex *self, gint offset)
+{
+  guint lo = 0;
+  guint hi = self->tunes->len;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (gabc_tune_index_get_tune_offset (self, mid) < offset)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+
+/*
+ * If the line at line_start is a field ("T:Title") return the field letter,
+ * otherwise 0.
+ */
+static gunichar
+gabc_tune_index_get_field_letter (const GtkTextIter *line_start)
+{
+  GtkTextIter iter = *line_start;
+  gunichar letter;
+
+  letter = gtk_text_iter_get_char (&iter);
+  if (letter >= 0x80 || !g_ascii_isalpha ((gchar) letter))
+    return 0;
+
+  if (!gtk_text_iter_forward_char (&iter) || gtk_text_iter_get_char (&iter) != ':')
+    return 0;
+
+  return letter;
+}
+
+
+static gchar *
+gabc_tune_index_get_field_value (const GtkTextIter *line_start)
+{
+  GtkTextIter value_start = *line_start;
+  GtkTextIter line_end = *line_start;
+
+  gtk_text_iter_forward_chars (&value_start, 2);
+  if (!gtk_text_iter_ends_line (&line_end))
+    gtk_text_iter_forward_to_line_end (&line_end);
+
+  return g_strstrip (gtk_text_iter_get_slice (&value_start, &line_end));
+}
+
+
+/*
+ * Read the tune header, stopping at K: (which closes the header), a blank
+ * line or the next X:.  Returns TRUE if anything changed.
+ */
+static gboolean
+gabc_tune_index_parse_header (GabcTuneIndex *self, GabcTuneInfo *tune)
+{
+  GabcTuneInfo old = *tune;
+  GtkTextIter iter;
+  gunichar letter;
+  gboolean first_line = TRUE;
+  gboolean changed;
+
+  tune->title = tune->key = tune->meter = tune->rhythm = NULL;
+  gabc_tune_index_remove_number (self, tune);
+  tune->number = 0;
+
+  gtk_text_buffer_get_iter_at_mark (self->buffer, &iter, tune->start_mark);
+
+  for (;;)
+    {
+      letter = gabc_tune_index_get_field_letter (&iter);
+
+      if (letter == 'X')
+        {
+          g_autofree gchar *value = NULL;
+
+          if (!first_line)
+            break;
+          value = gabc_tune_index_get_field_value (&iter);
+          tune->number = (guint) g_ascii_strtoull (value, NULL, 10);
+        }
+      else if (letter == 'T' && tune->title == NULL)
+        tune->title = gabc_tune_index_get_field_value (&iter);
+      else if (letter == 'M' && tune->meter == NULL)
+        tune->meter = gabc_tune_index_get_field_value (&iter);
+      else if (letter == 'R' && tune->rhythm == NULL)
+        tune->rhythm = gabc_tune_index_get_field_value (&iter);
+      else if (letter == 'K')
+        {
+          tune->key = gabc_tune_index_get_field_value (&iter);
+          break;
+        }
+      else if (letter == 0 && gtk_text_iter_ends_line (&iter))
+        break;
+
+      first_line = FALSE;
+      if (!gtk_text_iter_forward_line (&iter))
+        break;
+    }
+
+  gabc_tune_index_add_number (self, tune);
+
+  changed = (old.number != tune->number ||
+             g_strcmp0 (old.title, tune->title) != 0 ||
+             g_strcmp0 (old.key, tune->key) != 0 ||
+             g_strcmp0 (old.meter, tune->meter) != 0 ||
+             g_strcmp0 (old.rhythm, tune->rhythm) != 0);
+
+  gabc_tune_info_clear_fields (&old);
+
+  return changed;
+}
+
+
+/*
+ * Rescan the lines spanning [start_offset, end_offset] and splice the
+ * result into the index.
+ */
+static void
+gabc_tune_index_update_range (GabcTuneIndex *self,
+                              gint           start_offset,
+                              gint           end_offset)
+{
+  g_autoptr (GPtrArray) added = NULL;
+  GtkTextIter iter;
+  GtkTextIter limit;
+  gint limit_offset;
+  guint lo, hi, n_removed, n_added, i;
+
+  /* The text of the tunes the edit landed in has changed. */
+  if (!gabc_tune_index_lookup_offset (self, start_offset, &i))
+    i = 0;
+  if (gabc_tune_index_lookup_offset (self, end_offset, &hi))
+    for (; i <= hi; i++)
+      g_clear_pointer (&((GabcTuneInfo *) g_ptr_array_index (self->tunes, i))->parsed, gabc_abc_tune_free);
+
+  gtk_text_buffer_get_iter_at_offset (self->buffer, &iter, start_offset);
+  gtk_text_iter_set_line_offset (&iter, 0);
+
+  gtk_text_buffer_get_iter_at_offset (self->buffer, &limit, end_offset);
+  if (!gtk_text_iter_ends_line (&limit))
+    gtk_text_iter_forward_to_line_end (&limit);
+  limit_offset = gtk_text_iter_get_offset (&limit);
+
+  lo = gabc_tune_index_lower_bound (self, gtk_text_iter_get_offset (&iter));
+  hi = gabc_tune_index_lower_bound (self, limit_offset + 1);
+
+  added = g_ptr_array_new ();
+
+  do
+    {
+      if (gabc_tune_index_get_field_letter (&iter) == 'X')
+        {
+          GabcTuneInfo *tune = g_new0 (GabcTuneInfo, 1);
+
+          tune->start_mark = gtk_text_buffer_create_mark (self->buffer, NULL, &iter, TRUE);
+          gabc_tune_index_parse_header (self, tune);
+          g_ptr_array_add (added, tune);
+        }
+    }
+  while (gtk_text_iter_forward_line (&iter) && gtk_text_iter_get_offset (&iter) <= limit_offset);
+
+  n_removed = hi - lo;
+  n_added = added->len;
+
+  /* Nothing to splice for the common case of typing inside a tune body. */
+  if (n_removed > 0 || n_added > 0)
+    {
+      for (i = lo; i < hi; i++)
+        gabc_tune_index_free_tune (self, g_ptr_array_index (self->tunes, i));
+
+      if (n_added > n_removed)
+        {
+          guint old_len = self->tunes->len;
+
+          g_ptr_array_set_size (self->tunes, old_len + n_added - n_removed);
+          memmove (&self->tunes->pdata[lo + n_added],
+                   &self->tunes->pdata[hi],
+                   (old_len - hi) * sizeof (gpointer));
+        }
+      else if (n_added < n_removed)
+        {
+          g_ptr_array_remove_range (self->tunes, lo + n_added, n_removed - n_added);
+        }
+
+      for (i = 0; i < n_added; i++)
+        self->tunes->pdata[lo + i] = g_ptr_array_index (added, i);
+
+      g_signal_emit (self, signals [CHANGED], 0, lo, n_removed, n_added);
+    }
+
+  /* The edit may have been in the header of the tune before the splice. */
+  if (lo > 0 && gabc_tune_index_parse_header (self, g_ptr_array_index (self->tunes, lo - 1)))
+    g_signal_emit (self, signals [CHANGED], 0, lo - 1, 1, 1);
+}
+
+
+/*
+ * Once the index is up to date, tell anyone keeping work per tune which
+ * tunes the edit from start_offset to end_offset landed in.
+ */
+static void
+gabc_tune_index_emit_tunes_edited (GabcTuneIndex *self,
+                                   gint           start_offset,
+                                   gint           end_offset)
+{
+  GtkTextIter start;
+  GtkTextIter end;
+
+  gabc_tune_index_get_bounds_at_offset (self, start_offset, &start, NULL);
+  gabc_tune_index_get_bounds_at_offset (self, end_offset, NULL, &end);
+
+  g_signal_emit (self, signals [TUNES_EDITED], 0, &start, &end);
+}
+
+
+static void
+gabc_tune_index_insert_text_after (GtkTextBuffer *buffer,
+                                   GtkTextIter   *location,
+                                   gchar         *text,
+                                   gint           len,
+                                   GabcTuneIndex *self)
+{
+  gint start_offset;
+  gint end_offset;
+
+  /* The default handler has moved location to the end of the new text. */
+  end_offset = gtk_text_iter_get_offset (location);
+  start_offset = end_offset - (gint) g_utf8_strlen (text, len);
+
+  gabc_tune_index_update_range (self, start_offset, end_offset);
+  gabc_tune_index_emit_tunes_edited (self, start_offset, end_offset);
+}
+
+
+static void
+gabc_tune_index_delete_range_after (GtkTextBuffer *buffer,
+                                    GtkTextIter   *start,
+                                    GtkTextIter   *end,
+                                    GabcTuneIndex *self)
+{
+  gint offset = gtk_text_iter_get_offset (start);
+
+  gabc_tune_index_update_range (self, offset, offset);
+  gabc_tune_index_emit_tunes_edited (self, offset, offset);
+}
+
+
+static void
+gabc_tune_index_dispose (GObject *object)
+{
+  GabcTuneIndex *self = GABC_TUNE_INDEX (object);
+  guint i;
+
+  for (i = 0; i < self->tunes->len; i++)
+    gabc_tune_index_free_tune (self, g_ptr_array_index (self->tunes, i));
+  g_ptr_array_set_size (self->tunes, 0);
+
+  if (self->buffer != NULL)
+    {
+      g_clear_signal_handler (&self->insert_text_id, self->buffer);
+      g_clear_signal_handler (&self->delete_range_id, self->buffer);
+
+      g_object_remove_weak_pointer (G_OBJECT (self->buffer), (gpointer *) &self->buffer);
+      self->buffer = NULL;
+    }
+
+  G_OBJECT_CLASS (gabc_tune_index_parent_class)->dispose (object);
+}
+
+
+static void
+gabc_tune_index_finalize (GObject *object)
+{
+  GabcTuneIndex *self = GABC_TUNE_INDEX (object);
+
+  g_ptr_array_unref (self->tunes);
+  g_hash_table_unref (self->numbers);
+
+  G_OBJECT_CLASS (gabc_tune_index_parent_class)->finalize (object);
+}
+
+
+static void
+gabc_tune_index_class_init (GabcTuneIndexClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = gabc_tune_index_dispose;
+  object_class->finalize = gabc_tune_index_finalize;
+
+  /*
+   * Emitted after the index changes, with the same meaning as
+   * GListModel::items-changed: at position, removed tunes were replaced
+   * by added tunes.
+   */
+  signals [CHANGED] =
+    g_signal_new ("changed",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE,
+                  3,
+                  G_TYPE_UINT,
+                  G_TYPE_UINT,
+                  G_TYPE_UINT);
+
+  /*
+   * Emitted after each edit the index follows, with the span of whole
+   * tunes the edit landed in; text before the first X: counts as a tune of
+   * its own.  Edits made while frozen are covered by one emission for the
+   * whole buffer on the last thaw.
+   */
+  signals [TUNES_EDITED] =
+    g_signal_new ("tunes-edited",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE,
+                  2,
+                  GTK_TYPE_TEXT_ITER | G_SIGNAL_TYPE_STATIC_SCOPE,
+                  GTK_TYPE_TEXT_ITER | G_SIGNAL_TYPE_STATIC_SCOPE);
+}
+
+
+static void
+gabc_tune_index_init (GabcTuneIndex *self)
+{
+  self->tunes = g_ptr_array_new ();
+  self->numbers = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                         NULL, (GDestroyNotify) g_slist_free);
+}
+
+
+/*
+ * The index does not hold a reference on the buffer; it is expected to be
+ * owned by (and disposed with) the buffer it indexes.
+ */
+GabcTuneIndex *
+gabc_tune_index_new (GtkTextBuffer *buffer)
+{
+  GabcTuneIndex *self;
+  GtkTextIter start;
+  GtkTextIter end;
+
+  g_return_val_if_fail (GTK_IS_TEXT_BUFFER (buffer), NULL);
+
+  self = g_object_new (GABC_TYPE_TUNE_INDEX, NULL);
+  self->buffer = buffer;
+  g_object_add_weak_pointer (G_OBJECT (buffer), (gpointer *) &self->buffer);
+
+  self->insert_text_id = g_signal_connect_after (buffer, "insert-text",
+                                                 G_CALLBACK (gabc_tune_index_insert_text_after),
+                                                 self);
+  self->delete_range_id = g_signal_connect_after (buffer, "delete-range",
+                                                  G_CALLBACK (gabc_tune_index_delete_range_after),
+                                                  self);
+
+  gtk_text_buffer_get_bounds (buffer, &start, &end);
+  gabc_tune_index_update_range (self,
+                                gtk_text_iter_get_offset (&start),
+                                gtk_text_iter_get_offset (&end));
+
+  return self;
+}
+
+
+/*
+ * Stop following edits, for bulk loads where updating the index insert by
+ * insert would cost more than building it once at the end.  Lookups see a
+ * stale index until the matching gabc_tune_index_thaw ().
+ */
+void
+gabc_tune_index_freeze (GabcTuneIndex *self)
+{
+  if (self->freeze_count++ == 0 && self->buffer != NULL)
+    {
+      g_signal_handler_block (self->buffer, self->insert_text_id);
+      g_signal_handler_block (self->buffer, self->delete_range_id);
+    }
+}
+
+
+/*
+ * Start following edits again, rebuilding the whole index.
+ */
+void
+gabc_tune_index_thaw (GabcTuneIndex *self)
+{
+  GtkTextIter start;
+  GtkTextIter end;
+
+  g_return_if_fail (self->freeze_count > 0);
+
+  if (--self->freeze_count > 0 || self->buffer == NULL)
+    return;
+
+  g_signal_handler_unblock (self->buffer, self->insert_text_id);
+  g_signal_handler_unblock (self->buffer, self->delete_range_id);
+
+  gtk_text_buffer_get_bounds (self->buffer, &start, &end);
+  gabc_tune_index_update_range (self,
+                                gtk_text_iter_get_offset (&start),
+                                gtk_text_iter_get_offset (&end));
+
+  gtk_text_buffer_get_bounds (self->buffer, &start, &end);
+  g_signal_emit (self, signals [TUNES_EDITED], 0, &start, &end);
+}
+
+
+guint
+gabc_tune_index_get_n_tunes (GabcTuneIndex *self)
+{
+  return self->tunes->len;
+}
+
+
+const GabcTuneInfo *
+gabc_tune_index_get_tune (GabcTuneIndex *self, guint position)
+{
+  g_return_val_if_fail (position < self->tunes->len, NULL);
+
+  return g_ptr_array_index (self->tunes, position);
+}
+
+
+/*
+ * Find the tune containing offset.  Returns FALSE if offset is before the
+ * first X: (in the file header) or the book has no tunes.
+ */
+gboolean
+gabc_tune_index_lookup_offset (GabcTuneIndex *self,
+                               gint           offset,
+                               guint         *position)
+{
+  guint next;
+
+  next = gabc_tune_index_lower_bound (self, offset + 1);
+  if (next == 0)
+    return FALSE;
+
+  if (position != NULL)
+    *position = next - 1;
+  return TRUE;
+}
+
+
+/*
+ * Find the first tune (in buffer order) with X: number.
+ */
+gboolean
+gabc_tune_index_lookup_number (GabcTuneIndex *self,
+                               guint          number,
+                               guint         *position)
+{
+  GSList *list;
+  GabcTuneInfo *first = NULL;
+  gint first_offset = G_MAXINT;
+  GtkTextIter iter;
+  guint pos;
+
+  list = g_hash_table_lookup (self->numbers, GUINT_TO_POINTER (number));
+  if (list == NULL)
+    return FALSE;
+
+  for (; list != NULL; list = list->next)
+    {
+      GabcTuneInfo *tune = list->data;
+
+      gtk_text_buffer_get_iter_at_mark (self->buffer, &iter, tune->start_mark);
+      if (gtk_text_iter_get_offset (&iter) < first_offset)
+        {
+          first = tune;
+          first_offset = gtk_text_iter_get_offset (&iter);
+        }
+    }
+
+  /* Marks can share an offset, so step over any neighbours at the same spot. */
+  for (pos = gabc_tune_index_lower_bound (self, first_offset);
+       pos < self->tunes->len && g_ptr_array_index (self->tunes, pos) != first;
+       pos++)
+    ;
+
+  if (position != NULL)
+    *position = pos;
+  return TRUE;
+}
+
+
+/*
+ * Either of start or end may be NULL.
+ */
+void
+gabc_tune_index_get_tune_bounds (GabcTuneIndex *self,
+                                 guint          position,
+                                 GtkTextIter   *start,
+                                 GtkTextIter   *end)
+{
+  const GabcTuneInfo *tune;
+
+  g_return_if_fail (position < self->tunes->len);
+
+  if (start != NULL)
+    {
+      tune = g_ptr_array_index (self->tunes, position);
+      gtk_text_buffer_get_iter_at_mark (self->buffer, start, tune->start_mark);
+    }
+
+  if (end == NULL)
+    return;
+
+  if (position + 1 < self->tunes->len)
+    {
+      tune = g_ptr_array_index (self->tunes, position + 1);
+      gtk_text_buffer_get_iter_at_mark (self->buffer, end, tune->start_mark);
+    }
+  else
+    {
+      gtk_text_buffer_get_end_iter (self->buffer, end);
+    }
+}
+
+
+/*
+ * Bounds of the tune containing offset or, before the first X:, of the
+ * file header.  Either of start or end may be NULL.
+ */
+void
+gabc_tune_index_get_bounds_at_offset (GabcTuneIndex *self,
+                                      gint           offset,
+                                      GtkTextIter   *start,
+                                      GtkTextIter   *end)
+{
+  guint position;
+
+  if (gabc_tune_index_lookup_offset (self, offset, &position))
+    {
+      gabc_tune_index_get_tune_bounds (self, position, start, end);
+      return;
+    }
+
+  if (start != NULL)
+    gtk_text_buffer_get_start_iter (self->buffer, start);
+
+  if (end == NULL)
+    return;
+
+  if (self->tunes->len > 0)
+    gabc_tune_index_get_tune_bounds (self, 0, end, NULL);
+  else
+    gtk_text_buffer_get_end_iter (self->buffer, end);
+}
+
+
+/*
+ * The tune at position parsed, which is only done again after an edit
+ * touches it.  The result belongs to the index and lasts until the next
+ * edit.
+ */
+const GabcAbcTune *
+gabc_tune_index_get_parsed_tune (GabcTuneIndex *self,
+                                 guint          position)
+{
+  GabcTuneInfo *tune;
+
+  g_return_val_if_fail (position < self->tunes->len, NULL);
+
+  tune = g_ptr_array_index (self->tunes, position);
+  if (tune->parsed == NULL)
+    {
+      g_autofree gchar *text = NULL;
+      GtkTextIter start;
+      GtkTextIter end;
+
+      gabc_tune_index_get_tune_bounds (self, position, &start, &end);
+      text = gtk_text_buffer_get_text (self->buffer, &start, &end, TRUE);
+      tune->parsed = gabc_abc_tune_parse (text, strlen (text));
+    }
+
+  return tune->parsed;
+}
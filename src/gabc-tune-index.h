@@ -0,0 +1,81 @@
+/* gabc-tune-index.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <gtk/gtk.h>
+
+#include "gabc-abc-parser.h"
+
+G_BEGIN_DECLS
+
+/*
+ * One X: record in the buffer.  The tune runs from start_mark up to the
+ * start of the next tune (or the end of the buffer).  The strings are the
+ * first occurrence of each field in the tune header and may be NULL.
+ * parsed is filled in by gabc_tune_index_get_parsed_tune () and dropped
+ * whenever an edit touches the tune.
+ */
+typedef struct {
+  GtkTextMark  *start_mark;
+  guint         number;
+  gchar        *title;
+  gchar        *key;
+  gchar        *meter;
+  gchar        *rhythm;
+  GabcAbcTune  *parsed;
+} GabcTuneInfo;
+
+#define GABC_TYPE_TUNE_INDEX (gabc_tune_index_get_type())
+
+G_DECLARE_FINAL_TYPE (GabcTuneIndex, gabc_tune_index, GABC, TUNE_INDEX, GObject)
+
+GabcTuneIndex            *gabc_tune_index_new                     (GtkTextBuffer *buffer);
+
+void                      gabc_tune_index_freeze                  (GabcTuneIndex *self);
+
+void                      gabc_tune_index_thaw                    (GabcTuneIndex *self);
+
+guint                     gabc_tune_index_get_n_tunes             (GabcTuneIndex *self);
+
+const GabcTuneInfo *      gabc_tune_index_get_tune                (GabcTuneIndex *self,
+                                                                   guint          position);
+
+gboolean                  gabc_tune_index_lookup_offset           (GabcTuneIndex *self,
+                                                                   gint           offset,
+                                                                   guint         *position);
+
+gboolean                  gabc_tune_index_lookup_number           (GabcTuneIndex *self,
+                                                                   guint          number,
+                                                                   guint         *position);
+
+void                      gabc_tune_index_get_tune_bounds         (GabcTuneIndex *self,
+                                                                   guint          position,
+                                                                   GtkTextIter   *start,
+                                                                   GtkTextIter   *end);
+
+void                      gabc_tune_index_get_bounds_at_offset    (GabcTuneIndex *self,
+                                                                   gint           offset,
+                                                                   GtkTextIter   *start,
+                                                                   GtkTextIter   *end);
+
+const GabcAbcTune *       gabc_tune_index_get_parsed_tune         (GabcTuneIndex *self,
+                                                                   guint          position);
+
+G_END_DECLS
@@ -0,0 +1,129 @@
+/* gabc-tune-item.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * One tune in the outline: what its header said when the item was made,
+ * and the mark at its X: line.  Items are immutable; when a header changes
+ * the outline replaces the item.
+ */
+
+#include "gabc-tune-item.h"
+
+struct _GabcTuneItem
+{
+  GObject                       parent_instance;
+
+  GtkTextMark                  *start_mark;
+  guint                         number;
+  gchar                        *title;
+  gchar                        *key;
+  gchar                        *rhythm;
+};
+
+G_DEFINE_FINAL_TYPE (GabcTuneItem, gabc_tune_item, G_TYPE_OBJECT)
+
+
+static void
+gabc_tune_item_finalize (GObject *object)
+{
+  GabcTuneItem *self = GABC_TUNE_ITEM (object);
+
+  g_clear_object (&self->start_mark);
+  g_free (self->title);
+  g_free (self->key);
+  g_free (self->rhythm);
+
+  G_OBJECT_CLASS (gabc_tune_item_parent_class)->finalize (object);
+}
+
+
+static void
+gabc_tune_item_class_init (GabcTuneItemClass *klass)
+{
+  G_OBJECT_CLASS (klass)->finalize = gabc_tune_item_finalize;
+}
+
+
+static void
+gabc_tune_item_init (GabcTuneItem *self)
+{
+}
+
+
+/*
+ * Missing fields may be NULL; they are returned as empty strings.
+ */
+GabcTuneItem *
+gabc_tune_item_new (GtkTextMark *start_mark,
+                    guint        number,
+                    const gchar *title,
+                    const gchar *key,
+                    const gchar *rhythm)
+{
+  GabcTuneItem *self;
+
+  self = g_object_new (GABC_TYPE_TUNE_ITEM, NULL);
+  self->start_mark = g_object_ref (start_mark);
+  self->number = number;
+  self->title = g_strdup (title != NULL ? title : "");
+  self->key = g_strdup (key != NULL ? key : "");
+  self->rhythm = g_strdup (rhythm != NULL ? rhythm : "");
+
+  return self;
+}
+
+
+/*
+ * The mark is deleted from the buffer if the tune has gone since the item
+ * was made; check gtk_text_mark_get_deleted () before using it.
+ */
+GtkTextMark *
+gabc_tune_item_get_start_mark (GabcTuneItem *self)
+{
+  return self->start_mark;
+}
+
+
+guint
+gabc_tune_item_get_number (GabcTuneItem *self)
+{
+  return self->number;
+}
+
+
+const gchar *
+gabc_tune_item_get_title (GabcTuneItem *self)
+{
+  return self->title;
+}
+
+
+const gchar *
+gabc_tune_item_get_key (GabcTuneItem *self)
+{
+  return self->key;
+}
+
+
+const gchar *
+gabc_tune_item_get_rhythm (GabcTuneItem *self)
+{
+  return self->rhythm;
+}
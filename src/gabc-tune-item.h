@@ -0,0 +1,46 @@
+/* gabc-tune-item.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define GABC_TYPE_TUNE_ITEM (gabc_tune_item_get_type())
+
+G_DECLARE_FINAL_TYPE (GabcTuneItem, gabc_tune_item, GABC, TUNE_ITEM, GObject)
+
+GabcTuneItem             *gabc_tune_item_new                      (GtkTextMark  *start_mark,
+                                                                   guint         number,
+                                                                   const gchar  *title,
+                                                                   const gchar  *key,
+                                                                   const gchar  *rhythm);
+
+GtkTextMark *             gabc_tune_item_get_start_mark           (GabcTuneItem *self);
+
+guint                     gabc_tune_item_get_number               (GabcTuneItem *self);
+
+const gchar *             gabc_tune_item_get_title                (GabcTuneItem *self);
+
+const gchar *             gabc_tune_item_get_key                  (GabcTuneItem *self);
+
+const gchar *             gabc_tune_item_get_rhythm               (GabcTuneItem *self);
+
+G_END_DECLS
@@ -0,0 +1,604 @@
+/* gabc-tune-outline.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * The tunes in a tunebook, as a GListModel of GabcTuneItems for the
+ * outline sidebar.
+ *
+ * The model follows the GabcTuneIndex "changed" signal, which already has
+ * the meaning of GListModel::items-changed, so an edit only touches the
+ * rows of the tunes it changed.  Items are made when a row is first asked
+ * for and kept until their tune changes; a list view only ever asks for
+ * the rows on screen.
+ *
+ * With a filter or a sort order other than the book's, rows are mapped to
+ * tunes through an array of positions.  It is worked out in a thread from
+ * a copy of the tune headers so big books don't stall typing in the search
+ * entry.  Edits patch the mapping straight away (new tunes go at the end)
+ * and queue a refresh that puts everything in place shortly after.
+ */
+
+#include <string.h>
+
+#include "gabc-tune-outline.h"
+
+/* Changes bigger than this replace the mapping rather than patch it. */
+#define GABC_TUNE_OUTLINE_MAX_PATCH 256
+
+#define GABC_TUNE_OUTLINE_REFRESH_DELAY 250
+
+struct _GabcTuneOutline
+{
+  GObject                       parent_instance;
+
+  GabcTuneIndex                *tune_index;
+  gulong                        changed_id;
+
+  GPtrArray                    *items;        /* GabcTuneItem or NULL, one per tune */
+  GArray                       *positions;    /* tune of each row, NULL for book order */
+
+  gchar                        *filter;
+  GabcTuneOutlineSort           sort;
+
+  GCancellable                 *cancellable;
+  guint                         generation;
+  guint                         refresh_source_id;
+};
+
+static void gabc_tune_outline_list_model_init (GListModelInterface *iface);
+
+G_DEFINE_FINAL_TYPE_WITH_CODE (GabcTuneOutline, gabc_tune_outline, G_TYPE_OBJECT,
+                               G_IMPLEMENT_INTERFACE (G_TYPE_LIST_MODEL, gabc_tune_outline_list_model_init))
+
+typedef struct {
+  guint    position;
+  guint    number;
+  gchar   *title;
+  gchar   *key;
+  gchar   *rhythm;
+  gchar   *sort_key;
+} outline_row_t;
+
+typedef struct {
+  GArray               *rows;
+  gchar                *filter;
+  GabcTuneOutlineSort   sort;
+  guint                 generation;
+} outline_refresh_data_t;
+
+
+static void
+outline_row_clear (outline_row_t *row)
+{
+  g_free (row->title);
+  g_free (row->key);
+  g_free (row->rhythm);
+  g_free (row->sort_key);
+}
+
+
+static void
+outline_refresh_data_free (outline_refresh_data_t *data)
+{
+  g_array_unref (data->rows);
+  g_free (data->filter);
+  g_free (data);
+}
+
+
+static void
+gabc_tune_outline_item_free (gpointer item)
+{
+  if (item != NULL)
+    g_object_unref (item);
+}
+
+
+/*
+ * LIST MODEL
+ */
+static GType
+gabc_tune_outline_get_item_type (GListModel *list)
+{
+  return GABC_TYPE_TUNE_ITEM;
+}
+
+
+static guint
+gabc_tune_outline_get_n_items (GListModel *list)
+{
+  GabcTuneOutline *self = GABC_TUNE_OUTLINE (list);
+
+  return self->positions != NULL ? self->positions->len : self->items->len;
+}
+
+
+static gpointer
+gabc_tune_outline_get_item (GListModel *list,
+                            guint       position)
+{
+  GabcTuneOutline *self = GABC_TUNE_OUTLINE (list);
+  GabcTuneItem *item;
+  const GabcTuneInfo *tune;
+
+  if (position >= gabc_tune_outline_get_n_items (list))
+    return NULL;
+
+  if (self->positions != NULL)
+    position = g_array_index (self->positions, guint, position);
+
+  item = g_ptr_array_index (self->items, position);
+  if (item == NULL)
+    {
+      tune = gabc_tune_index_get_tune (self->tune_index, position);
+      item = gabc_tune_item_new (tune->start_mark, tune->number, tune->title, tune->key, tune->rhythm);
+      self->items->pdata[position] = item;
+    }
+
+  return g_object_ref (item);
+}
+
+
+static void
+gabc_tune_outline_list_model_init (GListModelInterface *iface)
+{
+  iface->get_item_type = gabc_tune_outline_get_item_type;
+  iface->get_n_items = gabc_tune_outline_get_n_items;
+  iface->get_item = gabc_tune_outline_get_item;
+}
+
+
+/*
+ * REFRESHING
+ */
+
+/*
+ * Lower case and without accents, for matching filter words.
+ */
+static gchar *
+gabc_tune_outline_fold (const gchar *text)
+{
+  g_autofree gchar *normalised = g_utf8_normalize (text, -1, G_NORMALIZE_ALL);
+
+  return g_utf8_casefold (normalised != NULL ? normalised : "", -1);
+}
+
+
+static gint
+gabc_tune_outline_compare_rows (gconstpointer a,
+                                gconstpointer b,
+                                gpointer      user_data)
+{
+  GArray *rows = user_data;
+  const outline_row_t *row_a = &g_array_index (rows, outline_row_t, *(const guint *) a);
+  const outline_row_t *row_b = &g_array_index (rows, outline_row_t, *(const guint *) b);
+  gint result = 0;
+
+  if (row_a->sort_key != NULL && row_b->sort_key != NULL)
+    result = strcmp (row_a->sort_key, row_b->sort_key);
+  else if (row_a->number != row_b->number)
+    result = (row_a->number > row_b->number) - (row_a->number < row_b->number);
+
+  if (result == 0)
+    result = (row_a->position > row_b->position) - (row_a->position < row_b->position);
+
+  return result;
+}
+
+
+static void
+gabc_tune_outline_refresh_thread (GTask        *task,
+                                  gpointer      source_object,
+                                  gpointer      task_data,
+                                  GCancellable *cancellable)
+{
+  outline_refresh_data_t *data = task_data;
+  g_autoptr (GArray) positions = g_array_new (FALSE, FALSE, sizeof (guint));
+  g_autofree gchar *folded_filter = gabc_tune_outline_fold (data->filter);
+  g_auto (GStrv) words = g_strsplit (folded_filter, " ", -1);
+  guint i;
+  guint j;
+
+  for (i = 0; i < data->rows->len; i++)
+    {
+      outline_row_t *row = &g_array_index (data->rows, outline_row_t, i);
+      const gchar *sort_field = NULL;
+
+      if (i % 1024 == 0 && g_task_return_error_if_cancelled (task))
+        return;
+
+      if (words[0] != NULL)
+        {
+          g_autofree gchar *text = g_strdup_printf ("%u %s %s %s", row->number, row->title, row->key, row->rhythm);
+          g_autofree gchar *folded = gabc_tune_outline_fold (text);
+
+          for (j = 0; words[j] != NULL; j++)
+            if (words[j][0] != '\0' && strstr (folded, words[j]) == NULL)
+              break;
+          if (words[j] != NULL)
+            continue;
+        }
+
+      switch (data->sort)
+        {
+        case GABC_TUNE_OUTLINE_SORT_TITLE:
+          sort_field = row->title;
+          break;
+        case GABC_TUNE_OUTLINE_SORT_KEY:
+          sort_field = row->key;
+          break;
+        case GABC_TUNE_OUTLINE_SORT_RHYTHM:
+          sort_field = row->rhythm;
+          break;
+        case GABC_TUNE_OUTLINE_SORT_BOOK:
+        case GABC_TUNE_OUTLINE_SORT_NUMBER:
+        default:
+          break;
+        }
+
+      if (sort_field != NULL)
+        {
+          g_autofree gchar *folded = gabc_tune_outline_fold (sort_field);
+
+          row->sort_key = g_utf8_collate_key (folded, -1);
+        }
+
+      g_array_append_val (positions, i);
+    }
+
+  if (data->sort != GABC_TUNE_OUTLINE_SORT_BOOK)
+    g_array_sort_with_data (positions, gabc_tune_outline_compare_rows, data->rows);
+
+  for (i = 0; i < positions->len; i++)
+    g_array_index (positions, guint, i) = g_array_index (data->rows, outline_row_t, g_array_index (positions, guint, i)).position;
+
+  g_task_return_pointer (task, g_steal_pointer (&positions), (GDestroyNotify) g_array_unref);
+}
+
+
+static void
+gabc_tune_outline_set_positions (GabcTuneOutline *self,
+                                 GArray          *positions)
+{
+  guint old_n_items = gabc_tune_outline_get_n_items (G_LIST_MODEL (self));
+
+  g_clear_pointer (&self->positions, g_array_unref);
+  self->positions = positions;
+
+  g_list_model_items_changed (G_LIST_MODEL (self), 0, old_n_items,
+                              gabc_tune_outline_get_n_items (G_LIST_MODEL (self)));
+}
+
+
+static void
+gabc_tune_outline_refresh_cb (GObject      *source_object,
+                              GAsyncResult *result,
+                              gpointer      user_data)
+{
+  GabcTuneOutline *self = GABC_TUNE_OUTLINE (source_object);
+  outline_refresh_data_t *data = g_task_get_task_data (G_TASK (result));
+  GArray *positions;
+
+  positions = g_task_propagate_pointer (G_TASK (result), NULL);
+  if (positions == NULL)
+    return;
+
+  /* The book changed while the thread was working. */
+  if (data->generation != self->generation)
+    {
+      g_array_unref (positions);
+      return;
+    }
+
+  gabc_tune_outline_set_positions (self, positions);
+}
+
+
+static gboolean
+gabc_tune_outline_is_book_order (GabcTuneOutline *self)
+{
+  return (self->filter == NULL || self->filter[0] == '\0') && self->sort == GABC_TUNE_OUTLINE_SORT_BOOK;
+}
+
+
+static void
+gabc_tune_outline_refresh (GabcTuneOutline *self)
+{
+  g_autoptr (GTask) task = NULL;
+  outline_refresh_data_t *data;
+  guint n_tunes;
+  guint i;
+
+  g_clear_handle_id (&self->refresh_source_id, g_source_remove);
+  self->generation++;
+
+  g_cancellable_cancel (self->cancellable);
+  g_clear_object (&self->cancellable);
+
+  if (gabc_tune_outline_is_book_order (self))
+    {
+      if (self->positions != NULL)
+        gabc_tune_outline_set_positions (self, NULL);
+      return;
+    }
+
+  n_tunes = gabc_tune_index_get_n_tunes (self->tune_index);
+
+  data = g_new0 (outline_refresh_data_t, 1);
+  data->rows = g_array_sized_new (FALSE, TRUE, sizeof (outline_row_t), n_tunes);
+  g_array_set_clear_func (data->rows, (GDestroyNotify) outline_row_clear);
+  data->filter = g_strdup (self->filter != NULL ? self->filter : "");
+  data->sort = self->sort;
+  data->generation = self->generation;
+
+  for (i = 0; i < n_tunes; i++)
+    {
+      const GabcTuneInfo *tune = gabc_tune_index_get_tune (self->tune_index, i);
+      outline_row_t row;
+
+      row.position = i;
+      row.number = tune->number;
+      row.title = g_strdup (tune->title != NULL ? tune->title : "");
+      row.key = g_strdup (tune->key != NULL ? tune->key : "");
+      row.rhythm = g_strdup (tune->rhythm != NULL ? tune->rhythm : "");
+      row.sort_key = NULL;
+      g_array_append_val (data->rows, row);
+    }
+
+  self->cancellable = g_cancellable_new ();
+
+  task = g_task_new (self, self->cancellable, gabc_tune_outline_refresh_cb, NULL);
+  g_task_set_source_tag (task, gabc_tune_outline_refresh);
+  g_task_set_task_data (task, data, (GDestroyNotify) outline_refresh_data_free);
+  g_task_run_in_thread (task, gabc_tune_outline_refresh_thread);
+}
+
+
+static gboolean
+gabc_tune_outline_refresh_timeout_cb (gpointer user_data)
+{
+  GabcTuneOutline *self = GABC_TUNE_OUTLINE (user_data);
+
+  self->refresh_source_id = 0;
+  gabc_tune_outline_refresh (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+/*
+ * FOLLOWING THE INDEX
+ */
+
+/*
+ * Make room for added tunes' items at position, in place of removed ones.
+ */
+static void
+gabc_tune_outline_splice_items (GabcTuneOutline *self,
+                                guint            position,
+                                guint            removed,
+                                guint            added)
+{
+  guint old_len;
+
+  g_ptr_array_remove_range (self->items, position, removed);
+
+  old_len = self->items->len;
+  g_ptr_array_set_size (self->items, old_len + added);
+  memmove (&self->items->pdata[position + added],
+           &self->items->pdata[position],
+           (old_len - position) * sizeof (gpointer));
+  memset (&self->items->pdata[position], 0, added * sizeof (gpointer));
+}
+
+
+/*
+ * Patch the mapping for a change in the index: rows of removed tunes go,
+ * rows after them are renumbered and added tunes are appended.
+ */
+static void
+gabc_tune_outline_patch_positions (GabcTuneOutline *self,
+                                   guint            position,
+                                   guint            removed,
+                                   guint            added)
+{
+  guint old_n_items = self->positions->len;
+  guint first = G_MAXUINT;
+  guint n = 0;
+  guint i;
+
+  for (i = 0; i < old_n_items; i++)
+    {
+      guint tune = g_array_index (self->positions, guint, i);
+
+      if (tune >= position + removed)
+        {
+          tune = tune - removed + added;
+        }
+      else if (tune >= position)
+        {
+          /* Replaced tunes keep their row, the rest go. */
+          first = MIN (first, i);
+          if (tune - position >= added)
+            continue;
+        }
+
+      g_array_index (self->positions, guint, n++) = tune;
+    }
+  g_array_set_size (self->positions, n);
+
+  for (i = removed; i < added; i++)
+    {
+      guint tune = position + i;
+
+      g_array_append_val (self->positions, tune);
+    }
+
+  if (first == G_MAXUINT && self->positions->len == old_n_items)
+    return;
+
+  first = MIN (first, n);
+  g_list_model_items_changed (G_LIST_MODEL (self), first,
+                              old_n_items - first, self->positions->len - first);
+}
+
+
+static void
+gabc_tune_outline_index_changed_cb (GabcTuneIndex   *tune_index,
+                                    guint            position,
+                                    guint            removed,
+                                    guint            added,
+                                    GabcTuneOutline *self)
+{
+  guint i;
+
+  gabc_tune_outline_splice_items (self, position, removed, added);
+
+  /* Whatever the thread is working on is out of date now. */
+  self->generation++;
+
+  if (self->positions == NULL)
+    g_list_model_items_changed (G_LIST_MODEL (self), position, removed, added);
+  else if (removed + added > GABC_TUNE_OUTLINE_MAX_PATCH)
+    {
+      GArray *positions = g_array_sized_new (FALSE, FALSE, sizeof (guint), self->items->len);
+
+      for (i = 0; i < self->items->len; i++)
+        g_array_append_val (positions, i);
+      gabc_tune_outline_set_positions (self, positions);
+    }
+  else
+    {
+      gabc_tune_outline_patch_positions (self, position, removed, added);
+    }
+
+  if (gabc_tune_outline_is_book_order (self))
+    return;
+
+  g_clear_handle_id (&self->refresh_source_id, g_source_remove);
+  self->refresh_source_id = g_timeout_add (GABC_TUNE_OUTLINE_REFRESH_DELAY,
+                                           gabc_tune_outline_refresh_timeout_cb,
+                                           self);
+}
+
+
+/*
+ * SETUP
+ */
+static void
+gabc_tune_outline_dispose (GObject *object)
+{
+  GabcTuneOutline *self = GABC_TUNE_OUTLINE (object);
+
+  g_cancellable_cancel (self->cancellable);
+  g_clear_object (&self->cancellable);
+  g_clear_handle_id (&self->refresh_source_id, g_source_remove);
+
+  if (self->tune_index != NULL)
+    {
+      g_clear_signal_handler (&self->changed_id, self->tune_index);
+      g_clear_object (&self->tune_index);
+    }
+
+  G_OBJECT_CLASS (gabc_tune_outline_parent_class)->dispose (object);
+}
+
+
+static void
+gabc_tune_outline_finalize (GObject *object)
+{
+  GabcTuneOutline *self = GABC_TUNE_OUTLINE (object);
+
+  g_ptr_array_unref (self->items);
+  g_clear_pointer (&self->positions, g_array_unref);
+  g_free (self->filter);
+
+  G_OBJECT_CLASS (gabc_tune_outline_parent_class)->finalize (object);
+}
+
+
+static void
+gabc_tune_outline_class_init (GabcTuneOutlineClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = gabc_tune_outline_dispose;
+  object_class->finalize = gabc_tune_outline_finalize;
+}
+
+
+static void
+gabc_tune_outline_init (GabcTuneOutline *self)
+{
+  self->items = g_ptr_array_new_with_free_func (gabc_tune_outline_item_free);
+  self->sort = GABC_TUNE_OUTLINE_SORT_BOOK;
+}
+
+
+GabcTuneOutline *
+gabc_tune_outline_new (GabcTuneIndex *tune_index)
+{
+  GabcTuneOutline *self;
+
+  g_return_val_if_fail (GABC_IS_TUNE_INDEX (tune_index), NULL);
+
+  self = g_object_new (GABC_TYPE_TUNE_OUTLINE, NULL);
+  self->tune_index = g_object_ref (tune_index);
+  g_ptr_array_set_size (self->items, gabc_tune_index_get_n_tunes (tune_index));
+  self->changed_id = g_signal_connect (tune_index, "changed",
+                                       G_CALLBACK (gabc_tune_outline_index_changed_cb), self);
+
+  return self;
+}
+
+
+/*
+ * Only show tunes with every word of filter somewhere in their X: number,
+ * title, key or rhythm.  An empty filter shows every tune.
+ */
+void
+gabc_tune_outline_set_filter (GabcTuneOutline *self,
+                              const gchar     *filter)
+{
+  g_return_if_fail (GABC_IS_TUNE_OUTLINE (self));
+
+  if (g_strcmp0 (self->filter, filter) == 0)
+    return;
+
+  g_free (self->filter);
+  self->filter = g_strdup (filter);
+
+  gabc_tune_outline_refresh (self);
+}
+
+
+void
+gabc_tune_outline_set_sort (GabcTuneOutline     *self,
+                            GabcTuneOutlineSort  sort)
+{
+  g_return_if_fail (GABC_IS_TUNE_OUTLINE (self));
+
+  if (self->sort == sort)
+    return;
+
+  self->sort = sort;
+
+  gabc_tune_outline_refresh (self);
+}
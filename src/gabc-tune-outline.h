@@ -0,0 +1,49 @@
+/* gabc-tune-outline.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <gio/gio.h>
+
+#include "gabc-tune-index.h"
+#include "gabc-tune-item.h"
+
+G_BEGIN_DECLS
+
+typedef enum {
+  GABC_TUNE_OUTLINE_SORT_BOOK,
+  GABC_TUNE_OUTLINE_SORT_NUMBER,
+  GABC_TUNE_OUTLINE_SORT_TITLE,
+  GABC_TUNE_OUTLINE_SORT_KEY,
+  GABC_TUNE_OUTLINE_SORT_RHYTHM,
+} GabcTuneOutlineSort;
+
+#define GABC_TYPE_TUNE_OUTLINE (gabc_tune_outline_get_type())
+
+G_DECLARE_FINAL_TYPE (GabcTuneOutline, gabc_tune_outline, GABC, TUNE_OUTLINE, GObject)
+
+GabcTuneOutline          *gabc_tune_outline_new                   (GabcTuneIndex       *tune_index);
+
+void                      gabc_tune_outline_set_filter            (GabcTuneOutline     *self,
+                                                                   const gchar         *filter);
+
+void                      gabc_tune_outline_set_sort              (GabcTuneOutline     *self,
+                                                                   GabcTuneOutlineSort  sort);
+
+G_END_DECLS
@@ -18,7 +18,11 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
+#include <string.h>
+
 #include "gabc-window.h"
+#include "gabc-render-stats.h"
+#include "gabc-transpose.h"
 #include "gabc-tunebook.h"
 
 // Define the structure here
@@ -28,13 +32,46 @@ struct _GabcTunebook
   GtkSourceBuffer               parent_instance;
   GtkSourceFile                *abc_source_file;
   gboolean                      is_modified;
+
+  GSettings                    *settings;
+  GabcTuneIndex                *tune_index;
+  GabcHighlighter              *highlighter;
+  GabcValidator                *validator;
+  GabcPreprocessor             *preprocessor;
+
+  gchar                        *scratch_checksum;
+  GabcLineMap                  *scratch_line_map;
+
+  GMappedFile                  *load_mapped_file;
+  gsize                         load_offset;
+  gsize                         load_length;
+  guint                         load_source_id;
+
+  GPtrArray                    *append_files;
+  guint                         append_position;
+  gsize                         append_offset;
+  GHashTable                   *append_numbers;
+  guint                         append_next_number;
+  GCancellable                 *append_cancellable;
+  guint                         append_source_id;
 };
 
 
 
 G_DEFINE_TYPE (GabcTunebook, gabc_tunebook, GTK_SOURCE_TYPE_BUFFER)
 
-static gchar * gabc_tunebook_set_midi_program (gchar * file_content, gint midi_program);
+enum {
+  LOADED,
+  LOAD_PROGRESS,
+  N_SIGNALS
+};
+
+static guint signals [N_SIGNALS];
+
+static void gabc_tunebook_cancel_load (GabcTunebook *self);
+static void gabc_tunebook_update_highlighting (GabcTunebook *self);
+static gboolean gabc_tunebook_cancel_append (GabcTunebook *self);
+
 
 GabcTunebook*
 gabc_tunebook_new (void)
@@ -47,12 +84,62 @@ gabc_tunebook_new (void)
 
 }
 
+static void
+gabc_tunebook_dispose (GObject *object)
+{
+  GabcTunebook *self = GABC_TUNEBOOK (object);
+
+  gabc_tunebook_cancel_load (self);
+  gabc_tunebook_cancel_append (self);
+  g_clear_object (&self->highlighter);
+  g_clear_object (&self->validator);
+  g_clear_object (&self->tune_index);
+  g_clear_object (&self->settings);
+  g_clear_object (&self->preprocessor);
+  g_clear_object (&self->abc_source_file);
+  g_clear_pointer (&self->scratch_checksum, g_free);
+  g_clear_object (&self->scratch_line_map);
+
+  G_OBJECT_CLASS (gabc_tunebook_parent_class)->dispose (object);
+}
+
+
 static void
 gabc_tunebook_class_init (GabcTunebookClass *klass)
 {
-  g_print ("In the class init\n");
-  //GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
   //GtkTextBufferClass *buffer_class = GTK_TEXT_BUFFER_CLASS (klass);
+
+  object_class->dispose = gabc_tunebook_dispose;
+
+  /*
+   * Emitted once the text from gabc_tunebook_open_file () or
+   * gabc_tunebook_append_files () is in the buffer.
+   */
+  signals [LOADED] =
+    g_signal_new ("loaded",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE,
+                  0);
+
+  /*
+   * Emitted as a large file, or a set of appended files, is read into the
+   * buffer in the background, with the fraction loaded so far.
+   */
+  signals [LOAD_PROGRESS] =
+    g_signal_new ("load-progress",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE,
+                  1,
+                  G_TYPE_DOUBLE);
 }
 
 
@@ -67,6 +154,32 @@ gabc_tunebook_init (GabcTunebook *self)
 
   self->abc_source_file = gtk_source_file_new ();
 
+  /* Kept up to date from the buffer's insert-text/delete-range signals. */
+  self->tune_index = gabc_tune_index_new (GTK_TEXT_BUFFER (self));
+
+  /* Rules are recompiled only when the settings they come from change. */
+  self->settings = g_settings_new ("me.pm.m0dns.gabc");
+  self->preprocessor = gabc_preprocessor_new (self->settings);
+
+  self->highlighter = gabc_highlighter_new (GTK_SOURCE_BUFFER (self), self->tune_index);
+  g_signal_connect_object (self->settings, "changed::native-highlighting",
+                           G_CALLBACK (gabc_tunebook_update_highlighting), self,
+                           G_CONNECT_SWAPPED);
+
+  /* Shared with the validator, so created first. */
+  gtk_text_buffer_create_tag (GTK_TEXT_BUFFER (self), GABC_DIAGNOSTIC_TAG_ERROR,
+                              "underline", PANGO_UNDERLINE_ERROR,
+                              NULL);
+  gtk_text_buffer_create_tag (GTK_TEXT_BUFFER (self), GABC_DIAGNOSTIC_TAG_WARNING,
+                              "underline", PANGO_UNDERLINE_ERROR,
+                              "underline-rgba", &(GdkRGBA) { 0.9, 0.6, 0.0, 1.0 },
+                              NULL);
+
+  self->validator = gabc_validator_new (GTK_SOURCE_BUFFER (self), self->tune_index);
+  g_signal_connect_object (self->settings, "changed::validate-while-typing",
+                           G_CALLBACK (gabc_tunebook_update_highlighting), self,
+                           G_CONNECT_SWAPPED);
+
   lm = gtk_source_language_manager_get_default ();
 
   language = gtk_source_language_manager_get_language (lm, id);
@@ -80,6 +193,267 @@ gabc_tunebook_init (GabcTunebook *self)
     // TODO move this to the tunebook class.
     gtk_source_buffer_set_language ((GtkSourceBuffer *) self, language);
   }
+
+  gabc_tunebook_update_highlighting (self);
+}
+
+
+/*
+ * Highlighting comes from GabcHighlighter unless the native-highlighting
+ * setting is off, in which case GtkSourceView highlights with abc.lang.
+ * Neither runs while a file is being loaded in the background, and nor
+ * does the validator, which checks the whole book once loading finishes.
+ */
+static void
+gabc_tunebook_update_highlighting (GabcTunebook *self)
+{
+  gboolean loading = (self->load_mapped_file != NULL);
+  gboolean native = g_settings_get_boolean (self->settings, "native-highlighting");
+  gboolean validate = g_settings_get_boolean (self->settings, "validate-while-typing");
+
+  gtk_source_buffer_set_highlight_syntax (GTK_SOURCE_BUFFER (self), !loading && !native);
+  gabc_highlighter_set_enabled (self->highlighter, !loading && native);
+  gabc_validator_set_enabled (self->validator, !loading && validate);
+}
+
+
+/*
+ * FAST OPEN
+ *
+ * Local files that are already UTF-8 with \n line ends (nearly all abc
+ * files) skip GtkSourceFileLoader's encoding detection.  The file is mapped
+ * rather than read, so it is never held in memory twice, and is inserted a
+ * chunk at a time from idle callbacks: the first screen appears straight
+ * away and the window stays responsive while the rest of a big collection
+ * arrives.  Highlighting and the tune index are held back until the end and
+ * then built once, rather than updated for every chunk.
+ */
+#define GABC_TUNEBOOK_LOAD_FIRST_CHUNK_SIZE (64 * 1024)
+#define GABC_TUNEBOOK_LOAD_CHUNK_SIZE       (1024 * 1024)
+
+#define GABC_TUNEBOOK_ONES  G_GUINT64_CONSTANT (0x0101010101010101)
+#define GABC_TUNEBOOK_HIGHS G_GUINT64_CONSTANT (0x8080808080808080)
+
+/*
+ * UTF-8 check for text that is mostly ASCII.  Eight bytes at a time are
+ * tested for a set high bit (non-ASCII) or a zero byte (which the text
+ * buffer won't take) with plain integer arithmetic; only words that fail
+ * are looked at a character at a time.
+ */
+static gboolean
+gabc_tunebook_validate_utf8 (const gchar *data,
+                             gsize        length)
+{
+  const gchar *p = data;
+  const gchar *end = data + length;
+
+  while (p < end)
+    {
+      if (end - p >= 8)
+        {
+          guint64 word;
+
+          memcpy (&word, p, sizeof (word));
+          if (((word | ((word - GABC_TUNEBOOK_ONES) & ~word)) & GABC_TUNEBOOK_HIGHS) == 0)
+            {
+              p += 8;
+              continue;
+            }
+        }
+
+      if ((guchar) *p < 0x80)
+        {
+          if (*p == '\0')
+            return FALSE;
+          p++;
+        }
+      else
+        {
+          gunichar c = g_utf8_get_char_validated (p, end - p);
+
+          if (c == (gunichar) -1 || c == (gunichar) -2)
+            return FALSE;
+          p = g_utf8_next_char (p);
+        }
+    }
+
+  return TRUE;
+}
+
+
+/*
+ * Stop a fast open part way through, leaving whatever has been inserted.
+ */
+static void
+gabc_tunebook_cancel_load (GabcTunebook *self)
+{
+  if (self->load_mapped_file == NULL)
+    return;
+
+  g_clear_handle_id (&self->load_source_id, g_source_remove);
+  g_clear_pointer (&self->load_mapped_file, g_mapped_file_unref);
+
+  gtk_text_buffer_end_irreversible_action (GTK_TEXT_BUFFER (self));
+  gabc_tune_index_thaw (self->tune_index);
+  gabc_tunebook_update_highlighting (self);
+}
+
+
+/*
+ * Insert the next chunk, ending it on a line break where there is one so
+ * no line is split across inserts (and never inside a character).
+ */
+static void
+gabc_tunebook_insert_next_chunk (GabcTunebook *self,
+                                 gsize         chunk_size)
+{
+  const gchar *contents = g_mapped_file_get_contents (self->load_mapped_file);
+  gsize chunk_end = MIN (self->load_offset + chunk_size, self->load_length);
+  GtkTextIter end;
+
+  if (chunk_end < self->load_length)
+    {
+      gsize line_end = chunk_end;
+
+      while (line_end > self->load_offset && contents[line_end - 1] != '\n')
+        line_end--;
+
+      if (line_end > self->load_offset)
+        chunk_end = line_end;
+      else
+        while (chunk_end > self->load_offset && ((guchar) contents[chunk_end] & 0xC0) == 0x80)
+          chunk_end--;
+    }
+
+  gtk_text_buffer_get_end_iter (GTK_TEXT_BUFFER (self), &end);
+  gtk_text_buffer_insert (GTK_TEXT_BUFFER (self), &end,
+                          contents + self->load_offset, chunk_end - self->load_offset);
+  self->load_offset = chunk_end;
+}
+
+
+static void
+gabc_tunebook_finish_load (GabcTunebook *self)
+{
+  GtkTextIter start;
+
+  gabc_tunebook_cancel_load (self);
+
+  gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (self), &start);
+  gtk_text_buffer_place_cursor (GTK_TEXT_BUFFER (self), &start);
+  gtk_text_buffer_set_modified (GTK_TEXT_BUFFER (self), FALSE);
+  self->is_modified = FALSE;
+
+  g_signal_emit (self, signals [LOADED], 0);
+}
+
+
+static gboolean
+gabc_tunebook_load_chunk_cb (gpointer user_data)
+{
+  GabcTunebook *self = GABC_TUNEBOOK (user_data);
+
+  gabc_tunebook_insert_next_chunk (self, GABC_TUNEBOOK_LOAD_CHUNK_SIZE);
+
+  if (self->load_offset < self->load_length)
+    {
+      g_signal_emit (self, signals [LOAD_PROGRESS], 0, (gdouble) self->load_offset / self->load_length);
+      return G_SOURCE_CONTINUE;
+    }
+
+  self->load_source_id = 0;
+  gabc_tunebook_finish_load (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+/*
+ * Insert the rest of a fast open now, for operations that need the whole
+ * file in the buffer (saving, appending, writing the scratch file).
+ */
+static void
+gabc_tunebook_complete_load (GabcTunebook *self)
+{
+  if (self->load_mapped_file == NULL)
+    return;
+
+  while (self->load_offset < self->load_length)
+    gabc_tunebook_insert_next_chunk (self, self->load_length - self->load_offset);
+
+  g_clear_handle_id (&self->load_source_id, g_source_remove);
+  gabc_tunebook_finish_load (self);
+}
+
+
+/*
+ * Returns FALSE, having done nothing, if the file can't take the fast path.
+ */
+static gboolean
+gabc_tunebook_open_mapped_file (GabcTunebook *self,
+                                GFile        *file)
+{
+  g_autofree gchar *path = NULL;
+  GMappedFile *mapped_file;
+  const gchar *contents;
+  gsize length;
+
+  path = g_file_get_path (file);
+  if (path == NULL)
+    return FALSE;
+
+  mapped_file = g_mapped_file_new (path, FALSE, NULL);
+  if (mapped_file == NULL)
+    return FALSE;
+
+  contents = g_mapped_file_get_contents (mapped_file);
+  length = g_mapped_file_get_length (mapped_file);
+
+  if (length == 0 ||
+      memchr (contents, '\r', length) != NULL ||
+      !gabc_tunebook_validate_utf8 (contents, length))
+    {
+      g_mapped_file_unref (mapped_file);
+      return FALSE;
+    }
+
+  gabc_tunebook_cancel_load (self);
+
+  /*
+   * No loader runs to record how the file is stored, so start from a fresh
+   * source file (UTF-8, LF, uncompressed, just as checked above) rather than
+   * saving with whatever the previous file was loaded with.
+   */
+  g_object_unref (self->abc_source_file);
+  self->abc_source_file = gtk_source_file_new ();
+  gtk_source_file_set_location (self->abc_source_file, file);
+
+  /* The buffer supplies the trailing newline on save, as after a normal load. */
+  if (contents[length - 1] == '\n')
+    length--;
+
+  self->load_mapped_file = mapped_file;
+  self->load_offset = 0;
+  self->load_length = length;
+
+  gabc_tune_index_freeze (self->tune_index);
+  gabc_tunebook_update_highlighting (self);
+  gtk_text_buffer_begin_irreversible_action (GTK_TEXT_BUFFER (self));
+  gtk_text_buffer_set_text (GTK_TEXT_BUFFER (self), "", 0);
+
+  gabc_tunebook_insert_next_chunk (self, GABC_TUNEBOOK_LOAD_FIRST_CHUNK_SIZE);
+
+  if (self->load_offset < self->load_length)
+    {
+      g_signal_emit (self, signals [LOAD_PROGRESS], 0, (gdouble) self->load_offset / self->load_length);
+      self->load_source_id = g_idle_add (gabc_tunebook_load_chunk_cb, self);
+    }
+  else
+    {
+      gabc_tunebook_finish_load (self);
+    }
+
+  return TRUE;
 }
 
 
@@ -88,11 +462,15 @@ gabc_tunebook_open_file (GabcTunebook      *self,
                          GFile           *file)
 {
   GtkSourceFileLoader *loader;
-  g_print ("gabc_tunebook_open_file\n");
-  //g_print ("File: %s\n",g_file_get_path(file));
 
   gtk_source_file_set_location(GTK_SOURCE_FILE (self->abc_source_file), file);
-  g_print ("File: %s",g_file_get_path( gtk_source_file_get_location (self->abc_source_file)));
+
+  gabc_tunebook_cancel_append (self);
+
+  if (gabc_tunebook_open_mapped_file (self, file))
+    return;
+
+  gabc_tunebook_cancel_load (self);
   loader = gtk_source_file_loader_new (GTK_SOURCE_BUFFER (self),
                                        GTK_SOURCE_FILE (self->abc_source_file));
 
@@ -113,75 +491,363 @@ gabc_tunebook_open_file_cb (GtkSourceFileLoader *loader,
 
   if (!gtk_source_file_loader_load_finish (loader, result, &error))
   {
-    g_print ("Error\n");
     g_printerr ("Error loading file: %s\n", error->message);
     g_clear_error (&error);
   }
   else
   {
-    g_print ("gabc_tunebook_open_file_cb: No error");
     gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (self), &start);
     gtk_text_buffer_place_cursor (GTK_TEXT_BUFFER (self), &start);
     self->is_modified = FALSE;
+    g_signal_emit (self, signals [LOADED], 0);
   }
   g_object_unref (loader);
 }
 
-void
-gabc_tunebook_append_file (GabcTunebook       *self,
-                           GFile            *file)
+/*
+ * APPEND
+ *
+ * Appended files are all read at once, concurrently, but go into the buffer
+ * strictly in the order they were given, a chunk at a time from idle
+ * callbacks.  X: numbers that are already in use in the book are changed
+ * to the next free number on the way in.  The whole append is one user
+ * action, so a single undo takes it all back out.  Further appends that
+ * arrive while one is running join its queue (and its undo step).
+ */
+#define GABC_TUNEBOOK_APPEND_CHUNK_SIZE (256 * 1024)
+
+typedef struct {
+  GFile   *file;
+  GBytes  *contents;   /* NULL until read, and after a failed read */
+  gboolean done;
+} append_file_t;
+
+typedef struct {
+  GabcTunebook *tunebook;
+  GPtrArray    *append_files;
+  guint         position;
+} append_read_data_t;
+
+
+static void
+gabc_tunebook_append_file_free (append_file_t *append_file)
 {
-  g_file_load_contents_async (file,
-                              NULL,
-                              (GAsyncReadyCallback) gabc_tunebook_append_file_cb,
-                              self);
+  g_object_unref (append_file->file);
+  g_clear_pointer (&append_file->contents, g_bytes_unref);
+  g_free (append_file);
 }
 
-void
-gabc_tunebook_append_file_cb  (GObject       *source_object,
-                                GAsyncResult  *result,
-                                GabcTunebook    *self)
+
+/*
+ * Stop an append part way through, leaving whatever has been inserted.
+ * Returns TRUE if one was running.
+ */
+static gboolean
+gabc_tunebook_cancel_append (GabcTunebook *self)
+{
+  if (self->append_files == NULL)
+    return FALSE;
+
+  g_cancellable_cancel (self->append_cancellable);
+  g_clear_object (&self->append_cancellable);
+  g_clear_handle_id (&self->append_source_id, g_source_remove);
+  g_clear_pointer (&self->append_files, g_ptr_array_unref);
+  g_clear_pointer (&self->append_numbers, g_hash_table_unref);
+
+  gtk_text_buffer_end_user_action (GTK_TEXT_BUFFER (self));
+
+  return TRUE;
+}
+
+
+static guint
+gabc_tunebook_append_take_number (GabcTunebook *self,
+                                  guint         number)
+{
+  if (number == 0 || g_hash_table_contains (self->append_numbers, GUINT_TO_POINTER (number)))
+    {
+      while (g_hash_table_contains (self->append_numbers, GUINT_TO_POINTER (self->append_next_number)))
+        self->append_next_number++;
+      number = self->append_next_number;
+    }
+
+  g_hash_table_add (self->append_numbers, GUINT_TO_POINTER (number));
+
+  return number;
+}
+
+
+/*
+ * Copy whole lines of text to out, dropping any \r before a line break
+ * and renumbering X: lines whose number is taken.
+ */
+static void
+gabc_tunebook_append_renumber (GabcTunebook *self,
+                               GString      *out,
+                               const gchar  *text,
+                               gsize         length)
 {
-  GFile *file = G_FILE (source_object);
+  const gchar *end = text + length;
+  const gchar *line = text;
+
+  while (line < end)
+    {
+      const gchar *line_end = memchr (line, '\n', end - line);
+      const gchar *next_line = (line_end != NULL) ? line_end + 1 : end;
+
+      if (line_end == NULL)
+        line_end = end;
+      if (line_end > line && line_end[-1] == '\r')
+        line_end--;
+
+      if (line_end - line >= 2 && line[0] == 'X' && line[1] == ':')
+        {
+          const gchar *digits = line + 2;
+          guint64 number = 0;
+
+          while (digits < line_end && (*digits == ' ' || *digits == '\t'))
+            digits++;
+          while (digits < line_end && g_ascii_isdigit (*digits) && number <= G_MAXUINT)
+            number = number * 10 + (*digits++ - '0');
+
+          g_string_append_printf (out, "X:%u",
+                                  gabc_tunebook_append_take_number (self, number <= G_MAXUINT ? (guint) number : 0));
+          g_string_append_len (out, digits, line_end - digits);
+        }
+      else
+        {
+          g_string_append_len (out, line, line_end - line);
+        }
+
+      if (next_line > line_end && next_line[-1] == '\n')
+        g_string_append_c (out, '\n');
+
+      line = next_line;
+    }
+}
+
+
+static gdouble
+gabc_tunebook_append_get_fraction (GabcTunebook *self)
+{
+  gdouble fraction = self->append_position;
+
+  if (self->append_position < self->append_files->len)
+    {
+      append_file_t *append_file = g_ptr_array_index (self->append_files, self->append_position);
+
+      if (append_file->contents != NULL && g_bytes_get_size (append_file->contents) > 0)
+        fraction += (gdouble) self->append_offset / g_bytes_get_size (append_file->contents);
+    }
+
+  return fraction / self->append_files->len;
+}
+
+
+/*
+ * Insert the next chunk of the file at append_position, ending it on a line
+ * break.  Returns FALSE if that file hasn't been read yet.
+ */
+static gboolean
+gabc_tunebook_append_next_chunk (GabcTunebook *self)
+{
+  append_file_t *append_file = g_ptr_array_index (self->append_files, self->append_position);
+  g_autoptr (GString) text = NULL;
+  const gchar *contents;
+  gsize length;
+  gsize chunk_end;
   GtkTextIter end;
 
-  g_autofree char *contents = NULL;
-  gsize length = 0;
+  if (!append_file->done)
+    return FALSE;
+
+  if (append_file->contents == NULL || g_bytes_get_size (append_file->contents) == 0)
+    {
+      self->append_position++;
+      self->append_offset = 0;
+      return TRUE;
+    }
+
+  contents = g_bytes_get_data (append_file->contents, &length);
+  chunk_end = MIN (self->append_offset + GABC_TUNEBOOK_APPEND_CHUNK_SIZE, length);
+  if (chunk_end < length)
+    {
+      const gchar *line_end = memchr (contents + chunk_end, '\n', length - chunk_end);
+
+      chunk_end = (line_end != NULL) ? (gsize) (line_end + 1 - contents) : length;
+    }
+
+  text = g_string_sized_new (chunk_end - self->append_offset + 2);
+
+  /* Keep a blank line between the book and each appended file. */
+  if (self->append_offset == 0 && !gabc_tunebook_is_empty (self))
+    g_string_append (text, "\n\n");
+
+  gabc_tunebook_append_renumber (self, text, contents + self->append_offset, chunk_end - self->append_offset);
+
+  gtk_text_buffer_get_end_iter (GTK_TEXT_BUFFER (self), &end);
+  gtk_text_buffer_insert (GTK_TEXT_BUFFER (self), &end, text->str, text->len);
 
+  if (chunk_end < length)
+    {
+      self->append_offset = chunk_end;
+    }
+  else
+    {
+      self->append_position++;
+      self->append_offset = 0;
+    }
+
+  return TRUE;
+}
+
+
+static gboolean
+gabc_tunebook_append_chunk_cb (gpointer user_data)
+{
+  GabcTunebook *self = GABC_TUNEBOOK (user_data);
+
+  if (!gabc_tunebook_append_next_chunk (self))
+    {
+      /* Picked up again when the file has been read. */
+      self->append_source_id = 0;
+      return G_SOURCE_REMOVE;
+    }
+
+  if (self->append_position < self->append_files->len)
+    {
+      g_signal_emit (self, signals [LOAD_PROGRESS], 0, gabc_tunebook_append_get_fraction (self));
+      return G_SOURCE_CONTINUE;
+    }
+
+  self->append_source_id = 0;
+  gabc_tunebook_cancel_append (self);
+  g_signal_emit (self, signals [LOADED], 0);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+gabc_tunebook_append_schedule (GabcTunebook *self)
+{
+  if (self->append_source_id == 0)
+    self->append_source_id = g_idle_add (gabc_tunebook_append_chunk_cb, self);
+}
+
+
+static void
+gabc_tunebook_append_read_cb (GObject      *source_object,
+                              GAsyncResult *result,
+                              gpointer      user_data)
+{
+  append_read_data_t *read_data = user_data;
+  GabcTunebook *self = read_data->tunebook;
+  append_file_t *append_file = g_ptr_array_index (read_data->append_files, read_data->position);
+  g_autoptr (GBytes) contents = NULL;
   g_autoptr (GError) error = NULL;
+  const gchar *data;
+  gsize length;
 
-  g_file_load_contents_finish (file,
-                               result,
-                               &contents,
-                               &length,
-                               NULL,
-                               &error);
-  /*
-  if (error != NULL)
+  contents = g_file_load_bytes_finish (G_FILE (source_object), result, NULL, &error);
+
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED) ||
+      read_data->append_files != self->append_files)
+    goto out;
+
+  append_file->done = TRUE;
+
+  if (contents == NULL)
+    {
+      g_printerr ("Error loading file: %s\n", error->message);
+    }
+  else
+    {
+      data = g_bytes_get_data (contents, &length);
+      if (gabc_tunebook_validate_utf8 (data, length))
+        append_file->contents = g_steal_pointer (&contents);
+      else
+        g_printerr ("Unable to load the contents of %s.  File is not encoded with UTF-8\n",
+                    g_file_peek_path (append_file->file));
+    }
+
+  if (read_data->position == self->append_position)
+    gabc_tunebook_append_schedule (self);
+
+out:
+  g_ptr_array_unref (read_data->append_files);
+  g_object_unref (read_data->tunebook);
+  g_free (read_data);
+}
+
+
+/*
+ * Append the files to the end of the book in the order given.  The
+ * "loaded" signal is emitted once they are all in.
+ */
+void
+gabc_tunebook_append_files (GabcTunebook  *self,
+                            GFile        **files,
+                            guint          n_files)
+{
+  guint i;
+
+  g_return_if_fail (GABC_IS_TUNEBOOK (self));
+
+  if (n_files == 0)
+    return;
+
+  gabc_tunebook_complete_load (self);
+
+  if (self->append_files == NULL)
     {
-      gabc_log_window_append_to_log (self->log_window, error->message);
-      g_clear_error (&error);
-      return;
+      GabcTuneIndex *tune_index = self->tune_index;
+
+      self->append_files = g_ptr_array_new_with_free_func ((GDestroyNotify) gabc_tunebook_append_file_free);
+      self->append_cancellable = g_cancellable_new ();
+      self->append_position = 0;
+      self->append_offset = 0;
+
+      self->append_numbers = g_hash_table_new (g_direct_hash, g_direct_equal);
+      self->append_next_number = 1;
+      for (i = 0; i < gabc_tune_index_get_n_tunes (tune_index); i++)
+        g_hash_table_add (self->append_numbers,
+                          GUINT_TO_POINTER (gabc_tune_index_get_tune (tune_index, i)->number));
+
+      gtk_text_buffer_begin_user_action (GTK_TEXT_BUFFER (self));
     }
 
-  if (!g_utf8_validate (contents, length, NULL))
+  for (i = 0; i < n_files; i++)
     {
-      gchar *err_msg = g_strdup_printf ("Unable to load the contents of %s.  File is not encoded with UTF-8\n", g_file_peek_path (file));
-      gabc_log_window_append_to_log (self->log_window, err_msg);
-      g_free (err_msg);
-      return;
-    }*/
+      append_file_t *append_file = g_new0 (append_file_t, 1);
+      append_read_data_t *read_data = g_new0 (append_read_data_t, 1);
 
-  gtk_text_buffer_get_end_iter (GTK_TEXT_BUFFER (self), &end);
+      append_file->file = g_object_ref (files[i]);
 
-  gtk_text_buffer_insert(GTK_TEXT_BUFFER (self), &end, "\n\n", -1);
+      read_data->tunebook = g_object_ref (self);
+      read_data->append_files = g_ptr_array_ref (self->append_files);
+      read_data->position = self->append_files->len;
+
+      g_ptr_array_add (self->append_files, append_file);
+
+      g_file_load_bytes_async (files[i],
+                               self->append_cancellable,
+                               gabc_tunebook_append_read_cb,
+                               read_data);
+    }
+
+  g_signal_emit (self, signals [LOAD_PROGRESS], 0, gabc_tunebook_append_get_fraction (self));
+}
 
-  gtk_text_buffer_get_end_iter (GTK_TEXT_BUFFER (self), &end);
 
-  gtk_text_buffer_insert(GTK_TEXT_BUFFER (self),
-                         &end,
-                         contents,
-                         -1);
+/*
+ * Takes ownership of file.
+ */
+void
+gabc_tunebook_append_file (GabcTunebook       *self,
+                           GFile            *file)
+{
+  gabc_tunebook_append_files (self, &file, 1);
   g_object_unref (file);
 }
 
@@ -189,9 +855,12 @@ gabc_tunebook_append_file_cb  (GObject       *source_object,
 void
 gabc_tunebook_save_file (GabcTunebook *self)
 {
-  GtkSourceFileSaver *saver = gtk_source_file_saver_new (
-                                    (GtkSourceBuffer *) self,
-                                    self->abc_source_file);
+  GtkSourceFileSaver *saver;
+
+  gabc_tunebook_complete_load (self);
+
+  saver = gtk_source_file_saver_new ((GtkSourceBuffer *) self,
+                                     self->abc_source_file);
   gtk_source_file_saver_save_async (saver,
                                     G_PRIORITY_DEFAULT,
                                     NULL, NULL, NULL, NULL,
@@ -219,65 +888,544 @@ gabc_tunebook_save_file_async_cb (GtkSourceFileSaver *saver,
   g_object_unref (saver);
 }
 
+/*
+ * SCRATCH FILE EXPORT
+ *
+ * The buffer is streamed to the scratch file a block of lines at a time, so
+ * at most one block is ever copied out of the GtkTextBuffer.  Each block
+ * goes through the preprocessor on the way and the checksum used by the
+ * render cache is computed over the bytes as they are written.
+ */
+#define GABC_TUNEBOOK_WRITE_CHUNK_LINES 512
+
+typedef struct {
+  GOutputStream *stream;
+  GChecksum     *checksum;
+  gint64         export_time;     /* microseconds in each phase */
+  gint64         preprocess_time;
+  gint64         write_time;
+} scratch_write_data_t;
+
+
+static gboolean
+gabc_tunebook_write_bytes (const gchar  *data,
+                           gsize         length,
+                           gpointer      user_data,
+                           GError      **error)
+{
+  scratch_write_data_t *write_data = user_data;
+  gint64 start_time = g_get_monotonic_time ();
+  gboolean written;
+
+  g_checksum_update (write_data->checksum, (const guchar *) data, length);
+  written = g_output_stream_write_all (write_data->stream, data, length, NULL, NULL, error);
+
+  write_data->write_time += g_get_monotonic_time () - start_time;
+  return written;
+}
+
+
+static gboolean
+gabc_tunebook_write_range (GabcTunebook            *self,
+                           GabcPreprocessorTarget   target,
+                           const GtkTextIter       *start,
+                           const GtkTextIter       *end,
+                           GabcLineMap             *line_map,
+                           scratch_write_data_t    *write_data,
+                           GError                 **error)
+{
+  GtkTextIter chunk_start = *start;
+  GtkTextIter chunk_end;
+
+  if (line_map != NULL)
+    gabc_line_map_set_source_line (line_map, gtk_text_iter_get_line (start));
+
+  while (gtk_text_iter_compare (&chunk_start, end) < 0)
+    {
+      g_autofree gchar *chunk = NULL;
+      gint64 start_time = g_get_monotonic_time ();
+      gint64 write_time = write_data->write_time;
+      gboolean processed;
+
+      chunk_end = chunk_start;
+      gtk_text_iter_forward_lines (&chunk_end, GABC_TUNEBOOK_WRITE_CHUNK_LINES);
+      if (gtk_text_iter_compare (&chunk_end, end) > 0)
+        chunk_end = *end;
+
+      chunk = gtk_text_iter_get_text (&chunk_start, &chunk_end);
+      write_data->export_time += g_get_monotonic_time () - start_time;
+
+      /* The writes happen inside the preprocessor; don't count them twice. */
+      start_time = g_get_monotonic_time ();
+      processed = gabc_preprocessor_process (self->preprocessor, target, chunk,
+                                             gtk_text_iter_starts_line (&chunk_start),
+                                             line_map,
+                                             gabc_tunebook_write_bytes, write_data, error);
+      write_data->preprocess_time += g_get_monotonic_time () - start_time - (write_data->write_time - write_time);
+      if (!processed)
+        return FALSE;
+
+      chunk_start = chunk_end;
+    }
+
+  return TRUE;
+}
+
+
+/*
+ * Write [header_start, header_end) followed by [start, end) to file_path,
+ * adding the bytes written to checksum and, if line_map is not NULL,
+ * recording where each line came from.  The header range may be empty.
+ */
+static gboolean
+gabc_tunebook_write_ranges (GabcTunebook            *self,
+                            GabcPreprocessorTarget   target,
+                            const gchar             *file_path,
+                            const GtkTextIter       *header_start,
+                            const GtkTextIter       *header_end,
+                            const GtkTextIter       *start,
+                            const GtkTextIter       *end,
+                            GChecksum               *checksum,
+                            GabcLineMap             *line_map,
+                            GError                 **error)
+{
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (GFileOutputStream) stream = NULL;
+  scratch_write_data_t write_data = { 0 };
+  GabcRenderStats *stats = gabc_render_stats_get_default ();
+  gint64 start_time = g_get_monotonic_time ();
+  gboolean written;
+
+  file = g_file_new_for_path (file_path);
+  stream = g_file_replace (file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, error);
+  if (stream == NULL)
+    return FALSE;
+
+  write_data.stream = G_OUTPUT_STREAM (stream);
+  write_data.checksum = checksum;
+
+  gabc_preprocessor_reset (self->preprocessor);
+
+  written = gabc_tunebook_write_range (self, target, header_start, header_end, line_map, &write_data, error) &&
+            gabc_tunebook_write_range (self, target, start, end, line_map, &write_data, error) &&
+            g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, error);
+
+  /* Opening and closing the file count as writing it. */
+  write_data.write_time = MAX (g_get_monotonic_time () - start_time - write_data.export_time - write_data.preprocess_time, 0);
+
+  gabc_render_stats_add (stats, GABC_RENDER_METRIC_EXPORT, write_data.export_time);
+  gabc_render_stats_add (stats, GABC_RENDER_METRIC_PREPROCESS, write_data.preprocess_time);
+  gabc_render_stats_add (stats, GABC_RENDER_METRIC_WRITE, write_data.write_time);
+  gabc_render_stats_add (stats, GABC_RENDER_METRIC_BUFFER_SIZE,
+                         gtk_text_buffer_get_char_count (GTK_TEXT_BUFFER (self)));
+
+  return written;
+}
+
+
+/*
+ * Returns the path of the scratch file, or NULL with error set if it could
+ * not be written in full; nothing should render it then.
+ */
+static gchar*
+gabc_tunebook_write_ranges_to_scratch_file (GabcTunebook           *self,
+                                            GabcPreprocessorTarget  target,
+                                            const GtkTextIter      *header_start,
+                                            const GtkTextIter      *header_end,
+                                            const GtkTextIter      *start,
+                                            const GtkTextIter      *end,
+                                            GError                **error)
+{
+  g_autoptr (GChecksum) checksum = NULL;
+  gchar *file_path;
+
+  self->is_modified = self->is_modified || gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (self));
+  //g_print("gabc_window_write_buffer_to_file set buffer_is_modified to %s\n", self->buffer_is_modified ? "TRUE" : "FALSE");
+
+  gtk_text_buffer_set_modified (GTK_TEXT_BUFFER (self), FALSE);
+
+  file_path = g_build_filename (g_getenv("XDG_CACHE_HOME"), "gabc_scratch.abc", NULL);
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+
+  g_clear_object (&self->scratch_line_map);
+  self->scratch_line_map = gabc_line_map_new ();
+
+  if (!gabc_tunebook_write_ranges (self, target, file_path, header_start, header_end, start, end,
+                                   checksum, self->scratch_line_map, error))
+    {
+      g_prefix_error (error, "Error writing scratch file: ");
+      g_clear_pointer (&self->scratch_checksum, g_free);
+      g_free (file_path);
+      return NULL;
+    }
+
+  g_free (self->scratch_checksum);
+  self->scratch_checksum = g_strdup (g_checksum_get_string (checksum));
+
+  return file_path;
+}
+
+
 gchar*
-gabc_tunebook_write_to_scratch_file (GabcTunebook  *self, GSettings *settings)
+gabc_tunebook_write_to_scratch_file (GabcTunebook *self, GabcPreprocessorTarget target, GError **error)
 {
   GtkTextIter start;
   GtkTextIter end;
-  char *text;
-  gchar *file_path;
-  gint midi_program; //TODO
+
+  gabc_tunebook_complete_load (self);
 
   gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (self), &start);
   gtk_text_buffer_get_end_iter (GTK_TEXT_BUFFER (self), &end);
-  text = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (self), &start, &end, FALSE);
 
-  self->is_modified = self->is_modified || gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (self));
-  //g_print("gabc_window_write_buffer_to_file set buffer_is_modified to %s\n", self->buffer_is_modified ? "TRUE" : "FALSE");
+  return gabc_tunebook_write_ranges_to_scratch_file (self, target, &start, &start, &start, &end, error);
+}
 
-  gtk_text_buffer_set_modified (GTK_TEXT_BUFFER (self), FALSE);
 
-  // Preprocess the file here
-  midi_program = g_settings_get_enum (settings, "abc2midi-midi-program");
-  if (midi_program < 128)
+static void
+gabc_tunebook_get_tunes_bounds (GabcTunebook *self,
+                                guint         first,
+                                guint         last,
+                                GtkTextIter  *header_start,
+                                GtkTextIter  *header_end,
+                                GtkTextIter  *start,
+                                GtkTextIter  *end)
+{
+  gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (self), header_start);
+  gabc_tune_index_get_tune_bounds (self->tune_index, 0, header_end, NULL);
+  gabc_tune_index_get_tune_bounds (self->tune_index, first, start, NULL);
+  gabc_tune_index_get_tune_bounds (self->tune_index, last, NULL, end);
+}
+
+
+/*
+ * Write the tunes at index positions first..last to the scratch file.  The
+ * file header (everything before the first X:) is kept in front of them as
+ * it may carry %%fmt and other directives the tunes depend on.
+ */
+gchar*
+gabc_tunebook_write_tunes_to_scratch_file (GabcTunebook           *self,
+                                           GabcPreprocessorTarget  target,
+                                           guint                   first,
+                                           guint                   last,
+                                           GError                **error)
+{
+  GtkTextIter header_start;
+  GtkTextIter header_end;
+  GtkTextIter start;
+  GtkTextIter end;
+
+  gabc_tunebook_complete_load (self);
+
+  g_return_val_if_fail (first <= last, NULL);
+  g_return_val_if_fail (last < gabc_tune_index_get_n_tunes (self->tune_index), NULL);
+
+  gabc_tunebook_get_tunes_bounds (self, first, last, &header_start, &header_end, &start, &end);
+
+  return gabc_tunebook_write_ranges_to_scratch_file (self, target, &header_start, &header_end, &start, &end, error);
+}
+
+
+/*
+ * As gabc_tunebook_write_tunes_to_scratch_file () but to a file of the
+ * caller's choosing, leaving the scratch file, its checksum and the
+ * modified flag alone.  Used for renders that run alongside the main ones.
+ */
+gboolean
+gabc_tunebook_write_tunes_to_file (GabcTunebook            *self,
+                                   GabcPreprocessorTarget   target,
+                                   guint                    first,
+                                   guint                    last,
+                                   const gchar             *file_path,
+                                   GError                 **error)
+{
+  g_autoptr (GChecksum) checksum = NULL;
+  GtkTextIter header_start;
+  GtkTextIter header_end;
+  GtkTextIter start;
+  GtkTextIter end;
+
+  gabc_tunebook_complete_load (self);
+
+  g_return_val_if_fail (first <= last, FALSE);
+  g_return_val_if_fail (last < gabc_tune_index_get_n_tunes (self->tune_index), FALSE);
+
+  gabc_tunebook_get_tunes_bounds (self, first, last, &header_start, &header_end, &start, &end);
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+
+  return gabc_tunebook_write_ranges (self, target, file_path, &header_start, &header_end, &start, &end,
+                                     checksum, NULL, error);
+}
+
+
+/*
+ * The directory the tools should run in: the one holding the abc file, so
+ * relative paths to format files keep working, or $XDG_CACHE_HOME for an
+ * unsaved tunebook.
+ */
+gchar *
+gabc_tunebook_get_working_dir (GabcTunebook *self)
+{
+  GFile *location;
+  g_autoptr (GFile) parent = NULL;
+
+  location = gtk_source_file_get_location (self->abc_source_file);
+  if (location == NULL)
+    return g_strdup (g_getenv ("XDG_CACHE_HOME"));
+
+  parent = g_file_get_parent (location);
+  return g_file_get_path (parent);
+}
+
+
+/*
+ * Where each line of the last scratch file came from in the buffer, for
+ * placing the tools' diagnostics.
+ */
+GabcLineMap *
+gabc_tunebook_get_scratch_line_map (GabcTunebook *self)
+{
+  return self->scratch_line_map;
+}
+
+
+/*
+ * DIAGNOSTICS
+ *
+ * Errors and warnings from the tools are shown as a source mark on the line
+ * (carrying the message for the tooltip) and an underline on the token they
+ * point at.  The positions are in the file the tool read, so they are taken
+ * back to the buffer through line_map; NULL means the tool read the buffer
+ * text unchanged.
+ */
+void
+gabc_tunebook_add_diagnostic (GabcTunebook         *self,
+                              const GabcDiagnostic *diagnostic,
+                              GabcLineMap          *line_map)
+{
+  GtkTextBuffer *buffer = GTK_TEXT_BUFFER (self);
+  GtkSourceMark *mark;
+  GtkTextIter line_start;
+  GtkTextIter line_end;
+  GtkTextIter start;
+  GtkTextIter end;
+  gboolean error = (diagnostic->severity == GABC_LOG_SEVERITY_ERROR);
+  guint line = diagnostic->line;
+
+  if (line_map != NULL && !gabc_line_map_lookup (line_map, diagnostic->line, &line))
+    return;
+
+  if (line >= (guint) gtk_text_buffer_get_line_count (buffer))
+    return;
+
+  gtk_text_buffer_get_iter_at_line (buffer, &line_start, line);
+  line_end = line_start;
+  if (!gtk_text_iter_ends_line (&line_end))
+    gtk_text_iter_forward_to_line_end (&line_end);
+
+  /* Underline the token at the column, or the whole line if there isn't one. */
+  start = line_start;
+  gtk_text_iter_set_line_offset (&start, MIN (diagnostic->column, (guint) gtk_text_iter_get_line_offset (&line_end)));
+  end = start;
+  while (!gtk_text_iter_ends_line (&end) && !g_unichar_isspace (gtk_text_iter_get_char (&end)))
+    gtk_text_iter_forward_char (&end);
+
+  if (gtk_text_iter_equal (&start, &end))
     {
-    text = gabc_tunebook_set_midi_program (text, midi_program);
+      start = line_start;
+      end = line_end;
     }
 
-  file_path = g_build_filename (g_getenv("XDG_CACHE_HOME"), "gabc_scratch.abc", NULL);
-  g_file_set_contents(file_path, text, -1, NULL);
+  gtk_text_buffer_apply_tag_by_name (buffer,
+                                     error ? GABC_DIAGNOSTIC_TAG_ERROR : GABC_DIAGNOSTIC_TAG_WARNING,
+                                     &start, &end);
 
-  g_free (text);
-  return file_path;
+  mark = gtk_source_buffer_create_source_mark (GTK_SOURCE_BUFFER (self), NULL,
+                                               error ? GABC_TUNEBOOK_MARK_ERROR : GABC_TUNEBOOK_MARK_WARNING,
+                                               &line_start);
+  g_object_set_data_full (G_OBJECT (mark), "gabc-diagnostic-message",
+                          g_strdup (diagnostic->message), g_free);
 }
 
 
-static gchar *
-gabc_tunebook_set_midi_program (gchar * file_content, gint midi_program)
+/*
+ * Take the underlines off each tune with a mark in category, and have the
+ * validator put its own back.
+ */
+static void
+gabc_tunebook_clear_diagnostic_tunes (GabcTunebook *self,
+                                      const gchar  *category)
 {
-  gchar *preprocessed_text;
-  GError *error = NULL;
-  GRegex *end_of_header_regex;
-  gchar *program_str = g_strdup_printf ("\\0\\n%%%%MIDI program %d", midi_program);
+  GtkTextBuffer *buffer = GTK_TEXT_BUFFER (self);
+  g_autoptr (GSList) at_start = NULL;
+  GtkTextIter iter;
+  GtkTextIter start;
+  GtkTextIter end;
 
-  end_of_header_regex = g_regex_new ("^K:.*$", G_REGEX_MULTILINE, 0, &error);
+  /* Moving forward to a mark skips one at iter itself. */
+  gtk_text_buffer_get_start_iter (buffer, &iter);
+  at_start = gtk_source_buffer_get_source_marks_at_iter (GTK_SOURCE_BUFFER (self), &iter, category);
+  if (at_start == NULL && !gtk_source_buffer_forward_iter_to_source_mark (GTK_SOURCE_BUFFER (self), &iter, category))
+    return;
 
-  if ( error )
-  {
-    //gabc_log_window_append_to_log (self->log_window, error->message);
-    g_clear_error (&error);
-  }
+  do
+    {
+      gabc_tune_index_get_bounds_at_offset (self->tune_index, gtk_text_iter_get_offset (&iter), &start, &end);
+      gtk_text_buffer_remove_tag_by_name (buffer, GABC_DIAGNOSTIC_TAG_ERROR, &start, &end);
+      gtk_text_buffer_remove_tag_by_name (buffer, GABC_DIAGNOSTIC_TAG_WARNING, &start, &end);
+      gabc_validator_invalidate (self->validator, &start, &end);
 
-  preprocessed_text = g_regex_replace (end_of_header_regex,
-                          file_content,
-                          -1,
-                          0,
-                          program_str,
-                          G_REGEX_MATCH_DEFAULT,
-                          NULL);
-  g_free (program_str);
-  g_regex_unref (end_of_header_regex);
-  return preprocessed_text;
+      /* Straight on to the next tune, past any more marks in this one. */
+      iter = end;
+      if (gtk_text_iter_is_end (&iter))
+        break;
+      gtk_text_iter_backward_char (&iter);
+    }
+  while (gtk_source_buffer_forward_iter_to_source_mark (GTK_SOURCE_BUFFER (self), &iter, category));
+}
+
+
+/*
+ * The validator's marks stay, and so do its underlines once it has checked
+ * the tunes that had diagnostics again.
+ */
+void
+gabc_tunebook_clear_diagnostics (GabcTunebook *self)
+{
+  GtkTextIter start;
+  GtkTextIter end;
+
+  gabc_tunebook_clear_diagnostic_tunes (self, GABC_TUNEBOOK_MARK_ERROR);
+  gabc_tunebook_clear_diagnostic_tunes (self, GABC_TUNEBOOK_MARK_WARNING);
+
+  gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (self), &start, &end);
+  gtk_source_buffer_remove_source_marks (GTK_SOURCE_BUFFER (self), &start, &end, GABC_TUNEBOOK_MARK_ERROR);
+  gtk_source_buffer_remove_source_marks (GTK_SOURCE_BUFFER (self), &start, &end, GABC_TUNEBOOK_MARK_WARNING);
+}
+
+
+/*
+ * TRANSPOSITION
+ *
+ * gabc_transpose_tune () gives an edit for each note, chord symbol and K:
+ * field that changes.  Edits with fewer than GABC_TUNEBOOK_EDIT_GAP bytes
+ * of unchanged text between them go into the buffer as one, which keeps
+ * the signal handlers of the index, highlighter and validator to a few
+ * calls per line, and everything is one user action, so one undo.
+ */
+#define GABC_TUNEBOOK_EDIT_GAP 8
+
+static void
+gabc_tunebook_apply_edits (GabcTunebook *self,
+                           gint          tune_offset,
+                           const gchar  *text,
+                           GArray       *edits,
+                           GString      *replacements)
+{
+  GtkTextBuffer *buffer = GTK_TEXT_BUFFER (self);
+  g_autoptr (GString) group = g_string_new (NULL);
+  const gchar *counted = text;
+  gint counted_chars = 0;
+  gint shift = 0;
+  guint i = 0;
+
+  while (i < edits->len)
+    {
+      const GabcTransposeEdit *edit = &g_array_index (edits, GabcTransposeEdit, i);
+      guint group_start = edit->offset;
+      guint group_end;
+      gint start_chars;
+      gint end_chars;
+      GtkTextIter start;
+      GtkTextIter end;
+
+      g_string_truncate (group, 0);
+      for (;;)
+        {
+          g_string_append_len (group, replacements->str + edit->new_offset, edit->new_length);
+          group_end = edit->offset + edit->length;
+
+          if (++i == edits->len)
+            break;
+          edit = &g_array_index (edits, GabcTransposeEdit, i);
+          if (edit->offset - group_end >= GABC_TUNEBOOK_EDIT_GAP)
+            break;
+          g_string_append_len (group, text + group_end, edit->offset - group_end);
+        }
+
+      /* Edits are in bytes; the buffer counts characters. */
+      start_chars = counted_chars + (gint) g_utf8_strlen (counted, text + group_start - counted);
+      end_chars = start_chars + (gint) g_utf8_strlen (text + group_start, group_end - group_start);
+      counted = text + group_end;
+      counted_chars = end_chars;
+
+      gtk_text_buffer_get_iter_at_offset (buffer, &start, tune_offset + start_chars + shift);
+      gtk_text_buffer_get_iter_at_offset (buffer, &end, tune_offset + end_chars + shift);
+      gtk_text_buffer_delete (buffer, &start, &end);
+      gtk_text_buffer_insert (buffer, &start, group->str, group->len);
+
+      shift += (gint) g_utf8_strlen (group->str, group->len) - (end_chars - start_chars);
+    }
+}
+
+
+/*
+ * Move the tunes first to last by semitones, rewriting their notes, chord
+ * symbols and K: fields in place.  Returns the number of tunes changed.
+ */
+guint
+gabc_tunebook_transpose (GabcTunebook *self,
+                         guint         first,
+                         guint         last,
+                         gint          semitones)
+{
+  g_autoptr (GString) replacements = g_string_new (NULL);
+  guint n_changed = 0;
+  guint position;
+
+  g_return_val_if_fail (GABC_IS_TUNEBOOK (self), 0);
+  g_return_val_if_fail (first <= last && last < gabc_tune_index_get_n_tunes (self->tune_index), 0);
+
+  if (semitones == 0)
+    return 0;
+
+  gtk_text_buffer_begin_user_action (GTK_TEXT_BUFFER (self));
+
+  /* From the last tune back, so the offsets of those before it hold. */
+  for (position = last + 1; position-- > first; )
+    {
+      g_autoptr (GabcAbcTune) tune = NULL;
+      g_autoptr (GArray) edits = NULL;
+      g_autofree gchar *text = NULL;
+      GtkTextIter start;
+      GtkTextIter end;
+
+      gabc_tune_index_get_tune_bounds (self->tune_index, position, &start, &end);
+      text = gtk_text_buffer_get_slice (GTK_TEXT_BUFFER (self), &start, &end, TRUE);
+      tune = gabc_abc_tune_parse (text, strlen (text));
+
+      g_string_truncate (replacements, 0);
+      edits = gabc_transpose_tune (tune, text, semitones, replacements);
+      if (edits->len == 0)
+        continue;
+
+      gabc_tunebook_apply_edits (self, gtk_text_iter_get_offset (&start), text, edits, replacements);
+      n_changed++;
+    }
+
+  gtk_text_buffer_end_user_action (GTK_TEXT_BUFFER (self));
+
+  return n_changed;
+}
+
+
+/*
+ * SHA-256 of the text last written to the scratch file, after preprocessing,
+ * or NULL if that write failed.
+ */
+const gchar *
+gabc_tunebook_get_scratch_checksum (GabcTunebook *self)
+{
+  return self->scratch_checksum;
 }
 
 
@@ -303,9 +1451,20 @@ gabc_tunebook_is_modified (GabcTunebook *self)
 void
 gabc_tunebook_clear (GabcTunebook *self)
 {
+  gboolean was_loading;
+
+  was_loading = gabc_tunebook_cancel_append (self);
+  if (self->load_mapped_file != NULL)
+    was_loading = TRUE;
+  gabc_tunebook_cancel_load (self);
+
   gtk_text_buffer_set_text (GTK_TEXT_BUFFER (self), "", -1);
   gtk_source_file_set_location (self->abc_source_file, NULL);
   self->is_modified = FALSE;
+
+  /* Anyone waiting on the load (the window keeps the view read only) is done. */
+  if (was_loading)
+    g_signal_emit (self, signals [LOADED], 0);
 }
 
 
@@ -334,3 +1493,16 @@ gabc_tunebook_set_abc_source_file (GabcTunebook *self, GFile *abc_src_file)
   gtk_source_file_set_location (self->abc_source_file, abc_src_file);
 }
 
+
+GabcTuneIndex *
+gabc_tunebook_get_tune_index (GabcTunebook *self)
+{
+  return self->tune_index;
+}
+
+
+GabcHighlighter *
+gabc_tunebook_get_highlighter (GabcTunebook *self)
+{
+  return self->highlighter;
+}
@@ -22,11 +22,22 @@
 #include <gtk/gtk.h>
 #include <gtksourceview/gtksource.h>
 
+#include "gabc-diagnostic.h"
+#include "gabc-highlighter.h"
+#include "gabc-line-map.h"
+#include "gabc-preprocessor.h"
+#include "gabc-tune-index.h"
+#include "gabc-validator.h"
+
 G_BEGIN_DECLS
 
 
 
 
+/* GtkSourceMark categories for tool diagnostics. */
+#define GABC_TUNEBOOK_MARK_ERROR   "gabc-error"
+#define GABC_TUNEBOOK_MARK_WARNING "gabc-warning"
+
 #define GABC_TYPE_TUNEBOOK (gabc_tunebook_get_type())
 
 G_DECLARE_FINAL_TYPE (GabcTunebook, gabc_tunebook, GABC, TUNEBOOK, GtkSourceBuffer)
@@ -43,9 +54,9 @@ void                      gabc_tunebook_open_file_cb              (GtkSourceFile
 void                      gabc_tunebook_append_file               (GabcTunebook        *self,
                                                                    GFile               *file);
 
-void                      gabc_tunebook_append_file_cb            (GObject       *source_object,
-                                                                   GAsyncResult  *result,
-                                                                   GabcTunebook    *self);
+void                      gabc_tunebook_append_files              (GabcTunebook        *self,
+                                                                   GFile              **files,
+                                                                   guint                n_files);
 
 gboolean                  gabc_tunebook_is_empty                  (GabcTunebook *self);
 
@@ -57,8 +68,39 @@ void                      gabc_tunebook_save_file_async_cb        (GtkSourceFile
                                                                    GAsyncResult       *result,
                                                                    GabcTunebook       *self);
 
-gchar *                   gabc_tunebook_write_to_scratch_file     (GabcTunebook  *self,
-                                                                   GSettings *settings);
+gchar *                   gabc_tunebook_write_to_scratch_file     (GabcTunebook           *self,
+                                                                   GabcPreprocessorTarget  target,
+                                                                   GError                **error);
+
+gchar *                   gabc_tunebook_write_tunes_to_scratch_file (GabcTunebook           *self,
+                                                                   GabcPreprocessorTarget  target,
+                                                                   guint                   first,
+                                                                   guint                   last,
+                                                                   GError                **error);
+
+gboolean                  gabc_tunebook_write_tunes_to_file       (GabcTunebook            *self,
+                                                                   GabcPreprocessorTarget   target,
+                                                                   guint                    first,
+                                                                   guint                    last,
+                                                                   const gchar             *file_path,
+                                                                   GError                 **error);
+
+const gchar *             gabc_tunebook_get_scratch_checksum      (GabcTunebook *self);
+
+GabcLineMap *             gabc_tunebook_get_scratch_line_map      (GabcTunebook *self);
+
+void                      gabc_tunebook_add_diagnostic            (GabcTunebook         *self,
+                                                                   const GabcDiagnostic *diagnostic,
+                                                                   GabcLineMap          *line_map);
+
+void                      gabc_tunebook_clear_diagnostics         (GabcTunebook *self);
+
+guint                     gabc_tunebook_transpose                 (GabcTunebook *self,
+                                                                   guint         first,
+                                                                   guint         last,
+                                                                   gint          semitones);
+
+gchar *                   gabc_tunebook_get_working_dir           (GabcTunebook *self);
 
 GtkSourceFile *           gabc_tunebook_get_abc_source_file       (GabcTunebook *self);
 
@@ -66,5 +108,8 @@ void                      gabc_tunebook_set_abc_source_file       (GabcTunebook
 
 void                      gabc_tunebook_clear                     (GabcTunebook *self);
 
+GabcTuneIndex *           gabc_tunebook_get_tune_index            (GabcTunebook *self);
+
+GabcHighlighter *         gabc_tunebook_get_highlighter           (GabcTunebook *self);
 
 G_END_DECLS
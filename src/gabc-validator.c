@@ -0,0 +1,514 @@
+/* gabc-validator.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Structural checks on the tunebook as it is edited (gabc_abc_tune_check ()),
+ * shown as line marks of their own and with the same underlines as the
+ * tools' diagnostics.
+ *
+ * Edits mark the tunes they touch as invalid, as reported by the tune
+ * index's "tunes-edited".  After
+ * a short pause in typing a batch of invalid tunes, the one at the cursor
+ * first, is copied out of the buffer and parsed and checked on a worker
+ * thread; the main thread only copies text and places marks.  Each tune in
+ * the batch is held between a pair of text marks, so its results still land
+ * in the right place if text moves around it meanwhile, and they are thrown
+ * away if the tune itself has been edited again since, as it will be back
+ * in the invalid region.  Batches run back to back until the region is
+ * empty, which takes a whole book through in the background after a load.
+ */
+
+#include <string.h>
+
+#include "gabc-abc-check.h"
+#include "gabc-diagnostic.h"
+#include "gabc-validator.h"
+
+#define GABC_VALIDATOR_DELAY        150     /* ms after the last edit */
+#define GABC_VALIDATOR_BATCH_TUNES  64
+#define GABC_VALIDATOR_BATCH_BYTES  (256 * 1024)
+
+struct _GabcValidator
+{
+  GObject                       parent_instance;
+
+  GtkTextBuffer                *buffer;
+  GabcTuneIndex                *tune_index;
+  GtkTextTag                   *error_tag;
+  GtkTextTag                   *warning_tag;
+  gboolean                      enabled;
+
+  GtkSourceRegion              *invalid_region;
+  guint                         source_id;
+  GCancellable                 *cancellable;  /* while a batch is running */
+};
+
+G_DEFINE_FINAL_TYPE (GabcValidator, gabc_validator, G_TYPE_OBJECT)
+
+/* A problem in characters from the start of its tune. */
+typedef struct {
+  GabcLogSeverity  severity;
+  gint             start;
+  gint             end;
+  gchar           *message;
+} validator_problem_t;
+
+typedef struct {
+  gchar         *text;
+  GtkTextMark   *start_mark;
+  GtkTextMark   *end_mark;
+  GArray        *problems;   /* of validator_problem_t, filled in by the thread */
+} validator_tune_t;
+
+static void gabc_validator_queue_update (GabcValidator *self,
+                                         guint          delay);
+
+
+static void
+validator_problem_clear (validator_problem_t *problem)
+{
+  g_free (problem->message);
+}
+
+
+static void
+validator_tune_clear (validator_tune_t *tune)
+{
+  g_free (tune->text);
+  g_clear_pointer (&tune->problems, g_array_unref);
+}
+
+
+/*
+ * Remove the validator's marks and the underlines from start to end, which
+ * is a run of whole lines.  Any tool underlines there go too, as they have
+ * been edited or are about to be checked again.
+ */
+static void
+gabc_validator_clear_range (GabcValidator     *self,
+                            const GtkTextIter *start,
+                            const GtkTextIter *end)
+{
+  GtkTextIter last = *end;
+
+  /* Not the mark at end itself, which belongs to the next tune. */
+  if (gtk_text_iter_compare (start, &last) < 0 && !gtk_text_iter_is_end (&last))
+    gtk_text_iter_backward_char (&last);
+
+  gtk_source_buffer_remove_source_marks (GTK_SOURCE_BUFFER (self->buffer), start, &last, GABC_VALIDATOR_MARK_ERROR);
+  gtk_source_buffer_remove_source_marks (GTK_SOURCE_BUFFER (self->buffer), start, &last, GABC_VALIDATOR_MARK_WARNING);
+  gtk_text_buffer_remove_tag (self->buffer, self->error_tag, start, end);
+  gtk_text_buffer_remove_tag (self->buffer, self->warning_tag, start, end);
+}
+
+
+/*
+ * Mark the tunes from start to end as needing to be checked again, such as
+ * after an edit or after something else has taken the underlines off them.
+ */
+void
+gabc_validator_invalidate (GabcValidator     *self,
+                           const GtkTextIter *start,
+                           const GtkTextIter *end)
+{
+  g_return_if_fail (GABC_IS_VALIDATOR (self));
+
+  if (!self->enabled)
+    return;
+
+  gtk_source_region_add_subregion (self->invalid_region, start, end);
+  gabc_validator_queue_update (self, GABC_VALIDATOR_DELAY);
+}
+
+
+static void
+gabc_validator_tunes_edited_cb (GabcTuneIndex *tune_index,
+                                GtkTextIter   *start,
+                                GtkTextIter   *end,
+                                GabcValidator *self)
+{
+  gabc_validator_invalidate (self, start, end);
+}
+
+
+/*
+ * Take the tune containing iter off the invalid region and into tunes.
+ * Text before the first tune is the file header, which has nothing to
+ * check, so it is just cleared.  Returns the size of the text taken.
+ */
+static gsize
+gabc_validator_take_tune (GabcValidator     *self,
+                          GArray            *tunes,
+                          const GtkTextIter *iter)
+{
+  validator_tune_t tune = { NULL, };
+  GtkTextIter start;
+  GtkTextIter end;
+
+  gabc_tune_index_get_bounds_at_offset (self->tune_index, gtk_text_iter_get_offset (iter), &start, &end);
+  gtk_source_region_subtract_subregion (self->invalid_region, &start, &end);
+
+  if (!gabc_tune_index_lookup_offset (self->tune_index, gtk_text_iter_get_offset (iter), NULL))
+    {
+      gabc_validator_clear_range (self, &start, &end);
+      return 0;
+    }
+
+  /* A slice rather than the text, so that offsets match the buffer. */
+  tune.text = gtk_text_buffer_get_slice (self->buffer, &start, &end, TRUE);
+  tune.start_mark = gtk_text_buffer_create_mark (self->buffer, NULL, &start, TRUE);
+  tune.end_mark = gtk_text_buffer_create_mark (self->buffer, NULL, &end, FALSE);
+  g_array_append_val (tunes, tune);
+
+  return strlen (tune.text);
+}
+
+
+static void
+gabc_validator_check_thread (GTask        *task,
+                             gpointer      source_object,
+                             gpointer      task_data,
+                             GCancellable *cancellable)
+{
+  GArray *tunes = task_data;
+  guint i;
+  guint j;
+
+  for (i = 0; i < tunes->len && !g_cancellable_is_cancelled (cancellable); i++)
+    {
+      validator_tune_t *tune = &g_array_index (tunes, validator_tune_t, i);
+      g_autoptr (GabcAbcTune) parsed = gabc_abc_tune_parse (tune->text, strlen (tune->text));
+      g_autoptr (GArray) problems = gabc_abc_tune_check (parsed);
+
+      tune->problems = g_array_sized_new (FALSE, FALSE, sizeof (validator_problem_t), problems->len);
+      g_array_set_clear_func (tune->problems, (GDestroyNotify) validator_problem_clear);
+
+      for (j = 0; j < problems->len; j++)
+        {
+          GabcAbcProblem *problem = &g_array_index (problems, GabcAbcProblem, j);
+          validator_problem_t converted;
+
+          converted.severity = problem->severity;
+          converted.start = (gint) g_utf8_pointer_to_offset (tune->text, tune->text + problem->offset);
+          converted.end = converted.start +
+            (gint) g_utf8_strlen (tune->text + problem->offset, problem->length);
+          converted.message = g_steal_pointer (&problem->message);
+          g_array_append_val (tune->problems, converted);
+        }
+    }
+
+  if (!g_task_return_error_if_cancelled (task))
+    g_task_return_boolean (task, TRUE);
+}
+
+
+/*
+ * Replace the marks on one tune with the problems found in it, unless the
+ * tune has been edited since it was copied out.
+ */
+static void
+gabc_validator_apply_tune (GabcValidator          *self,
+                           const validator_tune_t *tune)
+{
+  g_autoptr (GtkSourceRegion) edited = NULL;
+  GtkTextIter start;
+  GtkTextIter end;
+  guint i;
+
+  if (tune->problems == NULL ||
+      gtk_text_mark_get_deleted (tune->start_mark) ||
+      gtk_text_mark_get_deleted (tune->end_mark))
+    return;
+
+  gtk_text_buffer_get_iter_at_mark (self->buffer, &start, tune->start_mark);
+  gtk_text_buffer_get_iter_at_mark (self->buffer, &end, tune->end_mark);
+  if (gtk_text_iter_compare (&start, &end) >= 0)
+    return;
+
+  edited = gtk_source_region_intersect_subregion (self->invalid_region, &start, &end);
+  if (edited != NULL && !gtk_source_region_is_empty (edited))
+    return;
+
+  gabc_validator_clear_range (self, &start, &end);
+
+  for (i = 0; i < tune->problems->len; i++)
+    {
+      const validator_problem_t *problem = &g_array_index (tune->problems, validator_problem_t, i);
+      gboolean error = (problem->severity == GABC_LOG_SEVERITY_ERROR);
+      GtkSourceMark *mark;
+      GtkTextIter problem_start = start;
+      GtkTextIter problem_end = start;
+      GtkTextIter line_start;
+
+      gtk_text_iter_forward_chars (&problem_start, problem->start);
+      gtk_text_iter_forward_chars (&problem_end, problem->end);
+      line_start = problem_start;
+      gtk_text_iter_set_line_offset (&line_start, 0);
+
+      gtk_text_buffer_apply_tag (self->buffer, error ? self->error_tag : self->warning_tag,
+                                 &problem_start, &problem_end);
+
+      mark = gtk_source_buffer_create_source_mark (GTK_SOURCE_BUFFER (self->buffer), NULL,
+                                                   error ? GABC_VALIDATOR_MARK_ERROR : GABC_VALIDATOR_MARK_WARNING,
+                                                   &line_start);
+      g_object_set_data_full (G_OBJECT (mark), "gabc-diagnostic-message",
+                              g_strdup (problem->message), g_free);
+    }
+}
+
+
+static void
+gabc_validator_check_cb (GObject      *source_object,
+                         GAsyncResult *result,
+                         gpointer      user_data)
+{
+  GabcValidator *self = GABC_VALIDATOR (source_object);
+  GCancellable *cancellable = g_task_get_cancellable (G_TASK (result));
+  GArray *tunes = g_task_get_task_data (G_TASK (result));
+  gboolean checked;
+  guint i;
+
+  checked = g_task_propagate_boolean (G_TASK (result), NULL);
+
+  if (self->cancellable == cancellable)
+    g_clear_object (&self->cancellable);
+
+  /* The buffer owns the marks, and they went with it if it has gone. */
+  if (self->buffer == NULL)
+    return;
+
+  for (i = 0; i < tunes->len; i++)
+    {
+      validator_tune_t *tune = &g_array_index (tunes, validator_tune_t, i);
+
+      if (checked)
+        gabc_validator_apply_tune (self, tune);
+
+      gtk_text_buffer_delete_mark (self->buffer, tune->start_mark);
+      gtk_text_buffer_delete_mark (self->buffer, tune->end_mark);
+    }
+
+  if (checked && !gtk_source_region_is_empty (self->invalid_region))
+    gabc_validator_queue_update (self, 0);
+}
+
+
+/*
+ * Send the next batch of invalid tunes to a worker thread: the tune at the
+ * cursor, then the tunes from the start of the invalid region.
+ */
+static void
+gabc_validator_start_batch (GabcValidator *self)
+{
+  g_autoptr (GTask) task = NULL;
+  GtkSourceRegionIter region_iter;
+  GtkTextIter cursor;
+  GtkTextIter start;
+  GtkTextIter end;
+  GArray *tunes;
+  gsize bytes = 0;
+  guint position;
+
+  tunes = g_array_new (FALSE, FALSE, sizeof (validator_tune_t));
+  g_array_set_clear_func (tunes, (GDestroyNotify) validator_tune_clear);
+
+  gtk_text_buffer_get_iter_at_mark (self->buffer, &cursor, gtk_text_buffer_get_insert (self->buffer));
+  if (gabc_tune_index_lookup_offset (self->tune_index, gtk_text_iter_get_offset (&cursor), &position))
+    {
+      g_autoptr (GtkSourceRegion) at_cursor = NULL;
+
+      gabc_tune_index_get_tune_bounds (self->tune_index, position, &start, &end);
+      at_cursor = gtk_source_region_intersect_subregion (self->invalid_region, &start, &end);
+      if (at_cursor != NULL && !gtk_source_region_is_empty (at_cursor))
+        bytes += gabc_validator_take_tune (self, tunes, &cursor);
+    }
+
+  while (tunes->len < GABC_VALIDATOR_BATCH_TUNES && bytes < GABC_VALIDATOR_BATCH_BYTES)
+    {
+      gtk_source_region_get_start_region_iter (self->invalid_region, &region_iter);
+      if (!gtk_source_region_iter_get_subregion (&region_iter, &start, NULL))
+        break;
+
+      bytes += gabc_validator_take_tune (self, tunes, &start);
+    }
+
+  if (tunes->len == 0)
+    {
+      g_array_unref (tunes);
+      return;
+    }
+
+  self->cancellable = g_cancellable_new ();
+
+  task = g_task_new (self, self->cancellable, gabc_validator_check_cb, NULL);
+  g_task_set_source_tag (task, gabc_validator_start_batch);
+  g_task_set_task_data (task, tunes, (GDestroyNotify) g_array_unref);
+  g_task_run_in_thread (task, gabc_validator_check_thread);
+}
+
+
+static gboolean
+gabc_validator_update_cb (gpointer user_data)
+{
+  GabcValidator *self = GABC_VALIDATOR (user_data);
+
+  self->source_id = 0;
+  gabc_validator_start_batch (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+/*
+ * Start a batch after delay ms, putting it off again if called before
+ * then.  A batch already running queues the next one when it finishes.
+ */
+static void
+gabc_validator_queue_update (GabcValidator *self,
+                             guint          delay)
+{
+  if (self->cancellable != NULL)
+    return;
+
+  g_clear_handle_id (&self->source_id, g_source_remove);
+  self->source_id = g_timeout_add (delay, gabc_validator_update_cb, self);
+}
+
+
+static void
+gabc_validator_cancel (GabcValidator *self)
+{
+  g_clear_handle_id (&self->source_id, g_source_remove);
+
+  if (self->cancellable != NULL)
+    {
+      g_cancellable_cancel (self->cancellable);
+      g_clear_object (&self->cancellable);
+    }
+}
+
+
+static void
+gabc_validator_dispose (GObject *object)
+{
+  GabcValidator *self = GABC_VALIDATOR (object);
+
+  gabc_validator_cancel (self);
+
+  if (self->buffer != NULL)
+    {
+      g_object_remove_weak_pointer (G_OBJECT (self->buffer), (gpointer *) &self->buffer);
+      self->buffer = NULL;
+    }
+
+  g_clear_object (&self->invalid_region);
+  g_clear_object (&self->tune_index);
+
+  G_OBJECT_CLASS (gabc_validator_parent_class)->dispose (object);
+}
+
+
+static void
+gabc_validator_class_init (GabcValidatorClass *klass)
+{
+  G_OBJECT_CLASS (klass)->dispose = gabc_validator_dispose;
+}
+
+
+static void
+gabc_validator_init (GabcValidator *self)
+{
+}
+
+
+/*
+ * The validator starts disabled.  It keeps a weak reference to buffer,
+ * which would normally own it and must already have the diagnostic tags.
+ */
+GabcValidator *
+gabc_validator_new (GtkSourceBuffer *buffer,
+                    GabcTuneIndex   *tune_index)
+{
+  GabcValidator *self;
+  GtkTextTagTable *table;
+
+  g_return_val_if_fail (GTK_SOURCE_IS_BUFFER (buffer), NULL);
+
+  self = g_object_new (GABC_TYPE_VALIDATOR, NULL);
+  self->buffer = GTK_TEXT_BUFFER (buffer);
+  g_object_add_weak_pointer (G_OBJECT (buffer), (gpointer *) &self->buffer);
+  self->tune_index = g_object_ref (tune_index);
+
+  table = gtk_text_buffer_get_tag_table (self->buffer);
+  self->error_tag = gtk_text_tag_table_lookup (table, GABC_DIAGNOSTIC_TAG_ERROR);
+  self->warning_tag = gtk_text_tag_table_lookup (table, GABC_DIAGNOSTIC_TAG_WARNING);
+  g_return_val_if_fail (self->error_tag != NULL && self->warning_tag != NULL, self);
+
+  self->invalid_region = gtk_source_region_new (self->buffer);
+
+  g_signal_connect_object (tune_index, "tunes-edited",
+                           G_CALLBACK (gabc_validator_tunes_edited_cb),
+                           self, 0);
+
+  return self;
+}
+
+
+/*
+ * Turning the validator on checks the whole buffer in the background;
+ * turning it off removes its marks.
+ */
+void
+gabc_validator_set_enabled (GabcValidator *self,
+                            gboolean       enabled)
+{
+  GtkTextIter start;
+  GtkTextIter end;
+
+  g_return_if_fail (GABC_IS_VALIDATOR (self));
+
+  enabled = !!enabled;
+  if (self->enabled == enabled)
+    return;
+
+  self->enabled = enabled;
+
+  gabc_validator_cancel (self);
+  gtk_text_buffer_get_bounds (self->buffer, &start, &end);
+  g_clear_object (&self->invalid_region);
+  self->invalid_region = gtk_source_region_new (self->buffer);
+
+  if (enabled)
+    {
+      gtk_source_region_add_subregion (self->invalid_region, &start, &end);
+      gabc_validator_queue_update (self, 0);
+    }
+  else
+    {
+      gabc_validator_clear_range (self, &start, &end);
+    }
+}
+
+
+gboolean
+gabc_validator_get_enabled (GabcValidator *self)
+{
+  return self->enabled;
+}
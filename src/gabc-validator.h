@@ -0,0 +1,52 @@
+/* gabc-validator.h
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#pragma once
+
+#include <gtk/gtk.h>
+#include <gtksourceview/gtksource.h>
+
+#include "gabc-tune-index.h"
+
+G_BEGIN_DECLS
+
+/*
+ * GtkSourceMark categories for the validator's problems, kept apart from
+ * the tools' diagnostics so that neither clears the other.
+ */
+#define GABC_VALIDATOR_MARK_ERROR   "gabc-check-error"
+#define GABC_VALIDATOR_MARK_WARNING "gabc-check-warning"
+
+#define GABC_TYPE_VALIDATOR (gabc_validator_get_type())
+
+G_DECLARE_FINAL_TYPE (GabcValidator, gabc_validator, GABC, VALIDATOR, GObject)
+
+GabcValidator            *gabc_validator_new                      (GtkSourceBuffer *buffer,
+                                                                   GabcTuneIndex   *tune_index);
+
+void                      gabc_validator_set_enabled              (GabcValidator *self,
+                                                                   gboolean       enabled);
+
+gboolean                  gabc_validator_get_enabled              (GabcValidator *self);
+
+void                      gabc_validator_invalidate               (GabcValidator     *self,
+                                                                   const GtkTextIter *start,
+                                                                   const GtkTextIter *end);
+
+G_END_DECLS
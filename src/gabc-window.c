@@ -20,10 +20,25 @@
 
 #include "config.h"
 
+#include <glib/gstdio.h>
+#include <string.h>
+
 #include "gabc-window.h"
+#include "gabc-batch.h"
 #include "gabc-log-window.h"
 #include "gabc-save-changes-dialog-private.h"
 #include "gabc-file-filters.h"
+#include "gabc-player.h"
+#include "gabc-engraving-window.h"
+#include "gabc-preview-pane.h"
+#include "gabc-render-cache.h"
+#include "gabc-render-job.h"
+#include "gabc-render-service.h"
+#include "gabc-render-stats.h"
+#include "gabc-search-index.h"
+#include "gabc-tune-outline.h"
+
+#define GABC_WINDOW_MAX_SEARCH_RESULTS 100
 
 struct _GabcWindow
 {
@@ -34,17 +49,63 @@ struct _GabcWindow
         AdwWindowTitle      *window_title;
 	GtkSourceView       *main_text_view;
         GabcTunebook        *tunebook;
+        GabcPreviewPane     *preview_pane;
 
         GabcLogWindow       *log_window;
+        GabcEngravingWindow *engraving_window;
+        gchar               *engraving_key;     /* render cache key of the pages it shows */
+
+        GCancellable        *render_cancellable;
+
+        GabcPlayer          *player;
+
+        GtkRevealer         *progress_revealer;
+        GtkProgressBar      *progress_bar;
+
+        GabcSearchIndex     *search_index;
+        GtkPopover          *search_popover;
+        GtkSearchEntry      *search_entry;
+        GtkListBox          *search_results_list;
+        GtkLabel            *search_status_label;
+        gint                 pending_tune_line;
+
+        GabcTuneOutline     *tune_outline;
+        GtkWidget           *outline_sidebar;
+        GtkSearchEntry      *outline_filter_entry;
+        GtkDropDown         *outline_sort_dropdown;
+        GtkListView         *outline_list_view;
 };
 
 G_DEFINE_FINAL_TYPE (GabcWindow, gabc_window, ADW_TYPE_APPLICATION_WINDOW)
 
 typedef struct {
-  GFile *abc_file;
+  GPtrArray *abc_files;
   GabcWindow *gabc_window;
 } file_cb_data_t;
 
+typedef struct {
+  GabcWindow *gabc_window;
+  GCancellable *cancellable;
+  gchar *output_dir;
+} export_all_cb_data_t;
+
+typedef struct {
+  GabcWindow *gabc_window;
+  GCancellable *cancellable;
+  gchar *abc_file_path;
+  gchar *output_file_path;
+  gchar *output_file_name;
+  gchar *cache_key;
+  const gchar *cache_extension;
+  gboolean succeeded;
+} render_cb_data_t;
+
+/* What abcm2ps writes: PostScript, or SVG, a file per page, for the built-in viewer. */
+typedef enum {
+  ENGRAVING_FORMAT_PS,
+  ENGRAVING_FORMAT_SVG,
+} engraving_format_t;
+
 static gboolean
 gabc_window_close_request (GtkWindow *win);
 
@@ -63,7 +124,7 @@ gabc_window_on_drop (GtkDropTarget *target,
 
 
 static void
-gabc_windows_present_file (GabcWindow *self, GFile *file);
+gabc_windows_present_files (GabcWindow *self, GPtrArray *files);
 
 static void
 gabc_window_open_file_dialog (GSimpleAction *action G_GNUC_UNUSED,
@@ -112,6 +173,11 @@ gabc_window_save_midi_file_dialog_cb (GObject       *file_dialog,
                                  GAsyncResult  *res,
                                  gpointer       user_data);
 
+static void
+gabc_window_export_midi_all_handler (GSimpleAction *action G_GNUC_UNUSED,
+                                     GVariant      *parameter G_GNUC_UNUSED,
+                                     gpointer       user_data);
+
 
 static void
 gabc_window_set_window_title (GabcWindow *self);
@@ -132,11 +198,95 @@ gabc_window_play_file  (GSimpleAction *action G_GNUC_UNUSED,
                         GVariant      *parameter G_GNUC_UNUSED,
                         gpointer       user_data);
 
-gchar *
-gabc_window_write_ps_file (gchar *file_path, GabcWindow *self);
+static void
+gabc_window_engrave_tune (GSimpleAction *action G_GNUC_UNUSED,
+                          GVariant      *parameter G_GNUC_UNUSED,
+                          gpointer       user_data);
+
+static void
+gabc_window_play_tune  (GSimpleAction *action G_GNUC_UNUSED,
+                        GVariant      *parameter G_GNUC_UNUSED,
+                        gpointer       user_data);
+
+static void
+gabc_window_play_from_cursor (GSimpleAction *action G_GNUC_UNUSED,
+                              GVariant      *parameter G_GNUC_UNUSED,
+                              gpointer       user_data);
+
+static void
+gabc_window_loop_selection (GSimpleAction *action G_GNUC_UNUSED,
+                            GVariant      *parameter G_GNUC_UNUSED,
+                            gpointer       user_data);
+
+static void
+gabc_window_stop_playback (GSimpleAction *action G_GNUC_UNUSED,
+                           GVariant      *parameter G_GNUC_UNUSED,
+                           gpointer       user_data);
+
+static void
+gabc_window_find_similar (GSimpleAction *action G_GNUC_UNUSED,
+                          GVariant      *parameter G_GNUC_UNUSED,
+                          gpointer       user_data);
+
+static void
+gabc_window_transpose (GSimpleAction *action G_GNUC_UNUSED,
+                       GVariant      *parameter G_GNUC_UNUSED,
+                       gpointer       user_data);
+
+static gchar *
+gabc_window_write_scratch_file (GabcWindow *self, GabcPreprocessorTarget target, gboolean current_tune_only);
+
+static void
+gabc_window_show_scratch_error (GabcWindow *self, const GError *error);
+
+static gboolean
+gabc_window_get_current_tunes (GabcWindow *self, guint *first, guint *last);
+
+static void
+gabc_window_player_finished_cb (GabcPlayer *player,
+                                GError     *error,
+                                GabcWindow *self);
+
+static void
+gabc_window_cancel_render (GSimpleAction *action G_GNUC_UNUSED,
+                           GVariant      *parameter G_GNUC_UNUSED,
+                           gpointer       user_data);
+
+static void
+gabc_window_cancel_render_job (GabcWindow *self);
+
+static GabcRenderJob *
+gabc_window_new_ps_job (gchar *file_path, gchar *ps_file_path, engraving_format_t format, GabcWindow *self);
+
+static GabcRenderJob *
+gabc_window_new_midi_job (gchar *abc_file_path, gchar *midi_file_path, GabcWindow *self);
+
+static void
+gabc_window_start_render_job (GabcWindow          *self,
+                              GabcRenderJob       *job,
+                              GAsyncReadyCallback  callback,
+                              render_cb_data_t    *cb_data);
+
+static void
+gabc_window_render_job_succeeded (render_cb_data_t *cb_data);
 
 static void
-gabc_window_write_midi_file (gchar *abc_file_path, gchar *midi_file_path, GabcWindow *self, GError **error);
+gabc_window_render_job_done (render_cb_data_t *cb_data);
+
+static gboolean
+gabc_window_midi_job_succeeded (GabcRenderJob *job, GAsyncResult *result, GError **error);
+
+static gboolean
+gabc_window_ps_job_succeeded (GabcRenderJob *job, GAsyncResult *result, GError **error);
+
+static gchar *
+gabc_window_get_ps_cache_key (GabcWindow *self);
+
+static gchar *
+gabc_window_get_midi_cache_key (GabcWindow *self);
+
+static gchar *
+gabc_window_lookup_render_cache (GabcWindow *self, const gchar *key, const gchar *extension);
 
 static void
 gabc_window_play_media_file (gchar *file_path, GabcWindow *self);
@@ -182,7 +332,52 @@ gabc_window_class_init (GabcWindowClass *klass)
                                         GabcWindow,
                                         window_title);
 
+  gtk_widget_class_bind_template_child (widget_class,
+                                        GabcWindow,
+                                        preview_pane);
+
+  gtk_widget_class_bind_template_child (widget_class,
+                                        GabcWindow,
+                                        progress_revealer);
+
+  gtk_widget_class_bind_template_child (widget_class,
+                                        GabcWindow,
+                                        progress_bar);
+
+  gtk_widget_class_bind_template_child (widget_class,
+                                        GabcWindow,
+                                        search_popover);
+
+  gtk_widget_class_bind_template_child (widget_class,
+                                        GabcWindow,
+                                        search_entry);
+
+  gtk_widget_class_bind_template_child (widget_class,
+                                        GabcWindow,
+                                        search_results_list);
+
+  gtk_widget_class_bind_template_child (widget_class,
+                                        GabcWindow,
+                                        search_status_label);
+
+  gtk_widget_class_bind_template_child (widget_class,
+                                        GabcWindow,
+                                        outline_sidebar);
+
+  gtk_widget_class_bind_template_child (widget_class,
+                                        GabcWindow,
+                                        outline_filter_entry);
+
+  gtk_widget_class_bind_template_child (widget_class,
+                                        GabcWindow,
+                                        outline_sort_dropdown);
+
+  gtk_widget_class_bind_template_child (widget_class,
+                                        GabcWindow,
+                                        outline_list_view);
+
   g_type_ensure (GTK_SOURCE_TYPE_VIEW);
+  g_type_ensure (GABC_TYPE_PREVIEW_PANE);
 
 }
 
@@ -191,9 +386,18 @@ static const GActionEntry win_actions[] = {
     { "open-log", gabc_window_open_log_dialog },
     { "play", gabc_window_play_file },
     { "engrave", gabc_window_engrave_file},
+    { "play-tune", gabc_window_play_tune },
+    { "play-from-cursor", gabc_window_play_from_cursor },
+    { "loop-selection", gabc_window_loop_selection },
+    { "stop-playback", gabc_window_stop_playback },
+    { "find-similar", gabc_window_find_similar },
+    { "transpose", gabc_window_transpose },
+    { "engrave-tune", gabc_window_engrave_tune},
+    { "cancel-render", gabc_window_cancel_render},
     { "save", gabc_window_save_file_handler},
     { "save_as", gabc_window_save_file_dialog},
     { "export_midi", gabc_window_export_midi_handler},
+    { "export-midi-all", gabc_window_export_midi_all_handler},
     { "open", gabc_window_open_file_dialog},
     { "new", gabc_window_clear_buffer}
 };
@@ -219,188 +423,787 @@ dark_mode_to_adw_color_scheme (GValue   *value,
 }
 
 
-static void
-gabc_window_init (GabcWindow *self)
+static gchar *
+gabc_window_diagnostic_tooltip_cb (GtkSourceMarkAttributes *attributes,
+                                   GtkSourceMark           *mark,
+                                   gpointer                 user_data)
 {
-  //GtkSourceLanguageManager *lm;
-  //GtkSourceLanguage *language;
-  // gchar *id;
+  return g_strdup (g_object_get_data (G_OBJECT (mark), "gabc-diagnostic-message"));
+}
 
-  AdwStyleManager *sm;
-  GtkDropTarget *target;
 
-  gtk_widget_init_template (GTK_WIDGET (self));
+static void
+gabc_window_setup_diagnostic_marks (GabcWindow *self)
+{
+  GtkSourceMarkAttributes *attributes;
+
+  attributes = gtk_source_mark_attributes_new ();
+  gtk_source_mark_attributes_set_icon_name (attributes, "dialog-error-symbolic");
+  g_signal_connect (attributes, "query-tooltip-text", G_CALLBACK (gabc_window_diagnostic_tooltip_cb), NULL);
+  gtk_source_view_set_mark_attributes (GTK_SOURCE_VIEW (self->main_text_view),
+                                       GABC_TUNEBOOK_MARK_ERROR, attributes, 20);
+  g_object_unref (attributes);
+
+  attributes = gtk_source_mark_attributes_new ();
+  gtk_source_mark_attributes_set_icon_name (attributes, "dialog-warning-symbolic");
+  g_signal_connect (attributes, "query-tooltip-text", G_CALLBACK (gabc_window_diagnostic_tooltip_cb), NULL);
+  gtk_source_view_set_mark_attributes (GTK_SOURCE_VIEW (self->main_text_view),
+                                       GABC_TUNEBOOK_MARK_WARNING, attributes, 10);
+  g_object_unref (attributes);
+
+  /* The validator's, under the tools' own. */
+  attributes = gtk_source_mark_attributes_new ();
+  gtk_source_mark_attributes_set_icon_name (attributes, "dialog-error-symbolic");
+  g_signal_connect (attributes, "query-tooltip-text", G_CALLBACK (gabc_window_diagnostic_tooltip_cb), NULL);
+  gtk_source_view_set_mark_attributes (GTK_SOURCE_VIEW (self->main_text_view),
+                                       GABC_VALIDATOR_MARK_ERROR, attributes, 15);
+  g_object_unref (attributes);
+
+  attributes = gtk_source_mark_attributes_new ();
+  gtk_source_mark_attributes_set_icon_name (attributes, "dialog-warning-symbolic");
+  g_signal_connect (attributes, "query-tooltip-text", G_CALLBACK (gabc_window_diagnostic_tooltip_cb), NULL);
+  gtk_source_view_set_mark_attributes (GTK_SOURCE_VIEW (self->main_text_view),
+                                       GABC_VALIDATOR_MARK_WARNING, attributes, 5);
+  g_object_unref (attributes);
+
+  gtk_source_view_set_show_line_marks (GTK_SOURCE_VIEW (self->main_text_view), TRUE);
+}
 
-  self->settings = g_settings_new ("me.pm.m0dns.gabc");
 
-  target = gtk_drop_target_new (G_TYPE_INVALID, GDK_ACTION_COPY);
+/*
+ * Big files are read in the background; the text stays read only until
+ * they are complete so edits can't land in the middle of the load.
+ */
+static void
+gabc_window_tunebook_load_progress_cb (GabcTunebook *tunebook,
+                                       gdouble       fraction,
+                                       GabcWindow   *self)
+{
+  gtk_text_view_set_editable (GTK_TEXT_VIEW (self->main_text_view), FALSE);
 
-  gtk_drop_target_set_gtypes (target, (GType[1]) { GDK_TYPE_FILE_LIST, }, 1);
+  gtk_progress_bar_set_fraction (self->progress_bar, fraction);
+  gtk_progress_bar_set_text (self->progress_bar, "Loading");
+  gtk_revealer_set_reveal_child (self->progress_revealer, TRUE);
+}
 
-  /*
-   * see https://developer.gnome.org/documentation/tutorials/drag-and-drop.html?highlight=target
-   * for how to handle enter and leave targets.
-   */
-  g_signal_connect (target, "drop", G_CALLBACK (gabc_window_on_drop), self);
-  //g_signal_connect (target, "enter", G_CALLBACK (on_enter), self->main_text_view);
-  //g_signal_connect (target, "leave", G_CALLBACK (on_leave), self->main_text_view);
 
-  gtk_widget_add_controller (GTK_WIDGET (self->main_text_view), GTK_EVENT_CONTROLLER (target));
+static void
+gabc_window_goto_iter (GabcWindow        *self,
+                       const GtkTextIter *iter)
+{
+  GtkTextBuffer *buffer = GTK_TEXT_BUFFER (self->tunebook);
 
-  g_action_map_add_action_entries (G_ACTION_MAP (self),
-	                           win_actions,
-	                           G_N_ELEMENTS (win_actions),
-	                           self);
+  gtk_text_buffer_place_cursor (buffer, iter);
+  gtk_text_view_scroll_to_mark (GTK_TEXT_VIEW (self->main_text_view),
+                                gtk_text_buffer_get_insert (buffer),
+                                0.0, TRUE, 0.0, 0.1);
+  gtk_widget_grab_focus (GTK_WIDGET (self->main_text_view));
+}
 
-  sm = adw_style_manager_get_default();
 
-  g_settings_bind_with_mapping (self->settings, "dark-theme",
-                              sm, "color-scheme",
-                              G_SETTINGS_BIND_GET,
-                              dark_mode_to_adw_color_scheme,
-                              NULL,
-                              NULL,
-                              NULL);
+static void
+gabc_window_goto_line (GabcWindow *self,
+                       gint        line)
+{
+  GtkTextIter iter;
 
-  self->tunebook = gabc_tunebook_new();
-  gtk_text_view_set_buffer (GTK_TEXT_VIEW(self->main_text_view), (GtkTextBuffer *) self->tunebook);
+  gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (self->tunebook), &iter, line);
+  gabc_window_goto_iter (self, &iter);
+}
 
-  gtk_source_buffer_set_highlight_syntax ((GtkSourceBuffer *) self->tunebook, true);
-  gtk_source_view_set_show_line_numbers (GTK_SOURCE_VIEW(self->main_text_view), true);
 
-  self->log_window = gabc_log_window_new ((AdwApplicationWindow *) self);
+static void
+gabc_window_outline_setup_row (GtkSignalListItemFactory *factory,
+                               GtkListItem              *list_item,
+                               gpointer                  user_data)
+{
+  GtkWidget *box;
+  GtkWidget *title_label;
+  GtkWidget *detail_label;
 
-  gtk_widget_grab_focus ( (GtkWidget *) self->main_text_view);
-}
+  box = gtk_box_new (GTK_ORIENTATION_VERTICAL, 2);
 
+  title_label = gtk_label_new (NULL);
+  gtk_label_set_xalign (GTK_LABEL (title_label), 0.0);
+  gtk_label_set_ellipsize (GTK_LABEL (title_label), PANGO_ELLIPSIZE_END);
+  gtk_box_append (GTK_BOX (box), title_label);
 
-static gboolean
-gabc_window_close_request (GtkWindow *window)
-{
-  GabcWindow *self;
-  gboolean gabc_buffer_is_modified;
+  detail_label = gtk_label_new (NULL);
+  gtk_label_set_xalign (GTK_LABEL (detail_label), 0.0);
+  gtk_label_set_ellipsize (GTK_LABEL (detail_label), PANGO_ELLIPSIZE_END);
+  gtk_widget_add_css_class (detail_label, "dim-label");
+  gtk_widget_add_css_class (detail_label, "caption");
+  gtk_box_append (GTK_BOX (box), detail_label);
 
-  self = (GabcWindow *)window;
-  g_assert (GABC_IS_WINDOW (self));
+  gtk_list_item_set_child (list_item, box);
+}
 
-  gabc_buffer_is_modified = gtk_text_buffer_get_modified ( (GtkTextBuffer *) self->tunebook);
-  //g_print ("gabc_window_close_request: self->buffer_is_modified is %s\n", self->buffer_is_modified ? "TRUE" : "FALSE");
-  //g_print ("gabc_window_close_request: gabc_buffer_is_modified is %s\n", gabc_buffer_is_modified ? "TRUE" : "FALSE");
-  if (gabc_tunebook_is_modified(self->tunebook) || gabc_buffer_is_modified)
-    {
-      //g_print ("buffer is modified.\n");
-      _gabc_save_changes_dialog_run_async (GTK_WINDOW (self),
-                                             NULL,
-                                             gabc_window_confirm_cb,
-                                             g_object_ref (self));
-      return TRUE;
-    }
 
-  return GTK_WINDOW_CLASS (gabc_window_parent_class)->close_request (window);
+static void
+gabc_window_outline_bind_row (GtkSignalListItemFactory *factory,
+                              GtkListItem              *list_item,
+                              gpointer                  user_data)
+{
+  GtkWidget *title_label = gtk_widget_get_first_child (gtk_list_item_get_child (list_item));
+  GtkWidget *detail_label = gtk_widget_get_next_sibling (title_label);
+  GabcTuneItem *item = gtk_list_item_get_item (list_item);
+  const gchar *rhythm = gabc_tune_item_get_rhythm (item);
+  const gchar *key = gabc_tune_item_get_key (item);
+  g_autofree gchar *title = NULL;
+  g_autofree gchar *detail = NULL;
+
+  title = g_strdup_printf ("X:%u  %s", gabc_tune_item_get_number (item), gabc_tune_item_get_title (item));
+
+  if (rhythm[0] != '\0' && key[0] != '\0')
+    detail = g_strdup_printf ("%s · %s", rhythm, key);
+  else
+    detail = g_strconcat (rhythm, key, NULL);
 
+  gtk_label_set_text (GTK_LABEL (title_label), title);
+  gtk_label_set_text (GTK_LABEL (detail_label), detail);
+  gtk_widget_set_visible (detail_label, detail[0] != '\0');
 }
 
 
 static void
-gabc_window_confirm_cb (GObject        *object,
-                          GAsyncResult *result,
-                          gpointer      user_data)
+gabc_window_outline_activate_cb (GtkListView *list_view,
+                                 guint        position,
+                                 GabcWindow  *self)
 {
-  g_autoptr(GabcWindow) self = user_data;
-  g_autoptr(GError) error = NULL;
+  g_autoptr (GabcTuneItem) item = NULL;
+  GtkTextMark *start_mark;
+  GtkTextIter iter;
 
-  g_assert (GABC_IS_WINDOW (self));
-  g_assert (G_IS_ASYNC_RESULT (result));
+  item = g_list_model_get_item (G_LIST_MODEL (gtk_list_view_get_model (list_view)), position);
+  if (item == NULL)
+    return;
 
-  if (_gabc_save_changes_dialog_run_finish (result, &error))
-    {
-      //g_print ("gabc_window_confirm_cb: about to destroy the window\n");
-      gtk_window_destroy (GTK_WINDOW (self));
-    }
+  /* The tune may have been edited away since the row was drawn. */
+  start_mark = gabc_tune_item_get_start_mark (item);
+  if (gtk_text_mark_get_deleted (start_mark))
+    return;
+
+  gtk_text_buffer_get_iter_at_mark (GTK_TEXT_BUFFER (self->tunebook), &iter, start_mark);
+  gabc_window_goto_iter (self, &iter);
 }
 
 
 static void
-gabc_window_on_drop_choose (GObject *source_object, GAsyncResult *res, gpointer user_data) {
-  GFile *abc_file;
-  GabcWindow *self;
-  GError *error;
-  int button;
-  GtkAlertDialog *dialog;
-  file_cb_data_t *cb_data;
+gabc_window_outline_filter_changed_cb (GtkSearchEntry *entry,
+                                       GabcWindow     *self)
+{
+  gabc_tune_outline_set_filter (self->tune_outline, gtk_editable_get_text (GTK_EDITABLE (entry)));
+}
 
-  dialog = GTK_ALERT_DIALOG (source_object);
 
-  cb_data = user_data;
-  abc_file = (GFile *) cb_data->abc_file;
+static void
+gabc_window_outline_sort_changed_cb (GtkDropDown *dropdown,
+                                     GParamSpec  *pspec,
+                                     GabcWindow  *self)
+{
+  /* The dropdown lists the orders in GabcTuneOutlineSort order. */
+  gabc_tune_outline_set_sort (self->tune_outline, gtk_drop_down_get_selected (dropdown));
+}
 
-  self = cb_data->gabc_window;
-  g_assert (GABC_IS_WINDOW (self));
-  g_assert (G_IS_FILE (abc_file));
 
-  error = NULL;
-  button = gtk_alert_dialog_choose_finish (dialog, res, &error);
+static void
+gabc_window_setup_outline (GabcWindow *self)
+{
+  GtkListItemFactory *factory;
+  GtkSelectionModel *selection;
+  GAction *outline_action;
+
+  self->tune_outline = gabc_tune_outline_new (gabc_tunebook_get_tune_index (self->tunebook));
+
+  /* Only the rows on screen ever have widgets. */
+  factory = gtk_signal_list_item_factory_new ();
+  g_signal_connect (factory, "setup", G_CALLBACK (gabc_window_outline_setup_row), NULL);
+  g_signal_connect (factory, "bind", G_CALLBACK (gabc_window_outline_bind_row), NULL);
+  gtk_list_view_set_factory (self->outline_list_view, factory);
+  g_object_unref (factory);
+
+  selection = GTK_SELECTION_MODEL (gtk_no_selection_new (g_object_ref (G_LIST_MODEL (self->tune_outline))));
+  gtk_list_view_set_model (self->outline_list_view, selection);
+  g_object_unref (selection);
+
+  g_signal_connect (self->outline_list_view, "activate",
+                    G_CALLBACK (gabc_window_outline_activate_cb), self);
+  g_signal_connect (self->outline_filter_entry, "search-changed",
+                    G_CALLBACK (gabc_window_outline_filter_changed_cb), self);
+  g_signal_connect (self->outline_sort_dropdown, "notify::selected",
+                    G_CALLBACK (gabc_window_outline_sort_changed_cb), self);
+
+  outline_action = g_settings_create_action (self->settings, "show-outline");
+  g_action_map_add_action (G_ACTION_MAP (self), outline_action);
+  g_object_unref (outline_action);
+
+  g_settings_bind (self->settings, "show-outline",
+                   self->outline_sidebar, "visible",
+                   G_SETTINGS_BIND_GET);
+}
 
-  if (error) {
-    gabc_log_window_append_to_log (self->log_window, error->message);
-    g_clear_error (&error);
-    return;
-  }
 
-  if (button == 0) // Cancel
+static void
+gabc_window_tunebook_loaded_cb (GabcTunebook *tunebook,
+                                GabcWindow   *self)
+{
+  if (!gtk_text_view_get_editable (GTK_TEXT_VIEW (self->main_text_view)))
     {
-      return;
+      gtk_text_view_set_editable (GTK_TEXT_VIEW (self->main_text_view), TRUE);
+      gtk_revealer_set_reveal_child (self->progress_revealer, FALSE);
     }
-  else if (button == 1) // New
+
+  /* A search result opened the file; now its line exists. */
+  if (self->pending_tune_line >= 0)
     {
-      gabc_tunebook_open_file (self->tunebook, abc_file);
-      //TODO the following two lines should be in a callback
-      gtk_widget_grab_focus (GTK_WIDGET (self->main_text_view));
-      gabc_window_set_window_title (self);
+      gabc_window_goto_line (self, self->pending_tune_line);
+      self->pending_tune_line = -1;
     }
-  else if (button == 2) // Append
+}
+
+
+/*
+ * Replace the rows in the search popover with results, which the rows
+ * take over.
+ */
+static void
+gabc_window_search_show_results (GabcWindow  *self,
+                                 GPtrArray   *results,
+                                 const gchar *status)
+{
+  guint i;
+
+  gtk_list_box_remove_all (self->search_results_list);
+
+  g_ptr_array_set_free_func (results, NULL);
+
+  for (i = 0; i < results->len; i++)
     {
-      gabc_tunebook_append_file (self->tunebook, abc_file);
+      GabcSearchResult *result = g_ptr_array_index (results, i);
+      g_autofree gchar *basename = g_path_get_basename (result->path);
+      g_autofree gchar *subtitle = NULL;
+      GString *details;
+      AdwActionRow *row;
+
+      details = g_string_new (NULL);
+      g_string_append_printf (details, "X:%u", result->number);
+      if (result->similarity > 0)
+        g_string_append_printf (details, " · %.0f%%", result->similarity * 100);
+      if (result->rhythm[0] != '\0')
+        g_string_append_printf (details, " · %s", result->rhythm);
+      if (result->key[0] != '\0')
+        g_string_append_printf (details, " · %s", result->key);
+      g_string_append_printf (details, " · %s", basename);
+      subtitle = g_string_free (details, FALSE);
+
+      row = ADW_ACTION_ROW (adw_action_row_new ());
+      adw_preferences_row_set_use_markup (ADW_PREFERENCES_ROW (row), FALSE);
+      adw_preferences_row_set_title (ADW_PREFERENCES_ROW (row),
+                                     result->title[0] != '\0' ? result->title : "Untitled");
+      adw_action_row_set_subtitle (row, subtitle);
+      gtk_list_box_row_set_activatable (GTK_LIST_BOX_ROW (row), TRUE);
+
+      g_object_set_data_full (G_OBJECT (row), "gabc-search-result",
+                              result, (GDestroyNotify) gabc_search_result_free);
+
+      gtk_list_box_append (self->search_results_list, GTK_WIDGET (row));
     }
+
+  gtk_label_set_text (self->search_status_label, status);
+}
+
+
+static void
+gabc_window_search_update_results (GabcWindow *self)
+{
+  g_autoptr (GPtrArray) results = NULL;
+  g_autofree gchar *status = NULL;
+  const gchar *query;
+
+  query = gtk_editable_get_text (GTK_EDITABLE (self->search_entry));
+  results = gabc_search_index_search (self->search_index, query, GABC_WINDOW_MAX_SEARCH_RESULTS);
+
+  if (gabc_search_index_is_updating (self->search_index))
+    status = g_strdup ("Indexing");
+  else if (query[0] == '\0')
+    status = g_strdup_printf ("%u tunes indexed", gabc_search_index_get_n_tunes (self->search_index));
+  else if (results->len == GABC_WINDOW_MAX_SEARCH_RESULTS)
+    status = g_strdup_printf ("First %u matches", results->len);
   else
-    g_assert_not_reached();
+    status = g_strdup_printf ("%u matches", results->len);
 
-  g_free(cb_data);
-  g_object_unref (dialog);
+  gabc_window_search_show_results (self, results, status);
 }
 
 
 static void
-gabc_window_open_drop_action_dialog (GabcWindow *self, GFile *abc_file)
+gabc_window_search_changed_cb (GtkSearchEntry *entry,
+                               GabcWindow     *self)
 {
-  GtkAlertDialog *dialog;
-  file_cb_data_t *user_data;
-  const char* buttons[] = {"Cancel", "New", "Append", NULL};
-  g_assert (GABC_IS_WINDOW (self));
-  g_assert (G_IS_FILE (abc_file));
-  dialog = gtk_alert_dialog_new ("Open File");
+  gabc_window_search_update_results (self);
+}
 
-  gtk_alert_dialog_set_detail (dialog, "Start a new file for or append to existing tune?");
-  gtk_alert_dialog_set_buttons (dialog, buttons);
-  gtk_alert_dialog_set_cancel_button (dialog, 0);
-  gtk_alert_dialog_set_default_button (dialog, 2);
 
-  user_data = g_new0(file_cb_data_t, 1);
-  user_data->abc_file = abc_file;
-  user_data->gabc_window = self;
-  gtk_alert_dialog_choose (dialog, GTK_WINDOW (self), NULL, gabc_window_on_drop_choose, user_data);
+static void
+gabc_window_search_index_updated_cb (GabcSearchIndex *search_index,
+                                     GabcWindow      *self)
+{
+  gabc_window_search_update_results (self);
 }
 
+
 static void
-gabc_windows_present_file (GabcWindow *self, GFile *file) {
-  if ( gabc_tunebook_is_empty(self->tunebook) ) {
-    gabc_tunebook_open_file (self->tunebook, file);
-    //TODO the following two lines should be in a callback
-    gtk_widget_grab_focus (GTK_WIDGET (self->main_text_view));
-    gabc_window_set_window_title (self);
-  } else {
-    gabc_window_open_drop_action_dialog (self, file);
-  }
+gabc_window_search_directories_changed_cb (GSettings   *settings,
+                                           const gchar *key,
+                                           GabcWindow  *self)
+{
+  g_auto (GStrv) directories = g_settings_get_strv (settings, key);
+
+  gabc_search_index_set_directories (self->search_index, (const gchar * const *) directories);
+  gabc_window_search_update_results (self);
+}
+
+
+/*
+ * Look for tunes that go like the selection, or like the tune under the
+ * cursor when nothing is selected, and list them in the search popover.
+ * The tune itself is left out when its file is indexed.
+ */
+static void
+gabc_window_find_similar (GSimpleAction *action G_GNUC_UNUSED,
+                          GVariant      *parameter G_GNUC_UNUSED,
+                          gpointer       user_data)
+{
+  GabcWindow *self = GABC_WINDOW (user_data);
+  GtkTextBuffer *buffer = GTK_TEXT_BUFFER (self->tunebook);
+  GabcTuneIndex *tune_index = gabc_tunebook_get_tune_index (self->tunebook);
+  g_autoptr (GPtrArray) results = NULL;
+  g_autofree gchar *status = NULL;
+  g_autofree gchar *text = NULL;
+  g_autofree gchar *path = NULL;
+  const gchar *key = NULL;
+  GFile *location;
+  GabcMelody melody;
+  GtkTextIter start;
+  GtkTextIter end;
+  gint tune_line = -1;
+  guint position;
+  guint i;
+
+  if (gtk_text_buffer_get_selection_bounds (buffer, &start, &end))
+    {
+      if (gabc_tune_index_lookup_offset (tune_index, gtk_text_iter_get_offset (&start), &position))
+        key = gabc_tune_index_get_tune (tune_index, position)->key;
+    }
+  else if (gabc_tune_index_lookup_offset (tune_index, gtk_text_iter_get_offset (&start), &position))
+    {
+      /* The whole tune, header and all, so its K: field is read too. */
+      gabc_tune_index_get_tune_bounds (tune_index, position, &start, &end);
+    }
+
+  if (gabc_tune_index_lookup_offset (tune_index, gtk_text_iter_get_offset (&start), &position))
+    {
+      GtkTextIter tune_start;
+
+      gtk_text_buffer_get_iter_at_mark (buffer, &tune_start,
+                                        gabc_tune_index_get_tune (tune_index, position)->start_mark);
+      tune_line = gtk_text_iter_get_line (&tune_start);
+    }
+
+  gabc_melody_init (&melody, key);
+  text = gtk_text_buffer_get_text (buffer, &start, &end, FALSE);
+  gabc_melody_add_text (&melody, text, -1);
+
+  results = gabc_search_index_find_similar (self->search_index, &melody, GABC_WINDOW_MAX_SEARCH_RESULTS + 1);
+
+  location = gtk_source_file_get_location (gabc_tunebook_get_abc_source_file (self->tunebook));
+  path = (location != NULL) ? g_file_get_path (location) : NULL;
+  for (i = 0; i < results->len; i++)
+    {
+      GabcSearchResult *result = g_ptr_array_index (results, i);
+
+      if (g_strcmp0 (result->path, path) == 0 && (gint) result->line == tune_line)
+        {
+          g_ptr_array_remove_index (results, i);
+          break;
+        }
+    }
+  if (results->len > GABC_WINDOW_MAX_SEARCH_RESULTS)
+    g_ptr_array_set_size (results, GABC_WINDOW_MAX_SEARCH_RESULTS);
+
+  if (melody.n_intervals < GABC_MELODY_NGRAM)
+    status = g_strdup ("Select a few bars to find tunes like them");
+  else if (gabc_search_index_get_n_tunes (self->search_index) == 0)
+    status = g_strdup ("Add tune search folders in the preferences");
+  else
+    status = g_strdup_printf ("%u similar tunes", results->len);
+
+  gabc_window_search_show_results (self, results, status);
+  gtk_popover_popup (self->search_popover);
+}
+
+
+static void
+gabc_window_transpose_response_cb (AdwAlertDialog *dialog,
+                                   const char     *response,
+                                   GabcWindow     *self)
+{
+  GtkSpinButton *semitones_button = g_object_get_data (G_OBJECT (dialog), "semitones-button");
+  GabcTuneIndex *tune_index = gabc_tunebook_get_tune_index (self->tunebook);
+  gint semitones = gtk_spin_button_get_value_as_int (semitones_button);
+  g_autofree gchar *message = NULL;
+  gint64 start_time;
+  guint n_changed;
+  guint first;
+  guint last;
+
+  if (!g_strcmp0 (response, "book"))
+    {
+      first = 0;
+      last = gabc_tune_index_get_n_tunes (tune_index) - 1;
+    }
+  else if (g_strcmp0 (response, "tunes") || !gabc_window_get_current_tunes (self, &first, &last))
+    {
+      return;
+    }
+
+  start_time = g_get_monotonic_time ();
+  n_changed = gabc_tunebook_transpose (self->tunebook, first, last, semitones);
+  message = g_strdup_printf ("Transposed %u of %u tunes by %+d semitones in %.1f ms",
+                             n_changed, last - first + 1, semitones,
+                             (g_get_monotonic_time () - start_time) / 1000.0);
+  gabc_log_window_append_to_log (self->log_window, message);
+}
+
+
+/*
+ * Ask how far to move, then transpose the tunes under the cursor or the
+ * selection, or the whole book.  The tunebook does the edits as one user
+ * action, so a single undo puts everything back.
+ */
+static void
+gabc_window_transpose (GSimpleAction *action G_GNUC_UNUSED,
+                       GVariant      *parameter G_GNUC_UNUSED,
+                       gpointer       user_data)
+{
+  GabcWindow *self = GABC_WINDOW (user_data);
+  GabcTuneIndex *tune_index = gabc_tunebook_get_tune_index (self->tunebook);
+  GtkWidget *semitones_button;
+  AdwDialog *dialog;
+  guint first;
+  guint last;
+
+  if (gabc_tune_index_get_n_tunes (tune_index) == 0)
+    return;
+
+  dialog = adw_alert_dialog_new ("Transpose",
+                                 "Move notes, chord symbols and keys by this many semitones.");
+  adw_alert_dialog_add_responses (ADW_ALERT_DIALOG (dialog),
+                                  "cancel", "Cancel",
+                                  "book", "Whole Book",
+                                  "tunes", "Current Tunes",
+                                  NULL);
+  adw_alert_dialog_set_response_appearance (ADW_ALERT_DIALOG (dialog),
+                                            "tunes", ADW_RESPONSE_SUGGESTED);
+  adw_alert_dialog_set_response_enabled (ADW_ALERT_DIALOG (dialog), "tunes",
+                                         gabc_window_get_current_tunes (self, &first, &last));
+  adw_alert_dialog_set_default_response (ADW_ALERT_DIALOG (dialog), "tunes");
+  adw_alert_dialog_set_close_response (ADW_ALERT_DIALOG (dialog), "cancel");
+
+  semitones_button = gtk_spin_button_new_with_range (-24, 24, 1);
+  gtk_spin_button_set_value (GTK_SPIN_BUTTON (semitones_button), 2);
+  gtk_widget_set_halign (semitones_button, GTK_ALIGN_CENTER);
+  adw_alert_dialog_set_extra_child (ADW_ALERT_DIALOG (dialog), semitones_button);
+  g_object_set_data (G_OBJECT (dialog), "semitones-button", semitones_button);
+
+  g_signal_connect (dialog, "response", G_CALLBACK (gabc_window_transpose_response_cb), self);
+  adw_dialog_present (dialog, GTK_WIDGET (self));
+}
+
+
+/*
+ * Jump straight to the tune if its file is the one being edited, otherwise
+ * open the file like a drop would and jump once it has loaded.
+ */
+static void
+gabc_window_search_row_activated_cb (GtkListBox    *list,
+                                     GtkListBoxRow *row,
+                                     GabcWindow    *self)
+{
+  GabcSearchResult *result;
+  GFile *location;
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (GPtrArray) files = NULL;
+
+  result = g_object_get_data (G_OBJECT (row), "gabc-search-result");
+  if (result == NULL)
+    return;
+
+  gtk_popover_popdown (self->search_popover);
+
+  file = g_file_new_for_path (result->path);
+  location = gtk_source_file_get_location (gabc_tunebook_get_abc_source_file (self->tunebook));
+
+  if (location != NULL && g_file_equal (location, file))
+    {
+      gabc_window_goto_line (self, result->line);
+      return;
+    }
+
+  self->pending_tune_line = result->line;
+
+  files = g_ptr_array_new_with_free_func (g_object_unref);
+  g_ptr_array_add (files, g_steal_pointer (&file));
+  gabc_windows_present_files (self, files);
+}
+
+
+static void
+gabc_window_init (GabcWindow *self)
+{
+  //GtkSourceLanguageManager *lm;
+  //GtkSourceLanguage *language;
+  // gchar *id;
+
+  AdwStyleManager *sm;
+  GtkDropTarget *target;
+  GAction *preview_action;
+
+  gtk_widget_init_template (GTK_WIDGET (self));
+
+  self->settings = g_settings_new ("me.pm.m0dns.gabc");
+
+  target = gtk_drop_target_new (G_TYPE_INVALID, GDK_ACTION_COPY);
+
+  gtk_drop_target_set_gtypes (target, (GType[1]) { GDK_TYPE_FILE_LIST, }, 1);
+
+  /*
+   * see https://developer.gnome.org/documentation/tutorials/drag-and-drop.html?highlight=target
+   * for how to handle enter and leave targets.
+   */
+  g_signal_connect (target, "drop", G_CALLBACK (gabc_window_on_drop), self);
+  //g_signal_connect (target, "enter", G_CALLBACK (on_enter), self->main_text_view);
+  //g_signal_connect (target, "leave", G_CALLBACK (on_leave), self->main_text_view);
+
+  gtk_widget_add_controller (GTK_WIDGET (self->main_text_view), GTK_EVENT_CONTROLLER (target));
+
+  g_action_map_add_action_entries (G_ACTION_MAP (self),
+	                           win_actions,
+	                           G_N_ELEMENTS (win_actions),
+	                           self);
+
+  sm = adw_style_manager_get_default();
+
+  g_settings_bind_with_mapping (self->settings, "dark-theme",
+                              sm, "color-scheme",
+                              G_SETTINGS_BIND_GET,
+                              dark_mode_to_adw_color_scheme,
+                              NULL,
+                              NULL,
+                              NULL);
+
+  self->tunebook = gabc_tunebook_new();
+  gtk_text_view_set_buffer (GTK_TEXT_VIEW(self->main_text_view), (GtkTextBuffer *) self->tunebook);
+
+  gtk_source_view_set_show_line_numbers (GTK_SOURCE_VIEW(self->main_text_view), true);
+
+  gabc_preview_pane_set_tunebook (self->preview_pane, self->tunebook);
+
+  g_signal_connect_object (self->tunebook, "load-progress",
+                           G_CALLBACK (gabc_window_tunebook_load_progress_cb), self, 0);
+  g_signal_connect_object (self->tunebook, "loaded",
+                           G_CALLBACK (gabc_window_tunebook_loaded_cb), self, 0);
+
+  gabc_window_setup_diagnostic_marks (self);
+  gabc_window_setup_outline (self);
+
+  self->pending_tune_line = -1;
+  self->search_index = g_object_ref (gabc_search_index_get_default ());
+  g_signal_connect_object (self->search_index, "updated",
+                           G_CALLBACK (gabc_window_search_index_updated_cb), self, 0);
+  g_signal_connect (self->settings, "changed::search-directories",
+                    G_CALLBACK (gabc_window_search_directories_changed_cb), self);
+  gabc_window_search_directories_changed_cb (self->settings, "search-directories", self);
+  g_signal_connect (self->search_entry, "search-changed",
+                    G_CALLBACK (gabc_window_search_changed_cb), self);
+  g_signal_connect (self->search_results_list, "row-activated",
+                    G_CALLBACK (gabc_window_search_row_activated_cb), self);
+
+  preview_action = g_settings_create_action (self->settings, "show-preview");
+  g_action_map_add_action (G_ACTION_MAP (self), preview_action);
+  g_object_unref (preview_action);
+
+  g_settings_bind (self->settings, "show-preview",
+                   self->preview_pane, "visible",
+                   G_SETTINGS_BIND_GET);
+
+  self->log_window = gabc_log_window_new ((AdwApplicationWindow *) self);
+  self->engraving_window = gabc_engraving_window_new (GTK_WINDOW (self));
+
+  g_signal_connect_object (gabc_render_service_get_default (), "job-finished",
+                           G_CALLBACK (gabc_window_render_job_finished_cb), self, 0);
+
+  g_simple_action_set_enabled (G_SIMPLE_ACTION (g_action_map_lookup_action (G_ACTION_MAP (self), "cancel-render")),
+                               FALSE);
+
+  self->player = gabc_player_new ();
+  g_signal_connect (self->player, "finished",
+                    G_CALLBACK (gabc_window_player_finished_cb), self);
+  g_simple_action_set_enabled (G_SIMPLE_ACTION (g_action_map_lookup_action (G_ACTION_MAP (self), "stop-playback")),
+                               FALSE);
+
+  gtk_widget_grab_focus ( (GtkWidget *) self->main_text_view);
+}
+
+
+static gboolean
+gabc_window_close_request (GtkWindow *window)
+{
+  GabcWindow *self;
+  gboolean gabc_buffer_is_modified;
+
+  self = (GabcWindow *)window;
+  g_assert (GABC_IS_WINDOW (self));
+
+  gabc_buffer_is_modified = gtk_text_buffer_get_modified ( (GtkTextBuffer *) self->tunebook);
+  //g_print ("gabc_window_close_request: self->buffer_is_modified is %s\n", self->buffer_is_modified ? "TRUE" : "FALSE");
+  //g_print ("gabc_window_close_request: gabc_buffer_is_modified is %s\n", gabc_buffer_is_modified ? "TRUE" : "FALSE");
+  if (gabc_tunebook_is_modified(self->tunebook) || gabc_buffer_is_modified)
+    {
+      //g_print ("buffer is modified.\n");
+      _gabc_save_changes_dialog_run_async (GTK_WINDOW (self),
+                                             NULL,
+                                             gabc_window_confirm_cb,
+                                             g_object_ref (self));
+      return TRUE;
+    }
+
+  return GTK_WINDOW_CLASS (gabc_window_parent_class)->close_request (window);
+
+}
+
+
+static void
+gabc_window_confirm_cb (GObject        *object,
+                          GAsyncResult *result,
+                          gpointer      user_data)
+{
+  g_autoptr(GabcWindow) self = user_data;
+  g_autoptr(GError) error = NULL;
+
+  g_assert (GABC_IS_WINDOW (self));
+  g_assert (G_IS_ASYNC_RESULT (result));
+
+  if (_gabc_save_changes_dialog_run_finish (result, &error))
+    {
+      //g_print ("gabc_window_confirm_cb: about to destroy the window\n");
+      gtk_window_destroy (GTK_WINDOW (self));
+    }
+}
+
+
+/*
+ * Opens a single file; several files are appended in order to a new book.
+ */
+static void
+gabc_window_open_files (GabcWindow *self, GPtrArray *abc_files)
+{
+  if (abc_files->len == 1)
+    {
+      gabc_tunebook_open_file (self->tunebook, g_ptr_array_index (abc_files, 0));
+    }
+  else
+    {
+      gabc_tunebook_clear (self->tunebook);
+      gabc_tunebook_append_files (self->tunebook, (GFile **) abc_files->pdata, abc_files->len);
+    }
+
+  //TODO the following two lines should be in a callback
+  gtk_widget_grab_focus (GTK_WIDGET (self->main_text_view));
+  gabc_window_set_window_title (self);
+}
+
+
+static void
+gabc_window_on_drop_choose (GObject *source_object, GAsyncResult *res, gpointer user_data) {
+  GPtrArray *abc_files;
+  GabcWindow *self;
+  GError *error;
+  int button;
+  GtkAlertDialog *dialog;
+  file_cb_data_t *cb_data;
+
+  dialog = GTK_ALERT_DIALOG (source_object);
+
+  cb_data = user_data;
+  abc_files = cb_data->abc_files;
+
+  self = cb_data->gabc_window;
+  g_assert (GABC_IS_WINDOW (self));
+
+  error = NULL;
+  button = gtk_alert_dialog_choose_finish (dialog, res, &error);
+
+  if (error) {
+    gabc_log_window_append_to_log (self->log_window, error->message);
+    g_clear_error (&error);
+    self->pending_tune_line = -1;
+  }
+  else if (button == 0) // Cancel
+    {
+      self->pending_tune_line = -1;
+    }
+  else if (button == 1) // New
+    {
+      gabc_window_open_files (self, abc_files);
+    }
+  else if (button == 2) // Append
+    {
+      self->pending_tune_line = -1;
+      gabc_tunebook_append_files (self->tunebook, (GFile **) abc_files->pdata, abc_files->len);
+    }
+  else
+    g_assert_not_reached();
+
+  g_ptr_array_unref (abc_files);
+  g_free(cb_data);
+  g_object_unref (dialog);
+}
+
+
+static void
+gabc_window_open_drop_action_dialog (GabcWindow *self, GPtrArray *abc_files)
+{
+  GtkAlertDialog *dialog;
+  file_cb_data_t *user_data;
+  const char* buttons[] = {"Cancel", "New", "Append", NULL};
+  g_assert (GABC_IS_WINDOW (self));
+  dialog = gtk_alert_dialog_new (abc_files->len == 1 ? "Open File" : "Open Files");
+
+  if (abc_files->len == 1)
+    gtk_alert_dialog_set_detail (dialog, "Start a new file for or append to existing tune?");
+  else
+    gtk_alert_dialog_set_detail (dialog, "Start a new file from or append the files to existing tunes?");
+  gtk_alert_dialog_set_buttons (dialog, buttons);
+  gtk_alert_dialog_set_cancel_button (dialog, 0);
+  gtk_alert_dialog_set_default_button (dialog, 2);
+
+  user_data = g_new0(file_cb_data_t, 1);
+  user_data->abc_files = g_ptr_array_ref (abc_files);
+  user_data->gabc_window = self;
+  gtk_alert_dialog_choose (dialog, GTK_WINDOW (self), NULL, gabc_window_on_drop_choose, user_data);
+}
+
+static void
+gabc_windows_present_files (GabcWindow *self, GPtrArray *files) {
+  if (files->len == 0)
+    return;
+
+  if ( gabc_tunebook_is_empty(self->tunebook) ) {
+    gabc_window_open_files (self, files);
+  } else {
+    gabc_window_open_drop_action_dialog (self, files);
+  }
 }
 
 
@@ -413,371 +1216,1121 @@ gabc_window_on_drop (GtkDropTarget *target,
 {
   GdkFileList *file_list;
   GSList *list;
-  GFile *file;
+  GSList *l;
+  g_autoptr (GPtrArray) files = NULL;
 
   GabcWindow *self = data;
 
-  g_assert (GABC_IS_WINDOW (self));
+  g_assert (GABC_IS_WINDOW (self));
+
+  file_list = g_value_get_boxed (value);
+
+  list = gdk_file_list_get_files (file_list);
+
+  files = g_ptr_array_new_with_free_func (g_object_unref);
+  for (l = list; l != NULL; l = l->next)
+    {
+      g_assert (G_IS_FILE (l->data));
+      g_ptr_array_add (files, g_object_ref (l->data));
+    }
+
+  gabc_windows_present_files(self, files);
+  g_slist_free (list);
+
+  return TRUE;
+}
+
+
+static void
+gabc_window_dispose (GObject *object)
+{
+  GabcWindow *win;
+
+  win = GABC_WINDOW (object);
+
+  if (win->render_cancellable != NULL)
+    g_cancellable_cancel (win->render_cancellable);
+  g_clear_object (&win->render_cancellable);
+
+  if (win->player != NULL)
+    g_signal_handlers_disconnect_by_data (win->player, win);
+  g_clear_object (&win->player);
+
+  g_clear_object (&win->settings);
+
+  g_clear_object (&win->search_index);
+
+  g_clear_object (&win->tune_outline);
+
+  g_clear_object (&win->tunebook);
+
+  g_clear_pointer (&win->engraving_key, g_free);
+
+  G_OBJECT_CLASS (gabc_window_parent_class)->dispose (object);
+}
+
+GabcWindow *
+gabc_window_new (GabcApplication *app)
+{
+  return g_object_new (GABC_TYPE_WINDOW, "application", app, NULL);
+}
+
+
+static void
+gabc_window_clear_buffer (GSimpleAction *action G_GNUC_UNUSED,
+                          GVariant      *parameter G_GNUC_UNUSED,
+                          gpointer       user_data)
+{
+  GabcWindow *self = GABC_WINDOW (user_data);
+  gabc_tunebook_clear(self->tunebook);
+  gabc_window_set_window_title (self);
+}
+
+
+static void
+gabc_window_save_midi_file_dialog (GSimpleAction *action G_GNUC_UNUSED,
+                              GVariant      *parameter G_GNUC_UNUSED,
+                              gpointer       user_data)
+{
+  GtkFileDialog *gfd;
+  GtkFileFilter *midi_filter;
+  GListStore *filter_list;
+
+  GabcWindow *self = user_data;
+
+  gfd = gtk_file_dialog_new ();
+  gtk_file_dialog_set_title (gfd, "Export MIDI File");
+
+  midi_filter = gabc_file_filters_get_midi_file_filter();
+  filter_list = gabc_file_filters_get_filter_list(midi_filter);
+
+  gtk_file_dialog_set_filters (gfd, G_LIST_MODEL (filter_list));
+  gtk_file_dialog_set_default_filter (gfd, midi_filter);
+  gtk_file_dialog_set_initial_name ( gfd, "export.mid");
+
+  gtk_file_dialog_save (gfd,
+                        GTK_WINDOW (self),
+                        NULL,
+                        gabc_window_save_midi_file_dialog_cb,
+                        G_OBJECT (self));
+  g_object_unref (midi_filter);
+  g_object_unref (filter_list);
+}
+
+
+static void
+gabc_window_export_midi_job_cb (GObject       *source_object,
+                                GAsyncResult  *result,
+                                gpointer       user_data)
+{
+  render_cb_data_t *cb_data = user_data;
+  GabcWindow *self = cb_data->gabc_window;
+  GtkAlertDialog *alert_dialog;
+  g_autoptr (GError) err = NULL;
+
+  const gint dialog_str_buf_len = 50;
+  gchar dialog_str_buf[dialog_str_buf_len];
+
+  if (!gabc_window_midi_job_succeeded (GABC_RENDER_JOB (source_object), result, &err)
+      && g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      gabc_window_render_job_done (cb_data);
+      return;
+    }
+
+  if (err != NULL)
+    {
+      gabc_log_window_append_to_log (self->log_window, err->message);
+      g_snprintf (dialog_str_buf, dialog_str_buf_len, "Error writing midi file.  See log for details.");
+    }
+  else
+    {
+      g_snprintf (dialog_str_buf, dialog_str_buf_len, "Written midi file: %s", cb_data->output_file_name);
+    }
+
+  alert_dialog = gtk_alert_dialog_new ("%s", dialog_str_buf);
+  gtk_alert_dialog_show (alert_dialog, GTK_WINDOW (self));
+  g_object_unref (alert_dialog);
+
+  gabc_window_render_job_done (cb_data);
+}
+
+
+static void
+gabc_window_save_midi_file_dialog_cb (GObject       *file_dialog,
+                                 GAsyncResult  *res,
+                                 gpointer       user_data)
+{
+  GabcWindow *self = user_data;
+  GabcRenderJob *job;
+  render_cb_data_t *cb_data;
+
+  g_autoptr (GFile) midi_file = gtk_file_dialog_save_finish (GTK_FILE_DIALOG (file_dialog),
+                                                        res,
+                                                        NULL);
+  if (midi_file) {
+    g_autofree gchar *abc_file_path = NULL;
+
+    gabc_window_cancel_render_job (self);
+
+    abc_file_path = gabc_window_write_scratch_file (self, GABC_PREPROCESSOR_TARGET_ABC2MIDI, FALSE);
+    if (abc_file_path == NULL)
+      {
+        g_object_unref (file_dialog);
+        return;
+      }
+
+    cb_data = g_new0 (render_cb_data_t, 1);
+    cb_data->output_file_path = g_file_get_path (midi_file);
+    cb_data->output_file_name = g_file_get_basename (midi_file);
+    cb_data->abc_file_path = g_steal_pointer (&abc_file_path);
+
+    job = gabc_window_new_midi_job (cb_data->abc_file_path, cb_data->output_file_path, self);
+    gabc_window_start_render_job (self, job, gabc_window_export_midi_job_cb, cb_data);
+    g_object_unref (job);
+  }
+  g_object_unref (file_dialog);
+}
+
+
+static void
+gabc_window_open_file_dialog (GSimpleAction *action G_GNUC_UNUSED,
+                              GVariant      *parameter G_GNUC_UNUSED,
+                              gpointer       user_data)
+{
+  GtkFileDialog *gfd;
+  GtkFileFilter *abc_filter;
+  GListStore *filter_list;
+
+  GabcWindow *self = user_data;
+  gfd = gtk_file_dialog_new ();
+  gtk_file_dialog_set_title ( gfd, "Open abc File");
+
+  abc_filter = gabc_file_filters_get_abc_file_filter();
+  filter_list = gabc_file_filters_get_filter_list(abc_filter);
+
+  gtk_file_dialog_set_filters (gfd, G_LIST_MODEL (filter_list));
+  gtk_file_dialog_set_default_filter (gfd, abc_filter);
+
+  gtk_file_dialog_open_multiple (gfd,
+                                 GTK_WINDOW (self),
+                                 NULL,
+                                 gabc_window_file_open_cb,
+                                 G_OBJECT (self));
+
+  g_object_unref (abc_filter);
+  g_object_unref (filter_list);
+}
+
+
+static void
+gabc_window_file_open_cb (GObject       *file_dialog,
+              GAsyncResult  *res,
+              gpointer       user_data)
+{
+  GabcWindow *self;
+  g_autoptr (GListModel) file_list = gtk_file_dialog_open_multiple_finish (GTK_FILE_DIALOG (file_dialog),
+                                                                         res,
+                                                                         NULL);
+  g_autoptr (GPtrArray) files = NULL;
+  guint i;
+
+  self = (GabcWindow *) user_data;
+  if (file_list) {
+    files = g_ptr_array_new_with_free_func (g_object_unref);
+    for (i = 0; i < g_list_model_get_n_items (file_list); i++)
+      g_ptr_array_add (files, g_list_model_get_item (file_list, i));
+
+    gabc_windows_present_files (self, files);
+  }
+  g_object_unref (file_dialog);
+}
+
+
+static void
+gabc_window_set_window_title (GabcWindow *self)
+{
+  GFile *source_file;
+  GFile *parent_file;
+  GFile *home_file;
+  gchar *title;
+  gchar *sub_title;
+  GabcTunebook *tunebook;
+
+  tunebook = self->tunebook;
+
+  source_file = gtk_source_file_get_location(gabc_tunebook_get_abc_source_file(tunebook));
+
+  if (G_IS_FILE (source_file))
+    {
+      title = g_file_get_basename (source_file);
+      parent_file = g_file_get_parent (source_file);
+      home_file = g_file_new_for_path (g_getenv ("HOME"));
+      sub_title = g_file_get_relative_path (home_file, parent_file);
+      if (sub_title == NULL)
+        {
+          sub_title = g_file_get_path (parent_file);
+        }
+      g_object_unref (parent_file);
+      g_object_unref (home_file);
+    }
+  else
+    {
+      title = g_strdup ("New ABC Document");
+      sub_title = g_strdup ("");
+    }
+
+  adw_window_title_set_title (self->window_title, title);
+  adw_window_title_set_subtitle (self->window_title, sub_title);
+
+  g_free (title);
+  g_free (sub_title);
+
+}
+
+
+static void
+gabc_window_save_file_handler (GSimpleAction *action G_GNUC_UNUSED,
+                               GVariant      *parameter G_GNUC_UNUSED,
+                               gpointer       user_data)
+{
+  GabcWindow *self = user_data;
+  GabcTunebook *tunebook;
+
+  tunebook = self->tunebook;
+  g_print ("gabc_window_save_file_handler\n");
+  if (gtk_source_file_get_location(gabc_tunebook_get_abc_source_file(tunebook)) == NULL)
+  {
+    gabc_window_save_file_dialog (NULL, NULL, self);
+  }
+  else
+  {
+    gabc_tunebook_save_file (self->tunebook);
+  }
+}
+
+
+static void
+gabc_window_save_file_dialog (GSimpleAction *action G_GNUC_UNUSED,
+                              GVariant      *parameter G_GNUC_UNUSED,
+                              gpointer       user_data)
+{
+  GtkFileDialog *gfd;
+  GtkFileFilter *abc_filter;
+  GListStore *filter_list;
+
+  GabcWindow *self = user_data;
+
+  gfd = gtk_file_dialog_new ();
+  gtk_file_dialog_set_title (gfd, "Save abc File");
+
+  abc_filter = gabc_file_filters_get_abc_file_filter();
+  filter_list = gabc_file_filters_get_filter_list(abc_filter);
+
+  gtk_file_dialog_set_filters (gfd, G_LIST_MODEL (filter_list));
+  gtk_file_dialog_set_default_filter (gfd, abc_filter);
+  gtk_file_dialog_save (gfd,
+                        GTK_WINDOW (self),
+                        NULL,
+                        gabc_window_file_save_dialog_cb,
+                        G_OBJECT (self));
+  g_object_unref (abc_filter);
+  g_object_unref (filter_list);
+}
+
+
+static void
+gabc_window_file_save_dialog_cb (GObject       *file_dialog,
+                                 GAsyncResult  *res,
+                                 gpointer       user_data)
+{
+  GabcTunebook *tunebook;
+  GFile* save_file;
+  GabcWindow *self = user_data;
+  tunebook = self->tunebook;
+
+  save_file = gtk_file_dialog_save_finish (GTK_FILE_DIALOG (file_dialog), res, NULL);
+  if (save_file) {
+    gabc_tunebook_set_abc_source_file (tunebook, save_file);
+    gabc_tunebook_save_file (self->tunebook);
+    gabc_window_set_window_title (self);
+    //g_print ("gabc_window_file_save_dialog_cb: set self->buffer_is_modified = FALSE\n");
+  }
+  g_object_unref (file_dialog);
+}
+
+
+static void
+gabc_window_export_midi_handler (GSimpleAction *action G_GNUC_UNUSED,
+                               GVariant      *parameter G_GNUC_UNUSED,
+                               gpointer       user_data)
+{
+  GabcWindow *self = user_data;
+  gabc_window_save_midi_file_dialog (NULL, NULL, self);
+}
+
+
+/*
+ * EXPORT ALL TUNES AS MIDI
+ *
+ * One .mid per X: record, written into a chosen folder by a GabcBatch,
+ * which runs an abc2midi per CPU.  It shares the render cancellable, so
+ * Cancel Render stops it and starting another render cancels it.
+ */
+static void
+gabc_window_export_midi_all_progress_cb (GabcBatch   *batch,
+                                         const gchar *input_path,
+                                         guint        number,
+                                         const gchar *tool,
+                                         const gchar *output_path,
+                                         gint64       elapsed,
+                                         const gchar *reason,
+                                         GabcWindow  *self)
+{
+  g_autofree gchar *text = NULL;
+  guint n_done;
+  guint n_total;
+
+  gabc_batch_get_progress (batch, &n_done, &n_total);
+  text = g_strdup_printf ("Exported %u of %u tunes", n_done, n_total);
+
+  gtk_progress_bar_set_fraction (self->progress_bar, n_total > 0 ? (gdouble) n_done / n_total : 0.0);
+  gtk_progress_bar_set_text (self->progress_bar, text);
+}
+
+
+static void
+gabc_window_export_midi_all_cb (GObject       *source_object,
+                                GAsyncResult  *result,
+                                gpointer       user_data)
+{
+  GabcBatch *batch = GABC_BATCH (source_object);
+  export_all_cb_data_t *cb_data = user_data;
+  GabcWindow *self = cb_data->gabc_window;
+  GtkAlertDialog *alert_dialog;
+  g_autoptr (GError) error = NULL;
+  g_auto (GStrv) failures = NULL;
+  guint n_failures;
+  guint n_done;
+  guint i;
+
+  if (self->render_cancellable == cb_data->cancellable)
+    {
+      g_clear_object (&self->render_cancellable);
+      gabc_window_set_render_in_progress (self, FALSE);
+    }
+  gtk_revealer_set_reveal_child (self->progress_revealer, FALSE);
+
+  if (!gabc_batch_run_finish (batch, result, &error))
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+          gabc_log_window_append_to_log (self->log_window, error->message);
+          alert_dialog = gtk_alert_dialog_new ("Error exporting midi files.  See log for details.");
+          gtk_alert_dialog_show (alert_dialog, GTK_WINDOW (self));
+          g_object_unref (alert_dialog);
+        }
+    }
+  else
+    {
+      failures = gabc_batch_dup_failures (batch);
+      for (i = 0; failures[i] != NULL; i++)
+        gabc_log_window_append_to_log (self->log_window, failures[i]);
+
+      gabc_batch_get_progress (batch, &n_done, NULL);
+      n_failures = gabc_batch_get_n_failures (batch);
+
+      if (n_failures == 0)
+        alert_dialog = gtk_alert_dialog_new ("Exported %u midi files to %s", n_done, cb_data->output_dir);
+      else
+        alert_dialog = gtk_alert_dialog_new ("Exported %u midi files to %s, %u failed.  See log for details.",
+                                             n_done - MIN (n_done, n_failures),
+                                             cb_data->output_dir,
+                                             n_failures);
+      gtk_alert_dialog_show (alert_dialog, GTK_WINDOW (self));
+      g_object_unref (alert_dialog);
+    }
+
+  g_object_unref (cb_data->gabc_window);
+  g_object_unref (cb_data->cancellable);
+  g_free (cb_data->output_dir);
+  g_free (cb_data);
+}
 
-  file_list = g_value_get_boxed (value);
 
-  list = gdk_file_list_get_files (file_list);
+static gchar *
+gabc_window_get_tunebook_name (GabcWindow *self)
+{
+  GFile *location;
+  gchar *name;
 
-  file = g_slist_nth_data (list, 0);
-  g_assert (G_IS_FILE (file));
-  g_object_ref(file);
+  location = gtk_source_file_get_location (gabc_tunebook_get_abc_source_file (self->tunebook));
+  if (location == NULL)
+    return g_strdup ("tunebook");
 
-  gabc_windows_present_file(self, file);
-  g_slist_free (list);
+  name = g_file_get_basename (location);
+  if (g_str_has_suffix (name, ".abc"))
+    name[strlen (name) - 4] = '\0';
 
-  return TRUE;
+  return name;
 }
 
 
 static void
-gabc_window_dispose (GObject *object)
+gabc_window_export_midi_all_dialog_cb (GObject       *file_dialog,
+                                       GAsyncResult  *res,
+                                       gpointer       user_data)
 {
-  GabcWindow *win;
+  GabcWindow *self = user_data;
+  g_autoptr (GFile) folder = NULL;
+  g_autoptr (GabcBatch) batch = NULL;
+  g_autofree gchar *name = NULL;
+  g_autofree gchar *text = NULL;
+  g_autofree gchar *working_dir = NULL;
+  export_all_cb_data_t *cb_data;
+  GtkTextIter start;
+  GtkTextIter end;
+
+  folder = gtk_file_dialog_select_folder_finish (GTK_FILE_DIALOG (file_dialog), res, NULL);
+  g_object_unref (file_dialog);
+  if (folder == NULL)
+    return;
 
-  win = GABC_WINDOW (object);
+  gabc_window_cancel_render_job (self);
 
-  g_clear_object (&win->settings);
+  cb_data = g_new0 (export_all_cb_data_t, 1);
+  cb_data->gabc_window = g_object_ref (self);
+  cb_data->output_dir = g_file_get_path (folder);
 
-  g_clear_object (&win->tunebook);
+  gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (self->tunebook), &start, &end);
+  text = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (self->tunebook), &start, &end, FALSE);
+  name = gabc_window_get_tunebook_name (self);
+  working_dir = gabc_tunebook_get_working_dir (self->tunebook);
 
-  G_OBJECT_CLASS (gabc_window_parent_class)->dispose (object);
-}
+  batch = gabc_batch_new (self->settings);
+  gabc_batch_set_outputs (batch, FALSE, TRUE);
+  gabc_batch_set_output_dir (batch, cb_data->output_dir);
+  gabc_batch_add_text (batch, name, text, working_dir);
 
-GabcWindow *
-gabc_window_new (GabcApplication *app)
-{
-  return g_object_new (GABC_TYPE_WINDOW, "application", app, NULL);
+  g_signal_connect_object (batch, "job-finished",
+                           G_CALLBACK (gabc_window_export_midi_all_progress_cb),
+                           self, 0);
+
+  self->render_cancellable = g_cancellable_new ();
+  cb_data->cancellable = g_object_ref (self->render_cancellable);
+  gabc_window_set_render_in_progress (self, TRUE);
+
+  gtk_progress_bar_set_fraction (self->progress_bar, 0.0);
+  gtk_progress_bar_set_text (self->progress_bar, "Exporting tunes");
+  gtk_revealer_set_reveal_child (self->progress_revealer, TRUE);
+
+  gabc_batch_run_async (batch, self->render_cancellable, gabc_window_export_midi_all_cb, cb_data);
 }
 
 
 static void
-gabc_window_clear_buffer (GSimpleAction *action G_GNUC_UNUSED,
-                          GVariant      *parameter G_GNUC_UNUSED,
-                          gpointer       user_data)
+gabc_window_export_midi_all_handler (GSimpleAction *action G_GNUC_UNUSED,
+                                     GVariant      *parameter G_GNUC_UNUSED,
+                                     gpointer       user_data)
 {
-  GabcWindow *self = GABC_WINDOW (user_data);
-  gabc_tunebook_clear(self->tunebook);
-  gabc_window_set_window_title (self);
+  GabcWindow *self = user_data;
+  GtkFileDialog *gfd;
+
+  gfd = gtk_file_dialog_new ();
+  gtk_file_dialog_set_title (gfd, "Export All Tunes as MIDI");
+
+  gtk_file_dialog_select_folder (gfd,
+                                 GTK_WINDOW (self),
+                                 NULL,
+                                 gabc_window_export_midi_all_dialog_cb,
+                                 self);
 }
 
 
+/*
+ * Log error, if there is one, and tell the user the render failed, unless
+ * it was cancelled.  The tool's own errors are already in the log and
+ * marked in the tunebook by then.
+ */
 static void
-gabc_window_save_midi_file_dialog (GSimpleAction *action G_GNUC_UNUSED,
-                              GVariant      *parameter G_GNUC_UNUSED,
-                              gpointer       user_data)
+gabc_window_report_render_error (GabcWindow   *self,
+                                 const GError *error,
+                                 const gchar  *message)
 {
-  GtkFileDialog *gfd;
-  GtkFileFilter *midi_filter;
-  GListStore *filter_list;
+  GtkAlertDialog *alert_dialog;
 
-  GabcWindow *self = user_data;
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return;
 
-  gfd = gtk_file_dialog_new ();
-  gtk_file_dialog_set_title (gfd, "Export MIDI File");
+  if (error != NULL)
+    gabc_log_window_append_to_log (self->log_window, error->message);
 
-  midi_filter = gabc_file_filters_get_midi_file_filter();
-  filter_list = gabc_file_filters_get_filter_list(midi_filter);
+  alert_dialog = gtk_alert_dialog_new ("%s", message);
+  gtk_alert_dialog_show (alert_dialog, GTK_WINDOW (self));
+  g_object_unref (alert_dialog);
+}
 
-  gtk_file_dialog_set_filters (gfd, G_LIST_MODEL (filter_list));
-  gtk_file_dialog_set_default_filter (gfd, midi_filter);
-  gtk_file_dialog_set_initial_name ( gfd, "export.mid");
 
-  gtk_file_dialog_save (gfd,
-                        GTK_WINDOW (self),
-                        NULL,
-                        gabc_window_save_midi_file_dialog_cb,
-                        G_OBJECT (self));
-  g_object_unref (midi_filter);
-  g_object_unref (filter_list);
+static void
+gabc_window_engrave_job_cb (GObject       *source_object,
+                            GAsyncResult  *result,
+                            gpointer       user_data)
+{
+  render_cb_data_t *cb_data = user_data;
+  GabcWindow *self = cb_data->gabc_window;
+  g_autoptr (GError) error = NULL;
+
+  if (gabc_window_ps_job_succeeded (GABC_RENDER_JOB (source_object), result, &error))
+    {
+      gabc_window_render_job_succeeded (cb_data);
+      gabc_window_play_media_file (cb_data->output_file_path, self);
+    }
+  else
+    {
+      gabc_window_report_render_error (self, error, "Error engraving abc input.  See log for details.");
+    }
+
+  gabc_window_render_job_done (cb_data);
 }
 
 
 static void
-gabc_window_save_midi_file_dialog_cb (GObject       *file_dialog,
-                                 GAsyncResult  *res,
-                                 gpointer       user_data)
+gabc_window_view_engraving_job_cb (GObject       *source_object,
+                                   GAsyncResult  *result,
+                                   gpointer       user_data)
 {
-  GabcWindow *self = user_data;
-  char *midi_file_path;
-  char *abc_file_path;
-  GtkAlertDialog *alert_dialog;
-  GError *err = NULL;
+  render_cb_data_t *cb_data = user_data;
+  GabcWindow *self = cb_data->gabc_window;
+  g_autoptr (GError) error = NULL;
 
-  const gint dialog_str_buf_len = 50;
-  gchar dialog_str_buf[dialog_str_buf_len];
+  if (gabc_window_ps_job_succeeded (GABC_RENDER_JOB (source_object), result, &error) &&
+      gabc_engraving_window_show_output (self->engraving_window, cb_data->output_file_path))
+    {
+      cb_data->succeeded = TRUE;
+      g_free (self->engraving_key);
+      self->engraving_key = g_strdup (cb_data->cache_key);
+    }
+  else
+    {
+      gabc_window_report_render_error (self, error, "Error engraving abc input.  See log for details.");
+    }
 
-  g_autoptr (GFile) midi_file = gtk_file_dialog_save_finish (GTK_FILE_DIALOG (file_dialog),
-                                                        res,
-                                                        NULL);
-  if (midi_file) {
-    midi_file_path = g_file_get_path(midi_file);
+  gabc_window_render_job_done (cb_data);
+}
 
-    gtk_widget_set_sensitive (GTK_WIDGET (self->main_text_view), FALSE);
-    abc_file_path = gabc_tunebook_write_to_scratch_file (self->tunebook, self->settings);
-    gtk_widget_set_sensitive (GTK_WIDGET (self->main_text_view), TRUE);
 
-    gabc_window_write_midi_file (abc_file_path, midi_file_path, self, &err);
-    if (err != NULL)
-      {
-        g_snprintf (dialog_str_buf, dialog_str_buf_len, "Error writing midi file.  See log for details.");
-      }
-    else
-      {
-        g_snprintf (dialog_str_buf, dialog_str_buf_len, "Written midi file: %s", g_file_get_basename (midi_file) );
-      }
+/*
+ * Engrave as SVG, a file per page, for the engraving window.  When the
+ * text and settings are those of the pages it already shows there is
+ * nothing to engrave; otherwise the page view only draws the pages that
+ * came out differently.  Takes abc_file_path and cache_key.
+ */
+static void
+gabc_window_view_engraving (GabcWindow *self, gchar *abc_file_path, gchar *cache_key)
+{
+  GabcRenderJob *job;
+  render_cb_data_t *cb_data;
+
+  if (g_strcmp0 (cache_key, self->engraving_key) == 0)
+    {
+      gtk_window_present (GTK_WINDOW (self->engraving_window));
+      g_free (cache_key);
+      g_free (abc_file_path);
+      return;
+    }
 
-    alert_dialog = gtk_alert_dialog_new ("%s", dialog_str_buf);
-    gtk_alert_dialog_show (alert_dialog, GTK_WINDOW (self));
-    g_object_unref (alert_dialog);
+  cb_data = g_new0 (render_cb_data_t, 1);
+  cb_data->abc_file_path = abc_file_path;
+  cb_data->cache_key = cache_key;
+  cb_data->output_file_path = gabc_engraving_window_get_output_path (self->engraving_window);
 
-    g_free (abc_file_path);
-    g_free (midi_file_path);
-  }
-  //g_object_unref (dialog_str_buf);
-  g_object_unref (file_dialog);
+  job = gabc_window_new_ps_job (cb_data->abc_file_path, cb_data->output_file_path, ENGRAVING_FORMAT_SVG, self);
+  gabc_window_start_render_job (self, job, gabc_window_view_engraving_job_cb, cb_data);
+  g_object_unref (job);
 }
 
 
 static void
-gabc_window_open_file_dialog (GSimpleAction *action G_GNUC_UNUSED,
-                              GVariant      *parameter G_GNUC_UNUSED,
-                              gpointer       user_data)
+gabc_window_engrave (GabcWindow *self, gboolean current_tune_only)
 {
-  GtkFileDialog *gfd;
-  GtkFileFilter *abc_filter;
-  GListStore *filter_list;
+  GabcRenderJob *job;
+  render_cb_data_t *cb_data;
+  gchar *abc_file_path;
+  gchar *cache_key;
+  gchar *cached_file_path;
 
-  GabcWindow *self = user_data;
-  gfd = gtk_file_dialog_new ();
-  gtk_file_dialog_set_title ( gfd, "Open abc File");
+  /* Kill any render still reading the scratch file before rewriting it. */
+  gabc_window_cancel_render_job (self);
 
-  abc_filter = gabc_file_filters_get_abc_file_filter();
-  filter_list = gabc_file_filters_get_filter_list(abc_filter);
+  abc_file_path = gabc_window_write_scratch_file (self, GABC_PREPROCESSOR_TARGET_ABCM2PS, current_tune_only);
+  if (abc_file_path == NULL)
+    return;
 
-  gtk_file_dialog_set_filters (gfd, G_LIST_MODEL (filter_list));
-  gtk_file_dialog_set_default_filter (gfd, abc_filter);
+  cache_key = gabc_window_get_ps_cache_key (self);
 
-  gtk_file_dialog_open (gfd,
-                        GTK_WINDOW (self),
-                        NULL,
-                        gabc_window_file_open_cb,
-                        G_OBJECT (self));
+  if (g_settings_get_boolean (self->settings, "built-in-viewer"))
+    {
+      gabc_window_view_engraving (self, abc_file_path, cache_key);
+      return;
+    }
 
-  g_object_unref (abc_filter);
-  g_object_unref (filter_list);
+  cached_file_path = gabc_window_lookup_render_cache (self, cache_key, "ps");
+  if (cached_file_path != NULL)
+    {
+      gabc_window_play_media_file (cached_file_path, self);
+      g_free (cached_file_path);
+      g_free (cache_key);
+      g_free (abc_file_path);
+      return;
+    }
+
+  cb_data = g_new0 (render_cb_data_t, 1);
+  cb_data->abc_file_path = abc_file_path;
+  cb_data->cache_key = cache_key;
+  cb_data->cache_extension = "ps";
+  cb_data->output_file_path = gabc_render_cache_get_temp_path (gabc_render_cache_get_default (),
+                                                               cache_key, cb_data->cache_extension);
+
+  job = gabc_window_new_ps_job (cb_data->abc_file_path, cb_data->output_file_path, ENGRAVING_FORMAT_PS, self);
+  gabc_window_start_render_job (self, job, gabc_window_engrave_job_cb, cb_data);
+  g_object_unref (job);
 }
 
 
 static void
-gabc_window_file_open_cb (GObject       *file_dialog,
-              GAsyncResult  *res,
-              gpointer       user_data)
+gabc_window_engrave_file (GSimpleAction *action G_GNUC_UNUSED,
+                          GVariant      *parameter G_GNUC_UNUSED,
+                          gpointer       user_data)
 {
-  GabcWindow *self;
-  g_autoptr (GFile) file = gtk_file_dialog_open_finish (GTK_FILE_DIALOG (file_dialog),
-                                                        res,
-                                                        NULL);
+  gabc_window_engrave (GABC_WINDOW (user_data), FALSE);
+}
 
-  self = (GabcWindow *) user_data;
-  if (file) {
-    gabc_windows_present_file (self, file);
-    g_object_ref (file);  // Hang on to the file object for now.
-  }
-  g_object_unref (file_dialog);
+
+static void
+gabc_window_engrave_tune (GSimpleAction *action G_GNUC_UNUSED,
+                          GVariant      *parameter G_GNUC_UNUSED,
+                          gpointer       user_data)
+{
+  gabc_window_engrave (GABC_WINDOW (user_data), TRUE);
 }
 
 
 static void
-gabc_window_set_window_title (GabcWindow *self)
+gabc_window_play_job_cb (GObject       *source_object,
+                         GAsyncResult  *result,
+                         gpointer       user_data)
 {
-  GFile *source_file;
-  GFile *parent_file;
-  GFile *home_file;
-  gchar *title;
-  gchar *sub_title;
-  GabcTunebook *tunebook;
+  render_cb_data_t *cb_data = user_data;
+  GabcWindow *self = cb_data->gabc_window;
+  g_autoptr (GError) err = NULL;
 
-  tunebook = self->tunebook;
+  if (gabc_window_midi_job_succeeded (GABC_RENDER_JOB (source_object), result, &err))
+    {
+      gabc_window_render_job_succeeded (cb_data);
+      gabc_window_play_media_file (cb_data->output_file_path, self);
+    }
+  else
+    {
+      gabc_window_report_render_error (self, err, "Error converting abc input.  See log for details.");
+    }
 
-  source_file = gtk_source_file_get_location(gabc_tunebook_get_abc_source_file(tunebook));
+  gabc_window_render_job_done (cb_data);
+}
 
-  if (G_IS_FILE (source_file))
+
+/*
+ * The parsed tunes from start up to end, or NULL if start isn't the start
+ * of a tune.  Tunes the index has parsed since their last edit aren't
+ * parsed again.
+ */
+static GPtrArray *
+gabc_window_get_parsed_tunes (GabcWindow        *self,
+                              const GtkTextIter *start,
+                              const GtkTextIter *end)
+{
+  GabcTuneIndex *tune_index = gabc_tunebook_get_tune_index (self->tunebook);
+  GPtrArray *tunes;
+  GtkTextIter tune_start;
+  guint position;
+
+  if (!gabc_tune_index_lookup_offset (tune_index, gtk_text_iter_get_offset (start), &position))
+    return NULL;
+  gabc_tune_index_get_tune_bounds (tune_index, position, &tune_start, NULL);
+  if (!gtk_text_iter_equal (&tune_start, start))
+    return NULL;
+
+  tunes = g_ptr_array_new ();
+  for (; position < gabc_tune_index_get_n_tunes (tune_index); position++)
     {
-      title = g_file_get_basename (source_file);
-      parent_file = g_file_get_parent (source_file);
-      home_file = g_file_new_for_path (g_getenv ("HOME"));
-      sub_title = g_file_get_relative_path (home_file, parent_file);
-      if (sub_title == NULL)
-        {
-          sub_title = g_file_get_path (parent_file);
-        }
-      g_object_unref (parent_file);
-      g_object_unref (home_file);
+      gabc_tune_index_get_tune_bounds (tune_index, position, &tune_start, NULL);
+      if (gtk_text_iter_compare (&tune_start, end) >= 0)
+        break;
+      g_ptr_array_add (tunes, (gpointer) gabc_tune_index_get_parsed_tune (tune_index, position));
+    }
+
+  return tunes;
+}
+
+
+static gsize
+gabc_window_get_byte_count (GabcWindow        *self,
+                            const GtkTextIter *start,
+                            const GtkTextIter *end)
+{
+  g_autofree gchar *text = NULL;
+
+  if (gtk_text_iter_equal (start, end))
+    return 0;
+
+  text = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (self->tunebook), start, end, TRUE);
+  return strlen (text);
+}
+
+
+/*
+ * Play the notes between from and to with the built-in player, reading the
+ * text from start to end for the key, note lengths and tempo they are in.
+ * Fails if there is no audio output.
+ */
+static gboolean
+gabc_window_play_builtin (GabcWindow        *self,
+                          const GtkTextIter *start,
+                          const GtkTextIter *end,
+                          const GtkTextIter *from,
+                          const GtkTextIter *to,
+                          gboolean           loop,
+                          GError           **error)
+{
+  g_autoptr (GPtrArray) tunes = NULL;
+  g_autofree gchar *message = NULL;
+  GabcMidiSequence *sequence;
+  GabcAudioSink *sink;
+  gint64 start_time = g_get_monotonic_time ();
+  gsize from_byte;
+  gsize to_byte;
+
+  from_byte = gabc_window_get_byte_count (self, start, from);
+  to_byte = gtk_text_iter_equal (to, end) ? G_MAXSIZE : gabc_window_get_byte_count (self, start, to);
+
+  tunes = gabc_window_get_parsed_tunes (self, start, end);
+  if (tunes != NULL)
+    {
+      sequence = gabc_midi_sequence_new_for_tunes ((const GabcAbcTune * const *) tunes->pdata, tunes->len,
+                                                   from_byte, to_byte);
     }
   else
     {
-      title = g_strdup ("New ABC Document");
-      sub_title = g_strdup ("");
+      g_autofree gchar *text = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (self->tunebook), start, end, TRUE);
+
+      sequence = gabc_midi_sequence_new (text, strlen (text), from_byte, to_byte);
+    }
+  if (sequence->events->len == 0)
+    {
+      gabc_midi_sequence_free (sequence);
+      gabc_log_window_append_to_log (self->log_window, "There are no notes to play");
+      return TRUE;
     }
 
-  adw_window_title_set_title (self->window_title, title);
-  adw_window_title_set_subtitle (self->window_title, sub_title);
+  sink = gabc_audio_sink_new_device (GABC_PLAYER_RATE, error);
+  if (sink == NULL)
+    {
+      gabc_midi_sequence_free (sequence);
+      return FALSE;
+    }
+
+  message = g_strdup_printf ("Playing %u notes%s, ready in %.1f ms",
+                             sequence->events->len / 2,
+                             loop ? " in a loop" : "",
+                             (g_get_monotonic_time () - start_time) / 1000.0);
+  gabc_log_window_append_to_log (self->log_window, message);
+
+  gabc_player_play (self->player, sequence, sink, loop);
+  g_simple_action_set_enabled (G_SIMPLE_ACTION (g_action_map_lookup_action (G_ACTION_MAP (self), "stop-playback")),
+                               TRUE);
+
+  return TRUE;
+}
+
+
+/*
+ * Play the book, or the current tunes, with the built-in player if it is
+ * switched on.  Returns FALSE if it is off or can't be used, so the caller
+ * goes through abc2midi and an external player, with the abc2midi
+ * preferences applied.
+ */
+static gboolean
+gabc_window_play_builtin_tunes (GabcWindow *self, gboolean current_tune_only)
+{
+  GabcTuneIndex *tune_index = gabc_tunebook_get_tune_index (self->tunebook);
+  g_autoptr (GError) error = NULL;
+  GtkTextIter start;
+  GtkTextIter end;
+  GtkTextIter last_start;
+  guint first;
+  guint last;
+
+  if (!g_settings_get_boolean (self->settings, "built-in-player"))
+    return FALSE;
+
+  gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (self->tunebook), &start, &end);
+  if (current_tune_only && gabc_window_get_current_tunes (self, &first, &last))
+    {
+      gabc_tune_index_get_tune_bounds (tune_index, first, &start, &end);
+      gabc_tune_index_get_tune_bounds (tune_index, last, &last_start, &end);
+    }
+
+  if (gabc_window_play_builtin (self, &start, &end, &start, &end, FALSE, &error))
+    return TRUE;
+
+  /* Built without audio output: not worth a line in the log every time. */
+  if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED))
+    gabc_log_window_append_to_log (self->log_window, error->message);
+
+  return FALSE;
+}
+
+
+static void
+gabc_window_play (GabcWindow *self, gboolean current_tune_only)
+{
+  GabcRenderJob *job;
+  render_cb_data_t *cb_data;
+  gchar *abc_file_path;
+  gchar *cache_key;
+  gchar *cached_file_path;
+
+  if (gabc_window_play_builtin_tunes (self, current_tune_only))
+    return;
+
+  gabc_window_cancel_render_job (self);
+
+  abc_file_path = gabc_window_write_scratch_file (self, GABC_PREPROCESSOR_TARGET_ABC2MIDI, current_tune_only);
+  if (abc_file_path == NULL)
+    return;
+
+  cache_key = gabc_window_get_midi_cache_key (self);
+
+  cached_file_path = gabc_window_lookup_render_cache (self, cache_key, "mid");
+  if (cached_file_path != NULL)
+    {
+      gabc_window_play_media_file (cached_file_path, self);
+      g_free (cached_file_path);
+      g_free (cache_key);
+      g_free (abc_file_path);
+      return;
+    }
+
+  cb_data = g_new0 (render_cb_data_t, 1);
+  cb_data->abc_file_path = abc_file_path;
+  cb_data->cache_key = cache_key;
+  cb_data->cache_extension = "mid";
+  cb_data->output_file_path = gabc_render_cache_get_temp_path (gabc_render_cache_get_default (),
+                                                               cache_key, cb_data->cache_extension);
+
+  job = gabc_window_new_midi_job (cb_data->abc_file_path, cb_data->output_file_path, self);
+  gabc_window_start_render_job (self, job, gabc_window_play_job_cb, cb_data);
+  g_object_unref (job);
+}
+
+
+static void
+gabc_window_play_file  (GSimpleAction *action G_GNUC_UNUSED,
+                        GVariant      *parameter G_GNUC_UNUSED,
+                        gpointer       user_data)
+{
+  gabc_window_play (GABC_WINDOW (user_data), FALSE);
+}
+
+
+static void
+gabc_window_play_tune  (GSimpleAction *action G_GNUC_UNUSED,
+                        GVariant      *parameter G_GNUC_UNUSED,
+                        gpointer       user_data)
+{
+  gabc_window_play (GABC_WINDOW (user_data), TRUE);
+}
 
-  g_free (title);
-  g_free (sub_title);
 
+/*
+ * The tune around iter, or the whole buffer if iter isn't in a tune.
+ */
+static void
+gabc_window_get_tune_bounds_at (GabcWindow        *self,
+                                const GtkTextIter *iter,
+                                GtkTextIter       *start,
+                                GtkTextIter       *end)
+{
+  GabcTuneIndex *tune_index = gabc_tunebook_get_tune_index (self->tunebook);
+  guint position;
+
+  if (gabc_tune_index_lookup_offset (tune_index, gtk_text_iter_get_offset (iter), &position))
+    gabc_tune_index_get_tune_bounds (tune_index, position, start, end);
+  else
+    gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (self->tunebook), start, end);
 }
 
 
 static void
-gabc_window_save_file_handler (GSimpleAction *action G_GNUC_UNUSED,
-                               GVariant      *parameter G_GNUC_UNUSED,
-                               gpointer       user_data)
+gabc_window_show_play_error (GabcWindow *self, const GError *error)
 {
-  GabcWindow *self = user_data;
-  GabcTunebook *tunebook;
+  GtkAlertDialog *alert_dialog;
 
-  tunebook = self->tunebook;
-  g_print ("gabc_window_save_file_handler\n");
-  if (gtk_source_file_get_location(gabc_tunebook_get_abc_source_file(tunebook)) == NULL)
-  {
-    gabc_window_save_file_dialog (NULL, NULL, self);
-  }
-  else
-  {
-    gabc_tunebook_save_file (self->tunebook);
-  }
+  gabc_log_window_append_to_log (self->log_window, error->message);
+  alert_dialog = gtk_alert_dialog_new ("Error playing abc input: %s", error->message);
+  gtk_alert_dialog_show (alert_dialog, GTK_WINDOW (self));
+  g_object_unref (alert_dialog);
 }
 
 
+/*
+ * Play the rest of the tune from the cursor.
+ */
 static void
-gabc_window_save_file_dialog (GSimpleAction *action G_GNUC_UNUSED,
+gabc_window_play_from_cursor (GSimpleAction *action G_GNUC_UNUSED,
                               GVariant      *parameter G_GNUC_UNUSED,
                               gpointer       user_data)
 {
-  GtkFileDialog *gfd;
-  GtkFileFilter *abc_filter;
-  GListStore *filter_list;
-
   GabcWindow *self = user_data;
+  GtkTextBuffer *buffer = GTK_TEXT_BUFFER (self->tunebook);
+  g_autoptr (GError) error = NULL;
+  GtkTextIter cursor;
+  GtkTextIter start;
+  GtkTextIter end;
 
-  gfd = gtk_file_dialog_new ();
-  gtk_file_dialog_set_title (gfd, "Save abc File");
-
-  abc_filter = gabc_file_filters_get_abc_file_filter();
-  filter_list = gabc_file_filters_get_filter_list(abc_filter);
+  gtk_text_buffer_get_iter_at_mark (buffer, &cursor, gtk_text_buffer_get_insert (buffer));
+  gabc_window_get_tune_bounds_at (self, &cursor, &start, &end);
 
-  gtk_file_dialog_set_filters (gfd, G_LIST_MODEL (filter_list));
-  gtk_file_dialog_set_default_filter (gfd, abc_filter);
-  gtk_file_dialog_save (gfd,
-                        GTK_WINDOW (self),
-                        NULL,
-                        gabc_window_file_save_dialog_cb,
-                        G_OBJECT (self));
-  g_object_unref (abc_filter);
-  g_object_unref (filter_list);
+  if (!gabc_window_play_builtin (self, &start, &end, &cursor, &end, FALSE, &error))
+    gabc_window_show_play_error (self, error);
 }
 
 
+/*
+ * Play the selection over and over, or the whole tune if nothing is
+ * selected.  A selection running past the end of its tune stops there.
+ */
 static void
-gabc_window_file_save_dialog_cb (GObject       *file_dialog,
-                                 GAsyncResult  *res,
-                                 gpointer       user_data)
+gabc_window_loop_selection (GSimpleAction *action G_GNUC_UNUSED,
+                            GVariant      *parameter G_GNUC_UNUSED,
+                            gpointer       user_data)
 {
-  GabcTunebook *tunebook;
-  GFile* save_file;
   GabcWindow *self = user_data;
-  tunebook = self->tunebook;
+  g_autoptr (GError) error = NULL;
+  GtkTextIter from;
+  GtkTextIter to;
+  GtkTextIter start;
+  GtkTextIter end;
 
-  save_file = gtk_file_dialog_save_finish (GTK_FILE_DIALOG (file_dialog), res, NULL);
-  if (save_file) {
-    gabc_tunebook_set_abc_source_file (tunebook, save_file);
-    gabc_tunebook_save_file (self->tunebook);
-    gabc_window_set_window_title (self);
-    //g_print ("gabc_window_file_save_dialog_cb: set self->buffer_is_modified = FALSE\n");
-  }
-  g_object_unref (file_dialog);
+  if (gtk_text_buffer_get_selection_bounds (GTK_TEXT_BUFFER (self->tunebook), &from, &to))
+    {
+      gabc_window_get_tune_bounds_at (self, &from, &start, &end);
+      if (gtk_text_iter_compare (&to, &end) > 0)
+        to = end;
+    }
+  else
+    {
+      gabc_window_get_tune_bounds_at (self, &from, &start, &end);
+      from = start;
+      to = end;
+    }
+
+  if (!gabc_window_play_builtin (self, &start, &end, &from, &to, TRUE, &error))
+    gabc_window_show_play_error (self, error);
 }
 
 
 static void
-gabc_window_export_midi_handler (GSimpleAction *action G_GNUC_UNUSED,
-                               GVariant      *parameter G_GNUC_UNUSED,
-                               gpointer       user_data)
+gabc_window_stop_playback (GSimpleAction *action G_GNUC_UNUSED,
+                           GVariant      *parameter G_GNUC_UNUSED,
+                           gpointer       user_data)
 {
   GabcWindow *self = user_data;
-  gabc_window_save_midi_file_dialog (NULL, NULL, self);
+
+  gabc_player_stop (self->player);
 }
 
 
 static void
-gabc_window_engrave_file (GSimpleAction *action G_GNUC_UNUSED,
-                          GVariant      *parameter G_GNUC_UNUSED,
-                          gpointer       user_data)
+gabc_window_player_finished_cb (GabcPlayer *player,
+                                GError     *error,
+                                GabcWindow *self)
 {
-  gchar *abc_file_path, *ps_file_path;
-  //gboolean gabc_buffer_is_modified;
-  GabcWindow *self = user_data;
+  g_simple_action_set_enabled (G_SIMPLE_ACTION (g_action_map_lookup_action (G_ACTION_MAP (self), "stop-playback")),
+                               FALSE);
 
-  //gabc_buffer_is_modified = gtk_text_buffer_get_modified ( (GtkTextBuffer *) self->tunebook);
-  //TODO this check should be moved to the tunebook.
-  //self->tunebook->is_modified = gabc_tunebook_is_modified(self->tunebook) || gabc_buffer_is_modified;
+  if (error != NULL)
+    gabc_log_window_append_to_log (self->log_window, error->message);
+}
 
-  gtk_widget_set_sensitive (GTK_WIDGET (self->main_text_view), FALSE);
-  abc_file_path = gabc_tunebook_write_to_scratch_file (self->tunebook, self->settings);
-  gtk_widget_set_sensitive (GTK_WIDGET (self->main_text_view), TRUE);
 
-  ps_file_path = gabc_window_write_ps_file (abc_file_path, self);
-  if ((ps_file_path != NULL) && (ps_file_path[0] != '\0'))
-    {
-       gabc_window_play_media_file (ps_file_path, self);
-    }
-  else
+/*
+ * Find the tunes to render for the "-tune" actions: every tune touched by
+ * the selection, or the tune under the cursor.  Returns FALSE if the cursor
+ * is in the file header or the book has no X: records.
+ */
+static gboolean
+gabc_window_get_current_tunes (GabcWindow *self, guint *first, guint *last)
+{
+  GabcTuneIndex *tune_index;
+  GtkTextIter start;
+  GtkTextIter end;
+
+  tune_index = gabc_tunebook_get_tune_index (self->tunebook);
+
+  if (!gtk_text_buffer_get_selection_bounds (GTK_TEXT_BUFFER (self->tunebook), &start, &end))
     {
-       GtkAlertDialog *alert_dialog = gtk_alert_dialog_new ("Error engraving abc input");
-       gtk_alert_dialog_show (alert_dialog, GTK_WINDOW (self));
-       g_object_unref (alert_dialog);
+      if (!gabc_tune_index_lookup_offset (tune_index, gtk_text_iter_get_offset (&start), first))
+        return FALSE;
+      *last = *first;
+      return TRUE;
     }
 
-  g_free (abc_file_path);
-  g_free (ps_file_path);
+  if (!gabc_tune_index_lookup_offset (tune_index, gtk_text_iter_get_offset (&end) - 1, last))
+    return FALSE;
+
+  /* A selection starting in the file header covers the first tune. */
+  if (!gabc_tune_index_lookup_offset (tune_index, gtk_text_iter_get_offset (&start), first))
+    *first = 0;
+
+  return TRUE;
 }
 
 
-static void
-gabc_window_play_file  (GSimpleAction *action G_GNUC_UNUSED,
-                        GVariant      *parameter G_GNUC_UNUSED,
-                        gpointer       user_data)
+/*
+ * Returns NULL, having told the user why, if the scratch file could not be
+ * written; the caller should give up on the render.
+ */
+static gchar *
+gabc_window_write_scratch_file (GabcWindow *self, GabcPreprocessorTarget target, gboolean current_tune_only)
 {
-  gchar *abc_file_path, *midi_file_path;
-  //gboolean gabc_buffer_is_modified;
-  GError *err = NULL;
-  GabcWindow *self = user_data;
+  g_autoptr (GError) error = NULL;
+  gchar *file_path;
+  guint first;
+  guint last;
 
   gtk_widget_set_sensitive (GTK_WIDGET (self->main_text_view), FALSE);
-  abc_file_path = gabc_tunebook_write_to_scratch_file (self->tunebook, self->settings);
+  if (current_tune_only && gabc_window_get_current_tunes (self, &first, &last))
+    file_path = gabc_tunebook_write_tunes_to_scratch_file (self->tunebook, target, first, last, &error);
+  else
+    file_path = gabc_tunebook_write_to_scratch_file (self->tunebook, target, &error);
   gtk_widget_set_sensitive (GTK_WIDGET (self->main_text_view), TRUE);
 
-  midi_file_path = gabc_window_set_file_extension (abc_file_path, (gchar*)("mid"));
-  gabc_window_write_midi_file (abc_file_path, midi_file_path, self, &err);
-  if (err != NULL)
-    {
-      GtkAlertDialog *alert_dialog = gtk_alert_dialog_new ("Error converting abc input.  See log for details.");
-      gtk_alert_dialog_show (alert_dialog, GTK_WINDOW (self));
-      g_object_unref (alert_dialog);
-    }
-  else
-    {
-      gabc_window_play_media_file (midi_file_path, self);
-    }
+  if (file_path == NULL)
+    gabc_window_show_scratch_error (self, error);
+
+  return file_path;
+}
+
+
+static void
+gabc_window_show_scratch_error (GabcWindow *self, const GError *error)
+{
+  GtkAlertDialog *alert_dialog;
 
-  g_free (abc_file_path);
-  g_free (midi_file_path);
+  gabc_log_window_append_to_log (self->log_window, error->message);
+  alert_dialog = gtk_alert_dialog_new ("%s", error->message);
+  gtk_alert_dialog_show (alert_dialog, GTK_WINDOW (self));
+  g_object_unref (alert_dialog);
 }
 
 
@@ -814,192 +2367,388 @@ gabc_window_set_file_extension (gchar *file_path, gchar *extension)
 
 
 /*
- * Print the ps file. We need to specify the working diretory wehn running abc2ps
- * to keep any relative links to format specifiers working.
+ * RENDER JOBS
+ *
+ * Only one render runs at a time.  Starting a new one makes whatever is
+ * still in flight obsolete, so the old job is cancelled (which kills the
+ * child) rather than left to finish behind it.
  */
-
-gchar *
-gabc_window_write_ps_file (gchar *file_path, GabcWindow *self)
+static void
+gabc_window_set_render_in_progress (GabcWindow *self, gboolean in_progress)
 {
-  gchar *standard_output;
-  gchar *standard_error;
-  gint exit_status;
-  GError *error = NULL;
-  gboolean result;
+  GAction *action;
 
-  gchar *ps_file_path;
-  gchar *working_dir_path;
+  action = g_action_map_lookup_action (G_ACTION_MAP (self), "cancel-render");
+  g_simple_action_set_enabled (G_SIMPLE_ACTION (action), in_progress);
+}
 
-  gchar *fmt_file_path;
-  gchar *page_numbering_mode;
 
-  GFile *working_file;
-  GFile *working_dir_file;
+static void
+gabc_window_cancel_render_job (GabcWindow *self)
+{
+  if (self->render_cancellable != NULL)
+    {
+      g_cancellable_cancel (self->render_cancellable);
+      g_clear_object (&self->render_cancellable);
+      gabc_window_set_render_in_progress (self, FALSE);
+    }
+}
 
-  gint idx;
-  gchar *cmd[20];
 
-  GtkSourceFile* abc_src_file;
-  abc_src_file = gabc_tunebook_get_abc_source_file (self->tunebook);
-  if (gtk_source_file_get_location(abc_src_file) == NULL)
-  {
-    // copy the str so we can free it later.
-    g_print ("gtk_source_file_get_location(abc_src_file) == NULL\n");
-    working_dir_path = g_strdup (g_getenv ("XDG_CACHE_HOME"));
-  }
-  else
-  {
-    g_print ("gtk_source_file_get_location(abc_src_file) != NULL\n");
-    // gtk_source_file_get_location data is owned by the instance.
-    working_file = gtk_source_file_get_location (gabc_tunebook_get_abc_source_file (self->tunebook));
-    g_print("Working Location: %s\n", g_file_get_path (working_file));
-    working_dir_file = g_file_get_parent (working_file);
-    working_dir_path = g_file_get_path (working_dir_file);
-    g_object_unref (working_dir_file); // also working dir path...
-  }
+static void
+gabc_window_cancel_render (GSimpleAction *action G_GNUC_UNUSED,
+                           GVariant      *parameter G_GNUC_UNUSED,
+                           gpointer       user_data)
+{
+  GabcWindow *self = user_data;
 
-  ps_file_path = gabc_window_set_file_extension (file_path, (gchar *)("ps"));
+  if (self->render_cancellable != NULL)
+    gabc_log_window_append_to_log (self->log_window, (gchar *)("Render cancelled."));
 
-  idx = 0;
-  cmd[idx++] = (gchar *)("abcm2ps");
+  gabc_window_cancel_render_job (self);
+}
 
-  if (g_settings_get_boolean (self->settings, "abcm2ps-show-errors")) {
-      cmd[idx++] = (gchar *)("-i");
-  }
 
-  fmt_file_path = g_settings_get_string (self->settings, "abcm2ps-fmt-file-path");
+/*
+ * Tool output is parsed as it arrives, so the marks for a big book show up
+ * while the tool is still working through it.  The job carries the line
+ * map of the scratch file it reads and a count of the errors seen so far.
+ */
+static void
+gabc_window_render_output_line_cb (GabcRenderJob *job,
+                                   const gchar   *line,
+                                   gboolean       is_stderr,
+                                   GabcWindow    *self)
+{
+  GabcLineMap *line_map = g_object_get_data (G_OBJECT (job), "gabc-line-map");
+  GabcDiagnostic diagnostic = { 0 };
+  GabcLogSeverity severity;
+  guint n_errors;
 
-  if (fmt_file_path != 0)
-  {
-    cmd[idx++] = (gchar *)("-F");
-    cmd[idx++] = fmt_file_path;
-  }
+  severity = gabc_log_severity_from_text (line);
 
-  page_numbering_mode = g_settings_get_string (self->settings, "abcm2ps-page-numbering");
-  cmd[idx++] = (gchar *)("-N");
-  cmd[idx++] = (page_numbering_mode);
+  if (gabc_diagnostic_parse (line, &diagnostic))
+    {
+      severity = diagnostic.severity;
+      if (line_map != NULL)
+        gabc_tunebook_add_diagnostic (self->tunebook, &diagnostic, line_map);
+      gabc_diagnostic_clear (&diagnostic);
+    }
 
-  cmd[idx++] = (gchar *)("-O");
-  cmd[idx++] = ps_file_path;
-  cmd[idx++] = file_path;
-  cmd[idx++] = NULL;
+  if (severity == GABC_LOG_SEVERITY_ERROR)
+    {
+      n_errors = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (job), "gabc-n-errors"));
+      g_object_set_data (G_OBJECT (job), "gabc-n-errors", GUINT_TO_POINTER (n_errors + 1));
+    }
 
-  result = g_spawn_sync (working_dir_path, (gchar **)cmd, NULL,
-                      G_SPAWN_SEARCH_PATH, NULL, NULL,
-                      &standard_output, &standard_error,
-                      &exit_status, &error);
+  gabc_log_window_append_record (self->log_window,
+                                 gabc_render_job_get_tool (job),
+                                 gabc_render_job_get_id (job),
+                                 severity,
+                                 line);
+}
 
-  if (result != TRUE )
-  {
-    gabc_log_window_append_to_log (self->log_window, error->message);
-    g_clear_error (&error);
-  }
 
-  gabc_log_window_append_to_log (self->log_window, standard_output);
-  gabc_log_window_append_to_log (self->log_window, standard_error);
+static void
+gabc_window_render_job_finished_cb (GabcRenderService *service,
+                                    GabcRenderJob     *job,
+                                    gint64             wait_time,
+                                    gint64             run_time,
+                                    GabcWindow        *self)
+{
+  g_autofree gchar *message = NULL;
+  guint queue_depth;
 
-  if (exit_status != 0)
-    {
-      ps_file_path = g_strdup ("");
-    }
-  g_free (standard_output);
-  g_free (standard_error);
-  g_free (working_dir_path);
-  g_free (fmt_file_path);
-  g_free (page_numbering_mode);
+  if (g_object_get_data (G_OBJECT (job), "gabc-window") != self)
+    return;
 
-  return ps_file_path;
+  gabc_render_service_get_stats (service, NULL, &queue_depth, NULL, NULL);
+  message = g_strdup_printf ("%s[%u] took %.1f ms after %.1f ms in the queue (%u waiting)",
+                             gabc_render_job_get_tool (job),
+                             gabc_render_job_get_id (job),
+                             run_time / 1000.0,
+                             wait_time / 1000.0,
+                             queue_depth);
+  gabc_log_window_append_to_log (self->log_window, message);
 }
 
 
 static void
-gabc_window_write_midi_file (gchar *abc_file_path, gchar *midi_file_path, GabcWindow *self, GError **error)
+gabc_window_start_render_job (GabcWindow          *self,
+                              GabcRenderJob       *job,
+                              GAsyncReadyCallback  callback,
+                              render_cb_data_t    *cb_data)
 {
-  gchar *standard_output;
-  gchar *standard_error;
-  GError *abc2midi_error = NULL;
-  gint exit_status;
-  gboolean result;
+  gabc_window_cancel_render_job (self);
+
+  self->render_cancellable = g_cancellable_new ();
 
-  gchar *abc_basename;
+  cb_data->gabc_window = g_object_ref (self);
+  cb_data->cancellable = g_object_ref (self->render_cancellable);
 
-  GFile *abc_file;
+  /* Every render job reads the scratch file just written. */
+  gabc_tunebook_clear_diagnostics (self->tunebook);
+  if (gabc_tunebook_get_scratch_line_map (self->tunebook) != NULL)
+    g_object_set_data_full (G_OBJECT (job), "gabc-line-map",
+                            g_object_ref (gabc_tunebook_get_scratch_line_map (self->tunebook)),
+                            g_object_unref);
 
-  gint barfly_mode;
+  g_signal_connect_object (job, "output-line",
+                           G_CALLBACK (gabc_window_render_output_line_cb),
+                           self, 0);
 
-  gint idx;
-  gchar *cmd[10];
+  /* So this window only logs the timings of its own jobs. */
+  g_object_set_data (G_OBJECT (job), "gabc-window", self);
 
-  abc_file = g_file_new_for_path(abc_file_path);
-  abc_basename = g_file_get_basename (abc_file);
+  gabc_window_set_render_in_progress (self, TRUE);
+  gabc_render_service_run_async (gabc_render_service_get_default (), job,
+                                 self->render_cancellable, callback, cb_data);
+}
 
-  barfly_mode = g_settings_get_enum (self->settings, "abc2midi-barfly-mode");
 
-  idx = 0;
-  cmd[idx++] = (gchar *)("abc2midi");
-  cmd[idx++] = abc_basename;
+/*
+ * Mark the job as having worked and move its output into the render cache,
+ * before anything opens it: output_file_path becomes the cache entry.
+ */
+static void
+gabc_window_render_job_succeeded (render_cb_data_t *cb_data)
+{
+  gchar *entry_path;
 
-  cmd[idx++] = (gchar *)("-o");
-  cmd[idx++] = midi_file_path;
+  cb_data->succeeded = TRUE;
 
+  if (cb_data->cache_key == NULL || cb_data->cache_extension == NULL)
+    return;
 
-  if ( barfly_mode == 1 )
+  entry_path = gabc_render_cache_commit (gabc_render_cache_get_default (),
+                                         cb_data->cache_key, cb_data->cache_extension,
+                                         cb_data->output_file_path);
+  if (entry_path != NULL)
     {
-      cmd[idx++] = (gchar *)("-BF");
-      cmd[idx++] = (gchar *)("1");
+      g_free (cb_data->output_file_path);
+      cb_data->output_file_path = entry_path;
     }
-  else if ( barfly_mode == 2)
+}
+
+
+/*
+ * Must be called exactly once from each render job callback; frees cb_data.
+ */
+static void
+gabc_window_render_job_done (render_cb_data_t *cb_data)
+{
+  GabcWindow *self = cb_data->gabc_window;
+  GabcRenderStats *stats = gabc_render_stats_get_default ();
+  GStatBuf buf;
+
+  if (self->render_cancellable == cb_data->cancellable)
     {
-      cmd[idx++] = (gchar *)("-BF");
-      cmd[idx++] = (gchar *)("2");
+      g_clear_object (&self->render_cancellable);
+      gabc_window_set_render_in_progress (self, FALSE);
     }
 
-  cmd[idx++] = NULL;
+  if (cb_data->succeeded && cb_data->output_file_path != NULL &&
+      g_stat (cb_data->output_file_path, &buf) == 0)
+    gabc_render_stats_add (stats, GABC_RENDER_METRIC_OUTPUT_SIZE, buf.st_size);
+  gabc_render_stats_sample_peak_rss (stats);
+
+  /* Engravings for the built-in viewer are keyed but not cached. */
+  if (cb_data->cache_key != NULL && cb_data->cache_extension != NULL && !cb_data->succeeded)
+    gabc_render_cache_discard (gabc_render_cache_get_default (), cb_data->output_file_path);
+
+  g_object_unref (cb_data->cancellable);
+  g_object_unref (cb_data->gabc_window);
+  g_free (cb_data->abc_file_path);
+  g_free (cb_data->output_file_path);
+  g_free (cb_data->output_file_name);
+  g_free (cb_data->cache_key);
+  g_free (cb_data);
+}
 
 
-   result = g_spawn_sync (g_getenv("XDG_CACHE_HOME"), (gchar **)cmd, NULL,
-                      G_SPAWN_SEARCH_PATH, NULL, NULL,
-                      &standard_output, &standard_error,
-                      &exit_status, &abc2midi_error);
+/*
+ * Build the abcm2ps job. We need to specify the working diretory wehn running abc2ps
+ * to keep any relative links to format specifiers working.
+ */
+static gchar *
+gabc_window_get_ps_working_dir (GabcWindow *self)
+{
+  return gabc_tunebook_get_working_dir (self->tunebook);
+}
 
 
-  /* There seems to be a bit of a bug in abc2midi at the moment as no errors are
-   * reported if there is no input file.  A short comment is made to standard out */
-  if (!result)
-    {
-      g_print ("Error when running abc2midi\n");
-    }
-  g_print ("%s\n", standard_output);
-  if (g_strrstr (standard_output, "Error") != NULL)
-    {
-      g_print ("we got an error in abc2midi");
-    }
+static GabcRenderJob *
+gabc_window_new_ps_job (gchar *file_path, gchar *ps_file_path, engraving_format_t format, GabcWindow *self)
+{
+  g_autoptr (GStrvBuilder) builder = g_strv_builder_new ();
+  g_auto (GStrv) argv = NULL;
+  g_autofree gchar *working_dir_path = NULL;
+  g_autofree gchar *page_numbering_mode = NULL;
+
+  working_dir_path = gabc_window_get_ps_working_dir (self);
+  page_numbering_mode = g_settings_get_string (self->settings, "abcm2ps-page-numbering");
+
+  g_strv_builder_add (builder, "abcm2ps");
+  if (format == ENGRAVING_FORMAT_SVG)
+    g_strv_builder_add (builder, "-v");
+  g_strv_builder_addv (builder, (const char **) gabc_render_service_get_options (gabc_render_service_get_default (), "abcm2ps"));
+  g_strv_builder_add_many (builder, "-N", page_numbering_mode, "-O", ps_file_path, file_path, NULL);
+  argv = g_strv_builder_end (builder);
+
+  return gabc_render_job_new ((const gchar * const *) argv, working_dir_path);
+}
 
-  if (abc2midi_error != NULL)
+
+static GabcRenderJob *
+gabc_window_new_midi_job (gchar *abc_file_path, gchar *midi_file_path, GabcWindow *self)
+{
+  g_autoptr (GStrvBuilder) builder = g_strv_builder_new ();
+  g_auto (GStrv) argv = NULL;
+  g_autofree gchar *abc_basename = NULL;
+
+  abc_basename = g_path_get_basename (abc_file_path);
+
+  g_strv_builder_add_many (builder, "abc2midi", abc_basename, "-o", midi_file_path, NULL);
+  g_strv_builder_addv (builder, (const char **) gabc_render_service_get_options (gabc_render_service_get_default (), "abc2midi"));
+  argv = g_strv_builder_end (builder);
+
+  return gabc_render_job_new ((const gchar * const *) argv, g_getenv ("XDG_CACHE_HOME"));
+}
+
+
+/*
+ * There seems to be a bit of a bug in abc2midi at the moment as no errors are
+ * reported if there is no input file.  A short comment is made to standard out
+ * so that is checked as well as the job result.
+ */
+static gboolean
+gabc_window_midi_job_succeeded (GabcRenderJob *job, GAsyncResult *result, GError **error)
+{
+  if (!gabc_render_job_run_finish (job, result, error))
+    return FALSE;
+
+  if (g_object_get_data (G_OBJECT (job), "gabc-n-errors") != NULL)
     {
-      gabc_log_window_append_to_log (self->log_window, abc2midi_error->message);
-      g_print ("write midi file: we got an error\n");
-      g_propagate_error (error, abc2midi_error);
+      g_set_error (error,
+                   G_SPAWN_ERROR,                   // error domain
+                   G_SPAWN_ERROR_FAILED,            // error code
+                   "Failed to process abc file.");  // error message format string
+      return FALSE;
     }
-  else
+
+  return TRUE;
+}
+
+
+/*
+ * abcm2ps can fail without a GError, by exiting with an error status.
+ */
+static gboolean
+gabc_window_ps_job_succeeded (GabcRenderJob *job, GAsyncResult *result, GError **error)
+{
+  gint exit_status;
+
+  if (!gabc_render_job_run_finish (job, result, error))
+    return FALSE;
+
+  exit_status = gabc_render_job_get_exit_status (job);
+  if (exit_status != 0)
     {
-      if (g_strrstr (standard_output, "Error") != NULL)
-        {
-          g_set_error (error,
-                   G_SPAWN_ERROR_FAILED,            // error domain
-                   1,                               // error code
-                   "Failed to process abc file.");  // error message format string
-        }
+      g_set_error (error, G_SPAWN_ERROR, G_SPAWN_ERROR_FAILED,
+                   "abcm2ps exited with status %d", exit_status);
+      return FALSE;
     }
 
-  gabc_log_window_append_to_log (self->log_window, standard_output);
-  gabc_log_window_append_to_log (self->log_window, standard_error);
+  return TRUE;
+}
+
+
+/*
+ * RENDER CACHE
+ *
+ * The keys cover the preprocessed scratch text and every setting that ends
+ * up on the tool's command line.  The fmt file's modification time is
+ * included so editing the fmt file invalidates old renders.
+ */
+static void
+gabc_window_checksum_add_string (GChecksum *checksum, const gchar *str)
+{
+  if (str != NULL)
+    g_checksum_update (checksum, (const guchar *) str, -1);
+  /* Separator, so that ("ab", "c") and ("a", "bc") differ. */
+  g_checksum_update (checksum, (const guchar *) "", 1);
+}
+
+
+static gchar *
+gabc_window_get_ps_cache_key (GabcWindow *self)
+{
+  g_autoptr (GChecksum) checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  g_autofree gchar *fmt_file_path = NULL;
+  g_autofree gchar *page_numbering_mode = NULL;
+  g_autofree gchar *working_dir_path = NULL;
+  g_autofree gchar *fmt_mtime = NULL;
+  GStatBuf buf;
+
+  fmt_file_path = g_settings_get_string (self->settings, "abcm2ps-fmt-file-path");
+  page_numbering_mode = g_settings_get_string (self->settings, "abcm2ps-page-numbering");
+  working_dir_path = gabc_window_get_ps_working_dir (self);
+
+  if (fmt_file_path[0] != '\0' && g_stat (fmt_file_path, &buf) == 0)
+    fmt_mtime = g_strdup_printf ("%" G_GINT64_FORMAT, (gint64) buf.st_mtime);
 
-  g_object_unref (abc_file);
-  g_free (standard_output);
-  g_free (standard_error);
-  g_free (abc_basename);
+  gabc_window_checksum_add_string (checksum, "abcm2ps");
+  gabc_window_checksum_add_string (checksum, gabc_tunebook_get_scratch_checksum (self->tunebook));
+  gabc_window_checksum_add_string (checksum, g_settings_get_boolean (self->settings, "abcm2ps-show-errors") ? "-i" : "");
+  gabc_window_checksum_add_string (checksum, fmt_file_path);
+  gabc_window_checksum_add_string (checksum, fmt_mtime);
+  gabc_window_checksum_add_string (checksum, page_numbering_mode);
+  gabc_window_checksum_add_string (checksum, working_dir_path);
 
+  return g_strdup (g_checksum_get_string (checksum));
+}
+
+
+static gchar *
+gabc_window_get_midi_cache_key (GabcWindow *self)
+{
+  g_autoptr (GChecksum) checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  g_autofree gchar *barfly_mode = NULL;
+
+  /* The preprocessing rules (MIDI program etc.) are part of the scratch
+   * file text and so already covered by its checksum. */
+  barfly_mode = g_strdup_printf ("%d", g_settings_get_enum (self->settings, "abc2midi-barfly-mode"));
+
+  gabc_window_checksum_add_string (checksum, "abc2midi");
+  gabc_window_checksum_add_string (checksum, gabc_tunebook_get_scratch_checksum (self->tunebook));
+  gabc_window_checksum_add_string (checksum, barfly_mode);
+
+  return g_strdup (g_checksum_get_string (checksum));
+}
+
+
+static gchar *
+gabc_window_lookup_render_cache (GabcWindow *self, const gchar *key, const gchar *extension)
+{
+  GabcRenderCache *cache;
+  gchar *file_path;
+  gchar *message;
+  guint hits;
+  guint misses;
+
+  cache = gabc_render_cache_get_default ();
+  gabc_render_cache_set_max_size (cache,
+                                  (guint64) g_settings_get_uint (self->settings, "render-cache-max-size") * 1024 * 1024);
+
+  file_path = gabc_render_cache_lookup (cache, key, extension);
+
+  gabc_render_cache_get_stats (cache, &hits, &misses, NULL, NULL);
+  message = g_strdup_printf ("Render cache %s (%u hits, %u misses)",
+                             file_path != NULL ? "hit" : "miss", hits, misses);
+  gabc_log_window_append_to_log (self->log_window, message);
+  g_free (message);
+
+  return file_path;
 }
 
 
@@ -1010,6 +2759,10 @@ play_media_cb (GtkFileLauncher *launcher,
 {
   GError *error = NULL;
   GabcWindow *self = GABC_WINDOW(data);
+  gint64 *launch_time = g_object_get_data (G_OBJECT (launcher), "gabc-launch-time");
+
+  gabc_render_stats_add_time (gabc_render_stats_get_default (), GABC_RENDER_METRIC_LAUNCH,
+                              *launch_time, g_get_monotonic_time ());
 
   if (!gtk_file_launcher_launch_finish (launcher, result, &error))
   {
@@ -1024,11 +2777,14 @@ static void
 gabc_window_play_media_file (gchar *file_path, GabcWindow *self)
 {
   gboolean file_launcher_always_ask;
+  gint64 launch_time = g_get_monotonic_time ();
 
   GFile *media_file = g_file_new_for_path ((char *)file_path);
   GtkFileLauncher *launcher = gtk_file_launcher_new (media_file);
   file_launcher_always_ask = g_settings_get_boolean (self->settings, "file-launcher-always-ask");
   gtk_file_launcher_set_always_ask( launcher, file_launcher_always_ask);
+  g_object_set_data_full (G_OBJECT (launcher), "gabc-launch-time",
+                          g_memdup2 (&launch_time, sizeof (launch_time)), g_free);
   gtk_file_launcher_launch (launcher,
                             GTK_WINDOW (self),
                             NULL,
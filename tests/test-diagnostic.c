@@ -0,0 +1,106 @@
+/* test-diagnostic.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * gabc_diagnostic_parse () and gabc_diagnostic_get_severity () on lines
+ * of abcm2ps and abc2midi output, one table row per line.
+ */
+
+#include "gabc-diagnostic.h"
+
+typedef struct {
+  const gchar      *name;
+  const gchar      *text;
+  gboolean          parsed;
+  GabcLogSeverity   severity;  /* from gabc_diagnostic_get_severity () */
+  guint             line;
+  guint             column;
+  const gchar      *message;
+} diagnostic_case_t;
+
+static const diagnostic_case_t diagnostic_cases [] = {
+  { "abcm2ps-error", "tune.abc:12:4: error: Bad character",
+    TRUE, GABC_LOG_SEVERITY_ERROR, 11, 4, "Bad character" },
+  { "abcm2ps-warning", "tune.abc:7: warning: Line too much shrunk",
+    TRUE, GABC_LOG_SEVERITY_WARNING, 6, 0, "Line too much shrunk" },
+  /* Parsed as a warning, whatever the message says. */
+  { "abcm2ps-warning-about-error", "tune.abc:3: warning: error in chord",
+    TRUE, GABC_LOG_SEVERITY_WARNING, 2, 0, "error in chord" },
+  { "abcm2ps-line-zero", "tune.abc:0: error: No tune",
+    TRUE, GABC_LOG_SEVERITY_ERROR, 0, 0, "No tune" },
+  { "abc2midi-error", "Error in line-char 5-10 : Missing bar",
+    TRUE, GABC_LOG_SEVERITY_ERROR, 4, 10, "Missing bar" },
+  { "abc2midi-warning", "Warning in line 3 : Tempo ignored",
+    TRUE, GABC_LOG_SEVERITY_WARNING, 2, 0, "Tempo ignored" },
+  { "abc2midi-warning-char", "Warning in line-char 9-2 : Bar 4 has 5 units",
+    TRUE, GABC_LOG_SEVERITY_WARNING, 8, 2, "Bar 4 has 5 units" },
+  /* Not diagnostics, but still counted by the words in them. */
+  { "error-without-position", "error: No such file",
+    FALSE, GABC_LOG_SEVERITY_ERROR, 0, 0, NULL },
+  { "version", "abcm2ps-8.14.15 (Aug 2023)",
+    FALSE, GABC_LOG_SEVERITY_INFO, 0, 0, NULL },
+  { "output", "Output written on Out.ps (1 page, 1 title, 13422 bytes)",
+    FALSE, GABC_LOG_SEVERITY_INFO, 0, 0, NULL },
+  { "empty", "",
+    FALSE, GABC_LOG_SEVERITY_INFO, 0, 0, NULL },
+};
+
+
+static void
+test_diagnostic (gconstpointer data)
+{
+  const diagnostic_case_t *test = data;
+  GabcDiagnostic diagnostic = { 0 };
+
+  g_assert_cmpint (gabc_diagnostic_get_severity (test->text), ==, test->severity);
+
+  if (!test->parsed)
+    {
+      g_assert_false (gabc_diagnostic_parse (test->text, &diagnostic));
+      return;
+    }
+
+  g_assert_true (gabc_diagnostic_parse (test->text, &diagnostic));
+  g_assert_cmpint (diagnostic.severity, ==, test->severity);
+  g_assert_cmpuint (diagnostic.line, ==, test->line);
+  g_assert_cmpuint (diagnostic.column, ==, test->column);
+  g_assert_cmpstr (diagnostic.message, ==, test->message);
+
+  gabc_diagnostic_clear (&diagnostic);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+  guint i;
+
+  g_test_init (&argc, &argv, NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (diagnostic_cases); i++)
+    {
+      g_autofree gchar *path = g_strconcat ("/diagnostic/", diagnostic_cases[i].name, NULL);
+
+      g_test_add_data_func (path, &diagnostic_cases[i], test_diagnostic);
+    }
+
+  return g_test_run ();
+}
@@ -0,0 +1,132 @@
+/* test-line-map.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * GabcLineMap, one table row per case.  Each case is a script of what a
+ * writer did, as space-separated words;
+ *
+ *   c<n>   copied n lines
+ *   i<n>   inserted n lines
+ *   s<n>   skipped n lines
+ *   =<n>   moved to source line n
+ *
+ * and the source line expected for each output line from 0, with -1 for a
+ * failed lookup.
+ */
+
+#include "gabc-line-map.h"
+
+#define MAX_LOOKUPS 8
+
+typedef struct {
+  const gchar  *name;
+  const gchar  *script;
+  gint          expected [MAX_LOOKUPS];
+  guint         n_expected;
+} line_map_case_t;
+
+static const line_map_case_t line_map_cases [] = {
+  { "empty", "", { -1 }, 1 },
+  { "nothing-written", "c0 i0", { -1 }, 1 },
+  { "copy", "c3", { 0, 1, 2 }, 3 },
+  { "copies-merge", "c1 c1 c1", { 0, 1, 2 }, 3 },
+  /* Lines past the end carry on from the last segment. */
+  { "past-end", "c2", { 0, 1, 2, 3 }, 4 },
+  { "insert-skip", "c2 i1 s3 c2", { 0, 1, 1, 5, 6, 7 }, 6 },
+  { "insert-at-start", "i2 c2", { 0, 0, 0, 1 }, 4 },
+  { "jump", "=10 c1 =3 c2", { 10, 3, 4 }, 3 },
+  { "inserted-run", "c1 i3 c1", { 0, 0, 0, 0, 1 }, 5 },
+};
+
+
+static void
+test_line_map (gconstpointer data)
+{
+  const line_map_case_t *test = data;
+  g_autoptr (GabcLineMap) line_map = gabc_line_map_new ();
+  g_auto (GStrv) steps = g_strsplit (test->script, " ", -1);
+  guint i;
+
+  for (i = 0; steps[i] != NULL; i++)
+    {
+      guint n;
+
+      if (steps[i][0] == '\0')
+        continue;
+
+      n = (guint) g_ascii_strtoull (steps[i] + 1, NULL, 10);
+      switch (steps[i][0])
+        {
+        case 'c':
+          gabc_line_map_copy_lines (line_map, n);
+          break;
+
+        case 'i':
+          gabc_line_map_insert_lines (line_map, n);
+          break;
+
+        case 's':
+          gabc_line_map_skip_lines (line_map, n);
+          break;
+
+        case '=':
+          gabc_line_map_set_source_line (line_map, n);
+          break;
+
+        default:
+          g_assert_not_reached ();
+        }
+    }
+
+  for (i = 0; i < test->n_expected; i++)
+    {
+      guint source_line = G_MAXUINT;
+      gboolean found = gabc_line_map_lookup (line_map, i, &source_line);
+
+      if (test->expected[i] < 0)
+        {
+          g_assert_false (found);
+        }
+      else
+        {
+          g_assert_true (found);
+          g_assert_cmpuint (source_line, ==, (guint) test->expected[i]);
+        }
+    }
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+  guint i;
+
+  g_test_init (&argc, &argv, NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (line_map_cases); i++)
+    {
+      g_autofree gchar *path = g_strconcat ("/line-map/", line_map_cases[i].name, NULL);
+
+      g_test_add_data_func (path, &line_map_cases[i], test_line_map);
+    }
+
+  return g_test_run ();
+}
@@ -0,0 +1,171 @@
+/* test-preprocessor.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * GabcPreprocessor on the text of whole files, one table row per case:
+ * the abc2midi settings, the text in the pieces it is fed in, what comes
+ * out and the source line the line map gives for each line that does.
+ *
+ * Run it with GSETTINGS_BACKEND=memory and GSETTINGS_SCHEMA_DIR pointing at
+ * the compiled schema, as meson test does.
+ */
+
+#include "gabc-preprocessor.h"
+
+#define MAX_PIECES  3
+#define MAX_LINES   16
+
+typedef struct {
+  const gchar             *name;
+  GabcPreprocessorTarget   target;
+  gint                     midi_program;  /* 128 for none */
+  guint                    tempo;
+  const gchar             *strip;         /* comma-separated, or NULL */
+  const gchar             *pieces [MAX_PIECES];
+  gboolean                 reset;         /* between pieces, as between files */
+  const gchar             *expected;
+  gint                     lines [MAX_LINES];
+  guint                    n_lines;
+} preprocessor_case_t;
+
+static const preprocessor_case_t preprocessor_cases [] = {
+  /* Nothing to do for abcm2ps, whatever the abc2midi settings. */
+  { "abcm2ps", GABC_PREPROCESSOR_TARGET_ABCM2PS, 0, 120, "MIDI",
+    { "X:1\n%%MIDI program 5\nK:C\nC|\n" }, FALSE,
+    "X:1\n%%MIDI program 5\nK:C\nC|\n",
+    { 0, 1, 2, 3 }, 4 },
+  { "no-rules", GABC_PREPROCESSOR_TARGET_ABC2MIDI, 128, 0, NULL,
+    { "X:1\nK:C\nC|\n" }, FALSE,
+    "X:1\nK:C\nC|\n",
+    { 0, 1, 2 }, 3 },
+  /* After the header's K: only, not after a key change in the body. */
+  { "tempo-after-header", GABC_PREPROCESSOR_TARGET_ABC2MIDI, 128, 120, NULL,
+    { "X:1\nT:A\nK:D\nABc|\nK:G\nd|\n" }, FALSE,
+    "X:1\nT:A\nK:D\nQ:1/4=120\nABc|\nK:G\nd|\n",
+    { 0, 1, 2, 2, 3, 4, 5 }, 7 },
+  { "each-tune", GABC_PREPROCESSOR_TARGET_ABC2MIDI, 0, 100, NULL,
+    { "X:1\nK:C\nC|\n\nX:2\nK:Am\nA|\n" }, FALSE,
+    "X:1\nK:C\n%%MIDI program 0\nQ:1/4=100\nC|\n\nX:2\nK:Am\n%%MIDI program 0\nQ:1/4=100\nA|\n",
+    { 0, 1, 1, 1, 2, 3, 4, 5, 5, 5, 6 }, 11 },
+  /* A K: in the file header, before any X:, ends no tune header. */
+  { "file-header-key", GABC_PREPROCESSOR_TARGET_ABC2MIDI, 128, 90, NULL,
+    { "K:C\n\nX:1\nK:G\nG|\n" }, FALSE,
+    "K:C\n\nX:1\nK:G\nQ:1/4=90\nG|\n",
+    { 0, 1, 2, 3, 3, 4 }, 6 },
+  { "strip-directive", GABC_PREPROCESSOR_TARGET_ABC2MIDI, 128, 0, "MIDI",
+    { "X:1\n%%MIDI program 5\nK:C\nC|\n" }, FALSE,
+    "X:1\nK:C\nC|\n",
+    { 0, 2, 3 }, 3 },
+  /* The K: inside the stripped block is not the one that ends the header. */
+  { "strip-block", GABC_PREPROCESSOR_TARGET_ABC2MIDI, 128, 60, "%%beginps",
+    { "X:1\n%%beginps\n/x 1 def\nK:Z\n%%endps\nK:C\nC|\n" }, FALSE,
+    "X:1\nK:C\nQ:1/4=60\nC|\n",
+    { 0, 5, 5, 6 }, 4 },
+  /* State carries over from one piece to the next. */
+  { "block-across-pieces", GABC_PREPROCESSOR_TARGET_ABC2MIDI, 128, 0, "beginps",
+    { "X:1\n%%beginps\n/x 1 def\n", "/y 2 def\n%%endps\nK:C\n" }, FALSE,
+    "X:1\nK:C\n",
+    { 0, 5 }, 2 },
+  { "header-across-pieces", GABC_PREPROCESSOR_TARGET_ABC2MIDI, 128, 80, NULL,
+    { "X:1\nT:A\n", "K:C\nC|\n" }, FALSE,
+    "X:1\nT:A\nK:C\nQ:1/4=80\nC|\n",
+    { 0, 1, 2, 2, 3 }, 5 },
+  /* A reset forgets a tune header left open by the last file. */
+  { "reset", GABC_PREPROCESSOR_TARGET_ABC2MIDI, 128, 80, NULL,
+    { "X:1\nT:A\n", "K:C\nC|\n" }, TRUE,
+    "X:1\nT:A\nK:C\nC|\n",
+    { 0, 1, 2, 3 }, 4 },
+};
+
+
+static gboolean
+test_preprocessor_write (const gchar  *data,
+                         gsize         length,
+                         gpointer      user_data,
+                         GError      **error)
+{
+  g_string_append_len (user_data, data, length);
+  return TRUE;
+}
+
+
+static void
+test_preprocessor (gconstpointer data)
+{
+  const preprocessor_case_t *test = data;
+  g_autoptr (GSettings) settings = g_settings_new ("me.pm.m0dns.gabc");
+  g_autoptr (GabcPreprocessor) preprocessor = NULL;
+  g_autoptr (GabcLineMap) line_map = gabc_line_map_new ();
+  g_autoptr (GString) output = g_string_new (NULL);
+  g_auto (GStrv) strip = NULL;
+  g_autoptr (GError) error = NULL;
+  guint i;
+
+  strip = test->strip != NULL ? g_strsplit (test->strip, ",", -1) : g_new0 (gchar *, 1);
+
+  g_settings_set_enum (settings, "abc2midi-midi-program", test->midi_program);
+  g_settings_set_uint (settings, "abc2midi-tempo", test->tempo);
+  g_settings_set_int (settings, "abc2midi-transpose", 0);
+  g_settings_set_int (settings, "abc2midi-chordprog", -1);
+  g_settings_set_boolean (settings, "abc2midi-drone", FALSE);
+  g_settings_set_strv (settings, "abc2midi-strip-directives", (const gchar * const *) strip);
+
+  /* A new preprocessor reads the settings on first use. */
+  preprocessor = gabc_preprocessor_new (settings);
+
+  for (i = 0; i < MAX_PIECES && test->pieces[i] != NULL; i++)
+    {
+      if (i > 0 && test->reset)
+        gabc_preprocessor_reset (preprocessor);
+
+      g_assert_true (gabc_preprocessor_process (preprocessor, test->target, test->pieces[i], TRUE,
+                                                line_map, test_preprocessor_write, output, &error));
+      g_assert_no_error (error);
+    }
+
+  g_assert_cmpstr (output->str, ==, test->expected);
+
+  for (i = 0; i < test->n_lines; i++)
+    {
+      guint source_line = G_MAXUINT;
+
+      g_assert_true (gabc_line_map_lookup (line_map, i, &source_line));
+      g_assert_cmpuint (source_line, ==, (guint) test->lines[i]);
+    }
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+  guint i;
+
+  g_test_init (&argc, &argv, NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (preprocessor_cases); i++)
+    {
+      g_autofree gchar *path = g_strconcat ("/preprocessor/", preprocessor_cases[i].name, NULL);
+
+      g_test_add_data_func (path, &preprocessor_cases[i], test_preprocessor);
+    }
+
+  return g_test_run ();
+}
@@ -0,0 +1,99 @@
+/* test-transpose.c
+ *
+ * Copyright 2025 James Watson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * gabc_transpose_text () on whole files, one table row per case.
+ */
+
+#include <string.h>
+
+#include "gabc-transpose.h"
+
+typedef struct {
+  const gchar  *name;
+  gint          semitones;
+  const gchar  *text;
+  const gchar  *expected;
+} transpose_case_t;
+
+static const transpose_case_t transpose_cases [] = {
+  /* An accidental holds to the end of its bar, in the new key as in the old. */
+  { "accidentals-across-bar", 2,
+    "X:1\nK:C\n^F F | F|]\n",
+    "X:1\nK:D\n^G G | G|]\n" },
+  /* The mode stays, and the notes follow the key a tone up. */
+  { "mode-dorian", 2,
+    "X:1\nK:Ador\nA c e|]\n",
+    "X:1\nK:Bdor\nB d f|]\n" },
+  { "down-to-c", -2,
+    "X:1\nK:D\nd f a|]\n",
+    "X:1\nK:C\nc e g|]\n" },
+  /* Six flats rather than six sharps, and B flat becomes C flat. */
+  { "flat-key-enharmonic", 1,
+    "X:1\nK:F\nF B c|]\n",
+    "X:1\nK:Gb\nG c d|]\n" },
+  { "sharp-to-flat-key", 1,
+    "X:1\nK:C\nC E G|]\n",
+    "X:1\nK:Db\nD F A|]\n" },
+  /* An octave keeps the key's spelling and only moves the notes. */
+  { "octave", 12,
+    "X:1\nK:D\nA|]\n",
+    "X:1\nK:D\na|]\n" },
+  { "chord-symbols", 2,
+    "X:1\nK:G\n\"Am\"A2 \"D7/F#\"F|]\n",
+    "X:1\nK:A\n\"Bm\"B2 \"E7/G#\"G|]\n" },
+  /* The file header is copied as it is. */
+  { "file-header", 2,
+    "%%scale 0.8\nK:C\n\nX:1\nK:C\nC|]\n",
+    "%%scale 0.8\nK:C\n\nX:1\nK:D\nD|]\n" },
+  { "zero", 0,
+    "X:1\nK:C\nC|]\n",
+    "X:1\nK:C\nC|]\n" },
+};
+
+
+static void
+test_transpose (gconstpointer data)
+{
+  const transpose_case_t *test = data;
+  g_autofree gchar *result = NULL;
+
+  result = gabc_transpose_text (test->text, strlen (test->text), test->semitones);
+  g_assert_cmpstr (result, ==, test->expected);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+  guint i;
+
+  g_test_init (&argc, &argv, NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (transpose_cases); i++)
+    {
+      g_autofree gchar *path = g_strconcat ("/transpose/", transpose_cases[i].name, NULL);
+
+      g_test_add_data_func (path, &transpose_cases[i], test_transpose);
+    }
+
+  return g_test_run ();
+}